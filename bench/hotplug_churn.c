@@ -0,0 +1,737 @@
+/* hotplug_churn.c -- Hot-plug churn benchmark with an injected uevent source.
+ *
+ * Runs the real daemon with its hot-plug input replaced by one end of a
+ * SOCK_SEQPACKET socketpair (--uevent-fd) and its sysfs/dev lookups
+ * pointed at a synthetic tree (--sysfs-root, --dev-root). Each synthetic
+ * "USB adapter" is a sysfs device with VID/PID/serial attributes and a
+ * dev node symlinked to a PTY slave, so the daemon goes through the same
+ * identify/open/log path as for real hardware.
+ *
+ * Every round fires a storm of add uevents for --devices fresh adapters,
+ * waits until each one is being logged, then fires the matching removes
+ * and waits until the daemon has dropped them all. Meanwhile a few steady
+ * boards print timestamped lines and the benchmark tails their logs, so
+ * the report shows whether churn hurts capture on ports that are not
+ * being plugged:
+ *
+ *   - time-to-monitoring per device (uevent sent -> log file exists)
+ *   - time to drop a whole storm of removes
+ *   - lost events (devices never monitored / never dropped)
+ *   - steady-board line rate and log latency, before vs. during churn
+ *
+ *   make bench
+ *   ./bench/hotplug_churn --devices 48 --rounds 8 --report churn.json
+ *
+ * CHURN_DEBUG=1 keeps the daemon's output in churn_daemon.log.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/control.h"
+#include "../src/log.h"
+#include "../src/util.h"
+
+#define MAX_DEVICES  60          /* per storm; the daemon caps at 64 ports */
+#define MAX_STEADY   4
+#define STEADY_BASE  9000        /* ttyUSB numbers of the steady boards */
+#define LINE_LEN     80
+
+typedef struct {
+    int      master;
+    int      num;                /* ttyUSB<num> */
+    char     slave[64];
+    char     logpath[512];
+    uint64_t sent_ns;
+    uint64_t seen_ns;
+} device_t;
+
+typedef struct {
+    device_t dev;
+    int      logfd;
+    char     pending[4096];      /* partial line read from the log */
+    size_t   pending_len;
+    uint64_t seq;
+    uint64_t lines_sent;
+    uint64_t lines_seen;
+    uint64_t blocked;            /* writes refused by a full PTY */
+} steady_t;
+
+typedef struct {
+    double *v;
+    size_t  n, cap;
+} series_t;
+
+typedef struct {
+    const char *name;
+    double      seconds;
+    uint64_t    lines;
+    series_t    lat_us;
+    uint64_t    blocked;
+} phase_t;
+
+static struct {
+    const char *daemon;
+    int         devices;
+    int         rounds;
+    int         nsteady;
+    int         rate;            /* lines per second per steady board */
+    int         settle_ms;
+    int         baseline_s;
+    int         timeout_ms;
+    const char *report;
+} opt = {
+    .daemon = "./uart-monitor",
+    .devices = 48,
+    .rounds = 8,
+    .nsteady = 2,
+    .rate = 200,
+    .settle_ms = 50,
+    .baseline_s = 2,
+    .timeout_ms = 10000,
+    .report = "hotplug_churn_report.json",
+};
+
+static char     root[256];
+static int      uevent_sock = -1;
+static pid_t    daemon_pid = -1;
+static steady_t steady[MAX_STEADY];
+static phase_t *cur_phase;
+static uint64_t steady_start_ns;
+static unsigned seqnum;
+
+/* ------------------------------------------------------------------ */
+
+static void
+series_add(series_t *s, double v)
+{
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 256;
+        s->v = realloc(s->v, s->cap * sizeof(double));
+        if (!s->v) {
+            perror("realloc");
+            exit(2);
+        }
+    }
+    s->v[s->n++] = v;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double
+percentile(series_t *s, double p)
+{
+    if (s->n == 0)
+        return 0.0;
+    qsort(s->v, s->n, sizeof(double), cmp_double);
+    size_t i = (size_t)(p * (double)(s->n - 1) + 0.5);
+    return s->v[i];
+}
+
+/* Send one control command; returns 0 on an "OK" reply. */
+static int
+ctl(const char *cmd, char *resp, size_t sz)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy_safe(addr.sun_path, CONTROL_SOCK_PATH, sizeof(addr.sun_path));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    ssize_t nw = write(fd, cmd, strlen(cmd));
+    (void)nw;
+    size_t off = 0;
+    ssize_t n;
+    while (off < sz - 1 && (n = read(fd, resp + off, sz - 1 - off)) > 0)
+        off += (size_t)n;
+    resp[off] = '\0';
+    close(fd);
+    return strncmp(resp, "OK", 2) == 0 ? 0 : -1;
+}
+
+/* Read an integer field from the STATUS JSON, -1 if unavailable. */
+static long
+status_field(const char *field)
+{
+    char resp[CONTROL_MAX_MSG * 4];
+    ctl("STATUS\n", resp, sizeof(resp));
+    char key[64];
+    snprintf(key, sizeof(key), "\"%s\": ", field);
+    const char *p = strstr(resp, key);
+    return p ? atol(p + strlen(key)) : -1;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Synthetic sysfs/dev tree                                          */
+/* ------------------------------------------------------------------ */
+
+static int
+write_attr(const char *dir, const char *name, const char *val)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    fprintf(fp, "%s\n", val);
+    fclose(fp);
+    return 0;
+}
+
+/* Create the PTY, the sysfs device and the dev node for one adapter.
+ * The VID:PID is not in the board table, so the label is the tty name. */
+static int
+device_create(device_t *d, int num)
+{
+    memset(d, 0, sizeof(*d));
+    d->num = num;
+
+    int slave;
+    if (openpty(&d->master, &slave, NULL, NULL, NULL) < 0)
+        return -1;
+    strlcpy_safe(d->slave, ttyname(slave), sizeof(d->slave));
+    close(slave);
+    fcntl(d->master, F_SETFL, fcntl(d->master, F_GETFL) | O_NONBLOCK);
+
+    char usbdev[320], iface[352], cls[320], link[352], node[320], val[32];
+    snprintf(usbdev, sizeof(usbdev), "%s/sys/devices/usb1/1-%d", root, num);
+    snprintf(iface, sizeof(iface), "%s/1-%d:1.0", usbdev, num);
+    snprintf(cls, sizeof(cls), "%s/sys/class/tty/ttyUSB%d", root, num);
+    snprintf(link, sizeof(link), "%s/device", cls);
+    snprintf(node, sizeof(node), "%s/dev/ttyUSB%d", root, num);
+
+    if (mkdirp(iface) < 0 || mkdirp(cls) < 0)
+        return -1;
+    snprintf(val, sizeof(val), "CHURN%05d", num);
+    write_attr(usbdev, "idVendor", "1209");
+    write_attr(usbdev, "idProduct", "c4a5");
+    write_attr(usbdev, "serial", val);
+    write_attr(usbdev, "manufacturer", "uart-monitor");
+    write_attr(usbdev, "product", "churn adapter");
+    write_attr(iface, "bInterfaceNumber", "00");
+    if (symlink(iface, link) < 0 || symlink(d->slave, node) < 0)
+        return -1;
+
+    snprintf(d->logpath, sizeof(d->logpath), "%s/latest/ttyUSB%d.log",
+             LOG_BASE_DIR, num);
+    return 0;
+}
+
+static void
+device_destroy(device_t *d)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/dev/ttyUSB%d", root, d->num);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/sys/class/tty/ttyUSB%d/device",
+             root, d->num);
+    unlink(path);
+    if (d->master >= 0)
+        close(d->master);
+    d->master = -1;
+}
+
+/* Send one kernel-format uevent for ttyUSB<num>. */
+static int
+send_uevent(const char *action, int num)
+{
+    char msg[512];
+    int n = snprintf(msg, sizeof(msg),
+                     "%s@/devices/usb1/1-%d/1-%d:1.0/ttyUSB%d/tty/ttyUSB%d%c"
+                     "ACTION=%s%c"
+                     "DEVPATH=/devices/usb1/1-%d/1-%d:1.0/ttyUSB%d%c"
+                     "SUBSYSTEM=tty%c"
+                     "DEVNAME=ttyUSB%d%c"
+                     "SEQNUM=%u%c",
+                     action, num, num, num, num, 0,
+                     action, 0,
+                     num, num, num, 0,
+                     0,
+                     num, 0,
+                     ++seqnum, 0);
+    return send(uevent_sock, msg, (size_t)n, 0) == n ? 0 : -1;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Steady boards                                                     */
+/* ------------------------------------------------------------------ */
+
+static void
+steady_emit(steady_t *s, uint64_t now)
+{
+    if (steady_start_ns == 0)
+        return;
+    uint64_t due = (now - steady_start_ns) * (uint64_t)opt.rate / 1000000000ull;
+    while (s->lines_sent < due) {
+        char line[LINE_LEN + 1];
+        int n = snprintf(line, sizeof(line), "steady %d %llu %llu ",
+                         s->dev.num, (unsigned long long)s->seq,
+                         (unsigned long long)mono_ns());
+        memset(line + n, '.', (size_t)(LINE_LEN - 1 - n));
+        line[LINE_LEN - 1] = '\n';
+        if (write(s->dev.master, line, LINE_LEN) != LINE_LEN) {
+            /* the daemon is not draining this PTY: count it and
+             * drop the line rather than queue behind it */
+            s->blocked++;
+            if (cur_phase)
+                cur_phase->blocked++;
+            s->lines_sent = due;
+            break;
+        }
+        s->seq++;
+        s->lines_sent++;
+    }
+}
+
+static void
+steady_tail(steady_t *s)
+{
+    if (s->logfd < 0) {
+        s->logfd = open(s->dev.logpath, O_RDONLY | O_CLOEXEC);
+        if (s->logfd < 0)
+            return;
+    }
+
+    ssize_t n = read(s->logfd, s->pending + s->pending_len,
+                     sizeof(s->pending) - 1 - s->pending_len);
+    if (n <= 0)
+        return;
+    s->pending_len += (size_t)n;
+    s->pending[s->pending_len] = '\0';
+
+    uint64_t now = mono_ns();
+    char *line = s->pending;
+    char *nl;
+    while ((nl = strchr(line, '\n')) != NULL) {
+        *nl = '\0';
+        unsigned long long sent;
+        if (sscanf(line, "steady %*d %*u %llu", &sent) == 1) {
+            s->lines_seen++;
+            if (cur_phase) {
+                cur_phase->lines++;
+                series_add(&cur_phase->lat_us, (double)(now - sent) / 1e3);
+            }
+        }
+        line = nl + 1;
+    }
+    s->pending_len -= (size_t)(line - s->pending);
+    memmove(s->pending, line, s->pending_len);
+}
+
+/* Keep the steady boards talking while waiting for something else. */
+static void
+pump(void)
+{
+    uint64_t now = mono_ns();
+    char buf[4096];
+    for (int i = 0; i < opt.nsteady; i++) {
+        steady_emit(&steady[i], now);
+        while (read(steady[i].dev.master, buf, sizeof(buf)) > 0)
+            ;
+        steady_tail(&steady[i]);
+    }
+}
+
+static void
+pump_until(uint64_t until_ns)
+{
+    while (mono_ns() < until_ns) {
+        pump();
+        usleep(200);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/*  Storm rounds                                                      */
+/* ------------------------------------------------------------------ */
+
+typedef struct {
+    series_t attach_ms;          /* per device: uevent -> monitored */
+    series_t drop_ms;            /* per storm: removes -> all dropped */
+    int      sent_adds;
+    int      lost_adds;
+    int      lost_removes;
+} churn_t;
+
+static int
+wait_port_count(long want, uint64_t deadline)
+{
+    uint64_t next_poll = 0;
+    while (mono_ns() < deadline) {
+        pump();
+        uint64_t now = mono_ns();
+        if (now >= next_poll) {
+            if (status_field("port_count") == want)
+                return 0;
+            next_poll = now + 2000000ull;
+        }
+        usleep(200);
+    }
+    return -1;
+}
+
+static int
+storm_round(int round, churn_t *c)
+{
+    device_t devs[MAX_DEVICES];
+    int base = round * 1000 + 100;   /* fresh names every round */
+
+    for (int i = 0; i < opt.devices; i++) {
+        if (device_create(&devs[i], base + i) < 0) {
+            fprintf(stderr, "churn: cannot create device %d: %s\n",
+                    base + i, strerror(errno));
+            return -1;
+        }
+    }
+
+    /* add storm: all uevents back to back, as a powered hub would */
+    for (int i = 0; i < opt.devices; i++) {
+        devs[i].sent_ns = mono_ns();
+        if (send_uevent("add", devs[i].num) < 0)
+            return -1;
+        c->sent_adds++;
+    }
+
+    uint64_t deadline = mono_ns() + (uint64_t)opt.timeout_ms * 1000000ull;
+    int remaining = opt.devices;
+    while (remaining > 0 && mono_ns() < deadline) {
+        pump();
+        struct stat st;
+        for (int i = 0; i < opt.devices; i++) {
+            if (devs[i].seen_ns || stat(devs[i].logpath, &st) < 0)
+                continue;
+            devs[i].seen_ns = mono_ns();
+            series_add(&c->attach_ms,
+                       (double)(devs[i].seen_ns - devs[i].sent_ns) / 1e6);
+            remaining--;
+        }
+        usleep(200);
+    }
+    c->lost_adds += remaining;
+
+    /* remove storm */
+    uint64_t t0 = mono_ns();
+    for (int i = 0; i < opt.devices; i++) {
+        if (send_uevent("remove", devs[i].num) < 0)
+            return -1;
+    }
+    deadline = mono_ns() + (uint64_t)opt.timeout_ms * 1000000ull;
+    if (wait_port_count(opt.nsteady, deadline) == 0)
+        series_add(&c->drop_ms, (double)(mono_ns() - t0) / 1e6);
+    else
+        c->lost_removes++;
+
+    for (int i = 0; i < opt.devices; i++)
+        device_destroy(&devs[i]);
+
+    printf("  round %d: %d/%d monitored, attach p50 %.1f ms, "
+           "drop %.1f ms\n", round + 1, opt.devices - remaining,
+           opt.devices, percentile(&c->attach_ms, 0.50),
+           c->drop_ms.n ? c->drop_ms.v[c->drop_ms.n - 1] : -1.0);
+    fflush(stdout);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Report                                                            */
+/* ------------------------------------------------------------------ */
+
+static void
+phase_json(FILE *fp, phase_t *ph, const char *sep)
+{
+    double rate = ph->seconds > 0 ? (double)ph->lines / ph->seconds : 0.0;
+    fprintf(fp, "    \"%s\": { \"seconds\": %.2f, \"lines\": %llu, "
+            "\"lines_per_s\": %.1f, \"bytes_per_s\": %.0f, "
+            "\"latency_p50_us\": %.0f, \"latency_p99_us\": %.0f, "
+            "\"latency_max_us\": %.0f, \"blocked_writes\": %llu }%s\n",
+            ph->name, ph->seconds, (unsigned long long)ph->lines, rate,
+            rate * LINE_LEN, percentile(&ph->lat_us, 0.50),
+            percentile(&ph->lat_us, 0.99), percentile(&ph->lat_us, 1.0),
+            (unsigned long long)ph->blocked, sep);
+}
+
+static int
+write_report(churn_t *c, phase_t *base, phase_t *storm, long uevents_seen,
+             const char *failures)
+{
+    FILE *fp = fopen(opt.report, "w");
+    if (!fp) {
+        fprintf(stderr, "churn: cannot write %s: %s\n",
+                opt.report, strerror(errno));
+        return -1;
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"devices_per_storm\": %d,\n", opt.devices);
+    fprintf(fp, "  \"rounds\": %d,\n", opt.rounds);
+    fprintf(fp, "  \"settle_ms\": %d,\n", opt.settle_ms);
+    fprintf(fp, "  \"steady_boards\": %d,\n", opt.nsteady);
+    fprintf(fp, "  \"steady_rate_lines_per_s\": %d,\n", opt.rate);
+    fprintf(fp, "  \"events\": { \"adds_sent\": %d, \"adds_seen\": %ld, "
+            "\"lost_adds\": %d, \"lost_remove_storms\": %d },\n",
+            c->sent_adds + opt.nsteady, uevents_seen, c->lost_adds, c->lost_removes);
+    fprintf(fp, "  \"attach_ms\": { \"p50\": %.1f, \"p90\": %.1f, "
+            "\"p99\": %.1f, \"max\": %.1f },\n",
+            percentile(&c->attach_ms, 0.50), percentile(&c->attach_ms, 0.90),
+            percentile(&c->attach_ms, 0.99), percentile(&c->attach_ms, 1.0));
+    fprintf(fp, "  \"drop_storm_ms\": { \"p50\": %.1f, \"max\": %.1f },\n",
+            percentile(&c->drop_ms, 0.50), percentile(&c->drop_ms, 1.0));
+    fprintf(fp, "  \"steady\": {\n");
+    phase_json(fp, base, ",");
+    phase_json(fp, storm, "");
+    fprintf(fp, "  },\n");
+    fprintf(fp, "  \"result\": \"%s\",\n", failures[0] ? "fail" : "pass");
+    fprintf(fp, "  \"failures\": \"%s\"\n", failures);
+    fprintf(fp, "}\n");
+    fclose(fp);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "Usage: hotplug_churn [options]\n"
+        "  --daemon <path>     uart-monitor binary (default ./uart-monitor)\n"
+        "  --devices <n>       adapters per storm (default 48, max %d)\n"
+        "  --rounds <n>        add/remove storms (default 8)\n"
+        "  --steady <n>        boards printing throughout (default 2, max %d)\n"
+        "  --rate <lines/s>    steady board output (default 200)\n"
+        "  --settle-ms <ms>    daemon hot-plug settle delay (default 50)\n"
+        "  --baseline <s>      steady-only measurement first (default 2)\n"
+        "  --timeout-ms <ms>   per-storm deadline (default 10000)\n"
+        "  --report <file>     JSON report (default hotplug_churn_report.json)\n",
+        MAX_DEVICES, MAX_STEADY);
+}
+
+static pid_t
+start_daemon(int child_sock)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0) {
+        const char *out = getenv("CHURN_DEBUG") ? "churn_daemon.log"
+                                                : "/dev/null";
+        int devnull = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+            close(devnull);
+        }
+        char fdarg[16], settle[16], sysroot[300], devroot[300];
+        snprintf(fdarg, sizeof(fdarg), "%d", child_sock);
+        snprintf(settle, sizeof(settle), "%d", opt.settle_ms);
+        snprintf(sysroot, sizeof(sysroot), "%s/sys", root);
+        snprintf(devroot, sizeof(devroot), "%s/dev", root);
+        execl(opt.daemon, "uart-monitor", "monitor", "-f",
+              "--uevent-fd", fdarg, "--settle-ms", settle,
+              "--sysfs-root", sysroot, "--dev-root", devroot, (char *)NULL);
+        _exit(127);
+    }
+
+    char resp[CONTROL_MAX_MSG * 4];
+    for (int i = 0; i < 50; i++) {
+        usleep(100000);
+        if (ctl("STATUS\n", resp, sizeof(resp)) == 0 || resp[0] == '{')
+            return pid;
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+            return -1;
+    }
+    kill(pid, SIGTERM);
+    return -1;
+}
+
+static void
+cleanup_tree(void)
+{
+    if (!root[0])
+        return;
+    char cmd[320];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    if (system(cmd) != 0)
+        fprintf(stderr, "churn: could not remove %s\n", root);
+}
+
+int
+main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc)
+            opt.daemon = argv[++i];
+        else if (strcmp(argv[i], "--devices") == 0 && i + 1 < argc)
+            opt.devices = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc)
+            opt.rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--steady") == 0 && i + 1 < argc)
+            opt.nsteady = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+            opt.rate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--settle-ms") == 0 && i + 1 < argc)
+            opt.settle_ms = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            opt.baseline_s = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--timeout-ms") == 0 && i + 1 < argc)
+            opt.timeout_ms = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+            opt.report = argv[++i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (opt.devices < 1 || opt.devices > MAX_DEVICES || opt.rounds < 1 ||
+        opt.nsteady < 0 || opt.nsteady > MAX_STEADY || opt.rate < 1 ||
+        opt.settle_ms < 0 || opt.baseline_s < 1 || opt.timeout_ms < 1) {
+        usage();
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    snprintf(root, sizeof(root), "/tmp/umchurn.XXXXXX");
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 2;
+    }
+    char dir[300];
+    snprintf(dir, sizeof(dir), "%s/dev", root);
+    mkdirp(dir);
+    snprintf(dir, sizeof(dir), "%s/sys/class/tty", root);
+    mkdirp(dir);
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+        perror("socketpair");
+        cleanup_tree();
+        return 2;
+    }
+    uevent_sock = sv[0];
+    fcntl(uevent_sock, F_SETFD, FD_CLOEXEC);
+
+    daemon_pid = start_daemon(sv[1]);
+    close(sv[1]);
+    if (daemon_pid < 0) {
+        fprintf(stderr, "churn: daemon did not start (already running?)\n");
+        cleanup_tree();
+        return 2;
+    }
+    printf("churn: daemon PID %d, %d storms x %d devices, %d steady "
+           "boards\n", daemon_pid, opt.rounds, opt.devices, opt.nsteady);
+
+    /* steady boards come in through the same uevent path */
+    char failures[512] = "";
+    for (int i = 0; i < opt.nsteady; i++) {
+        steady[i].logfd = -1;
+        if (device_create(&steady[i].dev, STEADY_BASE + i) < 0 ||
+            send_uevent("add", STEADY_BASE + i) < 0) {
+            snprintf(failures, sizeof(failures), "steady board setup");
+            break;
+        }
+    }
+    if (!failures[0] && opt.nsteady > 0 &&
+        wait_port_count(opt.nsteady, mono_ns() + 5000000000ull) < 0)
+        snprintf(failures, sizeof(failures), "steady boards not monitored");
+
+    phase_t base = { .name = "baseline" };
+    phase_t storm = { .name = "churn" };
+    churn_t c;
+    memset(&c, 0, sizeof(c));
+
+    if (!failures[0]) {
+        steady_start_ns = mono_ns();
+        cur_phase = &base;
+        pump_until(mono_ns() + (uint64_t)opt.baseline_s * 1000000000ull);
+        base.seconds = (double)(mono_ns() - steady_start_ns) / 1e9;
+
+        uint64_t t0 = mono_ns();
+        cur_phase = &storm;
+        for (int r = 0; r < opt.rounds; r++) {
+            if (storm_round(r, &c) < 0) {
+                snprintf(failures, sizeof(failures), "round %d setup", r + 1);
+                break;
+            }
+            if (waitpid(daemon_pid, NULL, WNOHANG) == daemon_pid) {
+                snprintf(failures, sizeof(failures), "daemon exited");
+                daemon_pid = -1;
+                break;
+            }
+        }
+        /* give in-flight steady lines a chance to land */
+        pump_until(mono_ns() + 200000000ull);
+        storm.seconds = (double)(mono_ns() - t0) / 1e9;
+        cur_phase = NULL;
+    }
+
+    long uevents_seen = daemon_pid > 0 ? status_field("hotplug_adds") : -1;
+    if (!failures[0] && c.lost_adds > 0)
+        snprintf(failures, sizeof(failures), "%d device(s) never monitored",
+                 c.lost_adds);
+    else if (!failures[0] && c.lost_removes > 0)
+        snprintf(failures, sizeof(failures),
+                 "%d remove storm(s) not fully applied", c.lost_removes);
+
+    if (daemon_pid > 0) {
+        char resp[256];
+        ctl("QUIT\n", resp, sizeof(resp));
+        int status = 0;
+        waitpid(daemon_pid, &status, 0);
+        if (!failures[0] && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+            snprintf(failures, sizeof(failures), "daemon exit status %d",
+                     status);
+    }
+
+    write_report(&c, &base, &storm, uevents_seen, failures);
+
+    double base_rate = base.seconds > 0 ? (double)base.lines / base.seconds
+                                        : 0.0;
+    double storm_rate = storm.seconds > 0 ? (double)storm.lines / storm.seconds
+                                          : 0.0;
+    printf("churn: attach p50 %.1f ms p99 %.1f ms, drop storm p50 %.1f ms, "
+           "%d/%d adds lost\n", percentile(&c.attach_ms, 0.50),
+           percentile(&c.attach_ms, 0.99), percentile(&c.drop_ms, 0.50),
+           c.lost_adds, c.sent_adds);
+    printf("churn: steady %.0f -> %.0f lines/s, log p99 %.0f -> %.0f us, "
+           "%llu blocked writes during churn\n", base_rate, storm_rate,
+           percentile(&base.lat_us, 0.99), percentile(&storm.lat_us, 0.99),
+           (unsigned long long)storm.blocked);
+    printf("churn: %s%s (report: %s)\n",
+           failures[0] ? "FAIL: " : "PASS", failures, opt.report);
+
+    for (int i = 0; i < opt.nsteady; i++) {
+        if (steady[i].logfd >= 0)
+            close(steady[i].logfd);
+        device_destroy(&steady[i].dev);
+    }
+    close(uevent_sock);
+    cleanup_tree();
+    free(c.attach_ms.v);
+    free(c.drop_ms.v);
+    free(base.lat_us.v);
+    free(storm.lat_us.v);
+    return failures[0] ? 1 : 0;
+}
@@ -0,0 +1,264 @@
+/* pipeline.c -- Per-stage overhead of the log line pipeline.
+ *
+ * Feeds the same synthetic console output (printk-stamped lines with a
+ * share of heartbeat lines) through log_write() into a scratch log file,
+ * once with no stages and once per built-in stage on its own, then with
+ * all of them, and reports ns per line and MB/s for each. A stage's
+ * overhead is its run minus the bare run: framing, timestamps and the
+ * file write are the same in every configuration.
+ *
+ *   make bench
+ *   ./bench/pipeline --lines 500000 --report pipeline.json
+ *
+ * No daemon is involved; the scratch directory is removed at the end.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/crash.h"
+#include "../src/devclock.h"
+#include "../src/digest.h"
+#include "../src/filter.h"
+#include "../src/log.h"
+#include "../src/recent.h"
+#include "../src/toplines.h"
+#include "../src/util.h"
+
+#define CHUNK   4096        /* one read() of a busy port */
+#define REPEATS 3           /* best of */
+
+typedef struct {
+    long        lines;
+    int         timestamps;
+    const char *report;
+} options_t;
+
+typedef struct {
+    const char *name;
+    unsigned    stages;     /* bit per entry of stage_defs */
+    double      ns_line;
+    double      mb_s;
+} run_t;
+
+static const struct {
+    const char            *name;
+    const log_stage_ops_t *ops;
+} stage_defs[] = {
+    { "clock",  &log_stage_clock },
+    { "crash",  &log_stage_crash },
+    { "filter", &log_stage_filter },
+    { "recent", &log_stage_recent },
+    { "digest", &log_stage_digest },
+    { "toplines", &log_stage_toplines },
+};
+#define NSTAGE_DEFS ((int)(sizeof(stage_defs) / sizeof(stage_defs[0])))
+
+/* Console output: mostly driver chatter, every 8th line a heartbeat the
+ * filter drops, device time advancing 1 ms per line. */
+static char *
+make_input(long lines, size_t *len)
+{
+    size_t cap = (size_t)lines * 96 + 1;
+    char *buf = malloc(cap);
+    if (!buf)
+        return NULL;
+    size_t n = 0;
+    for (long i = 0; i < lines; i++) {
+        long ms = i + 1000;
+        if (i % 8 == 7)
+            n += (size_t)snprintf(buf + n, cap - n,
+                                  "[%5ld.%06ld] HB %ld\r\n",
+                                  ms / 1000, (ms % 1000) * 1000, i);
+        else
+            n += (size_t)snprintf(buf + n, cap - n,
+                                  "[%5ld.%06ld] eth0: rx queue %ld "
+                                  "refilled, %ld buffers posted\r\n",
+                                  ms / 1000, (ms % 1000) * 1000, i % 4,
+                                  i % 512);
+    }
+    *len = n;
+    return buf;
+}
+
+/* One pass of the input through a log with the given stages. Returns
+ * the elapsed ns, or 0 on failure. */
+static uint64_t
+run_once(const char *dir, const char *input, size_t len, unsigned stages,
+         int timestamps)
+{
+    devclock_t *dc = malloc(sizeof(*dc));
+    crash_t *crash = malloc(sizeof(*crash));
+    recent_t *recent = malloc(sizeof(*recent));
+    digest_t *digest = malloc(sizeof(*digest));
+    toplines_t *top = malloc(sizeof(*top));
+    filter_t filter;
+    filter_init(&filter);
+    filter_add(&filter, FILTER_DROP, "HB ");
+    filter_compile(&filter);
+    if (!dc || !crash || !recent || !digest || !top) {
+        free(dc);
+        free(crash);
+        free(recent);
+        free(digest);
+        free(top);
+        filter_free(&filter);
+        return 0;
+    }
+    devclock_init(dc);
+    char index[512];
+    snprintf(index, sizeof(index), "%s/crashes.idx", dir);
+    crash_init(crash, index, "bench");
+    crash_attach(crash, "bench", "bench.log");
+    recent_reset(recent);
+    char dpath[512];
+    snprintf(dpath, sizeof(dpath), "%s/bench.digest", dir);
+    digest_init(digest);
+    digest_open(digest, dpath);
+    toplines_reset(top);
+    void *ctx[] = { dc, crash, &filter, recent, digest, top };
+
+    log_file_t *lf = malloc(sizeof(*lf));
+    uint64_t took = 0;
+    if (lf && log_open(lf, dir, "bench", NULL) == 0) {
+        lf->timestamps = timestamps;
+        for (int i = 0; i < NSTAGE_DEFS; i++)
+            if (stages & (1u << i))
+                log_add_stage(lf, stage_defs[i].ops, ctx[i]);
+
+        uint64_t t0 = mono_ns();
+        for (size_t off = 0; off < len; off += CHUNK)
+            log_write(lf, input + off, len - off < CHUNK ? len - off : CHUNK);
+        log_flush(lf);
+        digest_poll(digest, mono_ns());
+        took = mono_ns() - t0;
+        log_close(lf);
+        unlink(lf->filepath);
+    }
+    crash_finish(crash);
+    unlink(index);
+    digest_close(digest);
+    unlink(dpath);
+    free(lf);
+    free(dc);
+    free(crash);
+    free(recent);
+    free(digest);
+    free(top);
+    filter_free(&filter);
+    return took;
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "Usage: pipeline [options]\n"
+        "  --lines <n>         Input lines per run (default 500000)\n"
+        "  --no-timestamps     Log without [timestamp] prefixes\n"
+        "  --report <file>     JSON report (default pipeline_report.json)\n");
+}
+
+static void
+write_report(const options_t *opt, const run_t *runs, int nruns,
+             size_t len)
+{
+    FILE *fp = fopen(opt->report, "w");
+    if (!fp) {
+        perror(opt->report);
+        return;
+    }
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"lines\": %ld,\n", opt->lines);
+    fprintf(fp, "  \"bytes\": %zu,\n", len);
+    fprintf(fp, "  \"timestamps\": %d,\n", opt->timestamps);
+    fprintf(fp, "  \"runs\": [\n");
+    for (int i = 0; i < nruns; i++)
+        fprintf(fp, "    { \"stages\": \"%s\", \"ns_per_line\": %.1f, "
+                "\"overhead_ns_per_line\": %.1f, \"mb_per_s\": %.1f }%s\n",
+                runs[i].name, runs[i].ns_line,
+                runs[i].ns_line - runs[0].ns_line, runs[i].mb_s,
+                i + 1 < nruns ? "," : "");
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+    fclose(fp);
+}
+
+int
+main(int argc, char *argv[])
+{
+    options_t opt = { .lines = 500000, .timestamps = 1,
+                      .report = "pipeline_report.json" };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc)
+            opt.lines = atol(argv[++i]);
+        else if (strcmp(argv[i], "--no-timestamps") == 0)
+            opt.timestamps = 0;
+        else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+            opt.report = argv[++i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (opt.lines <= 0) {
+        usage();
+        return 2;
+    }
+
+    char dir[] = "/tmp/uart-monitor-pipeline-XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    size_t len;
+    char *input = make_input(opt.lines, &len);
+    if (!input) {
+        rmdir(dir);
+        return 1;
+    }
+
+    run_t runs[NSTAGE_DEFS + 2];
+    int nruns = 0;
+    runs[nruns++] = (run_t){ .name = "none", .stages = 0 };
+    for (int i = 0; i < NSTAGE_DEFS; i++)
+        runs[nruns++] = (run_t){ .name = stage_defs[i].name,
+                                 .stages = 1u << i };
+    runs[nruns++] = (run_t){ .name = "all",
+                             .stages = (1u << NSTAGE_DEFS) - 1 };
+
+    printf("%ld lines, %.1f MB, chunks of %d bytes, timestamps %s\n\n",
+           opt.lines, (double)len / 1e6, CHUNK, opt.timestamps ? "on" : "off");
+    printf("  %-9s %12s %12s %10s\n", "stages", "ns/line", "overhead",
+           "MB/s");
+    int failed = 0;
+    for (int r = 0; r < nruns; r++) {
+        uint64_t best = 0;
+        for (int k = 0; k < REPEATS; k++) {
+            uint64_t t = run_once(dir, input, len, runs[r].stages,
+                                  opt.timestamps);
+            if (t && (!best || t < best))
+                best = t;
+        }
+        if (!best) {
+            fprintf(stderr, "pipeline: run '%s' failed\n", runs[r].name);
+            failed = 1;
+            break;
+        }
+        runs[r].ns_line = (double)best / (double)opt.lines;
+        runs[r].mb_s = (double)len / ((double)best / 1e9) / 1e6;
+        printf("  %-9s %12.1f %+12.1f %10.1f\n", runs[r].name,
+               runs[r].ns_line, runs[r].ns_line - runs[0].ns_line,
+               runs[r].mb_s);
+    }
+
+    if (!failed) {
+        write_report(&opt, runs, nruns, len);
+        printf("\nReport: %s\n", opt.report);
+    }
+    free(input);
+    rmdir(dir);
+    return failed;
+}
@@ -0,0 +1,757 @@
+/* soak.c -- Long-running soak benchmark with resource-leak detection.
+ *
+ * Runs the real daemon against synthetic PTY boards and keeps churning
+ * the paths where leaks hide: ADD/REMOVE (including "replugging" a board
+ * on a fresh PTY pair), YIELD/RECLAIM, CLEAR and ROTATE, while every board
+ * prints a steady stream of lines. The daemon's RSS, open fd count, CPU
+ * time, control round-trip and log-write latency are sampled over time.
+ * At the end a least-squares trend over the post-warm-up samples decides
+ * pass/fail, and everything is written to a JSON report.
+ *
+ *   make bench
+ *   ./bench/soak --duration 14400 --boards 16 --report soak.json
+ *
+ * Open fds are compared against what the daemon should hold for the
+ * current board states, so churn itself does not look like a leak. What
+ * a monitored and a yielded port cost is measured once after startup:
+ * it depends on the features the daemon has (log, spill and raw capture
+ * files, sockets), so it is not assumed.
+ *
+ * SOAK_DEBUG=1 keeps the daemon's output in soak_daemon.log and prints
+ * every control command that did not get an OK reply.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/log.h"
+#include "../src/control.h"
+#include "../src/util.h"
+
+#define MAX_BOARDS   64
+#define MAX_SAMPLES  20000
+#define TICK_MS      100
+#define RSS_NOISE_KB 256
+
+typedef struct {
+    int    master;
+    char   slave[64];
+    char   label[32];
+    char   logpath[512];
+    int    added;
+    int    yielded;
+    uint64_t lines;
+} board_t;
+
+typedef struct {
+    double t;
+    long   rss_kb;
+    int    fds;
+    int    fd_residual;
+    double cpu_pct;
+    int    ports;
+    double lat_p50_us, lat_p99_us;
+    double ctl_p50_us, ctl_p99_us;
+} sample_t;
+
+typedef struct {
+    double *v;
+    size_t  n, cap;
+} series_t;
+
+static struct {
+    const char *daemon;
+    int         duration;
+    int         nboards;
+    int         interval;
+    int         rate;            /* lines per second per board */
+    double      max_rss_kb_per_hour;
+    const char *report;
+} opt = {
+    .daemon = "./uart-monitor",
+    .duration = 60,
+    .nboards = 8,
+    .interval = 5,
+    .rate = 50,
+    .max_rss_kb_per_hour = 1024.0,
+    .report = "soak_report.json",
+};
+
+static board_t  boards[MAX_BOARDS];
+static sample_t samples[MAX_SAMPLES];
+static int      nsamples;
+static pid_t    daemon_pid = -1;
+
+static struct {
+    unsigned long add, remove, replug, yield, reclaim, clear, rotate,
+                  status, errors;
+} ops;
+
+/* fds of the daemon with no ports, and per monitored or yielded port */
+static struct {
+    int base;
+    int monitored;
+    int yielded;
+} fdcost;
+
+/* ------------------------------------------------------------------ */
+
+static double
+now_s(void)
+{
+    return (double)mono_ns() / 1e9;
+}
+
+static void
+series_add(series_t *s, double v)
+{
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 256;
+        s->v = realloc(s->v, s->cap * sizeof(double));
+        if (!s->v) {
+            perror("realloc");
+            exit(2);
+        }
+    }
+    s->v[s->n++] = v;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double
+percentile(series_t *s, double p)
+{
+    if (s->n == 0)
+        return 0.0;
+    qsort(s->v, s->n, sizeof(double), cmp_double);
+    size_t i = (size_t)(p * (double)(s->n - 1) + 0.5);
+    return s->v[i];
+}
+
+/* Send one control command; returns 0 on an "OK" reply. */
+static int
+ctl(const char *cmd, char *resp, size_t sz, series_t *rtt)
+{
+    uint64_t t0 = mono_ns();
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy_safe(addr.sun_path, CONTROL_SOCK_PATH, sizeof(addr.sun_path));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    ssize_t nw = write(fd, cmd, strlen(cmd));
+    (void)nw;
+    size_t off = 0;
+    ssize_t n;
+    while (off < sz - 1 && (n = read(fd, resp + off, sz - 1 - off)) > 0)
+        off += (size_t)n;
+    resp[off] = '\0';
+    close(fd);
+
+    if (rtt)
+        series_add(rtt, (double)(mono_ns() - t0) / 1e3);
+    if (getenv("SOAK_DEBUG") && strncmp(resp, "OK", 2) != 0)
+        fprintf(stderr, "DBG %s -> %s\n", cmd, resp);
+    return strncmp(resp, "OK", 2) == 0 ? 0 : -1;
+}
+
+static int
+board_open_pty(board_t *b)
+{
+    int slave;
+    if (openpty(&b->master, &slave, NULL, NULL, NULL) < 0)
+        return -1;
+    strlcpy_safe(b->slave, ttyname(slave), sizeof(b->slave));
+    close(slave);
+    fcntl(b->master, F_SETFL, fcntl(b->master, F_GETFL) | O_NONBLOCK);
+    return 0;
+}
+
+/* Write one line to every board that is being monitored. */
+static void
+boards_emit(void)
+{
+    for (int i = 0; i < opt.nboards; i++) {
+        board_t *b = &boards[i];
+        if (!b->added || b->yielded)
+            continue;
+        char line[128];
+        int n = snprintf(line, sizeof(line),
+                         "[%s] heartbeat %llu uptime=%.3f\r\n", b->label,
+                         (unsigned long long)b->lines++, now_s());
+        ssize_t nw = write(b->master, line, (size_t)n);
+        (void)nw;
+    }
+}
+
+/* Drain whatever the daemon might echo back (never in read-only mode,
+ * but keeps the PTY from ever blocking). */
+static void
+boards_drain(void)
+{
+    char buf[4096];
+    for (int i = 0; i < opt.nboards; i++) {
+        while (read(boards[i].master, buf, sizeof(buf)) > 0)
+            ;
+    }
+}
+
+/* Time from write() on each monitored board until the line is in its
+ * log file. A board that misses is counted and the others still are
+ * measured. */
+static void
+measure_latency(series_t *lat)
+{
+    for (int i = 0; i < opt.nboards; i++) {
+        board_t *b = &boards[i];
+        if (!b->added || b->yielded || !b->logpath[0])
+            continue;
+
+        struct stat st;
+        if (stat(b->logpath, &st) < 0) {
+            ops.errors++;
+            continue;
+        }
+        off_t before = st.st_size;
+
+        uint64_t t0 = mono_ns();
+        ssize_t nw = write(b->master, "latency probe\r\n", 15);
+        (void)nw;
+        int seen = 0;
+        while (!seen && mono_ns() - t0 < 1000000000ull) {
+            if (stat(b->logpath, &st) == 0 && st.st_size > before) {
+                series_add(lat, (double)(mono_ns() - t0) / 1e3);
+                seen = 1;
+            } else {
+                usleep(100);
+            }
+        }
+        if (!seen)
+            ops.errors++;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/*  /proc sampling                                                    */
+/* ------------------------------------------------------------------ */
+
+static long
+proc_rss_kb(pid_t pid)
+{
+    char path[64], line[256];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    long kb = -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "VmRSS: %ld", &kb) == 1)
+            break;
+    }
+    fclose(fp);
+    return kb;
+}
+
+static int
+proc_fd_count(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+    DIR *d = opendir(path);
+    if (!d)
+        return -1;
+    int n = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] != '.')
+            n++;
+    }
+    closedir(d);
+    return n;
+}
+
+static double
+proc_cpu_s(pid_t pid)
+{
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return 0.0;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[n] = '\0';
+
+    /* fields after the parenthesised comm: utime and stime are 14, 15 */
+    char *p = strrchr(buf, ')');
+    if (!p)
+        return 0.0;
+    unsigned long utime = 0, stime = 0;
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+               &utime, &stime) != 2)
+        return 0.0;
+    return (double)(utime + stime) / (double)sysconf(_SC_CLK_TCK);
+}
+
+/* fds the daemon should hold for the current board states */
+static int
+expected_fds(int *ports)
+{
+    int fds = fdcost.base;
+    *ports = 0;
+    for (int i = 0; i < opt.nboards; i++) {
+        if (!boards[i].added)
+            continue;
+        (*ports)++;
+        fds += boards[i].yielded ? fdcost.yielded : fdcost.monitored;
+    }
+    return fds;
+}
+
+/* Least-squares slope of y over t, per hour. */
+static double
+trend_per_hour(int first, int field)
+{
+    int n = nsamples - first;
+    if (n < 3)
+        return 0.0;
+    double st = 0, sy = 0, stt = 0, sty = 0;
+    for (int i = first; i < nsamples; i++) {
+        double t = samples[i].t;
+        double y = field == 0 ? (double)samples[i].rss_kb
+                              : (double)samples[i].fd_residual;
+        st += t; sy += y; stt += t * t; sty += t * y;
+    }
+    double den = n * stt - st * st;
+    if (den == 0.0)
+        return 0.0;
+    return (n * sty - st * sy) / den * 3600.0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Churn operations                                                  */
+/* ------------------------------------------------------------------ */
+
+static void
+op_add(board_t *b)
+{
+    char cmd[256], resp[1024];
+    snprintf(cmd, sizeof(cmd), "ADD %s %s\n", b->slave, b->label);
+    ops.add++;
+    if (ctl(cmd, resp, sizeof(resp), NULL) < 0) {
+        ops.errors++;
+        return;
+    }
+    /* "OK added <dev> <logfile>" */
+    char *sp = strrchr(resp, ' ');
+    if (sp) {
+        strlcpy_safe(b->logpath, sp + 1, sizeof(b->logpath));
+        b->logpath[strcspn(b->logpath, "\n")] = '\0';
+    }
+    b->added = 1;
+    b->yielded = 0;
+}
+
+static void
+op_remove(board_t *b, int replug)
+{
+    char cmd[256], resp[1024];
+    snprintf(cmd, sizeof(cmd), "REMOVE %s\n", b->slave);
+    ops.remove++;
+    if (ctl(cmd, resp, sizeof(resp), NULL) < 0)
+        ops.errors++;
+    b->added = 0;
+    b->yielded = 0;
+
+    if (replug) {
+        /* the board comes back on a different PTY, like a USB
+         * device re-enumerating */
+        close(b->master);
+        if (board_open_pty(b) < 0)
+            ops.errors++;
+        ops.replug++;
+    }
+}
+
+static void
+op_toggle_yield(board_t *b)
+{
+    char cmd[256], resp[1024];
+    snprintf(cmd, sizeof(cmd), "%s %s\n",
+             b->yielded ? "RECLAIM" : "YIELD", b->slave);
+    if (b->yielded)
+        ops.reclaim++;
+    else
+        ops.yield++;
+    if (ctl(cmd, resp, sizeof(resp), NULL) < 0) {
+        ops.errors++;
+        return;
+    }
+    b->yielded = !b->yielded;
+}
+
+static void
+churn(unsigned long tick, series_t *ctl_rtt)
+{
+    char resp[CONTROL_MAX_MSG * 4];
+    board_t *b = &boards[tick % (unsigned long)opt.nboards];
+
+    switch (tick % 7) {
+    case 0:
+        if (b->added && b->yielded)
+            op_toggle_yield(b);
+        else if (b->added)
+            op_remove(b, (tick / 7) % 2 == 0);
+        else
+            op_add(b);
+        break;
+    case 2:
+        if (b->added)
+            op_toggle_yield(b);
+        break;
+    case 4: {
+        char cmd[64];
+        snprintf(cmd, sizeof(cmd), "CLEAR %s\n", b->label);
+        ops.clear++;
+        if (b->added && ctl(cmd, resp, sizeof(resp), NULL) < 0)
+            ops.errors++;
+        break;
+    }
+    default:
+        ops.status++;
+        if (ctl("STATUS\n", resp, sizeof(resp), ctl_rtt) < 0 &&
+            resp[0] != '{')
+            ops.errors++;
+        break;
+    }
+
+    /* rotate the whole session every ~30 s */
+    if (tick % 300 == 299) {
+        ops.rotate++;
+        if (ctl("ROTATE\n", resp, sizeof(resp), NULL) < 0) {
+            ops.errors++;
+        } else {
+            /* "OK rotated <session>": logs moved, refresh paths */
+            const char *session = resp + strlen("OK rotated ");
+            resp[strcspn(resp, "\n")] = '\0';
+            for (int i = 0; i < opt.nboards; i++) {
+                char *slash = strrchr(boards[i].logpath, '/');
+                if (slash) {
+                    char name[64];
+                    strlcpy_safe(name, slash + 1, sizeof(name));
+                    snprintf(boards[i].logpath, sizeof(boards[i].logpath),
+                             "%.440s/%.63s", session, name);
+                }
+            }
+        }
+    }
+}
+
+/* Measure what a port costs in fds: the daemon alone, then with every
+ * board added, then with one of them yielded. Adds all boards. */
+static void
+calibrate_fds(void)
+{
+    usleep(200000);
+    fdcost.base = proc_fd_count(daemon_pid);
+    for (int i = 0; i < opt.nboards; i++)
+        op_add(&boards[i]);
+    boards_emit();
+    usleep(300000);
+    int all = proc_fd_count(daemon_pid);
+    /* rounded, in case one port opened something the others did not */
+    fdcost.monitored = (all - fdcost.base + opt.nboards / 2) / opt.nboards;
+
+    op_toggle_yield(&boards[0]);
+    usleep(100000);
+    int one_yielded = proc_fd_count(daemon_pid);
+    fdcost.yielded = fdcost.monitored - (all - one_yielded);
+    op_toggle_yield(&boards[0]);
+
+    printf("soak: fds base=%d per port=%d (yielded %d)\n", fdcost.base,
+           fdcost.monitored, fdcost.yielded);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Report                                                            */
+/* ------------------------------------------------------------------ */
+
+static int
+write_report(double rss_trend, double fd_trend, series_t *lat,
+             series_t *ctl_all, const char *failures)
+{
+    FILE *fp = fopen(opt.report, "w");
+    if (!fp) {
+        fprintf(stderr, "soak: cannot write %s: %s\n",
+                opt.report, strerror(errno));
+        return -1;
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"duration_s\": %d,\n", opt.duration);
+    fprintf(fp, "  \"boards\": %d,\n", opt.nboards);
+    fprintf(fp, "  \"rate_lines_per_s\": %d,\n", opt.rate);
+    fprintf(fp, "  \"ops\": { \"add\": %lu, \"remove\": %lu, "
+            "\"replug\": %lu, \"yield\": %lu, \"reclaim\": %lu, "
+            "\"clear\": %lu, \"rotate\": %lu, \"status\": %lu, "
+            "\"errors\": %lu },\n",
+            ops.add, ops.remove, ops.replug, ops.yield, ops.reclaim,
+            ops.clear, ops.rotate, ops.status, ops.errors);
+    fprintf(fp, "  \"trend\": { \"rss_kb_per_hour\": %.1f, "
+            "\"fd_residual_per_hour\": %.2f },\n", rss_trend, fd_trend);
+    fprintf(fp, "  \"latency_us\": { \"log_p50\": %.0f, \"log_p99\": %.0f, "
+            "\"log_max\": %.0f, \"control_p50\": %.0f, "
+            "\"control_p99\": %.0f },\n",
+            percentile(lat, 0.50), percentile(lat, 0.99),
+            percentile(lat, 1.0), percentile(ctl_all, 0.50),
+            percentile(ctl_all, 0.99));
+    fprintf(fp, "  \"samples\": [\n");
+    for (int i = 0; i < nsamples; i++) {
+        sample_t *s = &samples[i];
+        fprintf(fp, "    { \"t\": %.1f, \"rss_kb\": %ld, \"fds\": %d, "
+                "\"fd_residual\": %d, \"cpu_pct\": %.2f, \"ports\": %d, "
+                "\"log_p50_us\": %.0f, \"log_p99_us\": %.0f, "
+                "\"control_p50_us\": %.0f, \"control_p99_us\": %.0f }%s\n",
+                s->t, s->rss_kb, s->fds, s->fd_residual, s->cpu_pct,
+                s->ports, s->lat_p50_us, s->lat_p99_us, s->ctl_p50_us,
+                s->ctl_p99_us, i < nsamples - 1 ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+    fprintf(fp, "  \"result\": \"%s\",\n", failures[0] ? "fail" : "pass");
+    fprintf(fp, "  \"failures\": \"%s\"\n", failures);
+    fprintf(fp, "}\n");
+    fclose(fp);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "Usage: soak [options]\n"
+        "  --daemon <path>        uart-monitor binary (default ./uart-monitor)\n"
+        "  --duration <s>         run time in seconds (default 60)\n"
+        "  --boards <n>           synthetic PTY boards (default 8)\n"
+        "  --interval <s>         sample period (default 5)\n"
+        "  --rate <lines/s>       output per board (default 50)\n"
+        "  --max-rss-growth <kB/h> RSS trend limit (default 1024)\n"
+        "  --report <file>        JSON report (default soak_report.json)\n");
+}
+
+static pid_t
+start_daemon(void)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0) {
+        const char *out = getenv("SOAK_DEBUG") ? "soak_daemon.log"
+                                               : "/dev/null";
+        int devnull = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+            close(devnull);
+        }
+        /* --only with a name no real device has: PTY boards only */
+        execl(opt.daemon, "uart-monitor", "monitor", "-f", "-t",
+              "--only", "soak-no-real-ports", (char *)NULL);
+        _exit(127);
+    }
+
+    char resp[CONTROL_MAX_MSG * 4];
+    for (int i = 0; i < 50; i++) {
+        usleep(100000);
+        if (ctl("STATUS\n", resp, sizeof(resp), NULL) == 0 ||
+            resp[0] == '{')
+            return pid;
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+            return -1;
+    }
+    kill(pid, SIGTERM);
+    return -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc)
+            opt.daemon = argv[++i];
+        else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc)
+            opt.duration = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--boards") == 0 && i + 1 < argc)
+            opt.nboards = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+            opt.interval = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+            opt.rate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-rss-growth") == 0 && i + 1 < argc)
+            opt.max_rss_kb_per_hour = atof(argv[++i]);
+        else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+            opt.report = argv[++i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (opt.nboards < 1 || opt.nboards > MAX_BOARDS || opt.duration < 1 ||
+        opt.interval < 1 || opt.rate < 1) {
+        usage();
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < opt.nboards; i++) {
+        snprintf(boards[i].label, sizeof(boards[i].label), "SOAK_%02d", i);
+        if (board_open_pty(&boards[i]) < 0) {
+            perror("openpty");
+            return 2;
+        }
+    }
+
+    daemon_pid = start_daemon();
+    if (daemon_pid < 0) {
+        fprintf(stderr, "soak: daemon did not start (already running?)\n");
+        return 2;
+    }
+    printf("soak: daemon PID %d, %d boards, %d s\n",
+           daemon_pid, opt.nboards, opt.duration);
+
+    calibrate_fds();
+
+    series_t lat = {0}, ctl_rtt = {0}, lat_all = {0}, ctl_all = {0};
+    double start = now_s();
+    double next_sample = start + opt.interval;
+    double last_cpu = proc_cpu_s(daemon_pid);
+    double last_cpu_t = start;
+    int emit_every = 1000 / TICK_MS;
+    unsigned long tick = 0;
+    char failures[512] = "";
+
+    while (now_s() - start < opt.duration) {
+        /* spread each board's lines across the tick */
+        int per_tick = opt.rate / emit_every;
+        if (per_tick < 1)
+            per_tick = 1;
+        for (int k = 0; k < per_tick; k++)
+            boards_emit();
+        boards_drain();
+
+        churn(tick++, &ctl_rtt);
+
+        if (waitpid(daemon_pid, NULL, WNOHANG) == daemon_pid) {
+            snprintf(failures, sizeof(failures), "daemon exited");
+            daemon_pid = -1;
+            break;
+        }
+
+        if (now_s() >= next_sample && nsamples < MAX_SAMPLES) {
+            measure_latency(&lat);
+            sample_t *s = &samples[nsamples++];
+            double t = now_s();
+            double cpu = proc_cpu_s(daemon_pid);
+            s->t = t - start;
+            s->rss_kb = proc_rss_kb(daemon_pid);
+            s->fds = proc_fd_count(daemon_pid);
+            s->fd_residual = s->fds - expected_fds(&s->ports);
+            s->cpu_pct = (cpu - last_cpu) / (t - last_cpu_t) * 100.0;
+            s->lat_p50_us = percentile(&lat, 0.50);
+            s->lat_p99_us = percentile(&lat, 0.99);
+            s->ctl_p50_us = percentile(&ctl_rtt, 0.50);
+            s->ctl_p99_us = percentile(&ctl_rtt, 0.99);
+            last_cpu = cpu;
+            last_cpu_t = t;
+
+            printf("  t=%6.0fs rss=%ld kB fds=%d (residual %d) cpu=%.1f%% "
+                   "ports=%d log p99=%.0f us ctl p99=%.0f us\n",
+                   s->t, s->rss_kb, s->fds, s->fd_residual, s->cpu_pct,
+                   s->ports, s->lat_p99_us, s->ctl_p99_us);
+            fflush(stdout);
+
+            for (size_t i = 0; i < lat.n; i++)
+                series_add(&lat_all, lat.v[i]);
+            for (size_t i = 0; i < ctl_rtt.n; i++)
+                series_add(&ctl_all, ctl_rtt.v[i]);
+            lat.n = 0;
+            ctl_rtt.n = 0;
+            next_sample += opt.interval;
+        }
+
+        usleep(TICK_MS * 1000);
+    }
+
+    /* trends over the post-warm-up part of the run */
+    int first = nsamples / 5;
+    double rss_trend = trend_per_hour(first, 0);
+    double fd_trend = trend_per_hour(first, 1);
+
+    if (!failures[0] && nsamples >= 3) {
+        int fd_growth = samples[nsamples - 1].fd_residual -
+                        samples[first].fd_residual;
+        if (fd_growth > 0 && fd_trend > 0.0)
+            snprintf(failures, sizeof(failures),
+                     "fd leak: residual grew by %d (%.2f/h)",
+                     fd_growth, fd_trend);
+        /* short runs extrapolate page-granular noise into huge
+         * hourly rates: also require real absolute growth */
+        else if (rss_trend > opt.max_rss_kb_per_hour &&
+                 samples[nsamples - 1].rss_kb - samples[first].rss_kb >
+                 RSS_NOISE_KB)
+            snprintf(failures, sizeof(failures),
+                     "rss growth %.0f kB/h exceeds %.0f kB/h",
+                     rss_trend, opt.max_rss_kb_per_hour);
+    }
+
+    if (daemon_pid > 0) {
+        char resp[256];
+        ctl("QUIT\n", resp, sizeof(resp), NULL);
+        int status = 0;
+        waitpid(daemon_pid, &status, 0);
+        if (!failures[0] && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+            snprintf(failures, sizeof(failures), "daemon exit status %d",
+                     status);
+    }
+
+    write_report(rss_trend, fd_trend, &lat_all, &ctl_all, failures);
+
+    printf("soak: rss trend %.0f kB/h, fd residual trend %.2f/h, "
+           "%lu control errors\n", rss_trend, fd_trend, ops.errors);
+    printf("soak: %s%s (report: %s)\n",
+           failures[0] ? "FAIL: " : "PASS", failures, opt.report);
+
+    for (int i = 0; i < opt.nboards; i++)
+        close(boards[i].master);
+    free(lat.v);
+    free(ctl_rtt.v);
+    free(lat_all.v);
+    free(ctl_all.v);
+    return failures[0] ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+/* acl.c -- Control client credentials and per-port access lists.
+ *
+ * In system mode one daemon captures every port and the control socket
+ * is open to all local users. Each connection is identified by the
+ * kernel (SO_PEERCRED), not by anything the client sends, and each port
+ * is visible only to the principals its "allow" lines name.
+ */
+#include "acl.h"
+#include "util.h"
+
+#include <grp.h>
+#include <pwd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+int
+acl_peer_from_fd(int fd, acl_peer_t *p)
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+        return -1;
+    acl_peer_from_ids(p, cred.uid, cred.gid);
+    return 0;
+}
+
+void
+acl_peer_from_ids(acl_peer_t *p, uid_t uid, gid_t gid)
+{
+    memset(p, 0, sizeof(*p));
+    p->uid = uid;
+    p->gid = gid;
+    p->groups[0] = gid;
+    p->ngroups = 1;
+
+    struct passwd pw, *res = NULL;
+    char buf[4096];
+    if (getpwuid_r(uid, &pw, buf, sizeof(buf), &res) != 0 || !res)
+        return;
+    strlcpy_safe(p->user, pw.pw_name, sizeof(p->user));
+
+    int n = ACL_MAX_GROUPS;
+    if (getgrouplist(pw.pw_name, gid, p->groups, &n) >= 0)
+        p->ngroups = n;
+}
+
+static int
+is_number(const char *s)
+{
+    if (!*s)
+        return 0;
+    for (; *s; s++)
+        if (*s < '0' || *s > '9')
+            return 0;
+    return 1;
+}
+
+static int
+in_group(const acl_peer_t *p, const char *name)
+{
+    gid_t gid;
+    if (is_number(name)) {
+        gid = (gid_t)strtoul(name, NULL, 10);
+    } else {
+        struct group gr, *res = NULL;
+        char buf[4096];
+        if (getgrnam_r(name, &gr, buf, sizeof(buf), &res) != 0 || !res)
+            return 0;
+        gid = gr.gr_gid;
+    }
+    for (int i = 0; i < p->ngroups; i++)
+        if (p->groups[i] == gid)
+            return 1;
+    return 0;
+}
+
+static int
+principal_matches(const acl_peer_t *p, const char *who)
+{
+    if (strcmp(who, "*") == 0)
+        return 1;
+    if (who[0] == '@')
+        return in_group(p, who + 1);
+    if (is_number(who))
+        return p->uid == (uid_t)strtoul(who, NULL, 10);
+    return p->user[0] && strcmp(p->user, who) == 0;
+}
+
+int
+acl_who_matches(const acl_peer_t *p, const char *who)
+{
+    char list[256];
+    strlcpy_safe(list, who, sizeof(list));
+
+    char *saveptr;
+    for (char *w = strtok_r(list, ",", &saveptr); w;
+         w = strtok_r(NULL, ",", &saveptr)) {
+        if (principal_matches(p, w))
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+/* acl.h -- Control client credentials and per-port access lists */
+#ifndef ACL_H
+#define ACL_H
+
+#include <sys/types.h>
+
+#define ACL_MAX_GROUPS 64
+
+/* Who is on the other end of a control connection */
+typedef struct {
+    uid_t uid;
+    gid_t gid;
+    char  user[64];                  /* "" if the uid has no passwd entry */
+    gid_t groups[ACL_MAX_GROUPS];    /* primary and supplementary */
+    int   ngroups;
+} acl_peer_t;
+
+/* Fill p from the credentials of a connected Unix socket (SO_PEERCRED).
+ * Returns 0 on success, -1 on error. */
+int acl_peer_from_fd(int fd, acl_peer_t *p);
+
+/* Fill p for a uid/gid: user name and group list from the user database. */
+void acl_peer_from_ids(acl_peer_t *p, uid_t uid, gid_t gid);
+
+/* Check p against a comma-separated list of principals: a user name, a
+ * numeric uid, "@group" (by name or number) or "*" for anyone.
+ * Returns 1 if one of them matches. */
+int acl_who_matches(const acl_peer_t *p, const char *who);
+
+#endif /* ACL_H */
@@ -0,0 +1,1207 @@
+/* archive.c -- Compressed, indexed session archives (export).
+ *
+ * A failing test wants the session attached to a bug, and a session is
+ * often hundreds of MB of text. "export" packs a session directory into
+ * one file: every file is cut into ~1 MB blocks on line boundaries and
+ * the blocks are compressed independently (lz.h) on all cores. The
+ * index at the end records where each block came from and the time
+ * range of its lines, so "archive" can list, cat or grep a port over a
+ * time range by decompressing only the blocks that overlap it.
+ */
+#include "archive.h"
+#include "log.h"
+#include "lz.h"
+#include "util.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------ */
+/*  Line timestamps and time windows                                  */
+/* ------------------------------------------------------------------ */
+
+/* mktime() is far too slow to run on every line: lines share the hour,
+ * so it is only called when "YYYY-MM-DD HH" changes. */
+typedef struct {
+    char    hour[13];
+    int64_t base;               /* ms at HH:00:00, -1 if not a time */
+} time_cache_t;
+
+static int
+digits(const char *p, int n)
+{
+    int v = 0;
+    for (int i = 0; i < n; i++) {
+        if (p[i] < '0' || p[i] > '9')
+            return -1;
+        v = v * 10 + (p[i] - '0');
+    }
+    return v;
+}
+
+static int64_t
+line_time(const char *line, size_t len, time_cache_t *tc)
+{
+    const char *ts = NULL;
+
+    if (len > 1 && line[0] == '[') {
+        ts = line + 1;
+    } else if (len > 8 && memcmp(line, "--- ", 4) == 0) {
+        /* marker: "--- <text> [<ts>] ---" */
+        const char *end = line + len;
+        while (end > line && (end[-1] == '\n' || end[-1] == '\r'))
+            end--;
+        if (end - line > 8 && memcmp(end - 5, "] ---", 5) == 0) {
+            for (const char *p = end - 6; p > line; p--) {
+                if (*p == '[') {
+                    ts = p + 1;
+                    break;
+                }
+            }
+        }
+    }
+    /* "YYYY-MM-DD HH:MM:SS" */
+    if (!ts || (size_t)(line + len - ts) < 19 || ts[13] != ':' ||
+        ts[16] != ':')
+        return 0;
+    int mm = digits(ts + 14, 2), ss = digits(ts + 17, 2);
+    if (mm < 0 || ss < 0)
+        return 0;
+
+    if (memcmp(tc->hour, ts, 13) != 0) {
+        char buf[20];
+        memcpy(buf, ts, 13);
+        memcpy(buf + 13, ":00:00", 7);
+        memcpy(tc->hour, ts, 13);
+        if (timestamp_parse_ms(buf, &tc->base) < 0)
+            tc->base = -1;
+    }
+    if (tc->base < 0)
+        return 0;
+
+    int frac = 0;
+    if ((size_t)(line + len - ts) >= 23 && ts[19] == '.') {
+        frac = digits(ts + 20, 3);
+        if (frac < 0)
+            frac = 0;
+    }
+    return tc->base + (mm * 60 + ss) * 1000 + frac;
+}
+
+int64_t
+archive_line_time(const char *line, size_t len)
+{
+    time_cache_t tc = { "", 0 };
+    return line_time(line, len, &tc);
+}
+
+/* Copy the lines of src that fall in [since, until] (0: open) to dst,
+ * or just measure them if dst is NULL, and report the first and last
+ * timestamps of the lines kept. A line without a timestamp belongs to
+ * the last one before it (the first one of the block for leading
+ * lines); a block with no timestamps at all is kept whole. dst may be
+ * src. Returns the bytes kept. */
+static size_t
+window_lines(const char *src, size_t len, int64_t since, int64_t until,
+             char *dst, int64_t *t_first, int64_t *t_last)
+{
+    time_cache_t tc = { "", 0 };
+    int windowed = since || until;
+
+    /* leading lines take the block's first timestamp */
+    int64_t cur = 0;
+    for (size_t off = 0; windowed && off < len && !cur;) {
+        const char *nl = memchr(src + off, '\n', len - off);
+        size_t llen = nl ? (size_t)(nl - (src + off)) + 1 : len - off;
+        cur = line_time(src + off, llen, &tc);
+        off += llen;
+    }
+
+    size_t kept = 0;
+    int64_t first = 0, last = 0;
+    for (size_t off = 0; off < len;) {
+        const char *nl = memchr(src + off, '\n', len - off);
+        size_t llen = nl ? (size_t)(nl - (src + off)) + 1 : len - off;
+        int64_t t = line_time(src + off, llen, &tc);
+        if (t)
+            cur = t;
+        if (!windowed || !cur ||
+            ((!since || cur >= since) && (!until || cur <= until))) {
+            if (t) {
+                if (!first)
+                    first = t;
+                last = t;
+            }
+            if (dst && dst + kept != src + off)
+                memmove(dst + kept, src + off, llen);
+            kept += llen;
+        }
+        off += llen;
+    }
+    if (t_first)
+        *t_first = first;
+    if (t_last)
+        *t_last = last;
+    return kept;
+}
+
+static int
+block_in_window(const archive_block_t *b, int64_t since, int64_t until)
+{
+    if (!b->t_first)
+        return 1;
+    return (!since || b->t_last >= since) && (!until || b->t_first <= until);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Deduplicated segments                                             */
+/* ------------------------------------------------------------------ */
+
+/* "YYYY-MM-DD HH:MM:" only changes once a minute: a prefix is rebuilt
+ * from its ms with one localtime() per minute, and always the same way
+ * for the same ms, whatever the cache held before. */
+typedef struct {
+    int64_t minute;
+    char    head[18];           /* "YYYY-MM-DD HH:MM:" */
+} stamp_cache_t;
+
+#define STAMP_LEN 26            /* "[YYYY-MM-DD HH:MM:SS.mmm] " */
+
+static void
+stamp_fmt(stamp_cache_t *sc, int64_t ms, char *out)
+{
+    int64_t minute = ms - ms % 60000;
+    if (minute != sc->minute) {
+        char full[32];
+        timestamp_fmt_ms(minute, full, sizeof(full));
+        memcpy(sc->head, full, 17);
+        sc->head[17] = '\0';
+        sc->minute = minute;
+    }
+    int rest = (int)(ms - minute);
+    out[0] = '[';
+    memcpy(out + 1, sc->head, 17);
+    out[18] = (char)('0' + rest / 10000);
+    out[19] = (char)('0' + rest / 1000 % 10);
+    out[20] = '.';
+    out[21] = (char)('0' + rest / 100 % 10);
+    out[22] = (char)('0' + rest / 10 % 10);
+    out[23] = (char)('0' + rest % 10);
+    memcpy(out + 24, "] ", 3);
+}
+
+static size_t
+put_varint(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static int
+get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+    *v = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7) {
+        uint8_t b = *(*p)++;
+        *v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+/* Split lines into text without the daemon's "[timestamp] " prefixes
+ * and a column of varints saying where they were (see archive.h). A
+ * prefix is only taken out if it would be rebuilt byte for byte. text
+ * holds len bytes, times 10 per line. */
+static void
+split_stamps(const char *src, size_t len, char *text, size_t *text_len,
+             uint8_t *times, size_t *times_len)
+{
+    time_cache_t tc = { "", 0 };
+    stamp_cache_t sc = { -1, "" };
+    int64_t prev = 0;
+    size_t tn = 0, xn = 0;
+    for (size_t off = 0; off < len;) {
+        const char *line = src + off;
+        const char *nl = memchr(line, '\n', len - off);
+        size_t llen = nl ? (size_t)(nl - line) + 1 : len - off;
+        off += llen;
+
+        int64_t ms = 0;
+        char stamp[STAMP_LEN + 1];
+        if (llen > STAMP_LEN && line[0] == '[' &&
+            line[STAMP_LEN - 2] == ']' && line[STAMP_LEN - 1] == ' ')
+            ms = line_time(line, llen, &tc);
+        if (ms > 0) {
+            stamp_fmt(&sc, ms, stamp);
+            if (memcmp(stamp, line, STAMP_LEN) != 0)
+                ms = 0;
+        }
+        if (ms > 0) {
+            int64_t d = ms - prev;
+            uint64_t zz = ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+            xn += put_varint(times + xn, zz + 1);
+            prev = ms;
+            line += STAMP_LEN;
+            llen -= STAMP_LEN;
+        } else {
+            times[xn++] = 0;
+        }
+        memcpy(text + tn, line, llen);
+        tn += llen;
+    }
+    *text_len = tn;
+    *times_len = xn;
+}
+
+/* Inverse of split_stamps() into out, which holds out_len bytes.
+ * Returns -1 if the two do not rebuild exactly out_len bytes. */
+static int
+join_stamps(const char *text, size_t text_len, const uint8_t *times,
+            size_t times_len, char *out, size_t out_len)
+{
+    stamp_cache_t sc = { -1, "" };
+    const uint8_t *tp = times, *tend = times + times_len;
+    int64_t prev = 0;
+    size_t n = 0;
+    for (size_t off = 0; off < text_len;) {
+        const char *nl = memchr(text + off, '\n', text_len - off);
+        size_t llen = nl ? (size_t)(nl - (text + off)) + 1 : text_len - off;
+        uint64_t v;
+        if (get_varint(&tp, tend, &v) < 0)
+            return -1;
+        if (v) {
+            uint64_t zz = v - 1;
+            prev += (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+            if (prev <= 0 || n + STAMP_LEN > out_len)
+                return -1;
+            char stamp[STAMP_LEN + 1];
+            stamp_fmt(&sc, prev, stamp);
+            memcpy(out + n, stamp, STAMP_LEN);
+            n += STAMP_LEN;
+        }
+        if (n + llen > out_len)
+            return -1;
+        memcpy(out + n, text + off, llen);
+        n += llen;
+        off += llen;
+    }
+    return n == out_len && tp == tend ? 0 : -1;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Export                                                            */
+/* ------------------------------------------------------------------ */
+
+typedef struct {
+    uint32_t    stream;
+    int         fd;         /* the stream's log, read with pread */
+    uint64_t    raw_off;
+    size_t      raw_len;
+    char       *out;        /* compressed, malloc'd by the worker */
+    size_t      out_len;
+    size_t      kept;       /* bytes left after the time window */
+    uint32_t    crc;
+    int64_t     t_first;
+    int64_t     t_last;
+    int         failed;     /* errno */
+    /* --store: the segment split and chunked (see archive.h) */
+    char       *text;
+    size_t      text_len;
+    size_t      times_len;      /* before compression */
+    uint32_t    nchunks;
+    uint32_t   *chunk_len;
+    uint8_t   (*chunk_sha)[32];
+} export_job_t;
+
+typedef struct {
+    export_job_t   *jobs;
+    size_t          njobs;
+    size_t          next;
+    pthread_mutex_t lock;
+    int64_t         since;
+    int64_t         until;
+    int             dedup;
+} export_pool_t;
+
+/* Split the kept lines of a job into text and times, compress the
+ * times into j->out and cut and hash the text; the chunks themselves are
+ * stored by the export thread, in order. */
+static int
+chunk_job(export_job_t *j, const char *src)
+{
+    uint8_t *times = malloc(j->kept * 10 + 1);
+    j->text = malloc(j->kept);
+    if (!times || !j->text) {
+        free(times);
+        return -1;
+    }
+    split_stamps(src, j->kept, j->text, &j->text_len, times, &j->times_len);
+    j->out = malloc(LZ_BOUND(j->times_len));
+    if (!j->out) {
+        free(times);
+        return -1;
+    }
+    j->out_len = lz_compress(times, j->times_len, j->out);
+    free(times);
+
+    size_t cap = j->text_len / DEDUP_MIN_CHUNK + 1;
+    j->chunk_len = malloc(cap * sizeof(*j->chunk_len));
+    j->chunk_sha = malloc(cap * sizeof(*j->chunk_sha));
+    if (!j->chunk_len || !j->chunk_sha)
+        return -1;
+    for (size_t off = 0; off < j->text_len;) {
+        size_t n = dedup_cut(j->text + off, j->text_len - off);
+        j->chunk_len[j->nchunks] = (uint32_t)n;
+        dedup_sha256(j->text + off, n, j->chunk_sha[j->nchunks++]);
+        off += n;
+    }
+    return 0;
+}
+
+/* Read up to len bytes at off; fewer if the file has shrunk since the
+ * export looked at it (a CLEAR --truncate). -1 on a read error. */
+static ssize_t
+read_block(int fd, char *buf, size_t len, uint64_t off)
+{
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = pread(fd, buf + got, len - got, (off_t)(off + got));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        got += (size_t)n;
+    }
+    return (ssize_t)got;
+}
+
+static void
+compress_job(export_job_t *j, int64_t since, int64_t until, int dedup)
+{
+    char *src = malloc(j->raw_len ? j->raw_len : 1);
+    if (!src) {
+        j->failed = ENOMEM;
+        return;
+    }
+    ssize_t got = read_block(j->fd, src, j->raw_len, j->raw_off);
+    if (got < 0) {
+        j->failed = errno;
+        free(src);
+        return;
+    }
+    j->raw_len = (size_t)got;
+
+    /* the window only ever moves lines back: filter in place */
+    j->kept = window_lines(src, j->raw_len, since, until,
+                           since || until ? src : NULL,
+                           &j->t_first, &j->t_last);
+
+    if (j->kept > 0 && dedup) {
+        j->crc = crc32_update(0, src, j->kept);
+        if (chunk_job(j, src) < 0)
+            j->failed = ENOMEM;
+    } else if (j->kept > 0) {
+        j->out = malloc(LZ_BOUND(j->kept));
+        if (j->out) {
+            j->out_len = lz_compress(src, j->kept, j->out);
+            j->crc = crc32_update(0, src, j->kept);
+        } else {
+            j->failed = ENOMEM;
+        }
+    }
+    free(src);
+}
+
+static void *
+export_worker(void *arg)
+{
+    export_pool_t *pool = arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        size_t i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->njobs)
+            return NULL;
+        compress_job(&pool->jobs[i], pool->since, pool->until,
+                     pool->dedup);
+    }
+}
+
+static int
+name_cmp(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* Whether a session file belongs in an export limited to 'ports'. The
+ * session-wide indexes (marks, checkpoints) always do. */
+static int
+stream_selected(const char *name, const char *ports)
+{
+    if (!ports || strcmp(name, "marks.log") == 0 ||
+        strcmp(name, LOG_CHECKPOINTS) == 0)
+        return 1;
+
+    size_t stem = strcspn(name, ".");
+    char list[512];
+    strlcpy_safe(list, ports, sizeof(list));
+    char *saveptr;
+    for (char *p = strtok_r(list, ",", &saveptr); p;
+         p = strtok_r(NULL, ",", &saveptr)) {
+        if (strlen(p) == stem && strncmp(name, p, stem) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static void
+put_le(FILE *fp, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        fputc((int)(v >> (8 * i)) & 0xff, fp);
+}
+
+static void
+put_le32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void
+put_name(FILE *fp, const char *s)
+{
+    size_t n = strlen(s);
+    put_le(fp, n, 2);
+    fwrite(s, 1, n, fp);
+}
+
+/* Store the chunks of a job and replace its output with the segment
+ * payload of the manifest (see archive.h). */
+static int
+store_job(dedup_store_t *store, export_job_t *j, archive_stats_t *stats)
+{
+    size_t len = 16 + (size_t)j->nchunks * 4 + j->out_len;
+    uint8_t *p = malloc(len);
+    if (!p)
+        return -1;
+    put_le32(p, j->nchunks);
+    put_le32(p + 4, (uint32_t)j->text_len);
+    put_le32(p + 8, (uint32_t)j->times_len);
+    put_le32(p + 12, (uint32_t)j->out_len);
+    uint64_t before = store->added;
+    size_t off = 0;
+    for (uint32_t c = 0; c < j->nchunks; c++) {
+        int64_t id = dedup_put(store, j->chunk_sha[c], j->text + off,
+                               j->chunk_len[c]);
+        if (id < 0) {
+            free(p);
+            return -1;
+        }
+        put_le32(p + 16 + 4 * c, (uint32_t)id);
+        off += j->chunk_len[c];
+    }
+    memcpy(p + 16 + (size_t)j->nchunks * 4, j->out, j->out_len);
+    stats->chunks += j->nchunks;
+    stats->new_chunks += store->added - before;
+    free(j->out);
+    j->out = (char *)p;
+    j->out_len = len;
+    return 0;
+}
+
+int
+archive_export(const char *session_dir, const char *out_path,
+               const archive_opts_t *opts, archive_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    DIR *dir = opendir(session_dir);
+    if (!dir) {
+        fprintf(stderr, "export: %s: %s\n", session_dir, strerror(errno));
+        return -1;
+    }
+    char **names = NULL;
+    int nnames = 0, names_cap = 0;
+    int *fds = NULL;
+    char *scan = NULL;
+    export_job_t *jobs = NULL;
+    size_t njobs = 0, cap = 0;
+    dedup_store_t *store = NULL;
+    int rc = -1;
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        char path[1024];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", session_dir, ent->d_name);
+        /* tty-name symlinks duplicate the label logs */
+        if (lstat(path, &st) < 0 || !S_ISREG(st.st_mode) ||
+            strlen(ent->d_name) >= ARCHIVE_NAME_LEN ||
+            !stream_selected(ent->d_name, opts->ports))
+            continue;
+        if (nnames == names_cap) {
+            names_cap = names_cap ? names_cap * 2 : 64;
+            char **grown = realloc(names, (size_t)names_cap *
+                                          sizeof(*names));
+            if (!grown)
+                break;
+            names = grown;
+        }
+        names[nnames] = strdup(ent->d_name);
+        if (!names[nnames])
+            break;
+        nnames++;
+    }
+    closedir(dir);
+    if (ent) {
+        fprintf(stderr, "export: out of memory\n");
+        goto out;
+    }
+    if (nnames)
+        qsort(names, (size_t)nnames, sizeof(names[0]), name_cmp);
+
+    /* cut every file into blocks on line boundaries, up to the size it
+     * has now. The workers pread their blocks: a log truncated by CLEAR
+     * while we run only comes out shorter, where a mapping would fault. */
+    fds = malloc(((size_t)nnames + 1) * sizeof(*fds));
+    scan = malloc(ARCHIVE_BLOCK_SIZE);
+    if (!fds || !scan) {
+        fprintf(stderr, "export: out of memory\n");
+        goto out;
+    }
+    for (int s = 0; s < nnames; s++)
+        fds[s] = -1;
+    for (int s = 0; s < nnames; s++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", session_dir, names[s]);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            fprintf(stderr, "export: %s: %s\n", path, strerror(errno));
+            if (fd >= 0)
+                close(fd);
+            goto out;
+        }
+        fds[s] = fd;
+        size_t size = (size_t)st.st_size;
+
+        for (size_t off = 0; off < size;) {
+            size_t n = size - off;
+            if (n > ARCHIVE_BLOCK_SIZE) {
+                ssize_t got = read_block(fd, scan, ARCHIVE_BLOCK_SIZE, off);
+                if (got < 0) {
+                    fprintf(stderr, "export: %s: %s\n", path,
+                            strerror(errno));
+                    goto out;
+                }
+                if ((size_t)got < ARCHIVE_BLOCK_SIZE) {
+                    size = off + (size_t)got;       /* truncated */
+                    n = (size_t)got;
+                } else {
+                    const char *cut = memrchr(scan, '\n', (size_t)got);
+                    n = cut ? (size_t)(cut - scan) + 1 : (size_t)got;
+                }
+                if (n == 0)
+                    break;
+            }
+            if (njobs == cap) {
+                cap = cap ? cap * 2 : 64;
+                export_job_t *grown = realloc(jobs, cap * sizeof(*jobs));
+                if (!grown)
+                    goto out;
+                jobs = grown;
+            }
+            export_job_t *j = &jobs[njobs++];
+            memset(j, 0, sizeof(*j));
+            j->stream = (uint32_t)s;
+            j->fd = fd;
+            j->raw_off = off;
+            j->raw_len = n;
+            off += n;
+        }
+    }
+
+    /* compress on every core */
+    int nthreads = opts->jobs > 0 ? opts->jobs :
+                   (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1)
+        nthreads = 1;
+    if ((size_t)nthreads > njobs)
+        nthreads = njobs ? (int)njobs : 1;
+    stats->jobs = nthreads;
+
+    export_pool_t pool = {
+        .jobs = jobs, .njobs = njobs, .next = 0,
+        .since = opts->since, .until = opts->until,
+        .dedup = opts->store != NULL,
+    };
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_t threads[256];
+    int started = 0;
+    for (int t = 1; t < nthreads && t < 256; t++) {
+        if (pthread_create(&threads[started], NULL, export_worker,
+                           &pool) == 0)
+            started++;
+    }
+    export_worker(&pool);               /* this thread works too */
+    for (int t = 0; t < started; t++)
+        pthread_join(threads[t], NULL);
+    pthread_mutex_destroy(&pool.lock);
+
+    for (size_t i = 0; i < njobs; i++) {
+        if (jobs[i].failed) {
+            fprintf(stderr, "export: %s: %s\n", names[jobs[i].stream],
+                    strerror(jobs[i].failed));
+            goto out;
+        }
+    }
+    if (opts->store) {
+        store = malloc(sizeof(*store));
+        if (!store || dedup_open(store, opts->store, 1) < 0)
+            goto out;
+        for (size_t i = 0; i < njobs; i++)
+            if (jobs[i].kept && store_job(store, &jobs[i], stats) < 0)
+                goto out;
+    }
+
+    /* blocks in file order, then the index and the trailer */
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", out_path);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) {
+        fprintf(stderr, "export: %s: %s\n", tmp, strerror(errno));
+        goto out;
+    }
+    fwrite(store ? ARCHIVE_DEDUP_MAGIC : ARCHIVE_MAGIC, 1, 8, fp);
+    uint64_t pos = 8;
+    uint32_t nblocks = 0;
+    for (size_t i = 0; i < njobs; i++) {
+        export_job_t *j = &jobs[i];
+        if (j->kept == 0)
+            continue;
+        fwrite(j->out, 1, j->out_len, fp);
+        nblocks++;
+        pos += j->out_len;
+    }
+
+    uint64_t index_off = pos;
+    const char *session = strrchr(session_dir, '/');
+    session = session && session[1] ? session + 1 : session_dir;
+    put_le(fp, (uint32_t)nnames, 4);
+    put_le(fp, nblocks, 4);
+    put_name(fp, session);
+    uint32_t bi = 0;
+    for (int s = 0; s < nnames; s++) {
+        uint64_t size = 0;
+        uint32_t first = bi, n = 0;
+        for (size_t i = 0; i < njobs; i++) {
+            if (jobs[i].stream == (uint32_t)s && jobs[i].kept) {
+                size += jobs[i].kept;
+                n++;
+            }
+        }
+        bi += n;
+        put_name(fp, names[s]);
+        put_le(fp, size, 8);
+        put_le(fp, first, 4);
+        put_le(fp, n, 4);
+    }
+    uint64_t off = 8;
+    for (size_t i = 0; i < njobs; i++) {
+        const export_job_t *j = &jobs[i];
+        if (j->kept == 0)
+            continue;
+        put_le(fp, j->stream, 4);
+        put_le(fp, j->raw_off, 8);
+        put_le(fp, j->kept, 4);
+        put_le(fp, off, 8);
+        put_le(fp, j->out_len, 4);
+        put_le(fp, j->crc, 4);
+        put_le(fp, (uint64_t)j->t_first, 8);
+        put_le(fp, (uint64_t)j->t_last, 8);
+        off += j->out_len;
+    }
+    put_le(fp, index_off, 8);
+    fwrite(ARCHIVE_TRAILER, 1, 8, fp);
+
+    int failed = ferror(fp);
+    if (fclose(fp) != 0 || failed || rename(tmp, out_path) < 0) {
+        fprintf(stderr, "export: cannot write %s: %s\n", out_path,
+                strerror(errno));
+        unlink(tmp);
+        goto out;
+    }
+    stats->streams = (uint32_t)nnames;
+    stats->blocks = nblocks;
+    stats->stored_bytes = off + (store ? store->added_bytes : 0);
+    for (size_t i = 0; i < njobs; i++)
+        stats->raw_bytes += jobs[i].kept;
+    rc = 0;
+
+out:
+    if (store) {
+        /* chunks stored for a manifest that was not written are only
+         * unreferenced, never wrong */
+        dedup_close(store);
+        free(store);
+    }
+    for (size_t i = 0; i < njobs; i++) {
+        free(jobs[i].out);
+        free(jobs[i].text);
+        free(jobs[i].chunk_len);
+        free(jobs[i].chunk_sha);
+    }
+    free(jobs);
+    for (int s = 0; s < nnames; s++) {
+        if (fds && fds[s] >= 0)
+            close(fds[s]);
+        free(names[s]);
+    }
+    free(fds);
+    free(scan);
+    free(names);
+    return rc;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Reading                                                           */
+/* ------------------------------------------------------------------ */
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    int            bad;
+} cursor_t;
+
+static uint64_t
+get_le(cursor_t *c, int bytes)
+{
+    if (c->end - c->p < bytes) {
+        c->bad = 1;
+        return 0;
+    }
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++)
+        v |= (uint64_t)c->p[i] << (8 * i);
+    c->p += bytes;
+    return v;
+}
+
+static void
+get_name(cursor_t *c, char *dst, size_t sz)
+{
+    size_t n = (size_t)get_le(c, 2);
+    if (c->bad || n >= sz || (size_t)(c->end - c->p) < n) {
+        c->bad = 1;
+        dst[0] = '\0';
+        return;
+    }
+    memcpy(dst, c->p, n);
+    dst[n] = '\0';
+    c->p += n;
+}
+
+int
+archive_open(archive_t *a, const char *path)
+{
+    memset(a, 0, sizeof(*a));
+    a->fp = fopen(path, "r");
+    if (!a->fp) {
+        fprintf(stderr, "archive: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char magic[8];
+    uint8_t trailer[16];
+    if (fread(magic, 1, 8, a->fp) != 8 ||
+        (memcmp(magic, ARCHIVE_MAGIC, 8) != 0 &&
+         memcmp(magic, ARCHIVE_DEDUP_MAGIC, 8) != 0) ||
+        fseeko(a->fp, -16, SEEK_END) < 0 ||
+        fread(trailer, 1, 16, a->fp) != 16 ||
+        memcmp(trailer + 8, ARCHIVE_TRAILER, 8) != 0) {
+        fprintf(stderr, "archive: %s: not an export archive\n", path);
+        archive_close(a);
+        return -1;
+    }
+    cursor_t tc = { trailer, trailer + 8, 0 };
+    uint64_t index_off = get_le(&tc, 8);
+    off_t end = ftello(a->fp) - 16;
+    if (index_off < 8 || (off_t)index_off > end) {
+        fprintf(stderr, "archive: %s: bad index offset\n", path);
+        archive_close(a);
+        return -1;
+    }
+
+    size_t ilen = (size_t)(end - (off_t)index_off);
+    uint8_t *index = malloc(ilen ? ilen : 1);
+    if (!index || fseeko(a->fp, (off_t)index_off, SEEK_SET) < 0 ||
+        fread(index, 1, ilen, a->fp) != ilen) {
+        free(index);
+        fprintf(stderr, "archive: %s: cannot read index\n", path);
+        archive_close(a);
+        return -1;
+    }
+
+    cursor_t c = { index, index + ilen, 0 };
+    a->nstreams = (uint32_t)get_le(&c, 4);
+    a->nblocks = (uint32_t)get_le(&c, 4);
+    get_name(&c, a->session, sizeof(a->session));
+    /* each stream entry takes 18 bytes or more, each block 48 */
+    if (!c.bad && a->nstreams <= ilen / 18 &&
+        a->nblocks <= ilen / 48) {
+        a->streams = calloc(a->nstreams + 1, sizeof(*a->streams));
+        a->blocks = calloc(a->nblocks + 1, sizeof(*a->blocks));
+    }
+    if (!a->streams || !a->blocks) {
+        free(index);
+        fprintf(stderr, "archive: %s: bad index\n", path);
+        archive_close(a);
+        return -1;
+    }
+    for (uint32_t s = 0; s < a->nstreams; s++) {
+        archive_stream_t *st = &a->streams[s];
+        get_name(&c, st->name, sizeof(st->name));
+        st->size = get_le(&c, 8);
+        st->first_block = (uint32_t)get_le(&c, 4);
+        st->nblocks = (uint32_t)get_le(&c, 4);
+        if (st->first_block > a->nblocks ||
+            st->nblocks > a->nblocks - st->first_block)
+            c.bad = 1;
+    }
+    for (uint32_t i = 0; i < a->nblocks; i++) {
+        archive_block_t *b = &a->blocks[i];
+        b->stream = (uint32_t)get_le(&c, 4);
+        b->raw_off = get_le(&c, 8);
+        b->raw_len = (uint32_t)get_le(&c, 4);
+        b->off = get_le(&c, 8);
+        b->len = (uint32_t)get_le(&c, 4);
+        b->crc = (uint32_t)get_le(&c, 4);
+        b->t_first = (int64_t)get_le(&c, 8);
+        b->t_last = (int64_t)get_le(&c, 8);
+        if (b->stream >= a->nstreams || b->off + b->len > index_off)
+            c.bad = 1;
+    }
+    free(index);
+    if (c.bad) {
+        fprintf(stderr, "archive: %s: bad index\n", path);
+        archive_close(a);
+        return -1;
+    }
+
+    if (memcmp(magic, ARCHIVE_DEDUP_MAGIC, 8) == 0) {
+        /* a manifest: its chunks are in the store it sits in */
+        char dir[PATH_MAX];
+        strlcpy_safe(dir, path, sizeof(dir));
+        char *slash = strrchr(dir, '/');
+        if (slash)
+            *slash = '\0';
+        else
+            strlcpy_safe(dir, ".", sizeof(dir));
+        a->store = malloc(sizeof(*a->store));
+        if (!a->store || dedup_open(a->store, dir, 0) < 0) {
+            free(a->store);
+            a->store = NULL;
+            archive_close(a);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void
+archive_close(archive_t *a)
+{
+    if (a->fp)
+        fclose(a->fp);
+    if (a->store) {
+        dedup_close(a->store);
+        free(a->store);
+    }
+    free(a->streams);
+    free(a->blocks);
+    memset(a, 0, sizeof(*a));
+}
+
+/* Rebuild a segment of a manifest into raw (b->raw_len bytes) from the
+ * chunks and times in its payload. */
+static int
+rebuild_block(archive_t *a, const archive_block_t *b, const char *payload,
+              char *raw)
+{
+    cursor_t c = { (const uint8_t *)payload,
+                   (const uint8_t *)payload + b->len, 0 };
+    uint32_t nchunks = (uint32_t)get_le(&c, 4);
+    uint32_t text_len = (uint32_t)get_le(&c, 4);
+    uint32_t times_len = (uint32_t)get_le(&c, 4);
+    uint32_t packed = (uint32_t)get_le(&c, 4);
+    if (c.bad || text_len > b->raw_len || times_len > b->raw_len + 1 ||
+        (uint64_t)nchunks * 4 + packed != (uint64_t)(c.end - c.p))
+        return -1;
+    const uint8_t *ids = c.p;
+
+    char *text = malloc(text_len + DEDUP_MAX_CHUNK);
+    uint8_t *times = malloc(times_len ? times_len : 1);
+    int rc = -1;
+    if (!text || !times ||
+        lz_decompress(ids + 4 * (size_t)nchunks, packed, times,
+                      times_len) < 0)
+        goto out;
+    size_t n = 0;
+    for (uint32_t k = 0; k < nchunks; k++) {
+        cursor_t ic = { ids + 4 * k, ids + 4 * k + 4, 0 };
+        long got = n <= text_len ?
+                   dedup_get(a->store, (uint32_t)get_le(&ic, 4), text + n) :
+                   -1;
+        if (got < 0)
+            goto out;
+        n += (size_t)got;
+    }
+    if (n == text_len)
+        rc = join_stamps(text, text_len, times, times_len, raw, b->raw_len);
+out:
+    free(text);
+    free(times);
+    return rc;
+}
+
+char *
+archive_read_block(archive_t *a, uint32_t i)
+{
+    const archive_block_t *b = &a->blocks[i];
+    char *packed = malloc(b->len ? b->len : 1);
+    char *raw = malloc(b->raw_len ? b->raw_len : 1);
+    if (!packed || !raw ||
+        fseeko(a->fp, (off_t)b->off, SEEK_SET) < 0 ||
+        fread(packed, 1, b->len, a->fp) != b->len ||
+        (a->store ? rebuild_block(a, b, packed, raw)
+                  : lz_decompress(packed, b->len, raw, b->raw_len)) < 0 ||
+        crc32_update(0, raw, b->raw_len) != b->crc) {
+        fprintf(stderr, "archive: block %u is corrupt\n", i);
+        free(packed);
+        free(raw);
+        return NULL;
+    }
+    free(packed);
+    return raw;
+}
+
+/* ------------------------------------------------------------------ */
+/*  CLI                                                               */
+/* ------------------------------------------------------------------ */
+
+/* Parse the options shared by export and archive. Positional arguments
+ * are returned in pos[]; returns their count, or -1 on a bad option. */
+static int
+parse_opts(int argc, char *argv[], archive_opts_t *o, const char **out,
+           const char **pos, int max)
+{
+    int n = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "--ports") == 0 && i + 1 < argc) {
+            o->ports = argv[++i];
+        } else if ((strcmp(a, "--since") == 0 ||
+                    strcmp(a, "--until") == 0) && i + 1 < argc) {
+            int64_t *t = a[2] == 's' ? &o->since : &o->until;
+            if (timestamp_parse_arg(argv[++i], t) < 0) {
+                fprintf(stderr, "Bad time '%s' (YYYY-MM-DD HH:MM:SS, "
+                        "@epoch or -<n>[smhd])\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(a, "--jobs") == 0 && i + 1 < argc) {
+            o->jobs = atoi(argv[++i]);
+        } else if (strcmp(a, "--store") == 0 && i + 1 < argc && out) {
+            o->store = argv[++i];
+        } else if (strcmp(a, "-o") == 0 && i + 1 < argc && out) {
+            *out = argv[++i];
+        } else if (n < max) {
+            pos[n++] = a;
+        } else {
+            return -1;
+        }
+    }
+    return n;
+}
+
+int
+cmd_export(int argc, char *argv[])
+{
+    archive_opts_t o = {0};
+    const char *out = NULL, *pos[1];
+    if (parse_opts(argc, argv, &o, &out, pos, 1) != 1 || (out && o.store)) {
+        fprintf(stderr, "Usage: uart-monitor export <session|latest> "
+                "[-o file | --store dir] [--ports a,b] [--since t] "
+                "[--until t] [--jobs n]\n");
+        fprintf(stderr, "Example: uart-monitor export latest "
+                "--ports STM32N657_UART --since -10m\n");
+        return 1;
+    }
+
+    char dir[PATH_MAX];
+    if (strchr(pos[0], '/'))
+        strlcpy_safe(dir, pos[0], sizeof(dir));
+    else
+        snprintf(dir, sizeof(dir), "%s/%s", LOG_BASE_DIR, pos[0]);
+    char real[PATH_MAX];
+    if (!realpath(dir, real)) {
+        fprintf(stderr, "Session not found: %s\n", dir);
+        return 1;
+    }
+
+    /* a manifest lives in its store, where readers look for chunks */
+    char def[2 * PATH_MAX];
+    if (!out) {
+        const char *base = strrchr(real, '/');
+        base = base ? base + 1 : real;
+        if (o.store)
+            snprintf(def, sizeof(def), "%s/%s%s", o.store, base,
+                     ARCHIVE_DEDUP_EXT);
+        else
+            snprintf(def, sizeof(def), "%s.umz", base);
+        out = def;
+    }
+
+    archive_stats_t st;
+    uint64_t t0 = mono_ns();
+    if (archive_export(real, out, &o, &st) < 0)
+        return 1;
+    uint64_t ms = (mono_ns() - t0) / 1000000;
+
+    printf("Exported %u file(s), %u block(s): %llu -> %llu bytes "
+           "(%.1fx) in %llu ms on %d thread(s)\n%s\n", st.streams,
+           st.blocks, (unsigned long long)st.raw_bytes,
+           (unsigned long long)st.stored_bytes,
+           st.stored_bytes ? (double)st.raw_bytes / st.stored_bytes : 0.0,
+           (unsigned long long)ms, st.jobs, out);
+    if (o.store)
+        printf("Store %s: %llu chunk(s) referenced, %llu new\n", o.store,
+               (unsigned long long)st.chunks,
+               (unsigned long long)st.new_chunks);
+    return 0;
+}
+
+/* Print the lines of every selected block, or only those containing
+ * 'text', in the time window. Returns the number of lines printed. */
+static long
+archive_scan(archive_t *a, const archive_opts_t *o, const char *only,
+             const char *text)
+{
+    long printed = 0;
+    for (uint32_t s = 0; s < a->nstreams; s++) {
+        const archive_stream_t *st = &a->streams[s];
+        if (only) {
+            size_t stem = strcspn(st->name, ".");
+            if (strcmp(st->name, only) != 0 &&
+                (strlen(only) != stem || strncmp(st->name, only, stem)))
+                continue;
+        } else if (!stream_selected(st->name, o->ports)) {
+            continue;
+        }
+        for (uint32_t i = st->first_block;
+             i < st->first_block + st->nblocks; i++) {
+            if (!block_in_window(&a->blocks[i], o->since, o->until))
+                continue;
+            char *raw = archive_read_block(a, i);
+            if (!raw)
+                return -1;
+            size_t len = a->blocks[i].raw_len;
+            len = window_lines(raw, len, o->since, o->until, raw,
+                               NULL, NULL);
+            for (size_t off = 0; off < len;) {
+                const char *nl = memchr(raw + off, '\n', len - off);
+                size_t llen = nl ? (size_t)(nl - (raw + off)) + 1
+                                 : len - off;
+                if (!text || memmem(raw + off, llen, text, strlen(text))) {
+                    if (text)
+                        printf("%s: ", st->name);
+                    fwrite(raw + off, 1, llen, stdout);
+                    printed++;
+                }
+                off += llen;
+            }
+            free(raw);
+        }
+    }
+    return printed;
+}
+
+int
+cmd_archive(int argc, char *argv[])
+{
+    archive_opts_t o = {0};
+    const char *pos[3];
+    int n = parse_opts(argc, argv, &o, NULL, pos, 3);
+    const char *verb = n >= 2 ? pos[1] : "list";
+    if (n < 1 || (strcmp(verb, "list") == 0 && n > 2) ||
+        ((strcmp(verb, "cat") == 0 || strcmp(verb, "grep") == 0) &&
+         n != 3)) {
+        fprintf(stderr, "Usage: uart-monitor archive <file> "
+                "[list | cat <port> | grep <text>] [--ports a,b] "
+                "[--since t] [--until t]\n");
+        fprintf(stderr, "Example: uart-monitor archive fail.umz grep "
+                "\"Hard fault\" --since \"2026-02-25 14:30:00\"\n");
+        return 1;
+    }
+
+    archive_t a;
+    if (archive_open(&a, pos[0]) < 0)
+        return 1;
+
+    int rc = 0;
+    if (strcmp(verb, "list") == 0) {
+        printf("Session: %s\n", a.session);
+        if (a.store)
+            printf("Store:   %s (%u chunks)\n", a.store->dir,
+                   a.store->nrecs);
+        for (uint32_t s = 0; s < a.nstreams; s++) {
+            const archive_stream_t *st = &a.streams[s];
+            uint64_t stored = 0;
+            int64_t first = 0, last = 0;
+            for (uint32_t i = st->first_block;
+                 i < st->first_block + st->nblocks; i++) {
+                const archive_block_t *b = &a.blocks[i];
+                stored += b->len;
+                if (b->t_first && !first)
+                    first = b->t_first;
+                if (b->t_last)
+                    last = b->t_last;
+            }
+            char f[32], l[32];
+            timestamp_fmt_ms(first, f, sizeof(f));
+            timestamp_fmt_ms(last, l, sizeof(l));
+            printf("  %-32s %10llu -> %9llu bytes %4u block(s)  %s .. %s\n",
+                   st->name, (unsigned long long)st->size,
+                   (unsigned long long)stored, st->nblocks, f, l);
+        }
+    } else if (strcmp(verb, "cat") == 0) {
+        long lines = archive_scan(&a, &o, pos[2], NULL);
+        if (lines == 0 && !o.since && !o.until)
+            fprintf(stderr, "No '%s' in %s (see 'list')\n", pos[2], pos[0]);
+        rc = lines < 0;
+    } else if (strcmp(verb, "grep") == 0) {
+        long hits = archive_scan(&a, &o, NULL, pos[2]);
+        rc = hits < 0 ? 2 : hits == 0;
+    } else {
+        fprintf(stderr, "Unknown archive command: %s\n", verb);
+        rc = 1;
+    }
+    archive_close(&a);
+    return rc;
+}
@@ -0,0 +1,116 @@
+/* archive.h -- Compressed, indexed session archives (export) */
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dedup.h"
+
+/* Archive layout (integers little-endian):
+ *
+ *   "UMARCH1\n"
+ *   block 0 .. block n-1             lz-compressed (lz.h), independent
+ *   index                            streams and blocks, see archive.c
+ *   u64 index offset, "UMINDEX1"     fixed-size trailer
+ *
+ * Each session file is a stream, cut into blocks of about
+ * ARCHIVE_BLOCK_SIZE bytes on line boundaries. The index gives every
+ * block's place in its file and the first and last timestamps in it, so
+ * a reader seeks to the trailer, loads the index and decompresses only
+ * the blocks of the streams and time range it wants.
+ *
+ * "export --store <dir>" writes the same layout as <dir>/<session>.umd
+ * with magic "UMDEDUP\n", where a block (a segment of its file) holds
+ * no data of its own but what rebuilds it from the chunk store in the
+ * same directory (dedup.h):
+ *
+ *   u32 nchunks, u32 text bytes, u32 times bytes, u32 packed times
+ *   nchunks x u32 chunk id      the segment's lines without their
+ *                               "[timestamp] " prefixes, chunked
+ *   lz-compressed times         per line: varint 0 if it had no prefix,
+ *                               else 1 + zigzag ms delta to the last one
+ *
+ * Prefixes differ on every boot, so they are kept out of the chunks and
+ * identical boot logs dedupe to the same ids. */
+#define ARCHIVE_MAGIC       "UMARCH1\n"
+#define ARCHIVE_DEDUP_MAGIC "UMDEDUP\n"
+#define ARCHIVE_DEDUP_EXT   ".umd"
+#define ARCHIVE_TRAILER     "UMINDEX1"
+#define ARCHIVE_BLOCK_SIZE  (1024 * 1024)
+#define ARCHIVE_NAME_LEN    128
+
+typedef struct {
+    uint32_t stream;        /* index into streams[] */
+    uint64_t raw_off;       /* where the block starts in the session file */
+    uint32_t raw_len;       /* bytes after decompression */
+    uint64_t off;           /* compressed block in the archive */
+    uint32_t len;
+    uint32_t crc;           /* CRC-32 of the decompressed bytes */
+    int64_t  t_first;       /* first / last line timestamp (ms since */
+    int64_t  t_last;        /* the epoch), 0 if the block has none */
+} archive_block_t;
+
+typedef struct {
+    char     name[ARCHIVE_NAME_LEN];  /* file name in the session */
+    uint64_t size;                    /* bytes kept from the file */
+    uint32_t first_block;
+    uint32_t nblocks;
+} archive_stream_t;
+
+typedef struct {
+    FILE             *fp;
+    dedup_store_t    *store;  /* chunk store of a .umd, else NULL */
+    char              session[ARCHIVE_NAME_LEN];
+    archive_stream_t *streams;
+    uint32_t          nstreams;
+    archive_block_t  *blocks;
+    uint32_t          nblocks;
+} archive_t;
+
+typedef struct {
+    const char *ports;      /* comma-separated port labels, NULL: all */
+    int64_t     since;      /* keep lines in [since, until] (ms since */
+    int64_t     until;      /* the epoch), 0: open-ended */
+    int         jobs;       /* compression threads, 0: one per CPU */
+    const char *store;      /* chunk store directory, NULL: a .umz */
+} archive_opts_t;
+
+typedef struct {
+    uint64_t raw_bytes;
+    uint64_t stored_bytes;
+    uint32_t streams;
+    uint32_t blocks;
+    int      jobs;
+    uint64_t chunks;        /* --store: chunks referenced, and of */
+    uint64_t new_chunks;    /* those, the ones not stored before */
+} archive_stats_t;
+
+/* Write session_dir to out_path as one archive, compressing blocks on
+ * opts->jobs threads; with opts->store, add its chunks to the store and
+ * write out_path as its manifest there. Returns 0 on success. */
+int archive_export(const char *session_dir, const char *out_path,
+                   const archive_opts_t *opts, archive_stats_t *stats);
+
+/* Open an archive (or a store manifest) and load its index. Returns 0
+ * on success. */
+int archive_open(archive_t *a, const char *path);
+
+/* Release an archive opened with archive_open(). */
+void archive_close(archive_t *a);
+
+/* Decompress (or rebuild from the store) and verify block i into a
+ * malloc'd buffer of raw_len bytes. Returns NULL on error. */
+char *archive_read_block(archive_t *a, uint32_t i);
+
+/* Timestamp of a log line: the "[YYYY-MM-DD HH:MM:SS.mmm]" prefix of a
+ * timestamped line or the "[...]" of a "--- marker [...] ---" line, in
+ * ms since the epoch. Returns 0 if the line has none. */
+int64_t archive_line_time(const char *line, size_t len);
+
+/* CLI subcommands */
+int cmd_export(int argc, char *argv[]);
+int cmd_archive(int argc, char *argv[]);
+
+#endif /* ARCHIVE_H */
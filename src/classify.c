@@ -0,0 +1,247 @@
+/* classify.c -- Text, binary or mis-baud: what a port is sending.
+ *
+ * Every port used to be logged as text. A port carrying a binary
+ * protocol, or read at the wrong baud rate, then fills its log with
+ * garbage that breaks lines at random, confuses the line stages and the
+ * terminal of whoever looks at it. Watching the byte classes of the
+ * stream lets the daemon notice within a few KB and log such a port as
+ * a hex dump instead, with the raw bytes kept aside.
+ */
+#include "classify.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *const content_names[CONTENT_KINDS] = {
+    "unknown", "text", "binary", "misbaud",
+};
+
+static int
+bits_set(uint32_t v)
+{
+    int n = 0;
+    for (; v; v &= v - 1)
+        n++;
+    return n;
+}
+
+/* 0 for 0, else 1 + floor(log2(v)) */
+static int
+bit_length(uint32_t v)
+{
+    int n = 0;
+    for (; v; v >>= 1)
+        n++;
+    return n;
+}
+
+/* log2(v) in 1/65536ths, v > 0: the integer part from the bit length,
+ * each fraction bit from squaring the mantissa once */
+static uint32_t
+log2_q16(uint32_t v)
+{
+    uint32_t n = (uint32_t)bit_length(v) - 1;
+    uint64_t m = ((uint64_t)v << 16) >> n;     /* [1, 2) */
+    uint32_t r = n << 16;
+    for (uint32_t bit = 1u << 15; bit; bit >>= 1) {
+        m = (m * m) >> 16;
+        if (m >= 2u << 16) {
+            m >>= 1;
+            r |= bit;
+        }
+    }
+    return r;
+}
+
+static void
+window_reset(classify_t *c)
+{
+    c->n = 0;
+    c->printable = 0;
+    c->ctrl = 0;
+    c->high = 0;
+    c->bitrun = 0;
+    c->line_ends = 0;
+    c->longest = 0;
+    memset(c->len_hist, 0, sizeof(c->len_hist));
+    c->runs_seen = 0;
+    memset(c->seen, 0, sizeof(c->seen));
+}
+
+void
+classify_init(classify_t *c, content_t forced)
+{
+    memset(c, 0, sizeof(*c));
+    c->last_frames = -1;
+    if (forced == CONTENT_TEXT || forced == CONTENT_BINARY) {
+        c->kind = forced;
+        c->forced = 1;
+    }
+}
+
+size_t
+classify_feed(classify_t *c, const char *buf, size_t len)
+{
+    size_t take = CLASSIFY_WINDOW - c->n;
+    if (take > len)
+        take = len;
+    for (size_t i = 0; i < take; i++) {
+        unsigned c8 = (unsigned char)buf[i];
+        c->seen[c8 >> 3] |= (uint8_t)(1u << (c8 & 7));
+
+        /* ones then zeros, as sampled bits of a too-slow line are */
+        unsigned inv = ~c8 & 0xffu;
+        if ((inv & (inv + 1)) == 0) {
+            c->bitrun++;
+            c->runs_seen |= (uint16_t)(1u << bits_set(c8));
+        }
+
+        if (c->utf8_left) {
+            if ((c8 & 0xc0) == 0x80) {
+                c->utf8_left--;
+                c->printable++;
+                c->line_len++;
+                continue;
+            }
+            c->utf8_left = 0;       /* broken sequence */
+        }
+        if (c8 == '\n' || c8 == '\r') {
+            c->printable++;
+            c->line_ends++;
+            if (c->line_len > c->longest)
+                c->longest = c->line_len;
+            if (c->line_len > 0) {      /* not CR LF, not blank */
+                int b = bit_length(c->line_len);
+                c->len_hist[b < CLASSIFY_LEN_BUCKETS ?
+                            b : CLASSIFY_LEN_BUCKETS - 1]++;
+            }
+            c->line_len = 0;
+            continue;
+        }
+        c->line_len++;
+        if ((c8 >= 0x20 && c8 < 0x7f) || c8 == '\t' || c8 == 0x1b) {
+            c->printable++;
+        } else if (c8 < 0x80) {
+            c->ctrl++;
+        } else if (c8 >= 0xc2 && c8 <= 0xf4) {
+            c->utf8_left = c8 < 0xe0 ? 1 : c8 < 0xf0 ? 2 : 3;
+            c->printable++;
+        } else {
+            c->high++;
+        }
+    }
+    c->n += (uint32_t)take;
+    return take;
+}
+
+uint32_t
+classify_len_bits(const classify_t *c)
+{
+    /* H = log2(N) - sum(k * log2(k)) / N over the bucket counts k */
+    uint64_t lines = 0, sum = 0;
+    for (int i = 0; i < CLASSIFY_LEN_BUCKETS; i++) {
+        lines += c->len_hist[i];
+        if (c->len_hist[i] > 1)
+            sum += (uint64_t)c->len_hist[i] * log2_q16(c->len_hist[i]);
+    }
+    if (lines < 2)
+        return 0;
+    uint64_t h = (uint64_t)log2_q16((uint32_t)lines) - sum / lines;
+    return (uint32_t)((h * 1000 + 32768) >> 16);
+}
+
+content_t
+classify_window(const classify_t *c, long frames)
+{
+    uint64_t n = c->n;
+    uint32_t longest = c->line_len > c->longest ? c->line_len : c->longest;
+
+    if (n == 0)
+        return CONTENT_UNKNOWN;
+    /* a real UART says so itself; 1 in 64 bytes is well past noise */
+    if (frames > 0 && (uint64_t)frames * 64 >= n)
+        return CONTENT_MISBAUD;
+    /* mostly bit runs of several lengths: zero padding alone is not */
+    if ((uint64_t)c->bitrun * 2 >= n && bits_set(c->runs_seen) >= 3)
+        return CONTENT_MISBAUD;
+    if ((uint64_t)c->printable * 100 >= n * 95)
+        return CONTENT_TEXT;
+    /* text with a glitch or two: still broken into sensible lines, not
+     * at line-end bytes scattered through binary data, whose gaps are
+     * spread over every length */
+    uint32_t lines = 0;
+    for (int i = 0; i < CLASSIFY_LEN_BUCKETS; i++)
+        lines += c->len_hist[i];
+    if ((uint64_t)c->printable * 100 >= n * 85 && c->line_ends > 0 &&
+        longest <= CLASSIFY_LONG &&
+        (lines < CLASSIFY_LEN_LINES ||
+         classify_len_bits(c) <= CLASSIFY_LEN_BITS))
+        return CONTENT_TEXT;
+    return CONTENT_BINARY;
+}
+
+int
+classify_decide(classify_t *c, long frames)
+{
+    content_t k = classify_window(c, frames);
+    int spread = 0;
+    for (size_t i = 0; i < sizeof(c->seen); i++)
+        spread += bits_set(c->seen[i]);
+
+    c->last_printable = (uint32_t)((uint64_t)c->printable * 1000 / c->n);
+    c->last_high = (uint32_t)((uint64_t)c->high * 1000 / c->n);
+    c->last_ctrl = (uint32_t)((uint64_t)c->ctrl * 1000 / c->n);
+    c->last_bitrun = (uint32_t)((uint64_t)c->bitrun * 1000 / c->n);
+    c->last_line_ends = c->line_ends;
+    c->last_spread = (uint32_t)spread;
+    c->last_len_bits = classify_len_bits(c);
+    c->last_frames = frames;
+    c->windows++;
+    window_reset(c);
+
+    if (c->forced || k == c->kind) {
+        c->pending = CONTENT_UNKNOWN;
+        return 0;
+    }
+    if (c->kind != CONTENT_UNKNOWN && c->pending != k) {
+        c->pending = k;             /* once could be a burst */
+        return 0;
+    }
+    if (c->kind != CONTENT_UNKNOWN)
+        c->switches++;
+    c->kind = k;
+    c->pending = CONTENT_UNKNOWN;
+    return 1;
+}
+
+const char *
+classify_name(content_t k)
+{
+    return k < CONTENT_KINDS ? content_names[k] : "unknown";
+}
+
+size_t
+classify_hexline(const char *buf, size_t len, unsigned long long off,
+                 char out[CLASSIFY_HEX_LINE])
+{
+    static const char hex[] = "0123456789abcdef";
+    if (len > CLASSIFY_HEX_BYTES)
+        len = CLASSIFY_HEX_BYTES;
+    size_t n = (size_t)snprintf(out, CLASSIFY_HEX_LINE, "%08llx ", off);
+    for (size_t i = 0; i < CLASSIFY_HEX_BYTES; i++) {
+        unsigned char b = i < len ? (unsigned char)buf[i] : 0;
+        out[n++] = ' ';
+        out[n++] = i < len ? hex[b >> 4] : ' ';
+        out[n++] = i < len ? hex[b & 15] : ' ';
+    }
+    out[n++] = ' ';
+    out[n++] = ' ';
+    out[n++] = '|';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char b = (unsigned char)buf[i];
+        out[n++] = b >= 0x20 && b < 0x7f ? (char)b : '.';
+    }
+    out[n++] = '|';
+    out[n++] = '\n';
+    return n;
+}
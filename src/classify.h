@@ -0,0 +1,103 @@
+/* classify.h -- Text, binary or mis-baud: what a port is sending */
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CLASSIFY_WINDOW   2048      /* bytes per verdict */
+#define CLASSIFY_LONG     512       /* longer "lines" are not text */
+#define CLASSIFY_LEN_BUCKETS 11     /* line lengths 0, 1, 2-3 ... 512+ */
+#define CLASSIFY_LEN_LINES 8        /* lines before their spread counts */
+#define CLASSIFY_LEN_BITS 2400      /* more spread: random breaks, mbit */
+#define CLASSIFY_HEX_BYTES 16       /* bytes per hex dump line */
+#define CLASSIFY_HEX_LINE 96        /* room for one hex dump line */
+#define CLASSIFY_RAW_EXT  ".bin"    /* raw capture next to <label>.log */
+
+typedef enum {
+    CONTENT_UNKNOWN,        /* first window not complete yet */
+    CONTENT_TEXT,
+    CONTENT_BINARY,         /* a binary protocol: hex in the log */
+    CONTENT_MISBAUD,        /* bit-run garbage or framing errors */
+    CONTENT_KINDS
+} content_t;
+
+/* Streaming byte-class counts over fixed windows of CLASSIFY_WINDOW
+ * bytes. Text is mostly printable ASCII or UTF-8 broken into lines of
+ * similar length; a port read at the wrong baud rate turns every
+ * character into a few runs of sampled bits (0x00, 0x80, 0xc0 ... 0xfe)
+ * and, on real UARTs, framing errors; anything else is binary. Line
+ * lengths are kept as a histogram of powers of two, whose entropy tells
+ * lines apart from bytes that happen to be 0x0a or 0x0d. The first full
+ * window sets the verdict, a later change needs two windows in a row
+ * that agree. Costs a few compares and counter updates per byte (a bit
+ * count for bit-run bytes, a bucket for line ends) and the entropy of
+ * CLASSIFY_LEN_BUCKETS counts per window. */
+typedef struct {
+    content_t kind;         /* current verdict */
+    content_t pending;      /* a different verdict seen once */
+    int       forced;       /* set by the config: never reclassified */
+
+    /* current window */
+    uint32_t  n;
+    uint32_t  printable;    /* ASCII text, \t \r \n ESC, UTF-8 */
+    uint32_t  ctrl;         /* other C0 controls and DEL */
+    uint32_t  high;         /* bytes >= 0x80 that are not UTF-8 */
+    uint32_t  bitrun;       /* 0x00, 0x80, 0xc0 ... 0xfe, 0xff */
+    uint32_t  line_ends;
+    uint32_t  line_len;     /* bytes since the last line end */
+    uint32_t  longest;
+    uint16_t  len_hist[CLASSIFY_LEN_BUCKETS]; /* non-empty lines */
+    uint16_t  runs_seen;    /* bit-run values present, one bit each */
+    uint8_t   utf8_left;    /* continuation bytes still expected */
+    uint8_t   seen[32];     /* byte values present, for the spread */
+
+    /* last complete window, for status and METRICS */
+    uint32_t  last_printable;   /* per mille */
+    uint32_t  last_high;
+    uint32_t  last_ctrl;
+    uint32_t  last_bitrun;
+    uint32_t  last_line_ends;
+    uint32_t  last_spread;      /* distinct byte values */
+    uint32_t  last_len_bits;    /* line length entropy, millibits */
+    long      last_frames;      /* framing errors, -1 if unknown */
+    uint64_t  windows;
+    uint64_t  switches;
+} classify_t;
+
+/* Start over; kind is CONTENT_UNKNOWN unless forced (TEXT or BINARY)
+ * pins it. */
+void classify_init(classify_t *c, content_t forced);
+
+/* Count up to len bytes, stopping at the end of the window. Returns the
+ * bytes taken; call classify_decide() when classify_full() says so. */
+size_t classify_feed(classify_t *c, const char *buf, size_t len);
+
+static inline int
+classify_full(const classify_t *c)
+{
+    return c->n >= CLASSIFY_WINDOW;
+}
+
+/* Judge the full window, with the framing errors the port counted
+ * during it (-1 if the driver cannot tell), and start the next one.
+ * Returns 1 if the verdict changed. */
+int classify_decide(classify_t *c, long frames);
+
+/* The verdict a window with these counts gets, without hysteresis. */
+content_t classify_window(const classify_t *c, long frames);
+
+/* Entropy of the window's line length histogram in millibits: 0 when
+ * every line falls in one bucket, log2(CLASSIFY_LEN_BUCKETS) at most. */
+uint32_t classify_len_bits(const classify_t *c);
+
+/* "unknown", "text", "binary", "misbaud" */
+const char *classify_name(content_t k);
+
+/* Format up to CLASSIFY_HEX_BYTES bytes as one log line:
+ * "<offset>  xx xx ...  |ascii|\n", offset being where they start in
+ * the raw capture. Returns its length. */
+size_t classify_hexline(const char *buf, size_t len, unsigned long long off,
+                        char out[CLASSIFY_HEX_LINE]);
+
+#endif /* CLASSIFY_H */
@@ -0,0 +1,329 @@
+/* config.c -- Daemon configuration file.
+ *
+ * Line-oriented, whitespace-separated directives; '#' starts a comment:
+ *
+ *   # two adapters tapping one inter-chip link
+ *   link CPU_PMC VMK180_UART0 VMK180_UART1
+ *   reorder-window 20
+ *   integrity STM32H563_UART
+ *   digest STM32H563_UART
+ *   content MODBUS_GW binary
+ *   source unix:/tmp/qemu-serial0.sock QEMU_VIRT
+ *   durability group
+ *   sync-interval 1000
+ *   sync-pattern Kernel panic
+ *   filter STM32H563_UART drop ^tlm
+ *
+ *   # system mode (--system) access lists
+ *   allow STM32H563_UART alice,@fw-team
+ *   admin @lab-admins
+ */
+#include "config.h"
+#include "util.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONFIG_MAX_ARGS 8
+
+static const char *const default_sync_patterns[] = {
+    "panic", "Oops:", "HardFault", "Guru Meditation",
+};
+
+static const char *const durability_names[] = { "none", "marker", "group" };
+static const char *const priority_names[] = { "critical", "normal", "bulk" };
+static const char *const content_names[] = { "auto", "text", "binary" };
+
+void
+config_defaults(config_t *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->reorder_ms = 20;
+    cfg->durability = DURABILITY_MARKER;
+    cfg->sync_ms = 1000;
+    for (size_t i = 0; i < sizeof(default_sync_patterns) /
+                           sizeof(default_sync_patterns[0]); i++)
+        strlcpy_safe(cfg->sync_patterns[cfg->sync_pattern_count++],
+                     default_sync_patterns[i], CONFIG_PATTERN_LEN);
+}
+
+int
+config_parse_durability(const char *name, durability_t *out)
+{
+    for (int i = 0; i <= DURABILITY_GROUP; i++) {
+        if (strcmp(name, durability_names[i]) == 0) {
+            *out = (durability_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *
+config_durability_name(durability_t d)
+{
+    return durability_names[d];
+}
+
+int
+config_parse_priority(const char *name, prio_class_t *out)
+{
+    for (int i = 0; i < PRIO_CLASSES; i++) {
+        if (strcmp(name, priority_names[i]) == 0) {
+            *out = (prio_class_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *
+config_priority_name(prio_class_t p)
+{
+    return priority_names[p];
+}
+
+int
+config_parse_content(const char *name, content_mode_t *out)
+{
+    for (int i = 0; i <= CONTENT_MODE_BINARY; i++) {
+        if (strcmp(name, content_names[i]) == 0) {
+            *out = (content_mode_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Split a line into whitespace-separated words in place.
+ * Returns the number of words. */
+static int
+split_words(char *line, char *argv[], int max)
+{
+    int argc = 0;
+    char *saveptr;
+    char *tok = strtok_r(line, " \t\r\n", &saveptr);
+    while (tok && argc < max) {
+        if (tok[0] == '#')
+            break;
+        argv[argc++] = tok;
+        tok = strtok_r(NULL, " \t\r\n", &saveptr);
+    }
+    return argc;
+}
+
+/* Rejoin words into one space-separated pattern. */
+static void
+join_words(char *dst, size_t sz, int argc, char *argv[])
+{
+    dst[0] = '\0';
+    for (int i = 0; i < argc; i++) {
+        size_t len = strlen(dst);
+        snprintf(dst + len, sz - len, "%s%s", i ? " " : "", argv[i]);
+    }
+}
+
+static int
+parse_directive(config_t *cfg, int argc, char *argv[], int *own_patterns)
+{
+    if (strcmp(argv[0], "link") == 0) {
+        if (argc != 4)
+            return -1;
+        if (cfg->link_count >= CONFIG_MAX_LINKS)
+            return -1;
+        link_cfg_t *lc = &cfg->links[cfg->link_count++];
+        strlcpy_safe(lc->name, argv[1], sizeof(lc->name));
+        strlcpy_safe(lc->port_a, argv[2], sizeof(lc->port_a));
+        strlcpy_safe(lc->port_b, argv[3], sizeof(lc->port_b));
+        return 0;
+    }
+
+    if (strcmp(argv[0], "reorder-window") == 0) {
+        if (argc != 2)
+            return -1;
+        int ms = atoi(argv[1]);
+        if (ms < 0 || ms > 10000)
+            return -1;
+        cfg->reorder_ms = ms;
+        return 0;
+    }
+
+    if (strcmp(argv[0], "integrity") == 0) {
+        if (argc != 2 || cfg->integrity_count >= CONFIG_MAX_PORT_OPTS)
+            return -1;
+        strlcpy_safe(cfg->integrity[cfg->integrity_count++], argv[1],
+                     CONFIG_NAME_LEN);
+        return 0;
+    }
+
+    if (strcmp(argv[0], "digest") == 0) {
+        if (argc != 2 || cfg->digest_count >= CONFIG_MAX_PORT_OPTS)
+            return -1;
+        strlcpy_safe(cfg->digest[cfg->digest_count++], argv[1],
+                     CONFIG_NAME_LEN);
+        return 0;
+    }
+
+    if (strcmp(argv[0], "priority") == 0) {
+        if (argc != 3 || cfg->priority_count >= CONFIG_MAX_PORT_OPTS)
+            return -1;
+        prio_cfg_t *pc = &cfg->priorities[cfg->priority_count];
+        if (config_parse_priority(argv[2], &pc->prio) < 0)
+            return -1;
+        strlcpy_safe(pc->port, argv[1], sizeof(pc->port));
+        cfg->priority_count++;
+        return 0;
+    }
+
+    if (strcmp(argv[0], "content") == 0) {
+        if (argc != 3 || cfg->content_count >= CONFIG_MAX_PORT_OPTS)
+            return -1;
+        content_cfg_t *cc = &cfg->contents[cfg->content_count];
+        if (config_parse_content(argv[2], &cc->mode) < 0)
+            return -1;
+        strlcpy_safe(cc->port, argv[1], sizeof(cc->port));
+        cfg->content_count++;
+        return 0;
+    }
+
+    if (strcmp(argv[0], "source") == 0) {
+        if (argc < 2 || argc > 3 || cfg->source_count >= CONFIG_MAX_PORT_OPTS)
+            return -1;
+        source_cfg_t *sc = &cfg->sources[cfg->source_count];
+        strlcpy_safe(sc->spec, argv[1], sizeof(sc->spec));
+        strlcpy_safe(sc->label, argc == 3 ? argv[2] : "", sizeof(sc->label));
+        cfg->source_count++;
+        return 0;
+    }
+
+    if (strcmp(argv[0], "durability") == 0) {
+        if (argc != 2)
+            return -1;
+        return config_parse_durability(argv[1], &cfg->durability);
+    }
+
+    if (strcmp(argv[0], "sync-interval") == 0) {
+        if (argc != 2)
+            return -1;
+        int ms = atoi(argv[1]);
+        if (ms < 10 || ms > 600000)
+            return -1;
+        cfg->sync_ms = ms;
+        return 0;
+    }
+
+    if (strcmp(argv[0], "filter") == 0) {
+        if (argc < 4 || cfg->filter_count >= CONFIG_MAX_FILTERS)
+            return -1;
+        int drop;
+        if (strcmp(argv[2], "keep") == 0)
+            drop = 0;
+        else if (strcmp(argv[2], "drop") == 0)
+            drop = 1;
+        else
+            return -1;
+        filter_cfg_t *fc = &cfg->filters[cfg->filter_count++];
+        strlcpy_safe(fc->port, argv[1], sizeof(fc->port));
+        fc->drop = drop;
+        join_words(fc->pattern, sizeof(fc->pattern), argc - 3, argv + 3);
+        return 0;
+    }
+
+    if (strcmp(argv[0], "allow") == 0) {
+        if (argc < 3)
+            return -1;
+        for (int i = 2; i < argc; i++) {
+            if (cfg->acl_count >= CONFIG_MAX_ACLS)
+                return -1;
+            acl_cfg_t *ac = &cfg->acls[cfg->acl_count++];
+            strlcpy_safe(ac->port, argv[1], sizeof(ac->port));
+            strlcpy_safe(ac->who, argv[i], sizeof(ac->who));
+        }
+        return 0;
+    }
+
+    if (strcmp(argv[0], "admin") == 0) {
+        if (argc < 2)
+            return -1;
+        for (int i = 1; i < argc; i++) {
+            if (cfg->admin_count >= CONFIG_MAX_PORT_OPTS)
+                return -1;
+            strlcpy_safe(cfg->admins[cfg->admin_count++], argv[i],
+                         CONFIG_NAME_LEN);
+        }
+        return 0;
+    }
+
+    if (strcmp(argv[0], "sync-pattern") == 0) {
+        if (argc < 2)
+            return -1;
+        /* the first sync-pattern replaces the built-in list */
+        if (!*own_patterns) {
+            cfg->sync_pattern_count = 0;
+            *own_patterns = 1;
+        }
+        if (cfg->sync_pattern_count >= CONFIG_MAX_PATTERNS)
+            return -1;
+        join_words(cfg->sync_patterns[cfg->sync_pattern_count++],
+                   CONFIG_PATTERN_LEN, argc - 1, argv + 1);
+        return 0;
+    }
+
+    return -1;
+}
+
+int
+config_load(config_t *cfg, const char *path)
+{
+    char defpath[512];
+    if (!path) {
+        const char *home = getenv("HOME");
+        if (!home)
+            return 0;
+        snprintf(defpath, sizeof(defpath), "%s/%s",
+                 home, CONFIG_DEFAULT_NAME);
+    }
+
+    const char *fname = path ? path : defpath;
+    FILE *fp = fopen(fname, "r");
+    if (!fp) {
+        if (!path)
+            return 0;
+        fprintf(stderr, "config: cannot open %s: %s\n",
+                fname, strerror(errno));
+        return -1;
+    }
+
+    char line[512];
+    int lineno = 0;
+    int own_patterns = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char *argv[CONFIG_MAX_ARGS];
+        int argc = split_words(line, argv, CONFIG_MAX_ARGS);
+        if (argc == 0)
+            continue;
+        if (parse_directive(cfg, argc, argv, &own_patterns) < 0)
+            fprintf(stderr, "config: %s:%d: invalid '%s' directive "
+                    "(ignored)\n", fname, lineno, argv[0]);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+int
+config_name_matches(const char *name, const char *dev_path,
+                    const char *tty_name, const char *label)
+{
+    if (strcmp(name, dev_path) == 0)
+        return 1;
+
+    const char *stripped = name;
+    if (strncmp(name, "/dev/", 5) == 0)
+        stripped = name + 5;
+
+    return strcmp(stripped, label) == 0 || strcmp(stripped, tty_name) == 0;
+}
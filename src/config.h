@@ -0,0 +1,139 @@
+/* config.h -- Daemon configuration file (~/.config/uart-monitor.conf) */
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define CONFIG_DEFAULT_NAME  ".config/uart-monitor.conf"
+#define CONFIG_MAX_LINKS     8
+#define CONFIG_NAME_LEN      64
+#define CONFIG_MAX_PORT_OPTS 32
+#define CONFIG_MAX_PATTERNS  16
+#define CONFIG_PATTERN_LEN   128
+#define CONFIG_MAX_FILTERS   64
+#define CONFIG_MAX_ACLS      64
+#define CONFIG_SYSTEM_PATH   "/etc/uart-monitor.conf"
+
+/* How hard the daemon works to get log data onto stable storage */
+typedef enum {
+    DURABILITY_NONE,      /* page cache only (trickle writeback) */
+    DURABILITY_MARKER,    /* fdatasync on markers and sync-pattern lines */
+    DURABILITY_GROUP,     /* MARKER + periodic fdatasync of all ports */
+} durability_t;
+
+/* Port priority classes for the read scheduler, highest first */
+typedef enum {
+    PRIO_CRITICAL,        /* consoles that must never wait on bulk data */
+    PRIO_NORMAL,          /* default */
+    PRIO_BULK,            /* debug firehoses: absorb the backlog */
+    PRIO_CLASSES
+} prio_class_t;
+
+typedef struct {
+    char         port[CONFIG_NAME_LEN];
+    prio_class_t prio;
+} prio_cfg_t;
+
+/* What a port's log holds: detected from the data, or pinned */
+typedef enum {
+    CONTENT_MODE_AUTO,    /* default: text, binary or mis-baud by bytes */
+    CONTENT_MODE_TEXT,    /* always a text log */
+    CONTENT_MODE_BINARY,  /* always hex in the log, raw bytes aside */
+} content_mode_t;
+
+typedef struct {
+    char           port[CONFIG_NAME_LEN];
+    content_mode_t mode;
+} content_cfg_t;
+
+/* A socket or FIFO monitored from startup (see source.h) */
+typedef struct {
+    char spec[CONFIG_PATTERN_LEN];    /* unix:<path>, tcp:<host>:<port>... */
+    char label[CONFIG_NAME_LEN];      /* "" for a name made from spec */
+} source_cfg_t;
+
+/* A "link" pairs two monitored ports as the two directions of one
+ * logical UART link (e.g. two adapters tapping RX and TX of the same
+ * inter-chip connection).  Ports are named by device path, tty name
+ * or label, same as the control commands. */
+typedef struct {
+    char name[CONFIG_NAME_LEN];
+    char port_a[CONFIG_NAME_LEN];     /* carries A -> B traffic */
+    char port_b[CONFIG_NAME_LEN];     /* carries B -> A traffic */
+} link_cfg_t;
+
+/* One keep/drop line filter rule for a port (see filter.h) */
+typedef struct {
+    char port[CONFIG_NAME_LEN];
+    int  drop;                        /* 0: keep, 1: drop */
+    char pattern[CONFIG_PATTERN_LEN];
+} filter_cfg_t;
+
+/* System mode: who may see and control a port (see acl.h). Principals
+ * are user names, uids, "@group" or "*"; port "*" means every port. */
+typedef struct {
+    char port[CONFIG_NAME_LEN];
+    char who[CONFIG_PATTERN_LEN];     /* comma-separated principals */
+} acl_cfg_t;
+
+typedef struct {
+    link_cfg_t links[CONFIG_MAX_LINKS];
+    int        link_count;
+    int        reorder_ms;            /* link timeline reorder window */
+    /* ports whose probe frames are verified (see integrity.h) */
+    char       integrity[CONFIG_MAX_PORT_OPTS][CONFIG_NAME_LEN];
+    int        integrity_count;
+    /* ports that also get a <label>.digest (see digest.h) */
+    char       digest[CONFIG_MAX_PORT_OPTS][CONFIG_NAME_LEN];
+    int        digest_count;
+    durability_t durability;
+    int        sync_ms;               /* group commit interval */
+    /* lines that force a sync (crash output); defaults if none given */
+    char       sync_patterns[CONFIG_MAX_PATTERNS][CONFIG_PATTERN_LEN];
+    int        sync_pattern_count;
+    filter_cfg_t filters[CONFIG_MAX_FILTERS]; /* in file order */
+    int        filter_count;
+    acl_cfg_t  acls[CONFIG_MAX_ACLS]; /* system mode "allow" lines */
+    int        acl_count;
+    /* system mode: principals with every port and the daemon commands */
+    char       admins[CONFIG_MAX_PORT_OPTS][CONFIG_NAME_LEN];
+    int        admin_count;
+    prio_cfg_t priorities[CONFIG_MAX_PORT_OPTS]; /* "priority" lines */
+    int        priority_count;
+    content_cfg_t contents[CONFIG_MAX_PORT_OPTS]; /* "content" lines */
+    int        content_count;
+    source_cfg_t sources[CONFIG_MAX_PORT_OPTS]; /* "source" lines */
+    int        source_count;
+} config_t;
+
+/* Fill cfg with defaults. */
+void config_defaults(config_t *cfg);
+
+/* Load a config file. If path is NULL, ~/.config/uart-monitor.conf is
+ * tried and a missing file is not an error. Malformed lines are reported
+ * on stderr and skipped. Returns 0 on success, -1 if an explicitly
+ * named file cannot be read. */
+int config_load(config_t *cfg, const char *path);
+
+/* Parse a durability mode name ("none", "marker", "group").
+ * Returns 0 on success, -1 if unknown. */
+int config_parse_durability(const char *name, durability_t *out);
+
+/* Name of a durability mode. */
+const char *config_durability_name(durability_t d);
+
+/* Parse a priority class name ("critical", "normal", "bulk").
+ * Returns 0 on success, -1 if unknown. */
+int config_parse_priority(const char *name, prio_class_t *out);
+
+/* Name of a priority class. */
+const char *config_priority_name(prio_class_t p);
+
+/* Parse a content mode name ("auto", "text", "binary").
+ * Returns 0 on success, -1 if unknown. */
+int config_parse_content(const char *name, content_mode_t *out);
+
+/* Check whether a config port name refers to the given port identity
+ * (device path, tty name with or without /dev/, or label). */
+int config_name_matches(const char *name, const char *dev_path,
+                        const char *tty_name, const char *label);
+
+#endif /* CONFIG_H */
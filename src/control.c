@@ -2,22 +2,47 @@
  *
  * Protocol: newline-delimited text commands.
  *   YIELD /dev/ttyUSB0\n  -> OK yielded /dev/ttyUSB0\n
- *   RECLAIM /dev/ttyUSB0\n -> OK reclaimed /dev/ttyUSB0\n
- *   CLEAR <dev|label>\n   -> OK cleared /dev/ttyUSB0\n
- *   CLEAR --all\n         -> OK cleared N port(s)\n
+ *   RECLAIM /dev/ttyUSB0\n -> OK reclaimed /dev/ttyUSB0 reopen_ms=<ms>\n
+ *   YIELD board:<serial>\n -> OK yielded board:<serial> N port(s)\n
+ *                         <dev> <label> [already]\n...
+ *   RECLAIM group:<port>\n -> OK reclaimed group:<port> N port(s)\n
+ *                         <dev> <label> reopen_ms=<ms>|already|error=..\n
+ *   CLEAR <dev|label>\n   -> OK checkpoint <name> <label> <offset> [<time>]\n
+ *   CLEAR --all\n         -> OK checkpoint <name> N port(s) [<time>]\n
+ *                         (also for CLEAR board:<serial> / group:<port>)
+ *   CLEAR <port> --truncate\n -> OK cleared /dev/ttyUSB0 checkpoint <name>\n
+ *   ADD <dev> [label]\n    -> OK added <dev> <logfile>\n
+ *   REMOVE <dev|label>\n   -> OK removed <dev>\n
+ *   ROTATE\n               -> OK rotated <session path>\n
  *   STATUS\n               -> JSON blob\n
+ *   INTEGRITY\n            -> OK integrity\n<label>: <counters>\n...
+ *   METRICS\n              -> OK metrics\n<scope> key=value...\n...
+ *   MARK <text> [--ports a,b]\n -> OK mark <n> <count> port(s) [<time>]\n
+ *   PING <port> [opts]\n  -> OK ping ...\nrtt_ms ...\n (when the run ends)
+ *   BW <port> [opts]\n    -> OK bw ...\nbaud=... key=value...\n
+ *   OPEN <port> [--from cp]\n -> OK open <label> <offset>\n + log fd
+ *   OPEN <port> --digest\n -> OK open <label> 0\n + digest fd
+ *   TAIL <port> [N] [--since ms] [--after off]\n -> OK tail <label> <n>
+ *                         <first> <next>\n<lines>
+ *   TOPLINES <port> [N]\n -> OK toplines <label> <lines> <bytes> <n>\n
+ *                         <lines> <bytes> <share>% <template>\n...
  *   QUIT\n                 -> OK shutting down\n
  */
 #include "control.h"
+#include "digest.h"
 #include "log.h"
+#include "statpage.h"
 #include "util.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
 #include <unistd.h>
 
@@ -92,98 +117,375 @@ control_send_cmd(const char *sock_path, const char *cmd)
         return -1;
     }
 
-    /* read response */
+    /* read the response until the daemon closes: some (TAIL) are
+     * longer than one read */
     char buf[CONTROL_MAX_MSG];
-    ssize_t n = read(fd, buf, sizeof(buf) - 1);
-    if (n > 0) {
-        buf[n] = '\0';
-        printf("%s", buf);
-        if (buf[n - 1] != '\n')
-            printf("\n");
+    char head[2] = { 0, 0 };
+    size_t total = 0;
+    char last = '\n';
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        for (size_t i = 0; total + i < 2 && i < (size_t)n; i++)
+            head[total + i] = buf[i];
+        fwrite(buf, 1, (size_t)n, stdout);
+        total += (size_t)n;
+        last = buf[n - 1];
     }
+    if (last != '\n')
+        printf("\n");
 
     close(fd);
-    return (n > 0 && strncmp(buf, "OK", 2) == 0) ? 0 : 1;
+    return (total >= 2 && memcmp(head, "OK", 2) == 0) ? 0 : 1;
+}
+
+int
+control_send_fd(int client_fd, const char *msg, int fd)
+{
+    struct iovec iov = { .iov_base = (void *)msg, .iov_len = strlen(msg) };
+    union {
+        char           buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctl;
+    struct msghdr mh = { .msg_iov = &iov, .msg_iovlen = 1 };
+    if (fd >= 0) {
+        memset(&ctl, 0, sizeof(ctl));
+        mh.msg_control = ctl.buf;
+        mh.msg_controllen = sizeof(ctl.buf);
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+    }
+    return sendmsg(client_fd, &mh, MSG_NOSIGNAL) < 0 ? -1 : 0;
+}
+
+int
+control_open_log(const char *sock_path, const char *name, const char *from,
+                 int digest, long long *off)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy_safe(addr.sun_path, sock_path, sizeof(addr.sun_path));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "OPEN %s%s%s%s\n", name,
+             from ? " --from " : "", from ? from : "",
+             digest ? " --digest" : "");
+    if (write(fd, cmd, strlen(cmd)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    char resp[512];
+    struct iovec iov = { .iov_base = resp, .iov_len = sizeof(resp) - 1 };
+    union {
+        char           buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctl;
+    struct msghdr mh = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = ctl.buf, .msg_controllen = sizeof(ctl.buf),
+    };
+    ssize_t n = recvmsg(fd, &mh, MSG_CMSG_CLOEXEC);
+    close(fd);
+    if (n <= 0)
+        return -1;
+    resp[n] = '\0';
+
+    int log_fd = -1;
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    if (cm && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+        memcpy(&log_fd, CMSG_DATA(cm), sizeof(int));
+
+    /* "OK open <label> <offset>" */
+    if (strncmp(resp, "OK open ", 8) != 0 || log_fd < 0) {
+        if (log_fd >= 0)
+            close(log_fd);
+        fprintf(stderr, "%s", resp);
+        return -1;
+    }
+    const char *sp = strrchr(resp, ' ');
+    *off = sp ? strtoll(sp + 1, NULL, 10) : 0;
+    return log_fd;
 }
 
 int
 cmd_status(int argc, char *argv[])
 {
-    (void)argc; (void)argv;
+    int full = argc > 1 && strcmp(argv[1], "--full") == 0;
+
+    /* the shared-memory page answers without involving the daemon;
+     * integrity and link details need the full status from the socket */
+    if (!full) {
+        statpage_t *snap = malloc(sizeof(*snap));
+        if (snap && statpage_read(STATPAGE_PATH, snap) == 0) {
+            statpage_print_json(snap, stdout);
+            free(snap);
+            return 0;
+        }
+        free(snap);
+    }
     return control_send_cmd(CONTROL_SOCK_PATH, "STATUS\n");
 }
 
 int
-cmd_yield(int argc, char *argv[])
+cmd_add(int argc, char *argv[])
 {
     if (argc < 2) {
-        fprintf(stderr, "Usage: uart-monitor yield <device>\n");
-        fprintf(stderr, "Example: uart-monitor yield /dev/ttyUSB0\n");
+        fprintf(stderr, "Usage: uart-monitor add <device> [label]\n");
+        fprintf(stderr, "Example: uart-monitor add /dev/ttyS1 SOM_CONSOLE\n");
         return 1;
     }
     char cmd[512];
-    snprintf(cmd, sizeof(cmd), "YIELD %s\n", argv[1]);
+    snprintf(cmd, sizeof(cmd), "ADD %s%s%s\n", argv[1],
+             argc > 2 ? " " : "", argc > 2 ? argv[2] : "");
     return control_send_cmd(CONTROL_SOCK_PATH, cmd);
 }
 
 int
-cmd_reclaim(int argc, char *argv[])
+cmd_remove(int argc, char *argv[])
 {
     if (argc < 2) {
-        fprintf(stderr, "Usage: uart-monitor reclaim <device>\n");
-        fprintf(stderr, "Example: uart-monitor reclaim /dev/ttyUSB0\n");
+        fprintf(stderr, "Usage: uart-monitor remove <device|label>\n");
         return 1;
     }
     char cmd[512];
-    snprintf(cmd, sizeof(cmd), "RECLAIM %s\n", argv[1]);
+    snprintf(cmd, sizeof(cmd), "REMOVE %s\n", argv[1]);
     return control_send_cmd(CONTROL_SOCK_PATH, cmd);
 }
 
 int
-cmd_clear(int argc, char *argv[])
+cmd_rotate(int argc, char *argv[])
+{
+    (void)argc; (void)argv;
+    return control_send_cmd(CONTROL_SOCK_PATH, "ROTATE\n");
+}
+
+int
+cmd_integrity(int argc, char *argv[])
 {
-    if (argc >= 2 && strcmp(argv[1], "--all") == 0) {
-        return control_send_cmd(CONTROL_SOCK_PATH, "CLEAR --all\n");
+    (void)argc; (void)argv;
+    return control_send_cmd(CONTROL_SOCK_PATH, "INTEGRITY\n");
+}
+
+/* Forward "<VERB> <args...>" to the daemon. */
+static int
+send_joined(const char *verb, int argc, char *argv[])
+{
+    char cmd[512];
+    int off = snprintf(cmd, sizeof(cmd), "%s", verb);
+    for (int i = 1; i < argc && off < (int)sizeof(cmd) - 2; i++)
+        off += snprintf(cmd + off, sizeof(cmd) - (size_t)off - 1, " %s",
+                        argv[i]);
+    strcat(cmd, "\n");
+    return control_send_cmd(CONTROL_SOCK_PATH, cmd);
+}
+
+int
+cmd_mark(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: uart-monitor mark <text> "
+                "[--ports <dev|label>,...]\n");
+        fprintf(stderr, "Example: uart-monitor mark flash A done "
+                "--ports VMK180_UART0,STM32H563_UART\n");
+        return 1;
+    }
+    return send_joined("MARK", argc, argv);
+}
+
+int
+cmd_ping(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: uart-monitor ping <dev|label> "
+                "[--to <dev|label>] [--count n] [--interval ms] "
+                "[--size n]\n");
+        fprintf(stderr, "Example: uart-monitor ping HUB1_PORT3 "
+                "--count 100 --interval 20\n");
+        return 1;
+    }
+    return send_joined("PING", argc, argv);
+}
+
+int
+cmd_bw(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: uart-monitor bw <dev|label> "
+                "[--to <dev|label>] [--bauds a,b,...] [--step-ms ms] "
+                "[--size n]\n");
+        fprintf(stderr, "Example: uart-monitor bw ADAPTER_A --to ADAPTER_B "
+                "--bauds 115200,921600\n");
+        return 1;
+    }
+    return send_joined("BW", argc, argv);
+}
+
+int
+cmd_metrics(int argc, char *argv[])
+{
+    (void)argc; (void)argv;
+    return control_send_cmd(CONTROL_SOCK_PATH, "METRICS\n");
+}
+
+int
+cmd_toplines(int argc, char *argv[])
+{
+    const char *n = argc == 4 && strcmp(argv[2], "-n") == 0 ? argv[3] :
+                    argc == 2 ? "10" : NULL;
+    if (!n) {
+        fprintf(stderr, "Usage: uart-monitor toplines <device|label> "
+                "[-n N]\n");
+        fprintf(stderr, "Example: uart-monitor toplines STM32N657_UART "
+                "-n 20\n");
+        return 1;
     }
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "TOPLINES %s %s\n", argv[1], n);
+    return control_send_cmd(CONTROL_SOCK_PATH, cmd);
+}
 
+int
+cmd_yield(int argc, char *argv[])
+{
     if (argc < 2) {
-        fprintf(stderr, "Usage: uart-monitor clear <device|label|--all>\n");
+        fprintf(stderr, "Usage: uart-monitor yield <device|board:<serial>|"
+                "group:<port>>\n");
         fprintf(stderr, "Examples:\n");
-        fprintf(stderr, "  uart-monitor clear /dev/ttyUSB0\n");
-        fprintf(stderr, "  uart-monitor clear ttyUSB0\n");
-        fprintf(stderr, "  uart-monitor clear STM32N657_UART\n");
-        fprintf(stderr, "  uart-monitor clear --all\n");
+        fprintf(stderr, "  uart-monitor yield /dev/ttyUSB0\n");
+        fprintf(stderr, "  uart-monitor yield board:FT4232H_A1B2\n");
         return 1;
     }
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "YIELD %s\n", argv[1]);
+    return control_send_cmd(CONTROL_SOCK_PATH, cmd);
+}
 
+int
+cmd_reclaim(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: uart-monitor reclaim <device|"
+                "board:<serial>|group:<port>>\n");
+        fprintf(stderr, "Examples:\n");
+        fprintf(stderr, "  uart-monitor reclaim /dev/ttyUSB0\n");
+        fprintf(stderr, "  uart-monitor reclaim group:VMK180_UART0\n");
+        return 1;
+    }
     char cmd[512];
-    snprintf(cmd, sizeof(cmd), "CLEAR %s\n", argv[1]);
+    snprintf(cmd, sizeof(cmd), "RECLAIM %s\n", argv[1]);
     return control_send_cmd(CONTROL_SOCK_PATH, cmd);
 }
 
 int
-cmd_tail(int argc, char *argv[])
+cmd_clear(int argc, char *argv[])
 {
     if (argc < 2) {
-        fprintf(stderr, "Usage: uart-monitor tail <device|label>\n");
-        fprintf(stderr, "Example: uart-monitor tail ttyUSB0\n");
-        fprintf(stderr, "Example: uart-monitor tail VMK180_UART1\n");
+        fprintf(stderr, "Usage: uart-monitor clear <device|label|"
+                "board:<serial>|group:<port>|--all>\n"
+                "       [--name <checkpoint>] [--truncate]\n");
+        fprintf(stderr, "Examples:\n");
+        fprintf(stderr, "  uart-monitor clear /dev/ttyUSB0\n");
+        fprintf(stderr, "  uart-monitor clear ttyUSB0\n");
+        fprintf(stderr, "  uart-monitor clear STM32N657_UART "
+                "--name flash1\n");
+        fprintf(stderr, "  uart-monitor clear group:VMK180_UART0\n");
+        fprintf(stderr, "  uart-monitor clear --all\n");
+        fprintf(stderr, "  uart-monitor clear --all --truncate\n");
         return 1;
     }
+    return send_joined("CLEAR", argc, argv);
+}
 
-    const char *name = argv[1];
+/* ------------------------------------------------------------------ */
+/*  Log readers (tail / grep / wait)                                  */
+/* ------------------------------------------------------------------ */
 
+/* Open a port's log in the latest session, at checkpoint 'from' ("last"
+ * for the newest) or at its start if from is NULL; with digest set, its
+ * <label>.digest instead (from must be NULL). The file is read directly
+ * when we may; otherwise (a system-mode daemon keeps its logs private)
+ * the daemon is asked for a descriptor. A checkpoint beyond the end
+ * (the log was truncated since) reads from the start. */
+static FILE *
+open_port_log(const char *name, const char *from, int digest, int *local)
+{
     /* strip /dev/ prefix if present */
     if (strncmp(name, "/dev/", 5) == 0)
         name += 5;
 
     /* try direct path: /tmp/uart-monitor/latest/<name>.log */
     char logpath[512];
-    snprintf(logpath, sizeof(logpath),
-             "%s/latest/%s.log", LOG_BASE_DIR, name);
+    snprintf(logpath, sizeof(logpath), "%s/latest/%s.log",
+             LOG_BASE_DIR, name);
+
+    long long off = 0;
+    FILE *fp = fopen(logpath, "r");
+    *local = fp != NULL;
+    if (fp && digest) {
+        /* a tty name's .log is a symlink to <label>.log; the digest
+         * only exists under the label */
+        char real[PATH_MAX], label[256], path[600];
+        strlcpy_safe(label, name, sizeof(label));
+        if (realpath(logpath, real)) {
+            char *base = strrchr(real, '/') + 1;
+            char *dot = strrchr(base, '.');
+            if (dot)
+                *dot = '\0';
+            strlcpy_safe(label, base, sizeof(label));
+        }
+        snprintf(path, sizeof(path), "%s/latest/%s%s", LOG_BASE_DIR,
+                 label, DIGEST_EXT);
+        fclose(fp);
+        fp = fopen(path, "r");
+        if (!fp) {
+            fprintf(stderr, "No digest for %s: %s\n", name, path);
+            fprintf(stderr, "Start the daemon with --digest, or add "
+                    "'digest %s' to the config\n", label);
+            return NULL;
+        }
+    } else if (fp && from) {
+        char index_path[512];
+        snprintf(index_path, sizeof(index_path), "%s/latest/%s",
+                 LOG_BASE_DIR, LOG_CHECKPOINTS);
+        /* the index names the file, not a tty-name symlink to it */
+        char real[PATH_MAX];
+        const char *base = realpath(logpath, real) ? real : logpath;
+        base = strrchr(base, '/') + 1;
+        off = log_checkpoint_offset(index_path, base, from);
+        if (off < 0) {
+            fprintf(stderr, "No checkpoint '%s' for %s\n", from, logpath);
+            fclose(fp);
+            return NULL;
+        }
+    } else if (!fp) {
+        int fd = control_open_log(CONTROL_SOCK_PATH, name, from, digest,
+                                  &off);
+        if (fd >= 0)
+            fp = fdopen(fd, "r");
+    }
 
-    if (access(logpath, R_OK) != 0) {
-        /* not found -- try scanning for a label match */
+    if (!fp && digest) {
+        fprintf(stderr, "No digest for %s in %s/latest/\n", name,
+                LOG_BASE_DIR);
+        return NULL;
+    }
+    if (!fp) {
         fprintf(stderr, "Log file not found: %s\n", logpath);
         fprintf(stderr, "Available logs in %s/latest/:\n", LOG_BASE_DIR);
 
@@ -193,13 +495,267 @@ cmd_tail(int argc, char *argv[])
                  "ls -1 %s/latest/*.log 2>/dev/null", LOG_BASE_DIR);
         int ret = system(cmd);
         (void)ret;
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fileno(fp), &st) == 0 && off > (long long)st.st_size)
+        off = 0;
+    fseeko(fp, (off_t)off, SEEK_SET);
+    return fp;
+}
+
+/* Position fp at the start of its last n lines. */
+static void
+seek_last_lines(FILE *fp, int n)
+{
+    struct stat st;
+    if (fstat(fileno(fp), &st) < 0)
+        return;
+    off_t pos = st.st_size;
+    char buf[4096];
+    int lines = 0;
+    while (pos > 0) {
+        size_t chunk = pos < (off_t)sizeof(buf) ? (size_t)pos : sizeof(buf);
+        pos -= (off_t)chunk;
+        if (pread(fileno(fp), buf, chunk, pos) != (ssize_t)chunk)
+            break;
+        for (size_t i = chunk; i-- > 0;) {
+            /* the newline ending the last line does not count */
+            if (buf[i] == '\n' && pos + (off_t)i + 1 < st.st_size &&
+                ++lines == n) {
+                fseeko(fp, pos + (off_t)i + 1, SEEK_SET);
+                return;
+            }
+        }
+    }
+    fseeko(fp, 0, SEEK_SET);
+}
+
+/* Read the next complete line, waiting for the writer at the end of the
+ * file. Returns 1 with a line, 0 once deadline (mono_ns, 0: never) has
+ * passed. */
+static int
+follow_line(FILE *fp, char **line, size_t *cap, uint64_t deadline)
+{
+    for (;;) {
+        off_t start = ftello(fp);
+        ssize_t n = getline(line, cap, fp);
+        if (n > 0 && (*line)[n - 1] == '\n')
+            return 1;
+        /* at the end, or a line still being written: look again later */
+        clearerr(fp);
+        fseeko(fp, start, SEEK_SET);
+        if (deadline && mono_ns() >= deadline)
+            return 0;
+        usleep(50000);
+    }
+}
+
+/* Split "<port> [args...] [--from cp] [--timeout s]" options out of
+ * argv. Returns the number of positional arguments left in pos[]. */
+static int
+reader_args(int argc, char *argv[], const char **pos, int max,
+            const char **from, int *timeout_s)
+{
+    int n = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--from") == 0 && i + 1 < argc)
+            *from = argv[++i];
+        else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc &&
+                 timeout_s)
+            *timeout_s = atoi(argv[++i]);
+        else if (n < max)
+            pos[n++] = argv[i];
+        else
+            return -1;
+    }
+    return n;
+}
+
+/* tail -n N / --since ms / --after offset: print the port's latest
+ * lines from the daemon's memory once, without following the log. */
+static int
+tail_recent(int argc, char *argv[])
+{
+    char cmd[512];
+    int off = snprintf(cmd, sizeof(cmd), "TAIL");
+    for (int i = 1; i < argc && off < (int)sizeof(cmd) - 2; i++) {
+        if (strcmp(argv[i], "-n") == 0)
+            continue;       /* TAIL takes the count bare */
+        off += snprintf(cmd + off, sizeof(cmd) - (size_t)off - 1, " %s",
+                        argv[i]);
+    }
+    strcat(cmd, "\n");
+    return control_send_cmd(CONTROL_SOCK_PATH, cmd);
+}
+
+int
+cmd_tail(int argc, char *argv[])
+{
+    for (int i = 2; i < argc; i++)
+        if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--since") == 0 ||
+            strcmp(argv[i], "--after") == 0)
+            return tail_recent(argc, argv);
+
+    const char *pos[1], *from = NULL;
+    if (reader_args(argc, argv, pos, 1, &from, NULL) != 1) {
+        fprintf(stderr, "Usage: uart-monitor tail <device|label> "
+                "[--from <checkpoint|last>]\n");
+        fprintf(stderr, "       uart-monitor tail <device|label> "
+                "[-n N] [--since ms] [--after offset]\n");
+        fprintf(stderr, "Example: uart-monitor tail ttyUSB0\n");
+        fprintf(stderr, "Example: uart-monitor tail VMK180_UART1 "
+                "--from last\n");
+        fprintf(stderr, "Example: uart-monitor tail VMK180_UART1 "
+                "--since 5000\n");
         return 1;
     }
 
-    printf("Tailing %s (Ctrl-C to stop)...\n\n", logpath);
+    int local;
+    FILE *fp = open_port_log(pos[0], from, 0, &local);
+    if (!fp)
+        return 1;
+
+    const char *name = pos[0];
+    if (strncmp(name, "/dev/", 5) == 0)
+        name += 5;
+    printf("Tailing %s (Ctrl-C to stop)...\n\n", name);
     fflush(stdout);
 
-    char tailcmd[600];
-    snprintf(tailcmd, sizeof(tailcmd), "tail -f '%s'", logpath);
-    return system(tailcmd);
+    if (local && !from) {
+        fclose(fp);
+        char tailcmd[600];
+        snprintf(tailcmd, sizeof(tailcmd), "tail -f '%s/latest/%s.log'",
+                 LOG_BASE_DIR, name);
+        return system(tailcmd);
+    }
+
+    if (!from)
+        seek_last_lines(fp, 10);
+    char *line = NULL;
+    size_t cap = 0;
+    while (follow_line(fp, &line, &cap, 0)) {
+        fputs(line, stdout);
+        fflush(stdout);
+    }
+    free(line);
+    fclose(fp);
+    return 0;
+}
+
+int
+cmd_grep(int argc, char *argv[])
+{
+    const char *pos[2], *from = NULL;
+    if (reader_args(argc, argv, pos, 2, &from, NULL) != 2) {
+        fprintf(stderr, "Usage: uart-monitor grep <device|label> <text> "
+                "[--from <checkpoint|last>]\n");
+        fprintf(stderr, "Example: uart-monitor grep STM32N657_UART "
+                "\"Hard fault\" --from flash1\n");
+        return 2;
+    }
+
+    int local;
+    FILE *fp = open_port_log(pos[0], from, 0, &local);
+    if (!fp)
+        return 2;
+
+    int found = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, fp) > 0) {
+        if (strstr(line, pos[1])) {
+            fputs(line, stdout);
+            found++;
+        }
+    }
+    free(line);
+    fclose(fp);
+    return found ? 0 : 1;
+}
+
+int
+cmd_wait(int argc, char *argv[])
+{
+    const char *pos[2], *from = NULL;
+    int timeout_s = 0;
+    if (reader_args(argc, argv, pos, 2, &from, &timeout_s) != 2) {
+        fprintf(stderr, "Usage: uart-monitor wait <device|label> <text> "
+                "[--from <checkpoint|last>] [--timeout s]\n");
+        fprintf(stderr, "Example: uart-monitor wait STM32N657_UART "
+                "\"Boot complete\" --from last --timeout 30\n");
+        return 2;
+    }
+
+    int local;
+    FILE *fp = open_port_log(pos[0], from, 0, &local);
+    if (!fp)
+        return 2;
+    /* without --from only output that arrives from now on counts: an
+     * earlier boot's banner must not satisfy the wait */
+    if (!from)
+        fseeko(fp, 0, SEEK_END);
+
+    uint64_t deadline = timeout_s > 0 ?
+                        mono_ns() + (uint64_t)timeout_s * 1000000000ull : 0;
+    int rc = 1;
+    char *line = NULL;
+    size_t cap = 0;
+    while (follow_line(fp, &line, &cap, deadline)) {
+        if (strstr(line, pos[1])) {
+            fputs(line, stdout);
+            rc = 0;
+            break;
+        }
+    }
+    if (rc)
+        fprintf(stderr, "Timed out waiting for \"%s\" in %s\n",
+                pos[1], pos[0]);
+    free(line);
+    fclose(fp);
+    return rc;
+}
+
+/* Print a port's digest (<label>.digest in the latest session); with
+ * -f keep following it. */
+int
+cmd_digest(int argc, char *argv[])
+{
+    const char *name = NULL;
+    int follow = 0, extra = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--follow") == 0)
+            follow = 1;
+        else if (!name)
+            name = argv[i];
+        else
+            extra = 1;
+    }
+    if (!name || extra) {
+        fprintf(stderr, "Usage: uart-monitor digest <device|label> [-f]\n");
+        fprintf(stderr, "Example: uart-monitor digest STM32N657_UART -f\n");
+        return 1;
+    }
+
+    int local;
+    FILE *fp = open_port_log(name, NULL, 1, &local);
+    if (!fp)
+        return 1;
+
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, fp) > 0)
+        fputs(line, stdout);
+    fflush(stdout);
+    if (follow) {
+        clearerr(fp);
+        while (follow_line(fp, &line, &cap, 0)) {
+            fputs(line, stdout);
+            fflush(stdout);
+        }
+    }
+    free(line);
+    fclose(fp);
+    return 0;
 }
@@ -16,11 +16,34 @@ void control_close(int listen_fd, const char *sock_path);
  * Used by CLI client subcommands. Returns 0 on success. */
 int control_send_cmd(const char *sock_path, const char *cmd);
 
+/* Reply to a control client with msg, passing fd along (SCM_RIGHTS)
+ * when it is >= 0. Returns 0 on success. */
+int control_send_fd(int client_fd, const char *msg, int fd);
+
+/* Ask the daemon for a read-only descriptor of a port's log ("OPEN"),
+ * or of its digest if digest is set. *off is set to where checkpoint
+ * 'from' starts (0 if from is NULL). Returns the descriptor, or -1 (an
+ * error reply is printed). */
+int control_open_log(const char *sock_path, const char *name,
+                     const char *from, int digest, long long *off);
+
 /* CLI subcommands that talk to the running daemon */
 int cmd_status(int argc, char *argv[]);
 int cmd_yield(int argc, char *argv[]);
 int cmd_reclaim(int argc, char *argv[]);
 int cmd_clear(int argc, char *argv[]);
 int cmd_tail(int argc, char *argv[]);
+int cmd_grep(int argc, char *argv[]);
+int cmd_wait(int argc, char *argv[]);
+int cmd_digest(int argc, char *argv[]);
+int cmd_add(int argc, char *argv[]);
+int cmd_remove(int argc, char *argv[]);
+int cmd_rotate(int argc, char *argv[]);
+int cmd_integrity(int argc, char *argv[]);
+int cmd_metrics(int argc, char *argv[]);
+int cmd_toplines(int argc, char *argv[]);
+int cmd_mark(int argc, char *argv[]);
+int cmd_ping(int argc, char *argv[]);
+int cmd_bw(int argc, char *argv[]);
 
 #endif /* CONTROL_H */
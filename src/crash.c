@@ -0,0 +1,696 @@
+/* crash.c -- Crash signature detection and the cross-session crash index.
+ *
+ * Boards hit the same kernel oopses and hard faults over and over, and
+ * "how often has this one happened?" used to mean grepping every old
+ * session. Each port's completed lines pass through a detector: the
+ * trigger lines of Linux oopses and panics, Zephyr fatal errors, Cortex-M
+ * HardFault dumps and U-Boot exceptions are found in one pass by an
+ * Aho-Corasick automaton (filter.h). A triggered capture reduces the
+ * crash to a signature that stays the same from one occurrence to the
+ * next -- reason lines with addresses, counters and timestamps masked,
+ * plus the backtrace's function names -- and appends one line per
+ * occurrence to LOG_BASE_DIR/crashes.idx:
+ *
+ *   hash  kind  time_ms  port  session  log  offset  signature
+ *
+ * The index lives outside the session directories and is cut back with
+ * them: an entry goes when its session is pruned, so every occurrence
+ * points at a log that still exists. "crashes" groups it by hash.
+ */
+#include "crash.h"
+#include "filter.h"
+#include "housekeep.h"
+#include "log.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LINE_SIG_MAX 160    /* normalized reason line kept in a signature */
+
+/* ------------------------------------------------------------------ */
+/*  Crash formats                                                     */
+/* ------------------------------------------------------------------ */
+
+typedef struct {
+    const char   *text;
+    crash_kind_t  kind;
+} trigger_t;
+
+/* Lower entries win when several match one line ("***** HARD FAULT"
+ * is Zephyr, not a bare HardFault handler). At most FILTER_MAX_RULES. */
+static const trigger_t triggers[] = {
+    { "Kernel panic - not syncing", CRASH_LINUX },
+    { "Internal error: Oops",       CRASH_LINUX },
+    { "Oops: ",                     CRASH_LINUX },
+    { " BUG: ",                     CRASH_LINUX },  /* not "DEBUG: " */
+    { "^BUG: ",                     CRASH_LINUX },
+    { "Unable to handle kernel",    CRASH_LINUX },
+    { "general protection fault",   CRASH_LINUX },
+    { "kernel BUG at",              CRASH_LINUX },
+    { "ZEPHYR FATAL ERROR",         CRASH_ZEPHYR },
+    { " FAULT *****",               CRASH_ZEPHYR },
+    { "HardFault",                  CRASH_HARDFAULT },
+    { "Hard Fault",                 CRASH_HARDFAULT },
+    { "data abort",                 CRASH_UBOOT },
+    { "prefetch abort",             CRASH_UBOOT },
+    { "undefined instruction",      CRASH_UBOOT },
+    { "Synchronous Abort",          CRASH_UBOOT },
+};
+#define NTRIGGERS (int)(sizeof(triggers) / sizeof(triggers[0]))
+
+typedef struct {
+    const char        *name;
+    const char *const *keys;        /* reason lines kept in the signature */
+    const char *const *soft_ends;   /* end, unless more of it follows */
+    const char *const *ends;
+    int                max_lines;
+} kind_info_t;
+
+static const char *const linux_keys[] = { "ESR = ", NULL };
+static const char *const linux_soft[] = { "---[ end trace", NULL };
+static const char *const linux_ends[] = { "---[ end Kernel panic",
+                                          "Rebooting in", NULL };
+static const char *const zephyr_keys[] = { "FAULT", "Fault", "fault",
+                                           "Error", "error", "Violation",
+                                           "Current thread", NULL };
+static const char *const zephyr_ends[] = { "Halting system", NULL };
+static const char *const hf_keys[] = { "FSR", "FAULT", "Fault", "fault",
+                                       NULL };
+static const char *const uboot_keys[] = { "esr", "ESR", NULL };
+static const char *const uboot_ends[] = { "resetting", "Resetting", NULL };
+static const char *const none[] = { NULL };
+
+static const kind_info_t kinds[] = {
+    [CRASH_NONE]      = { "none", none, none, none, 0 },
+    [CRASH_LINUX]     = { "linux", linux_keys, linux_soft, linux_ends, 100 },
+    [CRASH_ZEPHYR]    = { "zephyr", zephyr_keys, none, zephyr_ends, 30 },
+    [CRASH_HARDFAULT] = { "hardfault", hf_keys, none, none, 24 },
+    [CRASH_UBOOT]     = { "uboot", uboot_keys, none, uboot_ends, 24 },
+};
+
+/* One automaton for every port; built on first use. */
+static filter_t trigger_filter;
+static int      trigger_ready;
+
+static crash_kind_t
+match_trigger(const char *line, size_t len)
+{
+    if (!trigger_ready) {
+        filter_init(&trigger_filter);
+        for (int i = 0; i < NTRIGGERS; i++)
+            filter_add(&trigger_filter, FILTER_KEEP, triggers[i].text);
+        if (filter_compile(&trigger_filter) < 0)
+            return CRASH_NONE;
+        trigger_ready = 1;
+    }
+    int rule = filter_match(&trigger_filter, line, len);
+    return rule < 0 ? CRASH_NONE : triggers[rule].kind;
+}
+
+static int
+contains_any(const char *line, size_t len, const char *const *list)
+{
+    for (; *list; list++)
+        if (memmem(line, len, *list, strlen(*list)))
+            return 1;
+    return 0;
+}
+
+const char *
+crash_kind_name(crash_kind_t k)
+{
+    return kinds[k].name;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Normalization                                                     */
+/* ------------------------------------------------------------------ */
+
+static int
+is_word(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+           (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+static int
+is_hex(char ch)
+{
+    return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f') ||
+           (ch >= 'A' && ch <= 'F');
+}
+
+/* Skip what the logger put in front of the message: kernel and Zephyr
+ * "[timestamp]" groups, a Zephyr "<err> module: " tag or "E: " level. */
+static const char *
+skip_prefixes(const char *p, const char *end)
+{
+    for (;;) {
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if (p < end && *p == '[') {
+            const char *close = memchr(p, ']', (size_t)(end - p));
+            if (!close || close - p > 40)
+                return p;
+            p = close + 1;
+        } else if (p < end && *p == '<') {
+            const char *close = memchr(p, '>', (size_t)(end - p));
+            if (!close || close - p > 12)
+                return p;
+            p = close + 1;
+            while (p < end && *p == ' ')
+                p++;
+            const char *colon = p;
+            while (colon < end && is_word(*colon))
+                colon++;
+            if (colon + 1 < end && colon[0] == ':' && colon[1] == ' ')
+                p = colon + 2;
+        } else if (end - p >= 3 && p[0] >= 'A' && p[0] <= 'Z' &&
+                   p[1] == ':' && p[2] == ' ') {
+            p += 3;
+        } else {
+            return p;
+        }
+    }
+}
+
+/* A word that is a number or an address rather than a name: decimal,
+ * 0x-prefixed, or a long run of hex digits ("ffff80001012abcd"). */
+static int
+is_value(const char *w, size_t n)
+{
+    size_t i = 0;
+    if (n > 2 && w[0] == '0' && (w[1] == 'x' || w[1] == 'X'))
+        i = 2;
+    int digit = 0;
+    for (size_t k = i; k < n; k++) {
+        if (!is_hex(w[k]))
+            return 0;
+        if (w[k] >= '0' && w[k] <= '9')
+            digit = 1;
+    }
+    return i == 2 || (w[0] >= '0' && w[0] <= '9') || (n >= 8 && digit);
+}
+
+/* Status registers (CFSR, HFSR, ESR...) describe the fault rather than
+ * where it happened, so the value after one is kept. */
+static int
+is_status_reg(const char *w, size_t n)
+{
+    return n >= 2 && (w[n - 2] == 's' || w[n - 2] == 'S') &&
+           (w[n - 1] == 'r' || w[n - 1] == 'R');
+}
+
+size_t
+crash_normalize(const char *line, size_t len, char *out, size_t sz)
+{
+    const char *end = line + len;
+    const char *p = skip_prefixes(line, end);
+    const char *prev = NULL;        /* last name word */
+    size_t prev_len = 0;
+    size_t n = 0;
+
+    if (sz == 0)
+        return 0;
+    while (p < end && n + 1 < sz) {
+        char ch = *p;
+        if (ch == ' ' || ch == '\t') {
+            while (p < end && (*p == ' ' || *p == '\t'))
+                p++;
+            if (n > 0 && p < end)
+                out[n++] = ' ';
+        } else if (is_word(ch)) {
+            const char *w = p;
+            while (p < end && is_word(*p))
+                p++;
+            size_t wl = (size_t)(p - w);
+            if (is_value(w, wl) && !(prev && is_status_reg(prev, prev_len))) {
+                out[n++] = '#';
+            } else {
+                if (wl > sz - 1 - n)
+                    wl = sz - 1 - n;
+                memcpy(out + n, w, wl);
+                n += wl;
+                if (!is_value(w, wl)) {
+                    prev = w;
+                    prev_len = wl;
+                }
+            }
+        } else {
+            if ((unsigned char)ch >= 0x20 && ch != 0x7f)
+                out[n++] = ch;
+            p++;
+        }
+    }
+    while (n > 0 && out[n - 1] == ' ')
+        n--;
+    out[n] = '\0';
+    return n;
+}
+
+/* Function name of a backtrace frame: the symbol before "+0x" in
+ * "foo+0x1c/0x40". Frames the unwinder is unsure of ("? foo+0x...")
+ * are skipped. Returns its length, 0 if the line has none. */
+static size_t
+frame_symbol(const char *line, size_t len, const char **sym)
+{
+    const char *end = line + len;
+    const char *p = skip_prefixes(line, end);
+    if (end - p >= 2 && p[0] == '?' && p[1] == ' ')
+        return 0;
+    const char *plus = memmem(p, (size_t)(end - p), "+0x", 3);
+    if (!plus)
+        return 0;
+    const char *s = plus;
+    while (s > p && (is_word(s[-1]) || s[-1] == '.'))
+        s--;
+    if (s == plus || (*s >= '0' && *s <= '9'))
+        return 0;
+    *sym = s;
+    return (size_t)(plus - s);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Capture                                                           */
+/* ------------------------------------------------------------------ */
+
+void
+crash_init(crash_t *c, const char *index_path, const char *label)
+{
+    memset(c, 0, sizeof(*c));
+    strlcpy_safe(c->index_path, index_path, sizeof(c->index_path));
+    strlcpy_safe(c->label, label, sizeof(c->label));
+}
+
+void
+crash_attach(crash_t *c, const char *session, const char *log_name)
+{
+    crash_finish(c);
+    strlcpy_safe(c->session, session, sizeof(c->session));
+    strlcpy_safe(c->log_name, log_name, sizeof(c->log_name));
+}
+
+static void
+sig_append(char *buf, size_t sz, size_t *len, const char *sep,
+           const char *s, size_t n)
+{
+    size_t sl = *len ? strlen(sep) : 0;
+    if (*len + sl + n + 1 > sz)
+        return;             /* full: the head of the crash is what counts */
+    memcpy(buf + *len, sep, sl);
+    memcpy(buf + *len + sl, s, n);
+    *len += sl + n;
+    buf[*len] = '\0';
+}
+
+static void
+add_reason(crash_t *c, const char *line, size_t len)
+{
+    char norm[LINE_SIG_MAX];
+    size_t n = crash_normalize(line, len, norm, sizeof(norm));
+    if (n)
+        sig_append(c->sig, sizeof(c->sig), &c->sig_len, " | ", norm, n);
+}
+
+static void
+start(crash_t *c, crash_kind_t kind, const char *line, size_t len,
+      long long off)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    c->kind = kind;
+    c->lines = 0;
+    c->soft_end = 0;
+    c->ts_ms = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+    c->offset = off;
+    c->sig_len = 0;
+    c->sig[0] = '\0';
+    c->frames_len = 0;
+    c->frames[0] = '\0';
+    c->nframes = 0;
+    add_reason(c, line, len);
+}
+
+/* FNV-1a over kind, reasons and frames */
+static uint64_t
+signature_hash(const crash_t *c)
+{
+    const char *parts[] = { kinds[c->kind].name, c->sig, c->frames };
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+        for (const char *p = parts[i]; *p; p++) {
+            h ^= (unsigned char)*p;
+            h *= 0x100000001b3ull;
+        }
+        h ^= '\t';
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static void
+record(crash_t *c)
+{
+    uint64_t hash = signature_hash(c);
+    char rec[CRASH_SIG_LEN + 1024];
+    int n = snprintf(rec, sizeof(rec),
+                     "%016llx\t%s\t%lld\t%s\t%s\t%s\t%lld\t%s%s%s\n",
+                     (unsigned long long)hash, kinds[c->kind].name,
+                     (long long)c->ts_ms, c->label,
+                     c->session[0] ? c->session : "-",
+                     c->log_name[0] ? c->log_name : "-", c->offset,
+                     c->sig, c->frames_len ? " @ " : "", c->frames);
+    if (n <= 0)
+        return;
+    if ((size_t)n >= sizeof(rec))
+        n = (int)sizeof(rec) - 1;
+
+    c->detected++;
+    c->last_hash = hash;
+    fprintf(stderr, "crash: %s: %s %016llx at %s:%lld\n", c->label,
+            kinds[c->kind].name, (unsigned long long)hash, c->log_name,
+            c->offset);
+
+    /* the open/write/close runs on the housekeeping thread, one
+     * O_APPEND write per occurrence */
+    char *line = malloc((size_t)n);
+    if (!line)
+        return;
+    memcpy(line, rec, (size_t)n);
+    housekeep_append(c->index_path, line, (size_t)n);
+}
+
+int
+crash_prune_index(const char *index_path, const char *base_dir)
+{
+    FILE *in = fopen(index_path, "r");
+    if (!in)
+        return errno == ENOENT ? 0 : -1;
+    char tmp[600];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", index_path, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW |
+                       O_CLOEXEC, 0644);
+    FILE *out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!out) {
+        if (fd >= 0)
+            close(fd);
+        fclose(in);
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    int dropped = 0;
+    while (getline(&line, &cap, in) > 0) {
+        /* hash kind time_ms port session ... */
+        const char *s = line;
+        for (int f = 0; f < 4 && s; f++) {
+            s = strchr(s, '\t');
+            if (s)
+                s++;
+        }
+        size_t len = s ? strcspn(s, "\t") : 0;
+        if (s && len > 0 && !(len == 1 && *s == '-')) {
+            char dir[768];
+            struct stat st;
+            snprintf(dir, sizeof(dir), "%s/%.*s", base_dir, (int)len, s);
+            if (stat(dir, &st) < 0) {
+                dropped++;
+                continue;
+            }
+        }
+        fputs(line, out);
+    }
+    free(line);
+    fclose(in);
+    if (fclose(out) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    if (dropped == 0) {
+        unlink(tmp);
+        return 0;
+    }
+    return rename(tmp, index_path) < 0 ? -1 : dropped;
+}
+
+int
+crash_finish(crash_t *c)
+{
+    if (c->kind == CRASH_NONE)
+        return 0;
+    record(c);
+    c->kind = CRASH_NONE;
+    return 1;
+}
+
+void
+crash_poll(crash_t *c, uint64_t now_ns)
+{
+    if (c->kind != CRASH_NONE &&
+        now_ns - c->last_ns > (uint64_t)CRASH_IDLE_MS * 1000000)
+        crash_finish(c);
+}
+
+int
+crash_feed(crash_t *c, const char *line, size_t len, long long off)
+{
+    crash_kind_t trig = match_trigger(line, len);
+    int done = 0;
+
+    if (c->kind != CRASH_NONE && c->soft_end && trig != c->kind)
+        done = crash_finish(c);     /* the crash really ended there */
+    if (c->kind != CRASH_NONE && trig != CRASH_NONE && trig != c->kind)
+        done |= crash_finish(c);    /* another kind of crash starts */
+
+    if (c->kind == CRASH_NONE) {
+        if (trig == CRASH_NONE)
+            return done;
+        start(c, trig, line, len, off);
+        c->last_ns = mono_ns();
+        return done;
+    }
+
+    const kind_info_t *k = &kinds[c->kind];
+    c->last_ns = mono_ns();
+    c->soft_end = 0;
+
+    if (trig == c->kind || contains_any(line, len, k->keys)) {
+        add_reason(c, line, len);
+    } else if (c->nframes < CRASH_MAX_FRAMES) {
+        const char *sym;
+        size_t n = frame_symbol(line, len, &sym);
+        if (n) {
+            sig_append(c->frames, sizeof(c->frames), &c->frames_len,
+                       " < ", sym, n);
+            c->nframes++;
+        }
+    }
+
+    if (contains_any(line, len, k->ends) || ++c->lines >= k->max_lines)
+        return crash_finish(c) | done;
+    if (contains_any(line, len, k->soft_ends))
+        c->soft_end = 1;
+    return done;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Index query                                                       */
+/* ------------------------------------------------------------------ */
+
+typedef struct {
+    uint64_t hash;
+    char     kind[16];
+    char     sig[CRASH_SIG_LEN + 256];
+    uint64_t count;
+    unsigned sessions;
+    char     last_session[128];
+    char     ports[128];        /* distinct labels, comma-separated */
+    int64_t  first;
+    int64_t  last;
+} crash_group_t;
+
+typedef struct {
+    const char *f[8];           /* hash kind ms port session log off sig */
+} crash_rec_t;
+
+static int
+split_record(char *line, crash_rec_t *r)
+{
+    line[strcspn(line, "\n")] = '\0';
+    int n = 0;
+    for (char *p = line; n < 8; n++) {
+        r->f[n] = p;
+        char *tab = n < 7 ? strchr(p, '\t') : NULL;
+        if (n < 7 && !tab)
+            return -1;
+        if (tab) {
+            *tab = '\0';
+            p = tab + 1;
+        }
+    }
+    return 0;
+}
+
+static void
+add_port_name(char *ports, size_t sz, const char *label)
+{
+    size_t ll = strlen(label);
+    for (const char *p = ports; *p; ) {
+        size_t n = strcspn(p, ",");
+        if (n == ll && memcmp(p, label, n) == 0)
+            return;
+        p += n + (p[n] == ',');
+    }
+    size_t len = strlen(ports);
+    snprintf(ports + len, sz - len, "%s%s", len ? "," : "", label);
+}
+
+static int
+by_count(const void *a, const void *b)
+{
+    const crash_group_t *x = a, *y = b;
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+    return (x->last < y->last) - (x->last > y->last);
+}
+
+int
+cmd_crashes(int argc, char *argv[])
+{
+    char index[512];
+    const char *port = NULL, *kind = NULL, *hash = NULL;
+    int64_t since = 0;
+
+    snprintf(index, sizeof(index), "%s/%s", LOG_BASE_DIR, CRASH_INDEX);
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "--port") == 0 && i + 1 < argc) {
+            port = argv[++i];
+        } else if (strcmp(a, "--kind") == 0 && i + 1 < argc) {
+            kind = argv[++i];
+        } else if (strcmp(a, "--index") == 0 && i + 1 < argc) {
+            strlcpy_safe(index, argv[++i], sizeof(index));
+        } else if (strcmp(a, "--since") == 0 && i + 1 < argc) {
+            if (timestamp_parse_arg(argv[++i], &since) < 0) {
+                fprintf(stderr, "Bad time '%s' (YYYY-MM-DD HH:MM:SS, "
+                        "@epoch or -<n>[smhd])\n", argv[i]);
+                return 1;
+            }
+        } else if (a[0] != '-' && !hash) {
+            hash = a;
+        } else {
+            fprintf(stderr, "Usage: uart-monitor crashes [<hash>] "
+                    "[--port P] [--kind K] [--since t] [--index file]\n");
+            fprintf(stderr, "Example: uart-monitor crashes --port "
+                    "stm32-console --since -7d\n");
+            return 1;
+        }
+    }
+
+    FILE *fp = fopen(index, "r");
+    if (!fp) {
+        if (errno == ENOENT) {
+            printf("No crashes recorded (%s)\n", index);
+            return 0;
+        }
+        fprintf(stderr, "Cannot read %s: %s\n", index, strerror(errno));
+        return 1;
+    }
+
+    crash_group_t *groups = NULL;
+    size_t ngroups = 0, cap = 0;
+    char *line = NULL;
+    size_t line_sz = 0;
+    unsigned long shown = 0;
+
+    while (getline(&line, &line_sz, fp) > 0) {
+        crash_rec_t r;
+        if (split_record(line, &r) < 0)
+            continue;
+        int64_t ms = strtoll(r.f[2], NULL, 10);
+        if ((port && strcmp(port, r.f[3]) != 0) ||
+            (kind && strcmp(kind, r.f[1]) != 0) ||
+            (since && ms < since) ||
+            (hash && strncmp(r.f[0], hash, strlen(hash)) != 0))
+            continue;
+
+        if (hash) {
+            /* one hash: every occurrence, with where to find it */
+            char t[32];
+            timestamp_fmt_ms(ms, t, sizeof(t));
+            if (shown++ == 0)
+                printf("%s %s\n  %s\n\n", r.f[0], r.f[1], r.f[7]);
+            printf("  %s  %-20s %s/%s/%s @%s\n", t, r.f[3], LOG_BASE_DIR,
+                   r.f[4], r.f[5], r.f[6]);
+            continue;
+        }
+
+        uint64_t h = strtoull(r.f[0], NULL, 16);
+        crash_group_t *g = NULL;
+        for (size_t i = 0; i < ngroups; i++)
+            if (groups[i].hash == h) {
+                g = &groups[i];
+                break;
+            }
+        if (!g) {
+            if (ngroups == cap) {
+                size_t nc = cap ? cap * 2 : 64;
+                crash_group_t *ng = realloc(groups, nc * sizeof(*ng));
+                if (!ng)
+                    break;
+                groups = ng;
+                cap = nc;
+            }
+            g = &groups[ngroups++];
+            memset(g, 0, sizeof(*g));
+            g->hash = h;
+            g->first = ms;
+            strlcpy_safe(g->kind, r.f[1], sizeof(g->kind));
+            strlcpy_safe(g->sig, r.f[7], sizeof(g->sig));
+        }
+        g->count++;
+        g->last = ms;
+        if (strcmp(g->last_session, r.f[4]) != 0) {
+            g->sessions++;
+            strlcpy_safe(g->last_session, r.f[4], sizeof(g->last_session));
+        }
+        add_port_name(g->ports, sizeof(g->ports), r.f[3]);
+    }
+    free(line);
+    fclose(fp);
+
+    if (hash) {
+        if (!shown)
+            fprintf(stderr, "No crash %s in %s\n", hash, index);
+        return shown == 0;
+    }
+
+    if (ngroups == 0) {
+        printf("No crashes recorded (%s)\n", index);
+        free(groups);
+        return 0;
+    }
+    qsort(groups, ngroups, sizeof(*groups), by_count);
+    printf("%-16s  %-9s %6s %8s  %-23s  %-23s  %s\n", "SIGNATURE", "KIND",
+           "COUNT", "SESSIONS", "FIRST SEEN", "LAST SEEN", "PORTS");
+    for (size_t i = 0; i < ngroups; i++) {
+        const crash_group_t *g = &groups[i];
+        char f[32], l[32];
+        timestamp_fmt_ms(g->first, f, sizeof(f));
+        timestamp_fmt_ms(g->last, l, sizeof(l));
+        printf("%016llx  %-9s %6llu %8u  %-23s  %-23s  %s\n    %.*s\n",
+               (unsigned long long)g->hash, g->kind,
+               (unsigned long long)g->count, g->sessions, f, l, g->ports,
+               100, g->sig);
+    }
+    free(groups);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/* crash.h -- Crash signature detection and the cross-session crash index */
+#ifndef CRASH_H
+#define CRASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CRASH_INDEX     "crashes.idx"   /* under LOG_BASE_DIR */
+#define CRASH_SIG_LEN   512
+#define CRASH_MAX_FRAMES 8
+#define CRASH_IDLE_MS   2000    /* a capture ends when the port goes quiet */
+
+typedef enum {
+    CRASH_NONE,
+    CRASH_LINUX,        /* oops, BUG, panic */
+    CRASH_ZEPHYR,       /* ">>> ZEPHYR FATAL ERROR", "***** ... FAULT" */
+    CRASH_HARDFAULT,    /* Cortex-M HardFault handler register dump */
+    CRASH_UBOOT,        /* U-Boot data/prefetch abort, undefined insn */
+} crash_kind_t;
+
+/* Per-port detector. A trigger line starts a capture; the lines after
+ * it are reduced to a signature (the trigger and reason lines with
+ * addresses, counters and timestamps masked, plus the function names of
+ * the backtrace) until the crash's end line, a line limit or
+ * CRASH_IDLE_MS of silence. The finished signature is hashed and one
+ * occurrence is queued for the index (housekeep.h). */
+typedef struct {
+    char         index_path[512];
+    char         label[64];
+    char         session[128];
+    char         log_name[128];
+
+    crash_kind_t kind;          /* capture in progress, or CRASH_NONE */
+    int          lines;
+    int64_t      ts_ms;         /* wall time of the trigger line */
+    long long    offset;        /* its offset in the port log */
+    uint64_t     last_ns;       /* mono_ns() of the last captured line */
+    int          soft_end;      /* saw an end line that may be followed
+                                 * by more of the same crash */
+    char         sig[CRASH_SIG_LEN];    /* reason lines, " | " separated */
+    size_t       sig_len;
+    char         frames[256];           /* backtrace, " < " separated */
+    size_t       frames_len;
+    int          nframes;
+
+    uint64_t     detected;      /* crashes recorded for this port */
+    uint64_t     last_hash;
+} crash_t;
+
+/* Start a detector for a port; index_path is the crash index. */
+void crash_init(crash_t *c, const char *index_path, const char *label);
+
+/* Name the session and log file that offsets refer to (after open and
+ * rotation). Finishes a capture still in progress. */
+void crash_attach(crash_t *c, const char *session, const char *log_name);
+
+/* Feed one completed line (without its "[timestamp] " or '\n') that
+ * starts at byte offset off of the log. Returns 1 if it completed a
+ * crash, which is then recorded. */
+int crash_feed(crash_t *c, const char *line, size_t len, long long off);
+
+/* Record a capture still in progress (port idle, closing, rotating).
+ * Returns 1 if there was one. */
+int crash_finish(crash_t *c);
+
+/* Finish the capture if the port has been quiet for CRASH_IDLE_MS. */
+void crash_poll(crash_t *c, uint64_t now_ns);
+
+/* Normalize a line for a signature: strip log prefixes, mask numbers
+ * and addresses, collapse blanks. Returns the output length. */
+size_t crash_normalize(const char *line, size_t len, char *out, size_t sz);
+
+/* Drop the index entries whose session directory under base_dir is
+ * gone (pruned with the sessions). Returns how many were dropped, -1 on
+ * error. */
+int crash_prune_index(const char *index_path, const char *base_dir);
+
+/* "linux", "zephyr", "hardfault", "uboot". */
+const char *crash_kind_name(crash_kind_t k);
+
+/* CLI subcommand: summarize or query the index */
+int cmd_crashes(int argc, char *argv[]);
+
+#endif /* CRASH_H */
@@ -0,0 +1,487 @@
+/* dedup.c -- Content-defined, deduplicating chunk store for archives.
+ *
+ * Boards that reboot all day print the same few KB of boot log every
+ * time, and a session archive is mostly those copies. The store keeps
+ * each distinct chunk once: streams are cut with a gear rolling hash
+ * (one shift and add per byte), every chunk is named by its SHA-256, and
+ * a manifest lists the chunk ids that rebuild a stream. Chunks are
+ * lz-compressed into large pack files that readers mmap.
+ */
+#include "dedup.h"
+#include "lz.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------ */
+/*  Chunking                                                          */
+/* ------------------------------------------------------------------ */
+
+/* Gear table: fixed pseudo-random values (splitmix64 from 0), so every
+ * build cuts the same data at the same places. */
+static uint64_t gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+static void
+gear_init(void)
+{
+    uint64_t x = 0;
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+size_t
+dedup_cut(const char *data, size_t len)
+{
+    static const uint64_t mask = (uint64_t)(DEDUP_AVG_CHUNK - 1) << 48;
+    pthread_once(&gear_once, gear_init);
+    if (len <= DEDUP_MIN_CHUNK)
+        return len;
+    size_t end = len < DEDUP_MAX_CHUNK ? len : DEDUP_MAX_CHUNK;
+    uint64_t h = 0;
+    /* the hash only sees the last 64 bytes: start just before the
+     * minimum, the bytes skipped cannot influence a cut after it */
+    for (size_t i = DEDUP_MIN_CHUNK - 64; i < end; i++) {
+        h = (h << 1) + gear[(unsigned char)data[i]];
+        if (i >= DEDUP_MIN_CHUNK && !(h & mask))
+            return i + 1;
+    }
+    return end;
+}
+
+/* ------------------------------------------------------------------ */
+/*  SHA-256 (FIPS 180-4)                                              */
+/* ------------------------------------------------------------------ */
+
+static const uint32_t sha_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void
+sha_block(uint32_t st[8], const uint8_t *p)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+               (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^
+                      (w[i - 15] >> 3);
+        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^
+                      (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = st[0], b = st[1], c = st[2], d = st[3];
+    uint32_t e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) +
+                      ((e & f) ^ (~e & g)) + sha_k[i] + w[i];
+        uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) +
+                      ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+    st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+}
+
+void
+dedup_sha256(const void *data, size_t len, uint8_t sha[32])
+{
+    uint32_t st[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                       0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    const uint8_t *p = data;
+    size_t n = len;
+    for (; n >= 64; p += 64, n -= 64)
+        sha_block(st, p);
+
+    uint8_t tail[128] = {0};
+    memcpy(tail, p, n);
+    tail[n] = 0x80;
+    size_t tl = n < 56 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++)
+        tail[tl - 1 - i] = (uint8_t)(bits >> (8 * i));
+    sha_block(st, tail);
+    if (tl == 128)
+        sha_block(st, tail + 64);
+    for (int i = 0; i < 8; i++) {
+        sha[4 * i] = (uint8_t)(st[i] >> 24);
+        sha[4 * i + 1] = (uint8_t)(st[i] >> 16);
+        sha[4 * i + 2] = (uint8_t)(st[i] >> 8);
+        sha[4 * i + 3] = (uint8_t)st[i];
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/*  Index                                                             */
+/* ------------------------------------------------------------------ */
+
+static uint64_t
+get64(const uint8_t *p, int bytes)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++)
+        v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static void
+put64(uint8_t *p, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t
+slot_of(const dedup_store_t *s, const uint8_t sha[32])
+{
+    return (uint32_t)get64(sha, 8) & (s->table_size - 1);
+}
+
+static int
+table_grow(dedup_store_t *s)
+{
+    uint32_t size = s->table_size ? s->table_size * 2 : 4096;
+    uint32_t *t = calloc(size, sizeof(*t));
+    if (!t)
+        return -1;
+    free(s->table);
+    s->table = t;
+    s->table_size = size;
+    for (uint32_t id = 0; id < s->nrecs; id++) {
+        uint32_t i = slot_of(s, s->recs[id].sha);
+        while (t[i])
+            i = (i + 1) & (size - 1);
+        t[i] = id + 1;
+    }
+    return 0;
+}
+
+static int64_t
+lookup(const dedup_store_t *s, const uint8_t sha[32])
+{
+    if (!s->table_size)
+        return -1;
+    for (uint32_t i = slot_of(s, sha); s->table[i];
+         i = (i + 1) & (s->table_size - 1)) {
+        uint32_t id = s->table[i] - 1;
+        if (memcmp(s->recs[id].sha, sha, 32) == 0)
+            return id;
+    }
+    return -1;
+}
+
+/* Append a record to the in-memory index (not to chunks.idx). */
+static int
+add_rec(dedup_store_t *s, const dedup_rec_t *r)
+{
+    if (s->nrecs == s->cap) {
+        uint32_t cap = s->cap ? s->cap * 2 : 1024;
+        dedup_rec_t *grown = realloc(s->recs, cap * sizeof(*grown));
+        if (!grown)
+            return -1;
+        s->recs = grown;
+        s->cap = cap;
+    }
+    if ((uint64_t)(s->nrecs + 1) * 2 > s->table_size && table_grow(s) < 0)
+        return -1;
+    s->recs[s->nrecs] = *r;
+    uint32_t i = slot_of(s, r->sha);
+    while (s->table[i])
+        i = (i + 1) & (s->table_size - 1);
+    s->table[i] = ++s->nrecs;
+    return 0;
+}
+
+static void
+pack_path(const dedup_store_t *s, uint32_t pack, char *buf, size_t sz)
+{
+    snprintf(buf, sz, "%s/pack-%04u", s->dir, pack);
+}
+
+static off_t
+file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+/* Load chunks.idx. Records past the end of their pack (a writer that
+ * died between the two writes) and a torn last record are dropped; a
+ * writer also cuts them off the file. */
+static int
+load_index(dedup_store_t *s)
+{
+    struct stat st;
+    if (fstat(s->idx_fd, &st) < 0)
+        return -1;
+    size_t n = (size_t)st.st_size / DEDUP_REC_SIZE;
+    uint8_t *buf = malloc(n ? n * DEDUP_REC_SIZE : 1);
+    if (!buf)
+        return -1;
+    size_t got = 0;
+    while (got < n * DEDUP_REC_SIZE) {
+        ssize_t r = pread(s->idx_fd, buf + got, n * DEDUP_REC_SIZE - got,
+                          (off_t)got);
+        if (r <= 0) {
+            free(buf);
+            return -1;
+        }
+        got += (size_t)r;
+    }
+
+    off_t pack_len[DEDUP_MAX_PACKS];
+    uint32_t known = 0;
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *p = buf + i * DEDUP_REC_SIZE;
+        dedup_rec_t r;
+        memcpy(r.sha, p, 32);
+        r.pack = (uint32_t)get64(p + 32, 4);
+        r.off = get64(p + 36, 8);
+        r.len = (uint32_t)get64(p + 44, 4);
+        r.raw_len = (uint32_t)get64(p + 48, 4);
+        r.crc = (uint32_t)get64(p + 52, 4);
+        if (r.pack >= DEDUP_MAX_PACKS || r.raw_len > DEDUP_MAX_CHUNK)
+            break;
+        while (known <= r.pack) {
+            char path[600];
+            pack_path(s, known, path, sizeof(path));
+            pack_len[known++] = file_size(path);
+        }
+        if (pack_len[r.pack] < 0 ||
+            r.off + r.len > (uint64_t)pack_len[r.pack])
+            break;
+        if (add_rec(s, &r) < 0) {
+            free(buf);
+            return -1;
+        }
+    }
+    free(buf);
+    if (s->writable && st.st_size != (off_t)s->nrecs * DEDUP_REC_SIZE &&
+        ftruncate(s->idx_fd, (off_t)s->nrecs * DEDUP_REC_SIZE) < 0)
+        return -1;
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  API                                                               */
+/* ------------------------------------------------------------------ */
+
+int
+dedup_open(dedup_store_t *s, const char *dir, int writable)
+{
+    memset(s, 0, sizeof(*s));
+    s->idx_fd = -1;
+    s->pack_fd = -1;
+    s->writable = writable;
+    strlcpy_safe(s->dir, dir, sizeof(s->dir));
+    if (writable && mkdirp(dir) < 0) {
+        fprintf(stderr, "dedup: cannot create %s: %s\n", dir,
+                strerror(errno));
+        return -1;
+    }
+
+    char path[600];
+    snprintf(path, sizeof(path), "%s/%s", dir, DEDUP_INDEX);
+    s->idx_fd = open(path, (writable ? O_RDWR | O_CREAT : O_RDONLY) |
+                     O_CLOEXEC, 0644);
+    if (s->idx_fd < 0) {
+        fprintf(stderr, "dedup: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (writable && flock(s->idx_fd, LOCK_EX) < 0) {
+        fprintf(stderr, "dedup: cannot lock %s: %s\n", path,
+                strerror(errno));
+        dedup_close(s);
+        return -1;
+    }
+    if (load_index(s) < 0) {
+        fprintf(stderr, "dedup: cannot load %s\n", path);
+        dedup_close(s);
+        return -1;
+    }
+    if (writable) {
+        /* new chunks go to the last pack until it is full */
+        uint32_t last = s->nrecs ? s->recs[s->nrecs - 1].pack : 0;
+        char pp[600];
+        pack_path(s, last, pp, sizeof(pp));
+        off_t len = file_size(pp);
+        s->pack = len >= (off_t)DEDUP_PACK_SIZE ? last + 1 : last;
+        s->pack_len = len >= 0 && s->pack == last ? (uint64_t)len : 0;
+    }
+    return 0;
+}
+
+int64_t
+dedup_put(dedup_store_t *s, const uint8_t sha[32], const char *data,
+          size_t len)
+{
+    int64_t id = lookup(s, sha);
+    if (id >= 0) {
+        s->reused++;
+        return id;
+    }
+    if (!s->writable || len > DEDUP_MAX_CHUNK)
+        return -1;
+
+    if (s->pack_fd < 0 || s->pack_len + LZ_BOUND(len) > DEDUP_PACK_SIZE) {
+        if (s->pack_fd >= 0) {
+            fdatasync(s->pack_fd);
+            close(s->pack_fd);
+            s->pack++;
+            s->pack_len = 0;
+        }
+        if (s->pack >= DEDUP_MAX_PACKS) {
+            fprintf(stderr, "dedup: %s: store is full\n", s->dir);
+            return -1;
+        }
+        char path[600];
+        pack_path(s, s->pack, path, sizeof(path));
+        s->pack_fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (s->pack_fd < 0) {
+            fprintf(stderr, "dedup: %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+
+    char packed[LZ_BOUND(DEDUP_MAX_CHUNK)];
+    size_t plen = lz_compress(data, len, packed);
+    for (size_t done = 0; done < plen;) {
+        ssize_t n = pwrite(s->pack_fd, packed + done, plen - done,
+                           (off_t)(s->pack_len + done));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            fprintf(stderr, "dedup: pack-%04u: %s\n", s->pack,
+                    n < 0 ? strerror(errno) : "short write");
+            return -1;
+        }
+        done += (size_t)n;
+    }
+
+    dedup_rec_t r;
+    memcpy(r.sha, sha, 32);
+    r.pack = s->pack;
+    r.off = s->pack_len;
+    r.len = (uint32_t)plen;
+    r.raw_len = (uint32_t)len;
+    r.crc = crc32_update(0, data, len);
+    if (add_rec(s, &r) < 0)
+        return -1;
+    s->pack_len += plen;
+    s->added++;
+    s->added_bytes += plen;
+    return s->nrecs - 1;
+}
+
+long
+dedup_get(dedup_store_t *s, uint32_t id, char *out)
+{
+    if (id >= s->nrecs)
+        return -1;
+    const dedup_rec_t *r = &s->recs[id];
+    if (s->maps[r->pack].len < r->off + r->len) {
+        /* not mapped yet, or grown since: map the whole pack again */
+        if (s->maps[r->pack].p)
+            munmap((void *)s->maps[r->pack].p, s->maps[r->pack].len);
+        s->maps[r->pack].p = NULL;
+        s->maps[r->pack].len = 0;
+        char path[600];
+        pack_path(s, r->pack, path, sizeof(path));
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0 ||
+            (uint64_t)st.st_size < r->off + r->len) {
+            if (fd >= 0)
+                close(fd);
+            return -1;
+        }
+        void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED,
+                       fd, 0);
+        close(fd);
+        if (m == MAP_FAILED)
+            return -1;
+        s->maps[r->pack].p = m;
+        s->maps[r->pack].len = (size_t)st.st_size;
+    }
+    if (lz_decompress(s->maps[r->pack].p + r->off, r->len, out,
+                      r->raw_len) < 0 ||
+        crc32_update(0, out, r->raw_len) != r->crc)
+        return -1;
+    return (long)r->raw_len;
+}
+
+void
+dedup_close(dedup_store_t *s)
+{
+    if (s->pack_fd >= 0) {
+        /* chunks reach the disk before the records naming them */
+        fdatasync(s->pack_fd);
+        close(s->pack_fd);
+    }
+    if (s->writable && s->idx_fd >= 0) {
+        uint32_t first = s->nrecs - (uint32_t)s->added;
+        size_t n = (size_t)s->added * DEDUP_REC_SIZE;
+        uint8_t *buf = malloc(n ? n : 1);
+        if (buf) {
+            for (uint32_t id = first; id < s->nrecs; id++) {
+                const dedup_rec_t *r = &s->recs[id];
+                uint8_t *p = buf + (size_t)(id - first) * DEDUP_REC_SIZE;
+                memcpy(p, r->sha, 32);
+                put64(p + 32, r->pack, 4);
+                put64(p + 36, r->off, 8);
+                put64(p + 44, r->len, 4);
+                put64(p + 48, r->raw_len, 4);
+                put64(p + 52, r->crc, 4);
+                memset(p + 56, 0, 4);
+            }
+            if (pwrite(s->idx_fd, buf, n, (off_t)first * DEDUP_REC_SIZE) !=
+                (ssize_t)n || fdatasync(s->idx_fd) < 0)
+                fprintf(stderr, "dedup: cannot write %s/%s: %s\n", s->dir,
+                        DEDUP_INDEX, strerror(errno));
+            free(buf);
+        }
+    }
+    if (s->idx_fd >= 0)
+        close(s->idx_fd);
+    for (int i = 0; i < DEDUP_MAX_PACKS; i++)
+        if (s->maps[i].p)
+            munmap((void *)s->maps[i].p, s->maps[i].len);
+    free(s->recs);
+    free(s->table);
+    memset(s, 0, sizeof(*s));
+    s->idx_fd = -1;
+    s->pack_fd = -1;
+}
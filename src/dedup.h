@@ -0,0 +1,84 @@
+/* dedup.h -- Content-defined, deduplicating chunk store for archives */
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Store layout (a directory, integers little-endian):
+ *
+ *   chunks.idx       one DEDUP_REC_SIZE record per chunk, append-only
+ *   pack-NNNN        lz-compressed chunks (lz.h), back to back
+ *   <session>.umd    manifests written by "export --store" (archive.h)
+ *
+ * Streams are cut into chunks where a rolling hash of the last bytes
+ * hits a pattern, so a cut depends only on nearby content: the same
+ * boot log printed after a reset, on another port or in another session
+ * is cut the same way and its chunks are stored once, keyed by their
+ * SHA-256. Chunks are never removed. */
+#define DEDUP_INDEX       "chunks.idx"
+#define DEDUP_MIN_CHUNK   1024
+#define DEDUP_AVG_CHUNK   4096          /* power of two */
+#define DEDUP_MAX_CHUNK   65536
+#define DEDUP_PACK_SIZE   (64u * 1024 * 1024)
+#define DEDUP_REC_SIZE    60
+#define DEDUP_MAX_PACKS   4096
+
+typedef struct {
+    uint8_t  sha[32];
+    uint32_t pack;
+    uint64_t off;           /* compressed chunk in the pack */
+    uint32_t len;
+    uint32_t raw_len;
+    uint32_t crc;           /* CRC-32 of the chunk */
+} dedup_rec_t;
+
+typedef struct {
+    char         dir[512];
+    int          writable;
+    int          idx_fd;    /* locked while writable */
+    dedup_rec_t *recs;      /* chunk id = position */
+    uint32_t     nrecs;
+    uint32_t     cap;
+    uint32_t    *table;     /* open addressing: id + 1, 0 = empty */
+    uint32_t     table_size;
+
+    int          pack_fd;   /* pack being appended to */
+    uint32_t     pack;
+    uint64_t     pack_len;
+
+    struct {                /* read side: packs mapped on first use */
+        const char *p;
+        size_t      len;
+    } maps[DEDUP_MAX_PACKS];
+
+    uint64_t     added;     /* this session: chunks / bytes written */
+    uint64_t     added_bytes;
+    uint64_t     reused;
+} dedup_store_t;
+
+/* Open the store in dir, creating it if writable. A writable store is
+ * locked against other writers until dedup_close(). Returns 0 on
+ * success. */
+int dedup_open(dedup_store_t *s, const char *dir, int writable);
+
+/* Flush new chunks to disk and release the store. */
+void dedup_close(dedup_store_t *s);
+
+/* Length of the chunk at the start of data: a content-defined cut
+ * between DEDUP_MIN_CHUNK and DEDUP_MAX_CHUNK bytes, or len. */
+size_t dedup_cut(const char *data, size_t len);
+
+/* SHA-256 of data into sha. */
+void dedup_sha256(const void *data, size_t len, uint8_t sha[32]);
+
+/* Store a chunk whose SHA-256 is sha, unless the store has it already.
+ * Returns its id, or -1 on a write error. */
+int64_t dedup_put(dedup_store_t *s, const uint8_t sha[32], const char *data,
+                  size_t len);
+
+/* Copy chunk id into out, which holds at least its raw_len bytes.
+ * Returns its length, or -1 if it is missing or corrupt. */
+long dedup_get(dedup_store_t *s, uint32_t id, char *out);
+
+#endif /* DEDUP_H */
@@ -0,0 +1,258 @@
+/* devclock.c -- Host <-> device clock model from in-band log timestamps.
+ *
+ * Host arrival times are skewed by the USB-serial adapter: a FIFO
+ * timeout, the USB polling interval and the tty layer add a variable
+ * delay of up to tens of milliseconds. Consoles that stamp their own
+ * lines (Linux printk, Zephyr, ESP-IDF/FreeRTOS ticks) say when the
+ * device printed them. Fitting the device clock to the host clock per
+ * port turns those stamps into host times that are much more accurate
+ * than arrival, so lines from several ports order correctly.
+ */
+#include "devclock.h"
+
+#include <string.h>
+
+static const char *const fmt_names[] = {
+    "none", "printk", "zephyr", "ticks"
+};
+
+void
+devclock_init(devclock_t *dc)
+{
+    memset(dc, 0, sizeof(*dc));
+}
+
+const char *
+devclock_fmt_name(devclock_fmt_t f)
+{
+    return fmt_names[f];
+}
+
+/* ------------------------------------------------------------------ */
+/*  Timestamp formats                                                 */
+/* ------------------------------------------------------------------ */
+
+/* Decimal digits at *p (at most max); advances *p. -1 if none. */
+static int64_t
+number(const char **p, const char *end, int max)
+{
+    int64_t v = 0;
+    int n = 0;
+    while (*p < end && n < max && **p >= '0' && **p <= '9') {
+        v = v * 10 + (**p - '0');
+        (*p)++;
+        n++;
+    }
+    return n ? v : -1;
+}
+
+/* "[    1.234567]": seconds, and a fraction of up to 9 digits. Nine
+ * digits of seconds (31 years) keep sec * 1e9 inside int64_t. */
+static int
+parse_printk(const char *p, const char *end, int64_t *ns)
+{
+    p++;
+    while (p < end && *p == ' ')
+        p++;
+    int64_t sec = number(&p, end, 9);
+    if (sec < 0 || p >= end || *p != '.')
+        return 0;
+    p++;
+    const char *f = p;
+    int64_t frac = number(&p, end, 9);
+    if (frac < 0 || p >= end || *p != ']')
+        return 0;
+    for (long n = p - f; n < 9; n++)
+        frac *= 10;
+    *ns = sec * 1000000000ll + frac;
+    return 1;
+}
+
+/* "[00:00:01.234,567]": hours (any number), minutes, seconds, ms, us */
+static int
+parse_zephyr(const char *p, const char *end, int64_t *ns)
+{
+    p++;
+    int64_t f[5];
+    static const char sep[5] = { ':', ':', '.', ',', ']' };
+    for (int i = 0; i < 5; i++) {
+        f[i] = number(&p, end, i == 0 ? 6 : 3);
+        if (f[i] < 0 || p >= end || *p != sep[i])
+            return 0;
+        p++;
+    }
+    *ns = ((f[0] * 3600 + f[1] * 60 + f[2]) * 1000000ll +
+           f[3] * 1000 + f[4]) * 1000;
+    return 1;
+}
+
+/* "I (1234) tag: ...", possibly after an ANSI color "\033[0;32m" */
+static int
+parse_ticks(const char *p, const char *end, int64_t *ns)
+{
+    if (p < end && *p == '\033') {
+        const char *m = memchr(p, 'm', (size_t)(end - p));
+        if (!m || m - p > 8)
+            return 0;
+        p = m + 1;
+    }
+    if (end - p < 5 || !strchr("EWIDV", p[0]) || p[0] == '\0' ||
+        p[1] != ' ' || p[2] != '(')
+        return 0;
+    p += 3;
+    int64_t ms = number(&p, end, 12);
+    if (ms < 0 || p >= end || *p != ')')
+        return 0;
+    *ns = ms * 1000000ll;
+    return 1;
+}
+
+devclock_fmt_t
+devclock_parse(const char *line, size_t len, int64_t *dev_ns)
+{
+    const char *end = line + len;
+    if (len < 4)
+        return DEVCLOCK_NONE;
+    if (line[0] == '[') {
+        if (parse_printk(line, end, dev_ns))
+            return DEVCLOCK_PRINTK;
+        if (parse_zephyr(line, end, dev_ns))
+            return DEVCLOCK_ZEPHYR;
+        return DEVCLOCK_NONE;
+    }
+    return parse_ticks(line, end, dev_ns) ? DEVCLOCK_TICKS : DEVCLOCK_NONE;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Model                                                             */
+/* ------------------------------------------------------------------ */
+
+/* Least squares through the bucket minima, then lowered so that no
+ * minimum lies below the line: delays only ever add. */
+static void
+refit(devclock_t *dc)
+{
+    devclock_point_t p[DEVCLOCK_POINTS + 1];
+    int n = 0;
+    for (int i = 0; i < dc->npts; i++)
+        p[n++] = dc->pts[(dc->head - dc->npts + i + DEVCLOCK_POINTS) %
+                         DEVCLOCK_POINTS];
+    p[n++] = dc->cur;
+
+    dc->dev0 = p[0].dev;
+    if (n < 2 || p[n - 1].dev - p[0].dev < DEVCLOCK_BUCKET_NS) {
+        int64_t lo = p[0].delta;
+        for (int i = 1; i < n; i++)
+            if (p[i].delta < lo)
+                lo = p[i].delta;
+        dc->off = lo;
+        dc->slope = 0;
+        return;
+    }
+
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int64_t y0 = p[0].delta;
+    for (int i = 0; i < n; i++) {
+        double x = (double)(p[i].dev - dc->dev0);
+        double y = (double)(p[i].delta - y0);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    double den = n * sxx - sx * sx;
+    double slope = den > 0 ? (n * sxy - sx * sy) / den : 0;
+    if (slope > DEVCLOCK_MAX_DRIFT || slope < -DEVCLOCK_MAX_DRIFT)
+        slope = 0;
+    double icept = (sy - slope * sx) / n;
+
+    double lowest = 0;
+    for (int i = 0; i < n; i++) {
+        double r = (double)(p[i].delta - y0) -
+                   (icept + slope * (double)(p[i].dev - dc->dev0));
+        if (i == 0 || r < lowest)
+            lowest = r;
+    }
+    dc->slope = slope;
+    dc->off = y0 + (int64_t)(icept + lowest);
+}
+
+int
+devclock_observe(devclock_t *dc, int64_t dev_ns, uint64_t host_ns)
+{
+    int reset = 0;
+    if (dc->have && dev_ns + DEVCLOCK_RESET_NS < dc->last_dev) {
+        uint64_t resets = dc->resets + 1;
+        devclock_fmt_t fmt = dc->fmt;
+        devclock_init(dc);
+        dc->resets = resets;
+        dc->fmt = fmt;
+        reset = 1;
+    }
+    if (dev_ns > dc->last_dev || !dc->have)
+        dc->last_dev = dev_ns;
+    dc->samples++;
+
+    devclock_point_t pt = { dev_ns, (int64_t)host_ns - dev_ns };
+    int64_t bucket = dev_ns / DEVCLOCK_BUCKET_NS;
+    if (!dc->have) {
+        dc->have = 1;
+        dc->cur_bucket = bucket;
+        dc->cur = pt;
+        refit(dc);
+    } else if (bucket != dc->cur_bucket) {
+        dc->pts[dc->head] = dc->cur;
+        dc->head = (dc->head + 1) % DEVCLOCK_POINTS;
+        if (dc->npts < DEVCLOCK_POINTS)
+            dc->npts++;
+        dc->cur_bucket = bucket;
+        dc->cur = pt;
+        refit(dc);
+    } else if (pt.delta < dc->cur.delta) {
+        dc->cur = pt;
+        refit(dc);
+    }
+
+    uint64_t corr = devclock_map(dc, dev_ns);
+    if (host_ns > corr)
+        dc->lat_sum_ns += host_ns - corr;
+    return reset;
+}
+
+uint64_t
+devclock_map(const devclock_t *dc, int64_t dev_ns)
+{
+    return (uint64_t)(dev_ns + dc->off +
+                      (int64_t)(dc->slope * (double)(dev_ns - dc->dev0)));
+}
+
+int
+devclock_line(devclock_t *dc, const char *line, size_t len,
+              uint64_t arrival_ns, uint64_t *host_ns)
+{
+    int64_t dev;
+    devclock_fmt_t fmt = devclock_parse(line, len, &dev);
+    if (fmt == DEVCLOCK_NONE)
+        return -1;
+    dc->fmt = fmt;
+    int reset = devclock_observe(dc, dev, arrival_ns);
+    *host_ns = devclock_map(dc, dev);
+    return reset;
+}
+
+int
+devclock_lookup(const devclock_t *dc, const char *line, size_t len,
+                uint64_t *host_ns)
+{
+    int64_t dev;
+    if (!dc->have || devclock_parse(line, len, &dev) == DEVCLOCK_NONE)
+        return -1;
+    *host_ns = devclock_map(dc, dev);
+    return 0;
+}
+
+double
+devclock_drift_ppm(const devclock_t *dc)
+{
+    return -dc->slope * 1e6;
+}
@@ -0,0 +1,83 @@
+/* devclock.h -- Host <-> device clock model from in-band log timestamps */
+#ifndef DEVCLOCK_H
+#define DEVCLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEVCLOCK_POINTS     64          /* bucket minima kept for the fit */
+#define DEVCLOCK_BUCKET_NS  10000000000ll   /* 10 s of device time */
+#define DEVCLOCK_RESET_NS   100000000ll /* device time going back >100 ms */
+#define DEVCLOCK_MAX_DRIFT  500e-6      /* beyond any crystal: bad data */
+
+typedef enum {
+    DEVCLOCK_NONE,
+    DEVCLOCK_PRINTK,    /* Linux "[    1.234567] " */
+    DEVCLOCK_ZEPHYR,    /* "[00:00:01.234,567] " */
+    DEVCLOCK_TICKS,     /* ESP-IDF / FreeRTOS "I (1234) tag: " (ms) */
+} devclock_fmt_t;
+
+typedef struct {
+    int64_t dev;        /* device time, ns since its boot */
+    int64_t delta;      /* smallest host - device time seen around it */
+} devclock_point_t;
+
+/* Per-port model: host = dev + off + slope * (dev - dev0).
+ *
+ * A line reaches the host some adapter and USB latency after the device
+ * stamped it, never before, so host - dev is the clock offset plus a
+ * non-negative delay. The minimum of it over each DEVCLOCK_BUCKET_NS of
+ * device time is close to the true offset; a line fitted through those
+ * minima (and lowered onto the lowest of them) gives offset and drift.
+ * A device time that goes backwards means the device rebooted: the
+ * model starts over. */
+typedef struct {
+    devclock_fmt_t   fmt;           /* format of the last stamped line */
+    int              have;          /* samples since the last reset */
+    int64_t          last_dev;
+    devclock_point_t pts[DEVCLOCK_POINTS];  /* completed buckets, ring */
+    int              npts;
+    int              head;
+    int64_t          cur_bucket;
+    devclock_point_t cur;           /* minimum of the open bucket */
+    int64_t          dev0;          /* fitted model */
+    int64_t          off;
+    double           slope;
+    uint64_t         samples;
+    uint64_t         resets;
+    uint64_t         lat_sum_ns;    /* arrival - corrected, summed */
+} devclock_t;
+
+/* Reset to an empty model (keeps nothing, counters included). */
+void devclock_init(devclock_t *dc);
+
+/* The device timestamp a line starts with, in ns. Returns its format,
+ * or DEVCLOCK_NONE if the line carries none. */
+devclock_fmt_t devclock_parse(const char *line, size_t len, int64_t *dev_ns);
+
+/* Add a line stamped dev_ns by the device that started arriving at
+ * host_ns (mono_ns()). Returns 1 if it showed a device reset. */
+int devclock_observe(devclock_t *dc, int64_t dev_ns, uint64_t host_ns);
+
+/* Host mono_ns() time at which the device stamped dev_ns. */
+uint64_t devclock_map(const devclock_t *dc, int64_t dev_ns);
+
+/* Parse, observe and map one line. Returns -1 if the line has no
+ * device timestamp, 1 on a device reset, 0 otherwise; *host_ns is the
+ * corrected time of the line. */
+int devclock_line(devclock_t *dc, const char *line, size_t len,
+                  uint64_t arrival_ns, uint64_t *host_ns);
+
+/* Corrected time of a line without updating the model (another reader
+ * of the same port). Returns 0, or -1 if the line has no timestamp or
+ * the model no samples. */
+int devclock_lookup(const devclock_t *dc, const char *line, size_t len,
+                    uint64_t *host_ns);
+
+/* Drift in parts per million, + when the device clock runs fast. */
+double devclock_drift_ppm(const devclock_t *dc);
+
+/* "printk", "zephyr", "ticks" or "none". */
+const char *devclock_fmt_name(devclock_fmt_t f);
+
+#endif /* DEVCLOCK_H */
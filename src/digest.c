@@ -0,0 +1,328 @@
+/* digest.c -- Condensed per-port log for AI consumers.
+ *
+ * Consoles repeat themselves: heartbeats, polling loops, progress bars
+ * redrawn with '\r'. An agent that only needs to know what happened
+ * reads <label>.digest instead of <label>.log, where each run of similar
+ * lines is folded into its first line and a summary that points back at
+ * the raw log by offset, while anything that looks like an error is
+ * kept verbatim with its surroundings.
+ */
+#include "digest.h"
+#include "crash.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *const alert_words[] = {
+    "error", "fail", "fatal", "panic", "warn", "fault", "oops", "assert",
+    "exception", "abort", "timeout", "timed out", "bug:",
+};
+static const char alert_first[] = "efpwoatb";   /* their first letters */
+
+void
+digest_init(digest_t *d)
+{
+    memset(d, 0, sizeof(*d));
+    d->fd = -1;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Line classes                                                      */
+/* ------------------------------------------------------------------ */
+
+size_t
+digest_strip(const char *text, size_t len, char *out, size_t sz)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < len && n + 1 < sz; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == 0x1b) {
+            /* CSI "ESC [ params final", or a two-byte escape */
+            if (i + 1 < len && text[i + 1] == '[') {
+                i += 2;
+                while (i < len && !((unsigned char)text[i] >= 0x40 &&
+                                    (unsigned char)text[i] <= 0x7e))
+                    i++;
+            } else {
+                i++;
+            }
+            continue;
+        }
+        if (c == '\t')
+            out[n++] = ' ';
+        else if (c >= 0x20 && c != 0x7f)
+            out[n++] = (char)c;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+int
+digest_is_alert(const char *text, size_t len)
+{
+    char low[DIGEST_LINE];
+    size_t n = len < sizeof(low) - 1 ? len : sizeof(low) - 1;
+    for (size_t i = 0; i < n; i++)
+        low[i] = (char)(text[i] >= 'A' && text[i] <= 'Z' ? text[i] + 32
+                                                        : text[i]);
+    /* one pass: only positions starting some word are compared */
+    for (size_t i = 0; i < n; i++) {
+        if (!strchr(alert_first, low[i]) || low[i] == '\0')
+            continue;
+        for (size_t k = 0; k < sizeof(alert_words) / sizeof(alert_words[0]);
+             k++) {
+            size_t wl = strlen(alert_words[k]);
+            if (alert_words[k][0] == low[i] && wl <= n - i &&
+                memcmp(low + i, alert_words[k], wl) == 0)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/* "42%", "[=====>    ]", "########" */
+int
+digest_is_progress(const char *text, size_t len)
+{
+    int bar = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = text[i];
+        if (c == '%' && i > 0 && text[i - 1] >= '0' && text[i - 1] <= '9')
+            return 1;
+        if (c == '#' || c == '=' || c == '.') {
+            if (++bar >= 8)
+                return 1;
+        } else {
+            bar = 0;
+        }
+    }
+    return 0;
+}
+
+/* Similarity key: FNV-1a of the line with values masked */
+static uint64_t
+line_key(const char *text, size_t len)
+{
+    char norm[DIGEST_LINE];
+    size_t n = crash_normalize(text, len, norm, sizeof(norm));
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)norm[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Output                                                            */
+/* ------------------------------------------------------------------ */
+
+static void
+out_flush(digest_t *d)
+{
+    size_t off = 0;
+    while (off < d->out_len && d->fd >= 0) {
+        ssize_t n = write(d->fd, d->out + off, d->out_len - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            /* the raw log is what matters: give up on the digest */
+            fprintf(stderr, "digest: %s: %s, disabled\n", d->path,
+                    n < 0 ? strerror(errno) : "short write");
+            close(d->fd);
+            d->fd = -1;
+            break;
+        }
+        off += (size_t)n;
+    }
+    d->bytes_out += off;
+    d->out_len = 0;
+}
+
+static void
+out_put(digest_t *d, const char *s, size_t len)
+{
+    if (d->out_len + len > sizeof(d->out))
+        out_flush(d);
+    if (len > sizeof(d->out))
+        len = sizeof(d->out);
+    memcpy(d->out + d->out_len, s, len);
+    d->out_len += len;
+}
+
+static void
+out_line(digest_t *d, const char *ts, const char *text, size_t len,
+         const char *suffix)
+{
+    out_put(d, ts, strlen(ts));
+    out_put(d, text, len);
+    if (suffix)
+        out_put(d, suffix, strlen(suffix));
+    out_put(d, "\n", 1);
+    d->lines_out++;
+}
+
+/* Close the open run: its final state for progress, else a summary and
+ * the last line. */
+static void
+end_run(digest_t *d)
+{
+    if (!d->have_run)
+        return;
+    char note[96];
+    if (d->run_progress) {
+        if (d->run_count > 0)
+            snprintf(note, sizeof(note), "  [%ld updates]", d->run_count + 1);
+        out_line(d, d->held_ts, d->held, d->held_len,
+                 d->run_count > 0 ? note : NULL);
+    } else if (d->run_count > 1) {
+        int n = snprintf(note, sizeof(note),
+                         "... %ld similar lines (log %lld-%lld) ...",
+                         d->run_count - 1, d->run_off, d->held_off);
+        out_line(d, "", note, (size_t)n, NULL);
+        out_line(d, d->held_ts, d->held, d->held_len, NULL);
+    } else if (d->run_count == 1) {
+        out_line(d, d->held_ts, d->held, d->held_len, NULL);
+    }
+    d->have_run = 0;
+    d->run_count = 0;
+}
+
+static void
+hold(digest_t *d, const char *ts, const char *text, size_t len,
+     long long off)
+{
+    strlcpy_safe(d->held_ts, ts, sizeof(d->held_ts));
+    memcpy(d->held, text, len);
+    d->held_len = len;
+    d->held_off = off;
+}
+
+/* ------------------------------------------------------------------ */
+/*  API                                                               */
+/* ------------------------------------------------------------------ */
+
+int
+digest_open(digest_t *d, const char *path)
+{
+    if (d->fd >= 0)
+        digest_close(d);
+    strlcpy_safe(d->path, path, sizeof(d->path));
+    d->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (d->fd < 0) {
+        fprintf(stderr, "digest: cannot open %s: %s\n", path,
+                strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+void
+digest_line(digest_t *d, const char *ts, const char *text, size_t len,
+            long long off, uint64_t ns)
+{
+    char clean[DIGEST_LINE];
+    size_t n = digest_strip(text, len, clean, sizeof(clean));
+    d->lines_in++;
+    d->bytes_in += strlen(ts) + len + 1;
+    d->last_ns = ns;
+    if (n == 0)
+        return;                 /* blank lines neither show nor end a run */
+
+    uint64_t key = line_key(clean, n);
+    int alert = digest_is_alert(clean, n);
+    d->alerts += alert;
+
+    /* alerts are never folded, however often they repeat. Closing the
+     * open run writes its last line: that is the line before the alert,
+     * whether it was folded, a progress state or already out. */
+    if (alert) {
+        end_run(d);
+        out_line(d, ts, clean, n, NULL);
+        d->after = DIGEST_CONTEXT;
+        return;
+    }
+
+    /* a repeat folds into the open run */
+    if (d->have_run && key == d->run_hash) {
+        if (d->run_count++ == 0)
+            d->run_off = off;
+        hold(d, ts, clean, n, off);
+        return;
+    }
+
+    end_run(d);
+    d->have_run = 1;
+    d->run_hash = key;
+    d->run_start_ns = ns;
+    d->run_progress = 0;
+    if (d->after > 0) {
+        d->after--;             /* context after an alert: verbatim */
+    } else if (digest_is_progress(clean, n)) {
+        d->run_progress = 1;
+        hold(d, ts, clean, n, off);     /* only the final state counts */
+        return;
+    }
+    out_line(d, ts, clean, n, NULL);
+}
+
+void
+digest_marker(digest_t *d, const char *text, size_t len)
+{
+    end_run(d);
+    out_line(d, "", text, len, NULL);
+}
+
+void
+digest_reset(digest_t *d)
+{
+    d->have_run = 0;
+    d->run_count = 0;
+    d->after = 0;
+    d->out_len = 0;
+    if (d->fd >= 0 && ftruncate(d->fd, 0) < 0)
+        fprintf(stderr, "digest: cannot truncate %s: %s\n", d->path,
+                strerror(errno));
+}
+
+void
+digest_poll(digest_t *d, uint64_t now_ns)
+{
+    if (digest_pending(d)) {
+        if (d->run_progress &&
+            now_ns - d->last_ns >= (uint64_t)DIGEST_IDLE_MS * 1000000ull) {
+            end_run(d);
+        } else if (!d->run_progress && d->run_count > 1 &&
+                   now_ns - d->run_start_ns >=
+                   (uint64_t)DIGEST_HOLD_MS * 1000000ull) {
+            /* keep folding into a fresh run after the summary */
+            uint64_t key = d->run_hash;
+            end_run(d);
+            d->have_run = 1;
+            d->run_hash = key;
+            d->run_start_ns = now_ns;
+        }
+    }
+    if (d->out_len)
+        out_flush(d);
+}
+
+int
+digest_pending(const digest_t *d)
+{
+    return d->have_run && (d->run_progress || d->run_count > 0);
+}
+
+void
+digest_close(digest_t *d)
+{
+    end_run(d);
+    out_flush(d);
+    if (d->fd >= 0)
+        close(d->fd);
+    d->fd = -1;
+}
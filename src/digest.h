@@ -0,0 +1,91 @@
+/* digest.h -- Condensed per-port log for AI consumers */
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DIGEST_EXT        ".digest"   /* next to <label>.log */
+#define DIGEST_LINE       1024        /* longer lines are cut */
+#define DIGEST_CONTEXT    3           /* lines kept as-is after an alert */
+#define DIGEST_IDLE_MS    1000        /* progress shows its final state */
+#define DIGEST_HOLD_MS    60000       /* a repeat run is summarized */
+#define DIGEST_BUF_SIZE   8192
+
+/* Written as lines go by, never by reading the log back:
+ *   - ANSI escapes and control characters are stripped, blank lines
+ *     dropped;
+ *   - a run of similar lines (equal once numbers, addresses and [..]
+ *     groups are masked) keeps its first line, then one summary with the
+ *     log offsets of the run and the last line;
+ *   - a run of progress lines (percentages, bars) keeps only its final
+ *     state, with the number of updates;
+ *   - error/warning lines are kept verbatim and never folded, with the
+ *     line before them (the open run's last line, written when the
+ *     alert closes it) and DIGEST_CONTEXT lines after;
+ *   - daemon markers are kept.
+ * Output is buffered and written by digest_poll() once per loop. */
+typedef struct {
+    int      fd;
+    char     path[512];
+
+    int      have_run;        /* a run is open */
+    uint64_t run_hash;        /* its similarity key */
+    int      run_progress;
+    long     run_count;       /* lines after its first */
+    long long run_off;        /* log offset of its second line */
+    uint64_t run_start_ns;
+    uint64_t last_ns;
+    char     held_ts[64];     /* its last line, not yet written */
+    char     held[DIGEST_LINE];
+    size_t   held_len;
+    long long held_off;
+    int      after;           /* lines still kept after an alert */
+
+    char     out[DIGEST_BUF_SIZE];
+    size_t   out_len;
+
+    uint64_t lines_in;
+    uint64_t bytes_in;
+    uint64_t lines_out;
+    uint64_t bytes_out;
+    uint64_t alerts;
+} digest_t;
+
+/* Reset to a closed, empty digest. */
+void digest_init(digest_t *d);
+
+/* Start writing the digest to path (appending); a digest open on another
+ * file is finished first. Returns -1 if the file cannot be opened. */
+int digest_open(digest_t *d, const char *path);
+
+/* Condense one log line: ts is its "[timestamp] " prefix (may be ""),
+ * off its offset in the log, ns mono_ns() of its arrival. */
+void digest_line(digest_t *d, const char *ts, const char *text, size_t len,
+                 long long off, uint64_t ns);
+
+/* A daemon marker line ("--- ... ---"): kept as-is. */
+void digest_marker(digest_t *d, const char *text, size_t len);
+
+/* The log was truncated: so is the digest. */
+void digest_reset(digest_t *d);
+
+/* Write what is buffered; end a progress run quiet for DIGEST_IDLE_MS
+ * and summarize a repeat run open for DIGEST_HOLD_MS. */
+void digest_poll(digest_t *d, uint64_t now_ns);
+
+/* A run is being held back: digest_poll() has work to do later. */
+int digest_pending(const digest_t *d);
+
+/* Write everything out and close the file. */
+void digest_close(digest_t *d);
+
+/* Copy text without ANSI escape sequences and control characters.
+ * Returns the output length. */
+size_t digest_strip(const char *text, size_t len, char *out, size_t sz);
+
+/* Heuristics, exposed for tests. */
+int digest_is_alert(const char *text, size_t len);
+int digest_is_progress(const char *text, size_t len);
+
+#endif /* DIGEST_H */
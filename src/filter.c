@@ -0,0 +1,175 @@
+/* filter.c -- Per-port keep/drop line filters applied before the log file.
+ *
+ * Heartbeat and telemetry lines can make up most of a log without ever
+ * being read. Each port may carry an ordered list of keep/drop rules;
+ * every completed line is decided by the first rule that matches it
+ * before it is staged for the file. The unanchored patterns are compiled
+ * into a single dense Aho-Corasick automaton, so one pass over the line
+ * finds the lowest-numbered matching rule.
+ */
+#include "filter.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_STATE 0xffff
+
+static const char *const action_names[] = { "keep", "drop" };
+
+void
+filter_init(filter_t *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->match_all = FILTER_NONE;
+}
+
+int
+filter_add(filter_t *f, filter_action_t action, const char *pattern)
+{
+    if (f->nrules >= FILTER_MAX_RULES || pattern[0] == '\0')
+        return -1;
+    f->action[f->nrules] = action;
+    strlcpy_safe(f->pattern[f->nrules], pattern, sizeof(f->pattern[0]));
+    f->nrules++;
+    return 0;
+}
+
+static int
+unanchored(const char *pat)
+{
+    return pat[0] != '^' && strcmp(pat, "*") != 0;
+}
+
+int
+filter_compile(filter_t *f)
+{
+    filter_free(f);
+    f->match_all = FILTER_NONE;
+
+    size_t states = 1;
+    for (int i = 0; i < f->nrules; i++) {
+        if (strcmp(f->pattern[i], "*") == 0 && f->match_all == FILTER_NONE)
+            f->match_all = (uint8_t)i;
+        if (unanchored(f->pattern[i]))
+            states += strlen(f->pattern[i]);
+    }
+
+    f->next = malloc(states * 256 * sizeof(uint16_t));
+    f->first = malloc(states);
+    int *fail = malloc(states * sizeof(int));
+    int *queue = malloc(states * sizeof(int));
+    if (!f->next || !f->first || !fail || !queue) {
+        free(fail);
+        free(queue);
+        filter_free(f);
+        return -1;
+    }
+    memset(f->next, 0xff, states * 256 * sizeof(uint16_t));
+    memset(f->first, FILTER_NONE, states);
+
+    /* trie */
+    int n = 1;
+    for (int i = 0; i < f->nrules; i++) {
+        if (!unanchored(f->pattern[i]))
+            continue;
+        int s = 0;
+        for (const unsigned char *p = (const unsigned char *)f->pattern[i];
+             *p; p++) {
+            uint16_t *t = &f->next[(size_t)s * 256 + *p];
+            if (*t == NO_STATE)
+                *t = (uint16_t)n++;
+            s = *t;
+        }
+        if (f->first[s] > i)
+            f->first[s] = (uint8_t)i;
+    }
+
+    /* failure links, folded into a full transition table */
+    int head = 0, tail = 0;
+    for (int c = 0; c < 256; c++) {
+        uint16_t *t = &f->next[c];
+        if (*t == NO_STATE) {
+            *t = 0;
+        } else {
+            fail[*t] = 0;
+            queue[tail++] = *t;
+        }
+    }
+    while (head < tail) {
+        int s = queue[head++];
+        if (f->first[fail[s]] < f->first[s])
+            f->first[s] = f->first[fail[s]];
+        for (int c = 0; c < 256; c++) {
+            uint16_t *t = &f->next[(size_t)s * 256 + c];
+            uint16_t via_fail = f->next[(size_t)fail[s] * 256 + c];
+            if (*t == NO_STATE) {
+                *t = via_fail;
+            } else {
+                fail[*t] = via_fail;
+                queue[tail++] = *t;
+            }
+        }
+    }
+
+    free(fail);
+    free(queue);
+    f->nstates = n;
+    return 0;
+}
+
+int
+filter_match(const filter_t *f, const char *line, size_t len)
+{
+    unsigned best = f->match_all;
+
+    if (f->next) {
+        int s = 0;
+        for (size_t i = 0; i < len && best > 0; i++) {
+            s = f->next[(size_t)s * 256 + (unsigned char)line[i]];
+            if (f->first[s] < best)
+                best = f->first[s];
+        }
+    }
+
+    for (int i = 0; i < f->nrules && (unsigned)i < best; i++) {
+        const char *pat = f->pattern[i];
+        if (pat[0] != '^')
+            continue;
+        size_t plen = strlen(pat + 1);
+        if (plen <= len && memcmp(line, pat + 1, plen) == 0)
+            best = (unsigned)i;
+    }
+
+    return best == FILTER_NONE ? -1 : (int)best;
+}
+
+int
+filter_drop(filter_t *f, const char *line, size_t len)
+{
+    int rule = filter_match(f, line, len);
+    if (rule < 0)
+        return 0;
+    f->hits[rule]++;
+    if (f->action[rule] != FILTER_DROP)
+        return 0;
+    f->dropped_lines++;
+    f->dropped_bytes += len + 1;
+    return 1;
+}
+
+void
+filter_free(filter_t *f)
+{
+    free(f->next);
+    free(f->first);
+    f->next = NULL;
+    f->first = NULL;
+    f->nstates = 0;
+}
+
+const char *
+filter_action_name(filter_action_t a)
+{
+    return action_names[a];
+}
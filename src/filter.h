@@ -0,0 +1,53 @@
+/* filter.h -- Per-port keep/drop line filters applied before the log file */
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FILTER_MAX_RULES 16
+#define FILTER_NONE      0xff
+
+typedef enum { FILTER_KEEP, FILTER_DROP } filter_action_t;
+
+/* Rules are tried in order and the first one that matches a line decides
+ * it; a line no rule matches is kept. A pattern matches anywhere in the
+ * line, "^text" only at its start, and "*" matches every line. */
+typedef struct {
+    int             nrules;
+    filter_action_t action[FILTER_MAX_RULES];
+    char            pattern[FILTER_MAX_RULES][128];
+    uint64_t        hits[FILTER_MAX_RULES];   /* lines each rule decided */
+    uint64_t        dropped_lines;
+    uint64_t        dropped_bytes;
+
+    /* compiled: one Aho-Corasick automaton over the unanchored patterns,
+     * so a line is scanned once whatever the number of rules */
+    int             nstates;
+    uint16_t       *next;          /* nstates x 256 transitions */
+    uint8_t        *first;         /* lowest rule ending in each state */
+    uint8_t         match_all;     /* lowest "*" rule, or FILTER_NONE */
+} filter_t;
+
+/* Start an empty filter. */
+void filter_init(filter_t *f);
+
+/* Append a rule. Returns 0, or -1 if the filter is full. */
+int filter_add(filter_t *f, filter_action_t action, const char *pattern);
+
+/* Build the matcher after the last filter_add(). Returns 0 on success. */
+int filter_compile(filter_t *f);
+
+/* Index of the rule that decides a line, or -1 if none matches. */
+int filter_match(const filter_t *f, const char *line, size_t len);
+
+/* Decide one completed line and count it. Returns 1 if it is dropped. */
+int filter_drop(filter_t *f, const char *line, size_t len);
+
+/* Free the compiled matcher. */
+void filter_free(filter_t *f);
+
+/* "keep" or "drop". */
+const char *filter_action_name(filter_action_t a);
+
+#endif /* FILTER_H */
@@ -16,6 +16,7 @@
 
 /* Which backend we ended up using */
 static enum { HP_NETLINK, HP_INOTIFY } hp_mode;
+static char hp_dev_root[256] = "/dev";
 
 int
 hotplug_is_monitored(const char *devname)
@@ -83,6 +84,15 @@ hotplug_init(void)
     return -1;
 }
 
+int
+hotplug_init_fd(int fd, const char *dev_root)
+{
+    hp_mode = HP_NETLINK;
+    if (dev_root)
+        strlcpy_safe(hp_dev_root, dev_root, sizeof(hp_dev_root));
+    return fd;
+}
+
 /* Parse a netlink KOBJECT_UEVENT message.
  * The message is a sequence of NUL-terminated strings:
  *   add@/devices/.../ttyUSB0\0
@@ -129,7 +139,8 @@ parse_netlink(const char *buf, size_t len, hotplug_event_t *ev)
         return 0;
 
     strlcpy_safe(ev->devname, devname, sizeof(ev->devname));
-    snprintf(ev->devpath, sizeof(ev->devpath), "/dev/%s", devname);
+    snprintf(ev->devpath, sizeof(ev->devpath), "%.190s/%.63s", hp_dev_root,
+             devname);
     return 1;
 }
 
@@ -176,9 +187,9 @@ hotplug_read(int fd, hotplug_event_t *ev)
 
     if (hp_mode == HP_NETLINK) {
         char buf[8192];
-        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
         if (n <= 0)
-            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+            return -1;
         return parse_netlink(buf, (size_t)n, ev);
     }
 
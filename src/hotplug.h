@@ -18,8 +18,14 @@ typedef struct {
  * Returns the fd to add to epoll, or -1 on error. */
 int hotplug_init(void);
 
+/* Use an existing fd carrying netlink-format uevent datagrams (e.g. one
+ * end of a SOCK_SEQPACKET socketpair) instead of the kernel socket, with
+ * device nodes under dev_root (NULL = "/dev"). Returns fd. */
+int hotplug_init_fd(int fd, const char *dev_root);
+
 /* Read and parse a hotplug event from the fd.
- * Returns 1 if a relevant tty event was parsed, 0 if irrelevant, -1 on error. */
+ * Returns 1 if a relevant tty event was parsed, 0 if irrelevant, -1 on
+ * error or when no event is queued (errno EAGAIN). */
 int hotplug_read(int fd, hotplug_event_t *ev);
 
 /* Check if a device name matches our monitored patterns. */
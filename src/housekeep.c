@@ -0,0 +1,393 @@
+/* housekeep.c -- Normal-priority worker thread for slow housekeeping.
+ *
+ * The capture loop may run pinned and under SCHED_FIFO/RR. Anything that
+ * can block on the filesystem for a long time -- status.json rewrites,
+ * crash index appends, session pruning, every fdatasync -- is queued
+ * here instead and done by one thread with the default policy, in FIFO
+ * order.
+ */
+#include "housekeep.h"
+#include "crash.h"
+#include "log.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef enum { JOB_WRITE, JOB_APPEND, JOB_PRUNE, JOB_SYNC } job_type_t;
+
+typedef struct job {
+    struct job *next;
+    job_type_t  type;
+    char        path[512];
+    char       *data;             /* JOB_WRITE/APPEND text, JOB_SYNC fds */
+    uint64_t   *ids;              /* JOB_SYNC tags */
+    size_t      len;
+    int         keep;
+} job_t;
+
+static pthread_t       hk_thread;
+static pthread_mutex_t hk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  hk_cond = PTHREAD_COND_INITIALIZER;
+static job_t          *hk_head, *hk_tail;
+static int             hk_running;
+static int             hk_stopping;
+
+static uint64_t        hk_batches, hk_last_ns, hk_max_ns;
+
+/* finished syncs, a ring the capture thread empties */
+static housekeep_synced_t hk_done[HOUSEKEEP_SYNC_RESULTS];
+static unsigned        hk_done_head, hk_done_len;
+
+static void
+write_file(const char *path, const char *data, size_t len)
+{
+    char tmp[600];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, getpid());
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW |
+                       O_CLOEXEC, 0644);
+    if (fd < 0)
+        return;
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(fd, data + off, len - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        off += (size_t)n;
+    }
+
+    /* on a full disk keep the last complete file rather than
+     * replacing it with a truncated one */
+    if (close(fd) != 0 || off < len) {
+        unlink(tmp);
+        return;
+    }
+    rename(tmp, path);
+}
+
+static void
+append_file(const char *path, const char *data, size_t len)
+{
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW |
+                        O_CLOEXEC, 0644);
+    if (fd < 0 || write(fd, data, len) != (ssize_t)len)
+        fprintf(stderr, "housekeep: cannot append to %s: %s\n", path,
+                strerror(errno));
+    if (fd >= 0)
+        close(fd);
+}
+
+static void
+prune(int keep)
+{
+    if (log_prune_sessions(keep) <= 0)
+        return;
+    char index[512];
+    snprintf(index, sizeof(index), "%s/%s", LOG_BASE_DIR, CRASH_INDEX);
+    crash_prune_index(index, LOG_BASE_DIR);
+}
+
+static void
+sync_done(uint64_t id, uint64_t ns, int err)
+{
+    unsigned slot = (hk_done_head + hk_done_len) % HOUSEKEEP_SYNC_RESULTS;
+    if (hk_done_len == HOUSEKEEP_SYNC_RESULTS)
+        hk_done_head = (hk_done_head + 1) % HOUSEKEEP_SYNC_RESULTS;
+    else
+        hk_done_len++;
+    hk_done[slot].id = id;
+    hk_done[slot].ns = ns;
+    hk_done[slot].err = err;
+}
+
+static void
+sync_batch(const int *fds, const uint64_t *ids, int n)
+{
+    uint64_t t0 = mono_ns();
+    for (int i = 0; i < n; i++) {
+        uint64_t t = mono_ns();
+        int err = fdatasync(fds[i]) < 0 ? errno : 0;
+        close(fds[i]);
+        pthread_mutex_lock(&hk_lock);
+        sync_done(ids[i], mono_ns() - t, err);
+        pthread_mutex_unlock(&hk_lock);
+    }
+    uint64_t took = mono_ns() - t0;
+
+    pthread_mutex_lock(&hk_lock);
+    hk_batches++;
+    hk_last_ns = took;
+    if (took > hk_max_ns)
+        hk_max_ns = took;
+    pthread_mutex_unlock(&hk_lock);
+}
+
+static void
+free_job(job_t *job)
+{
+    free(job->data);
+    free(job->ids);
+    free(job);
+}
+
+static void
+run_job(job_t *job)
+{
+    switch (job->type) {
+    case JOB_WRITE:
+        write_file(job->path, job->data, job->len);
+        break;
+    case JOB_APPEND:
+        append_file(job->path, job->data, job->len);
+        break;
+    case JOB_PRUNE:
+        prune(job->keep);
+        break;
+    case JOB_SYNC:
+        sync_batch((const int *)job->data, job->ids, (int)job->len);
+        break;
+    }
+    free_job(job);
+}
+
+static void *
+worker(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&hk_lock);
+    for (;;) {
+        while (!hk_head && !hk_stopping)
+            pthread_cond_wait(&hk_cond, &hk_lock);
+        job_t *job = hk_head;
+        if (!job)
+            break;                       /* stopping, queue empty */
+        hk_head = job->next;
+        if (!hk_head)
+            hk_tail = NULL;
+        pthread_mutex_unlock(&hk_lock);
+        run_job(job);
+        pthread_mutex_lock(&hk_lock);
+    }
+    pthread_mutex_unlock(&hk_lock);
+    return NULL;
+}
+
+int
+housekeep_start(void)
+{
+    if (hk_running)
+        return 0;
+
+    /* explicit default policy: never inherit a real-time one */
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+
+    /* signals are consumed through signalfd by the capture thread;
+     * the worker must not be a candidate for their delivery */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+
+    hk_stopping = 0;
+    int err = pthread_create(&hk_thread, &attr, worker, NULL);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        fprintf(stderr, "housekeep: cannot start worker: %s "
+                "(running jobs inline)\n", strerror(err));
+        return -1;
+    }
+    hk_running = 1;
+    return 0;
+}
+
+void
+housekeep_stop(void)
+{
+    if (!hk_running)
+        return;
+    pthread_mutex_lock(&hk_lock);
+    hk_stopping = 1;
+    pthread_cond_signal(&hk_cond);
+    pthread_mutex_unlock(&hk_lock);
+    pthread_join(hk_thread, NULL);
+    hk_running = 0;
+}
+
+/* Whether a sync of id is queued and not started yet. */
+static int
+sync_queued(uint64_t id)
+{
+    for (job_t *q = hk_head; q; q = q->next) {
+        if (q->type != JOB_SYNC)
+            continue;
+        for (size_t i = 0; i < q->len; i++)
+            if (q->ids[i] == id)
+                return 1;
+    }
+    return 0;
+}
+
+/* Queue a job, or run it here if there is no worker. */
+static void
+submit(job_t *job)
+{
+    if (!hk_running) {
+        run_job(job);
+        return;
+    }
+
+    pthread_mutex_lock(&hk_lock);
+    if (job->type == JOB_SYNC) {
+        /* a file still waiting for its sync needs no second one: the
+         * queued one covers everything written until it runs */
+        int *fds = (int *)job->data;
+        size_t keep = 0;
+        for (size_t i = 0; i < job->len; i++) {
+            if (sync_queued(job->ids[i])) {
+                close(fds[i]);
+                continue;
+            }
+            fds[keep] = fds[i];
+            job->ids[keep++] = job->ids[i];
+        }
+        job->len = keep;
+        if (keep == 0) {
+            pthread_mutex_unlock(&hk_lock);
+            free_job(job);
+            return;
+        }
+    }
+    if (job->type == JOB_WRITE) {
+        /* only the newest contents of a file matter */
+        for (job_t *q = hk_head; q; q = q->next) {
+            if (q->type == JOB_WRITE && strcmp(q->path, job->path) == 0) {
+                free(q->data);
+                q->data = job->data;
+                q->len = job->len;
+                pthread_mutex_unlock(&hk_lock);
+                free(job);
+                return;
+            }
+        }
+    }
+    job->next = NULL;
+    if (hk_tail)
+        hk_tail->next = job;
+    else
+        hk_head = job;
+    hk_tail = job;
+    pthread_cond_signal(&hk_cond);
+    pthread_mutex_unlock(&hk_lock);
+}
+
+static job_t *
+new_job(job_type_t type)
+{
+    job_t *job = calloc(1, sizeof(*job));
+    if (job)
+        job->type = type;
+    return job;
+}
+
+void
+housekeep_write_file(const char *path, char *data, size_t len)
+{
+    job_t *job = new_job(JOB_WRITE);
+    if (!job) {
+        free(data);
+        return;
+    }
+    strlcpy_safe(job->path, path, sizeof(job->path));
+    job->data = data;
+    job->len = len;
+    submit(job);
+}
+
+void
+housekeep_append(const char *path, char *data, size_t len)
+{
+    job_t *job = new_job(JOB_APPEND);
+    if (!job) {
+        free(data);
+        return;
+    }
+    strlcpy_safe(job->path, path, sizeof(job->path));
+    job->data = data;
+    job->len = len;
+    submit(job);
+}
+
+void
+housekeep_prune(int keep)
+{
+    job_t *job = new_job(JOB_PRUNE);
+    if (!job)
+        return;
+    job->keep = keep;
+    submit(job);
+}
+
+void
+housekeep_sync(const int *fds, const uint64_t *ids, int n)
+{
+    if (n <= 0)
+        return;
+    job_t *job = new_job(JOB_SYNC);
+    int *dups = malloc((size_t)n * sizeof(int));
+    uint64_t *tags = malloc((size_t)n * sizeof(uint64_t));
+    if (!job || !dups || !tags) {
+        free(job);
+        free(dups);
+        free(tags);
+        return;
+    }
+
+    int ndup = 0;
+    for (int i = 0; i < n; i++) {
+        int fd = fcntl(fds[i], F_DUPFD_CLOEXEC, 0);
+        if (fd >= 0) {
+            dups[ndup] = fd;
+            tags[ndup++] = ids[i];
+        }
+    }
+    job->data = (char *)dups;
+    job->ids = tags;
+    job->len = (size_t)ndup;
+    submit(job);
+}
+
+int
+housekeep_sync_results(housekeep_synced_t *out, int max)
+{
+    int n = 0;
+    pthread_mutex_lock(&hk_lock);
+    while (n < max && hk_done_len > 0) {
+        out[n++] = hk_done[hk_done_head];
+        hk_done_head = (hk_done_head + 1) % HOUSEKEEP_SYNC_RESULTS;
+        hk_done_len--;
+    }
+    pthread_mutex_unlock(&hk_lock);
+    return n;
+}
+
+void
+housekeep_sync_stats(uint64_t *batches, uint64_t *last_ns, uint64_t *max_ns)
+{
+    pthread_mutex_lock(&hk_lock);
+    *batches = hk_batches;
+    *last_ns = hk_last_ns;
+    *max_ns = hk_max_ns;
+    pthread_mutex_unlock(&hk_lock);
+}
@@ -0,0 +1,54 @@
+/* housekeep.h -- Normal-priority worker thread for slow housekeeping */
+#ifndef HOUSEKEEP_H
+#define HOUSEKEEP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Start the worker. Call before the capture thread raises its own
+ * scheduling priority or CPU affinity: the worker must keep the default
+ * policy so file I/O never competes with capture at real-time priority.
+ * Without a worker (not started, or start failed) every job runs
+ * synchronously in the caller. Returns 0 on success. */
+int housekeep_start(void);
+
+/* Finish queued jobs and join the worker. */
+void housekeep_stop(void);
+
+/* Atomically replace path with data (via path.tmp + rename). Takes
+ * ownership of data (malloc'd). A write to the same path that is still
+ * queued is superseded. */
+void housekeep_write_file(const char *path, char *data, size_t len);
+
+/* Append data to path in one O_APPEND write, so lines from several
+ * writers never interleave. Takes ownership of data (malloc'd). */
+void housekeep_append(const char *path, char *data, size_t len);
+
+/* Remove old session directories (log_prune_sessions), then the crash
+ * index entries of the sessions removed (crash_prune_index). */
+void housekeep_prune(int keep);
+
+#define HOUSEKEEP_SYNC_RESULTS 256  /* finished syncs kept until taken */
+
+/* One fdatasync the worker finished. */
+typedef struct {
+    uint64_t id;                  /* tag the fd was queued with */
+    uint64_t ns;                  /* how long fdatasync took */
+    int      err;                 /* errno, 0 if it succeeded */
+} housekeep_synced_t;
+
+/* fdatasync every fd as one group-commit batch; ids[i] tags fds[i] in
+ * the results. The fds are dup'd, so the caller may close its own
+ * copies right away. */
+void housekeep_sync(const int *fds, const uint64_t *ids, int n);
+
+/* Take up to max finished syncs, oldest first, so the owner of each fd
+ * can account for it. Returns how many were taken. If more than
+ * HOUSEKEEP_SYNC_RESULTS pile up, the oldest are dropped. */
+int housekeep_sync_results(housekeep_synced_t *out, int max);
+
+/* Group-commit batch statistics. */
+void housekeep_sync_stats(uint64_t *batches, uint64_t *last_ns,
+                          uint64_t *max_ns);
+
+#endif /* HOUSEKEEP_H */
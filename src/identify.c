@@ -16,6 +16,18 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+static char sysfs_root[256] = "/sys";
+static char dev_root[256] = "/dev";
+
+void
+identify_set_roots(const char *sys, const char *dev)
+{
+    if (sys)
+        strlcpy_safe(sysfs_root, sys, sizeof(sysfs_root));
+    if (dev)
+        strlcpy_safe(dev_root, dev, sizeof(dev_root));
+}
+
 /* Extract the USB bus path (e.g. "1-6.2") from a sysfs device path.
  * Looks for pattern /usbN/<path>/ in the resolved sysfs path. */
 static void
@@ -62,7 +74,7 @@ identify_port(const char *dev_path, tty_port_t *port)
     char syslink[512];
     char resolved[PATH_MAX];
     snprintf(syslink, sizeof(syslink),
-             "/sys/class/tty/%s/device", port->tty_name);
+             "%s/class/tty/%s/device", sysfs_root, port->tty_name);
 
     if (realpath(syslink, resolved) == NULL) {
         /* no sysfs entry -- might be a virtual tty */
@@ -163,10 +175,15 @@ scan_all_ports(tty_port_t *ports, int max_ports)
 
     memset(&g, 0, sizeof(g));
 
-    glob("/dev/ttyUSB*",  flags, NULL, &g);
-    flags |= GLOB_APPEND;
-    glob("/dev/ttyACM*",  flags, NULL, &g);
-    glob("/dev/ttyUART*", flags, NULL, &g);
+    static const char *const patterns[] = {
+        "ttyUSB*", "ttyACM*", "ttyUART*"
+    };
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        char pat[300];
+        snprintf(pat, sizeof(pat), "%s/%s", dev_root, patterns[i]);
+        glob(pat, flags, NULL, &g);
+        flags |= GLOB_APPEND;
+    }
 
     for (size_t i = 0; i < g.gl_pathc && n < max_ports; i++) {
         if (identify_port(g.gl_pathv[i], &ports[n]) == 0)
@@ -221,6 +238,13 @@ get_device_label(tty_port_t *port)
     strlcpy_safe(port->label, port->tty_name, sizeof(port->label));
 }
 
+void
+port_group_key(const tty_port_t *port, char *key, size_t sz)
+{
+    snprintf(key, sz, "%04x:%04x:%s:%s", port->vid, port->pid,
+             port->serial, port->usb_path);
+}
+
 int
 group_ports(tty_port_t *ports, int nports,
             device_group_t *groups, int max_groups)
@@ -228,11 +252,8 @@ group_ports(tty_port_t *ports, int nports,
     int ngroups = 0;
 
     for (int i = 0; i < nports; i++) {
-        /* build group key: vid:pid:serial:usb_path */
         char key[256];
-        snprintf(key, sizeof(key), "%04x:%04x:%s:%s",
-                 ports[i].vid, ports[i].pid,
-                 ports[i].serial, ports[i].usb_path);
+        port_group_key(&ports[i], key, sizeof(key));
 
         /* find existing group */
         int found = -1;
@@ -3,6 +3,7 @@
 #define IDENTIFY_H
 
 #include "devices.h"
+#include <stddef.h>
 #include <stdint.h>
 
 #define MAX_PORTS       64
@@ -39,12 +40,21 @@ typedef struct {
 
 #define MAX_BOARD_IDS 32
 
+/* Override where sysfs and device nodes are looked up (default "/sys"
+ * and "/dev"), so tests can point identification at synthetic trees.
+ * NULL leaves a root unchanged. */
+void identify_set_roots(const char *sysfs_root, const char *dev_root);
+
 /* Scan all /dev/ttyUSB*, ttyACM*, ttyUART* ports. Returns count. */
 int scan_all_ports(tty_port_t *ports, int max_ports);
 
 /* Identify a single port by reading sysfs. Returns 0 on success. */
 int identify_port(const char *dev_path, tty_port_t *port);
 
+/* Key of the USB device a port belongs to, "vid:pid:serial:usb_path":
+ * the interfaces of one multi-UART chip share it. */
+void port_group_key(const tty_port_t *port, char *key, size_t sz);
+
 /* Group ports by parent USB device. Returns number of groups. */
 int group_ports(tty_port_t *ports, int nports,
                 device_group_t *groups, int max_groups);
@@ -0,0 +1,268 @@
+/* integrity.c -- End-to-end data-integrity probe for the capture path.
+ *
+ * A pattern source (firmware or a PTY "board" in the tests) emits
+ * sequence-numbered, CRC-protected frames. The daemon verifies them on
+ * the raw read() chunks, before any log processing, and counts gaps,
+ * duplicates and corruption. Each error is correlated with the size of
+ * the read that exposed it, recent event-loop stalls and the kernel's
+ * overrun counters. The fastest error-free throughput window is kept as
+ * well; it is a rate the source reached without loss, not the limit of
+ * the port (PING/BW search for that).
+ */
+#include "integrity.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IG_MAX_GAP 1000000u   /* larger jumps are treated as a restart */
+
+const size_t integrity_read_bucket_max[IG_READ_BUCKETS] = {
+    1, 15, 63, 255, 1023, 4095, (size_t)-1
+};
+
+void
+integrity_init(integrity_t *ig, size_t full_read, int fd)
+{
+    memset(ig, 0, sizeof(*ig));
+    ig->enabled = 1;
+    ig->full_read = full_read;
+    ig->win_start_ns = mono_ns();
+    if (serial_get_icount(fd, &ig->icount_base) == 0) {
+        ig->have_icount = 1;
+        ig->icount_last = ig->icount_base;
+    }
+}
+
+size_t
+integrity_frame(char *buf, size_t sz, uint32_t seq, int payload_len)
+{
+    char body[IG_LINE_MAX];
+    if (payload_len < 1 || payload_len > IG_LINE_MAX - 32)
+        return 0;
+
+    int n = snprintf(body, sizeof(body), "%08x ", seq);
+    for (int i = 0; i < payload_len; i++)
+        body[n + i] = (char)('A' + (seq + (uint32_t)i) % 26);
+    n += payload_len;
+
+    uint32_t crc = crc32_update(0, body, (size_t)n);
+    int total = snprintf(buf, sz, IG_MAGIC "%.*s %08x\n", n, body, crc);
+    if (total < 0 || (size_t)total >= sz)
+        return 0;
+    return (size_t)total;
+}
+
+/* Parse "UMIP <seq> <payload> <crc>"; returns 0 and the sequence
+ * number if the frame is intact. */
+static int
+parse_frame(const char *line, int len, uint32_t *seq)
+{
+    const int magic_len = (int)sizeof(IG_MAGIC) - 1;
+    if (len < magic_len + 8 + 1 + 1 + 1 + 8)
+        return -1;
+
+    const char *body = line + magic_len;
+    int body_len = len - magic_len - 9;      /* strip " <crc>" */
+    if (body[body_len] != ' ' || body[8] != ' ')
+        return -1;
+
+    char hex[9];
+    memcpy(hex, body + body_len + 1, 8);
+    hex[8] = '\0';
+    char *end;
+    uint32_t crc = (uint32_t)strtoul(hex, &end, 16);
+    if (*end != '\0')
+        return -1;
+    if (crc32_update(0, body, (size_t)body_len) != crc)
+        return -1;
+
+    memcpy(hex, body, 8);
+    *seq = (uint32_t)strtoul(hex, &end, 16);
+    return *end == '\0' ? 0 : -1;
+}
+
+static void
+count_error(integrity_t *ig, size_t chunk_len)
+{
+    ig->win_errors++;
+    if (chunk_len >= ig->full_read)
+        ig->errors_on_full_read++;
+    if (ig->stall_pending)
+        ig->errors_after_stall++;
+}
+
+static void
+check_line(integrity_t *ig, size_t chunk_len)
+{
+    const char *line = ig->line;
+    int len = ig->line_len;
+
+    /* find the last frame start: a lost tail merges two frames */
+    const char *start = NULL;
+    for (const char *p = line; (p = memmem(p, (size_t)(line + len - p),
+                                            IG_MAGIC, 5)) != NULL; p++)
+        start = p;
+    if (!start)
+        return;                      /* ordinary console output */
+
+    if (start != line) {
+        ig->corrupt++;
+        ig->corrupt_unmatched++;
+        count_error(ig, chunk_len);
+    }
+    len -= (int)(start - line);
+
+    uint32_t seq;
+    if (parse_frame(start, len, &seq) < 0) {
+        ig->corrupt++;
+        ig->corrupt_unmatched++;
+        count_error(ig, chunk_len);
+        return;
+    }
+
+    /* the corrupt frames since the last good one filled part of any gap:
+     * they arrived, so they are not also lost */
+    uint64_t mangled = ig->corrupt_unmatched;
+    ig->corrupt_unmatched = 0;
+    if (ig->synced && seq != ig->next_seq) {
+        uint32_t ahead = seq - ig->next_seq;
+        uint32_t behind = ig->next_seq - seq;
+        if (ahead < IG_MAX_GAP) {
+            if (ahead > mangled) {
+                ig->frames_lost += ahead - mangled;
+                ig->gap_events++;
+                count_error(ig, chunk_len);
+            }
+        } else if (behind <= 1024) {
+            ig->duplicates++;
+            count_error(ig, chunk_len);
+            return;
+        } else {
+            ig->resyncs++;
+        }
+    }
+
+    ig->synced = 1;
+    ig->next_seq = seq + 1;
+    ig->frames_ok++;
+    ig->stall_pending = 0;
+}
+
+void
+integrity_feed(integrity_t *ig, const char *data, size_t len,
+               uint64_t ts_ns)
+{
+    (void)ts_ns;
+    if (!ig->enabled || len == 0)
+        return;
+
+    ig->bytes += len;
+    ig->win_bytes += len;
+    int b = 0;
+    if (len >= ig->full_read)
+        b = IG_READ_BUCKETS - 1;
+    else
+        while (len > integrity_read_bucket_max[b])
+            b++;
+    ig->read_hist[b]++;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        if (c == '\n' || c == '\r') {
+            if (ig->line_len > 0)
+                check_line(ig, len);
+            ig->line_len = 0;
+            continue;
+        }
+        if (ig->line_len < IG_LINE_MAX)
+            ig->line[ig->line_len++] = c;
+        else
+            ig->line_len = 0;        /* runaway line: not a frame */
+    }
+}
+
+void
+integrity_note_stall(integrity_t *ig, uint64_t stall_ns)
+{
+    if (!ig->enabled)
+        return;
+    ig->stalls++;
+    ig->stall_pending = 1;
+    if (stall_ns > ig->max_stall_ns)
+        ig->max_stall_ns = stall_ns;
+}
+
+void
+integrity_tick(integrity_t *ig, uint64_t now_ns, int fd)
+{
+    if (!ig->enabled)
+        return;
+
+    uint64_t elapsed = now_ns - ig->win_start_ns;
+    if (elapsed < (uint64_t)IG_WINDOW_MS * 1000000ull)
+        return;
+
+    /* kernel overruns are only sampled once per window, so they count
+     * against the window in which they were noticed */
+    serial_icount_t ic;
+    if (ig->have_icount && serial_get_icount(fd, &ic) == 0) {
+        long d = (ic.overrun - ig->icount_last.overrun) +
+                 (ic.buf_overrun - ig->icount_last.buf_overrun);
+        if (d > 0)
+            ig->win_errors += (uint64_t)d;
+        ig->icount_last = ic;
+    }
+
+    ig->last_bps = ig->win_bytes * 1000000000ull / elapsed;
+    if (ig->win_errors == 0 && ig->win_bytes > 0 &&
+        ig->last_bps > ig->best_clean_bps)
+        ig->best_clean_bps = ig->last_bps;
+
+    ig->win_start_ns = now_ns;
+    ig->win_bytes = 0;
+    ig->win_errors = 0;
+}
+
+uint64_t
+integrity_errors(const integrity_t *ig)
+{
+    uint64_t n = ig->frames_lost + ig->duplicates + ig->corrupt;
+    if (ig->have_icount)
+        n += (uint64_t)((ig->icount_last.overrun - ig->icount_base.overrun) +
+                        (ig->icount_last.buf_overrun -
+                         ig->icount_base.buf_overrun));
+    return n;
+}
+
+void
+integrity_summary(const integrity_t *ig, char *buf, size_t sz)
+{
+    char kernel[64];
+    if (ig->have_icount)
+        snprintf(kernel, sizeof(kernel), "%ld/%ld",
+                 ig->icount_last.overrun - ig->icount_base.overrun,
+                 ig->icount_last.buf_overrun - ig->icount_base.buf_overrun);
+    else
+        snprintf(kernel, sizeof(kernel), "n/a");
+
+    snprintf(buf, sz,
+             "frames=%llu lost=%llu gaps=%llu dup=%llu corrupt=%llu "
+             "resync=%llu kernel_overrun=%s full_read_errors=%llu "
+             "stall_errors=%llu stalls=%llu max_stall_ms=%.1f "
+             "rate=%llu B/s best_clean=%llu B/s",
+             (unsigned long long)ig->frames_ok,
+             (unsigned long long)ig->frames_lost,
+             (unsigned long long)ig->gap_events,
+             (unsigned long long)ig->duplicates,
+             (unsigned long long)ig->corrupt,
+             (unsigned long long)ig->resyncs,
+             kernel,
+             (unsigned long long)ig->errors_on_full_read,
+             (unsigned long long)ig->errors_after_stall,
+             (unsigned long long)ig->stalls,
+             (double)ig->max_stall_ns / 1e6,
+             (unsigned long long)ig->last_bps,
+             (unsigned long long)ig->best_clean_bps);
+}
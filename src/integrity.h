@@ -0,0 +1,93 @@
+/* integrity.h -- End-to-end data-integrity probe for the capture path */
+#ifndef INTEGRITY_H
+#define INTEGRITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "serial.h"
+
+/* Probe frame, one per line (CRC-32 covers "<seq> <payload>"):
+ *
+ *   UMIP <seq:8 hex> <payload> <crc32:8 hex>\n
+ *
+ * The payload is arbitrary printable text without spaces; the reference
+ * generator integrity_frame() cycles 'A'..'Z' from the sequence number.
+ * Lines that do not contain "UMIP " are ignored, so firmware can mix
+ * probe frames with its normal console output. */
+#define IG_MAGIC         "UMIP "
+#define IG_LINE_MAX      256
+#define IG_STALL_MS      20       /* loop iterations longer than this */
+#define IG_WINDOW_MS     1000     /* throughput window */
+#define IG_READ_BUCKETS  7
+
+typedef struct {
+    int      enabled;
+    size_t   full_read;           /* read() size that means "buffer full" */
+
+    /* frame assembly */
+    char     line[IG_LINE_MAX];
+    int      line_len;
+    int      synced;              /* at least one good frame seen */
+    uint32_t next_seq;
+
+    /* verdicts */
+    uint64_t bytes;
+    uint64_t frames_ok;
+    uint64_t frames_lost;         /* sum of sequence gaps */
+    uint64_t gap_events;
+    uint64_t duplicates;
+    uint64_t corrupt;             /* bad CRC or mangled frame */
+    uint64_t corrupt_unmatched;   /* corrupt since the last good frame */
+    uint64_t resyncs;             /* generator restarted */
+
+    /* correlation */
+    uint64_t read_hist[IG_READ_BUCKETS];
+    uint64_t errors_on_full_read; /* error seen in a buffer-full read */
+    uint64_t errors_after_stall;  /* error after a loop stall */
+    int      stall_pending;
+    uint64_t stalls;
+    uint64_t max_stall_ns;
+    int      have_icount;
+    serial_icount_t icount_base;
+    serial_icount_t icount_last;
+
+    /* throughput */
+    uint64_t win_start_ns;
+    uint64_t win_bytes;
+    uint64_t win_errors;
+    uint64_t last_bps;
+    uint64_t best_clean_bps;      /* fastest window without errors: what
+                                   * the source sent, not a port limit */
+} integrity_t;
+
+/* Read-size histogram bucket upper bounds (last bucket is "full"). */
+extern const size_t integrity_read_bucket_max[IG_READ_BUCKETS];
+
+/* Reset and enable the checker. full_read is the caller's read buffer
+ * size; fd (may be -1) is used for the kernel counter baseline. */
+void integrity_init(integrity_t *ig, size_t full_read, int fd);
+
+/* Format probe frame 'seq' with payload_len payload bytes into buf.
+ * Returns the frame length including '\n', or 0 if buf is too small. */
+size_t integrity_frame(char *buf, size_t sz, uint32_t seq, int payload_len);
+
+/* Verify one read() chunk. */
+void integrity_feed(integrity_t *ig, const char *data, size_t len,
+                    uint64_t ts_ns);
+
+/* Record an event-loop stall (one iteration took stall_ns). */
+void integrity_note_stall(integrity_t *ig, uint64_t stall_ns);
+
+/* Close throughput windows and sample kernel counters. Call at least
+ * once per IG_WINDOW_MS; fd may be -1 while the port is yielded. */
+void integrity_tick(integrity_t *ig, uint64_t now_ns, int fd);
+
+/* Total errors: lost + duplicate + corrupt frames + kernel overruns.
+ * Each frame is in at most one of the three. */
+uint64_t integrity_errors(const integrity_t *ig);
+
+/* One-line human-readable summary. */
+void integrity_summary(const integrity_t *ig, char *buf, size_t sz);
+
+#endif /* INTEGRITY_H */
@@ -3,16 +3,36 @@
  * Creates /tmp/uart-monitor/session-<timestamp>/ directories with
  * per-port log files. Each line gets a [timestamp] prefix.
  * A "latest" symlink always points to the current session.
+ *
+ * Log output never blocks capture on a full or stalled disk: a failed
+ * or slow write switches the file to an in-memory spill ring that is
+ * drained when the disk recovers, followed by a marker saying how many
+ * bytes were spilled and lost.
+ *
+ * Written data is pushed toward the disk with sync_file_range() every
+ * LOG_WRITEBACK_SIZE bytes so dirty pages never pile up into a long
+ * stall at the next fdatasync(); when fdatasync() happens (markers,
+ * sync-pattern lines, periodic group commit) is the caller's policy, and
+ * so is where (log_set_sync_handler).
  */
 #include "log.h"
+#include "crash.h"
+#include "devclock.h"
+#include "digest.h"
+#include "toplines.h"
+#include "filter.h"
+#include "recent.h"
 #include "util.h"
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -48,55 +68,522 @@ log_create_session(char *session_path, size_t sz)
     return 0;
 }
 
+/* ------------------------------------------------------------------ */
+/*  Output path: staged lines -> disk, or the spill ring when degraded */
+/* ------------------------------------------------------------------ */
+
+static void
+spill_push(log_file_t *lf, const char *data, size_t len)
+{
+    if (!lf->spill) {
+        lf->spill = malloc(LOG_SPILL_SIZE);
+        if (!lf->spill) {
+            lf->lost += len;
+            lf->episode_lost += len;
+            return;
+        }
+    }
+
+    /* keep the oldest data: the marker reports what was dropped */
+    size_t room = LOG_SPILL_SIZE - lf->spill_len;
+    size_t n = len < room ? len : room;
+    size_t tail = (lf->spill_head + lf->spill_len) % LOG_SPILL_SIZE;
+    size_t first = n < LOG_SPILL_SIZE - tail ? n : LOG_SPILL_SIZE - tail;
+    memcpy(lf->spill + tail, data, first);
+    memcpy(lf->spill, data + first, n - first);
+    lf->spill_len += n;
+    lf->spilled += n;
+    lf->episode_spilled += n;
+    lf->lost += len - n;
+    lf->episode_lost += len - n;
+}
+
+static void
+enter_degraded(log_file_t *lf, int err, uint64_t write_ns)
+{
+    lf->retry_ns = mono_ns() + (uint64_t)LOG_RETRY_MS * 1000000ull;
+    lf->last_errno = err;
+    if (lf->degraded)
+        return;
+
+    lf->degraded = 1;
+    lf->degraded_events++;
+    lf->episode_spilled = 0;
+    lf->episode_lost = 0;
+    if (err)
+        fprintf(stderr, "log: %s: %s, spilling to memory\n",
+                lf->filepath, strerror(err));
+    else
+        fprintf(stderr, "log: %s: write stalled %.0f ms, spilling to "
+                "memory\n", lf->filepath, (double)write_ns / 1e6);
+}
+
+/* write() all of data; returns bytes written and sets *err on failure.
+ * A write slower than LOG_SLOW_WRITE_MS counts as a stall. */
+static size_t
+write_timed(log_file_t *lf, const char *data, size_t len, int *err,
+            uint64_t *took)
+{
+    uint64_t t0 = mono_ns();
+    size_t off = 0;
+    *err = 0;
+    while (off < len) {
+        ssize_t n = write(lf->fd, data + off, len - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            *err = n < 0 ? errno : EIO;
+            break;
+        }
+        off += (size_t)n;
+    }
+    *took = mono_ns() - t0;
+    if (*took > lf->max_write_ns)
+        lf->max_write_ns = *took;
+    return off;
+}
+
+/* Account for data that reached the file; start writeback of it in
+ * LOG_WRITEBACK_SIZE pieces without waiting for completion. */
+static void
+wrote(log_file_t *lf, size_t n)
+{
+    lf->file_off += (off_t)n;
+    lf->dirty = 1;
+    if (lf->file_off - lf->wb_off >= LOG_WRITEBACK_SIZE) {
+        sync_file_range(lf->fd, lf->wb_off, lf->file_off - lf->wb_off,
+                        SYNC_FILE_RANGE_WRITE);
+        lf->wb_off = lf->file_off;
+    }
+}
+
+static void
+sink(log_file_t *lf, const char *data, size_t len)
+{
+    if (len == 0)
+        return;
+    if (lf->degraded) {
+        spill_push(lf, data, len);
+        return;
+    }
+
+    int err;
+    uint64_t took;
+    size_t n = write_timed(lf, data, len, &err, &took);
+    wrote(lf, n);
+    if (n < len) {
+        enter_degraded(lf, err, took);
+        spill_push(lf, data + n, len - n);
+    } else if (took > (uint64_t)LOG_SLOW_WRITE_MS * 1000000ull) {
+        /* it went through, but the next one may block the loop just
+         * as long: hold output in memory until the retry */
+        enter_degraded(lf, 0, took);
+    }
+}
+
+static void
+out_commit(log_file_t *lf)
+{
+    sink(lf, lf->out, lf->out_len);
+    lf->out_len = 0;
+}
+
+static void
+out_append(log_file_t *lf, const char *data, size_t len)
+{
+    if (lf->out_len + len > sizeof(lf->out))
+        out_commit(lf);
+    if (len > sizeof(lf->out)) {
+        sink(lf, data, len);
+        return;
+    }
+    memcpy(lf->out + lf->out_len, data, len);
+    lf->out_len += len;
+}
+
+static int
+matches_sync_pattern(const log_file_t *lf)
+{
+    if (!lf->sync_on_marker || lf->linebuf_len == 0)
+        return 0;
+    for (int i = 0; i < lf->sync_pattern_count; i++) {
+        const char *pat = lf->sync_patterns[i];
+        if (memmem(lf->linebuf, (size_t)lf->linebuf_len,
+                   pat, strlen(pat)))
+            return 1;
+    }
+    return 0;
+}
+
+static void
+out_printf(log_file_t *lf, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* log offset the next staged byte will land at */
+static long long
+out_offset(const log_file_t *lf)
+{
+    return (long long)lf->file_off + (long long)lf->spill_len +
+           (long long)lf->out_len;
+}
+
+/* Run the completed line through the port's stages, then stage it
+ * (with its timestamp) plus '\n' for the file. */
+static void
+emit_line(log_file_t *lf)
+{
+    log_record_t rec = {
+        .text = lf->linebuf, .len = (size_t)lf->linebuf_len,
+        .ts = lf->line_ts, .ts_size = sizeof(lf->line_ts),
+        .arrival_ns = lf->line_start_ns,
+    };
+    int drop = 0;
+    for (int i = 0; i < lf->nstages && !drop; i++) {
+        log_stage_t *st = &lf->stages[i];
+        if (lf->binary && !st->ops->binary)
+            continue;
+        /* a stage before may have staged a marker */
+        rec.off = out_offset(lf);
+        st->lines++;
+        if (st->ops->line(lf, st->ctx, &rec) == LOG_DROP) {
+            st->dropped++;
+            drop = 1;
+        }
+    }
+    if (!drop) {
+        lf->linebuf_len = (int)rec.len;
+        if (matches_sync_pattern(lf))
+            lf->sync_pending = 1;
+        out_append(lf, rec.ts, strlen(rec.ts));
+        out_append(lf, rec.text, rec.len);
+        out_append(lf, "\n", 1);
+        lf->bytes_written += rec.len + 1;
+    }
+    lf->linebuf_len = 0;
+    lf->line_ts[0] = '\0';
+}
+
+static void
+out_printf(log_file_t *lf, const char *fmt, ...)
+{
+    char buf[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        out_append(lf, buf, (size_t)n < sizeof(buf) ? (size_t)n
+                                                    : sizeof(buf) - 1);
+}
+
+static void (*sync_handler)(log_file_t *lf);
+
+void
+log_set_sync_handler(void (*fn)(log_file_t *lf))
+{
+    sync_handler = fn;
+}
+
+/* A marker or sync-pattern line wants the file on disk. */
+static void
+sync_soon(log_file_t *lf)
+{
+    if (!sync_handler) {
+        log_sync(lf);
+        return;
+    }
+    if (lf->fd < 0 || !lf->dirty || lf->degraded)
+        return;
+    lf->dirty = 0;
+    lf->wb_off = lf->file_off;
+    sync_handler(lf);
+}
+
+void
+log_sync_done(log_file_t *lf, uint64_t ns, int err)
+{
+    lf->syncs++;
+    lf->sync_ns_total += ns;
+    if (ns > lf->sync_max_ns)
+        lf->sync_max_ns = ns;
+    if (err)
+        fprintf(stderr, "log: fdatasync %s: %s\n",
+                lf->filepath, strerror(err));
+}
+
+int
+log_sync(log_file_t *lf)
+{
+    if (lf->fd < 0 || !lf->dirty || lf->degraded)
+        return 0;
+
+    uint64_t t0 = mono_ns();
+    int ret = fdatasync(lf->fd);
+    int err = ret < 0 ? errno : 0;
+    log_sync_done(lf, mono_ns() - t0, err);
+    if (ret < 0)
+        return -1;
+    lf->dirty = 0;
+    lf->wb_off = lf->file_off;
+    return 1;
+}
+
+int
+log_service(log_file_t *lf, uint64_t now_ns)
+{
+    if (!lf->degraded)
+        return 0;
+    if (now_ns < lf->retry_ns || lf->fd < 0)
+        return 1;
+
+    /* drain the oldest contiguous run; one write per attempt bounds how
+     * long a still-stalled disk can hold up the loop */
+    if (lf->spill_len > 0) {
+        size_t run = LOG_SPILL_SIZE - lf->spill_head;
+        if (run > lf->spill_len)
+            run = lf->spill_len;
+
+        int err;
+        uint64_t took;
+        size_t n = write_timed(lf, lf->spill + lf->spill_head, run,
+                               &err, &took);
+        wrote(lf, n);
+        lf->spill_head = (lf->spill_head + n) % LOG_SPILL_SIZE;
+        lf->spill_len -= n;
+        if (n < run || took > (uint64_t)LOG_SLOW_WRITE_MS * 1000000ull) {
+            enter_degraded(lf, err, took);
+            return 1;
+        }
+        if (lf->spill_len > 0)
+            return 1;        /* wrapped: next run on the next pass */
+    }
+
+    lf->degraded = 0;
+    lf->spill_head = 0;
+    if (lf->episode_spilled || lf->episode_lost) {
+        char ts[32];
+        timestamp_now(ts, sizeof(ts));
+        out_printf(lf, "\n--- STORAGE RECOVERED: %llu bytes spilled, "
+                   "%llu bytes lost (%s) [%s] ---\n\n",
+                   (unsigned long long)lf->episode_spilled,
+                   (unsigned long long)lf->episode_lost,
+                   lf->last_errno ? strerror(lf->last_errno) : "slow writes",
+                   ts);
+        out_commit(lf);
+    }
+    fprintf(stderr, "log: %s: storage recovered\n", lf->filepath);
+    return lf->degraded;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Built-in line stages                                              */
+/* Stage "--- msg [ts] ---" between blank lines, let the stages see it
+ * and sync if the port wants markers on disk. Returns the marker's
+ * offset. Shared by log_marker_at and the clock stage's reset marker,
+ * which lands ahead of the line being emitted. */
+static long long
+put_marker(log_file_t *lf, const char *msg, const char *ts)
+{
+    /* where the marker will land, counting output still spilled */
+    long long off = out_offset(lf);
+    out_printf(lf, "\n--- %s [%s] ---\n\n", msg, ts);
+    /* stages see the marker line itself, without the blank lines */
+    char line[1024], no_ts[1] = "";
+    int n = snprintf(line, sizeof(line), "--- %s [%s] ---", msg, ts);
+    log_record_t rec = { .text = line, .len = (size_t)n, .ts = no_ts,
+                         .ts_size = sizeof(no_ts), .arrival_ns = mono_ns(),
+                         .off = off + 1 };
+    for (int i = 0; i < lf->nstages && (size_t)n < sizeof(line); i++)
+        if (lf->stages[i].ops->marker)
+            lf->stages[i].ops->marker(lf->stages[i].ctx, &rec);
+    out_commit(lf);
+    if (lf->sync_on_marker)
+        sync_soon(lf);
+    return off;
+}
+/* ------------------------------------------------------------------ */
+
+int
+log_add_stage(log_file_t *lf, const log_stage_ops_t *ops, void *ctx)
+{
+    if (!ctx || lf->nstages >= LOG_MAX_STAGES)
+        return -1;
+    lf->stages[lf->nstages++] = (log_stage_t){ .ops = ops, .ctx = ctx };
+    return 0;
+}
+
+/* Feed a device-stamped line to the clock model. A device reset gets a
+ * marker; with timestamps on, the line's stamp gains the corrected
+ * device time: "[2026-03-18 14:30:12.345 ~14:30:12.341234] ". */
+static int
+clock_line(log_file_t *lf, void *clock, log_record_t *rec)
+{
+    devclock_t *dc = clock;
+    uint64_t corr;
+    int r = devclock_line(dc, rec->text, rec->len, rec->arrival_ns, &corr);
+    if (r < 0)
+        return LOG_PASS;
+    if (r == 1) {
+        char ts[32], msg[64];
+        timestamp_now(ts, sizeof(ts));
+        snprintf(msg, sizeof(msg), "DEVICE RESET (%s clock went back)",
+                 devclock_fmt_name(dc->fmt));
+        put_marker(lf, msg, ts);
+    }
+
+    size_t n = strlen(rec->ts);
+    if (n < 2 || rec->ts[n - 2] != ']')
+        return LOG_PASS;
+    uint64_t wall = corr + (uint64_t)mono_to_wall_offset();
+    struct timespec t = { .tv_sec = (time_t)(wall / 1000000000ull),
+                          .tv_nsec = (long)(wall % 1000000000ull) };
+    char us[32];
+    timestamp_fmt_us(&t, us, sizeof(us));
+    snprintf(rec->ts + n - 2, rec->ts_size - (n - 2), " ~%s] ", us + 11);
+    return LOG_PASS;
+}
+
+const log_stage_ops_t log_stage_clock = { .name = "clock",
+                                          .line = clock_line };
+
+/* Add it before "filter": the crash detector sees filtered lines too. */
+static int
+crash_line(log_file_t *lf, void *crash, log_record_t *rec)
+{
+    (void)lf;
+    crash_feed(crash, rec->text, rec->len, rec->off);
+    return LOG_PASS;
+}
+
+const log_stage_ops_t log_stage_crash = { .name = "crash",
+                                          .line = crash_line };
+
+static int
+filter_line(log_file_t *lf, void *filter, log_record_t *rec)
+{
+    (void)lf;
+    return filter_drop(filter, rec->text, rec->len) ? LOG_DROP : LOG_PASS;
+}
+
+const log_stage_ops_t log_stage_filter = { .name = "filter",
+                                           .line = filter_line };
+
+static int
+recent_line(log_file_t *lf, void *recent, log_record_t *rec)
+{
+    (void)lf;
+    recent_push(recent, rec->off, rec->arrival_ns, rec->ts, rec->text,
+                rec->len);
+    return LOG_PASS;
+}
+
+static void
+recent_marker(void *recent, const log_record_t *rec)
+{
+    recent_push(recent, rec->off, rec->arrival_ns, NULL, rec->text,
+                rec->len);
+}
+
+static void
+recent_clear(void *recent)
+{
+    recent_reset(recent);
+}
+
+const log_stage_ops_t log_stage_recent = { .name = "recent",
+                                           .line = recent_line,
+                                           .marker = recent_marker,
+                                           .reset = recent_clear,
+                                           .binary = 1 };
+
+static int
+condense_line(log_file_t *lf, void *digest, log_record_t *rec)
+{
+    (void)lf;
+    digest_line(digest, rec->ts, rec->text, rec->len, rec->off,
+                rec->arrival_ns);
+    return LOG_PASS;
+}
+
+static void
+condense_marker(void *digest, const log_record_t *rec)
+{
+    digest_marker(digest, rec->text, rec->len);
+}
+
+static void
+condense_clear(void *digest)
+{
+    digest_reset(digest);
+}
+
+const log_stage_ops_t log_stage_digest = { .name = "digest",
+                                           .line = condense_line,
+                                           .marker = condense_marker,
+                                           .reset = condense_clear };
+
+static int
+toplines_line(log_file_t *lf, void *top, log_record_t *rec)
+{
+    (void)lf;
+    toplines_add(top, rec->text, rec->len);
+    return LOG_PASS;
+}
+
+static void
+toplines_clear(void *top)
+{
+    toplines_reset(top);
+}
+
+const log_stage_ops_t log_stage_toplines = { .name = "toplines",
+                                             .line = toplines_line,
+                                             .reset = toplines_clear };
+
+/* ------------------------------------------------------------------ */
+
 int
 log_open(log_file_t *lf, const char *session_path,
          const char *tty_name, const char *header)
 {
+    static uint64_t sync_ids;
     memset(lf, 0, sizeof(*lf));
+    lf->sync_id = ++sync_ids;
 
     snprintf(lf->filepath, sizeof(lf->filepath),
              "%s/%s.log", session_path, tty_name);
 
-    lf->fp = fopen(lf->filepath, "a");
-    if (!lf->fp) {
+    lf->fd = open(lf->filepath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                  0644);
+    if (lf->fd < 0) {
         fprintf(stderr, "log: cannot open %s: %s\n",
                 lf->filepath, strerror(errno));
         return -1;
     }
 
-    /* line-buffered for tail -f friendliness */
-    setvbuf(lf->fp, NULL, _IOLBF, 0);
-
     lf->session_start = time(NULL);
     clock_gettime(CLOCK_MONOTONIC, &lf->last_flush);
+    lf->file_off = lseek(lf->fd, 0, SEEK_END);
+    if (lf->file_off < 0)
+        lf->file_off = 0;
+    lf->wb_off = lf->file_off;
 
     /* write header */
     if (header && header[0]) {
-        fprintf(lf->fp, "=== UART Monitor Session ===\n");
-        fprintf(lf->fp, "%s", header);
         char ts[32];
         timestamp_now(ts, sizeof(ts));
-        fprintf(lf->fp, "Started: %s\n", ts);
-        fprintf(lf->fp, "===\n\n");
-        fflush(lf->fp);
+        out_printf(lf, "=== UART Monitor Session ===\n%sStarted: %s\n===\n\n",
+                   header, ts);
+        out_commit(lf);
     }
 
     return 0;
 }
 
-/* Write a timestamp prefix for the current partial line. */
-static void
-write_timestamp(log_file_t *lf)
-{
-    char ts[32];
-    timestamp_now(ts, sizeof(ts));
-    fprintf(lf->fp, "[%s] ", ts);
-}
-
 int
 log_write(log_file_t *lf, const char *data, size_t len)
 {
-    if (!lf->fp || len == 0)
+    if (lf->fd < 0 || len == 0)
         return 0;
 
     for (size_t i = 0; i < len; i++) {
@@ -120,111 +607,185 @@ log_write(log_file_t *lf, const char *data, size_t len)
         }
 
         if (lf->linebuf_len == 0 && c != '\n' && lf->timestamps) {
-            /* starting a new line: write timestamp */
-            write_timestamp(lf);
+            /* starting a new line: remember when it started */
+            char ts[32];
+            timestamp_now(ts, sizeof(ts));
+            snprintf(lf->line_ts, sizeof(lf->line_ts), "[%s] ", ts);
         }
+        if (lf->linebuf_len == 0 && c != '\n' && lf->nstages)
+            lf->line_start_ns = mono_ns();
 
         if (c == '\n') {
-            /* flush the line */
-            if (lf->linebuf_len > 0) {
-                fwrite(lf->linebuf, 1, (size_t)lf->linebuf_len, lf->fp);
-                lf->bytes_written += (size_t)lf->linebuf_len;
-                lf->linebuf_len = 0;
-            }
-            fputc('\n', lf->fp);
-            lf->bytes_written++;
+            emit_line(lf);
         } else {
             /* buffer the character */
             if (lf->linebuf_len < LOG_LINE_BUF_SIZE - 1) {
                 lf->linebuf[lf->linebuf_len++] = c;
             }
             /* if buffer full, force flush */
-            if (lf->linebuf_len >= LOG_LINE_BUF_SIZE - 1) {
-                fwrite(lf->linebuf, 1, (size_t)lf->linebuf_len, lf->fp);
-                lf->bytes_written += (size_t)lf->linebuf_len;
-                fputc('\n', lf->fp);
-                lf->bytes_written++;
-                lf->linebuf_len = 0;
-            }
+            if (lf->linebuf_len >= LOG_LINE_BUF_SIZE - 1)
+                emit_line(lf);
         }
     }
 
+    /* complete lines go out now (tail -f friendly); a partial line waits
+     * for its end or for log_flush() */
+    out_commit(lf);
+    if (lf->sync_pending) {
+        lf->sync_pending = 0;
+        sync_soon(lf);
+    }
     clock_gettime(CLOCK_MONOTONIC, &lf->last_flush);
     return 0;
 }
 
+int
+log_write_binary(log_file_t *lf, const char *lines, size_t len)
+{
+    lf->binary = 1;
+    int r = log_write(lf, lines, len);
+    lf->binary = 0;
+    return r;
+}
+
 void
 log_flush(log_file_t *lf)
 {
-    if (!lf->fp)
+    if (lf->fd < 0)
         return;
-    if (lf->linebuf_len > 0) {
-        /* flush partial line with timestamp already written */
-        fwrite(lf->linebuf, 1, (size_t)lf->linebuf_len, lf->fp);
-        lf->bytes_written += (size_t)lf->linebuf_len;
-        fputc('\n', lf->fp);
-        lf->bytes_written++;
-        lf->linebuf_len = 0;
-    }
-    fflush(lf->fp);
+    if (lf->linebuf_len > 0)
+        emit_line(lf);
+    out_commit(lf);
 }
 
 void
 log_marker(log_file_t *lf, const char *msg)
 {
-    if (!lf->fp)
-        return;
+    char ts[32];
+    timestamp_now(ts, sizeof(ts));
+    log_marker_at(lf, msg, ts);
+}
+
+long long
+log_marker_at(log_file_t *lf, const char *msg, const char *ts)
+{
+    if (lf->fd < 0)
+        return -1;
 
     /* flush any pending partial line first */
-    if (lf->linebuf_len > 0) {
-        fwrite(lf->linebuf, 1, (size_t)lf->linebuf_len, lf->fp);
-        fputc('\n', lf->fp);
-        lf->linebuf_len = 0;
-    }
+    if (lf->linebuf_len > 0)
+        emit_line(lf);
 
-    char ts[32];
-    timestamp_now(ts, sizeof(ts));
-    fprintf(lf->fp, "\n--- %s [%s] ---\n\n", msg, ts);
-    fflush(lf->fp);
+    return put_marker(lf, msg, ts);
 }
 
 void
 log_clear(log_file_t *lf)
 {
-    if (!lf->fp)
+    if (lf->fd < 0)
         return;
 
-    /* flush any pending partial line */
-    if (lf->linebuf_len > 0) {
-        lf->linebuf_len = 0;
-    }
+    /* drop any pending partial line and anything still spilled: it
+     * belongs to the contents being cleared */
+    lf->linebuf_len = 0;
+    lf->line_ts[0] = '\0';
+    lf->out_len = 0;
     lf->last_was_cr = 0;
+    lf->spill_head = 0;
+    lf->spill_len = 0;
+    lf->degraded = 0;
 
-    /* reopen file in truncate mode */
-    fclose(lf->fp);
-    lf->fp = fopen(lf->filepath, "w");
-    if (!lf->fp) {
-        fprintf(stderr, "log: cannot reopen %s: %s\n",
+    /* O_APPEND: the next write lands at the new end */
+    if (ftruncate(lf->fd, 0) < 0)
+        fprintf(stderr, "log: cannot truncate %s: %s\n",
                 lf->filepath, strerror(errno));
-        return;
-    }
+    lf->file_off = 0;
+    lf->wb_off = 0;
+    for (int i = 0; i < lf->nstages; i++)
+        if (lf->stages[i].ops->reset)
+            lf->stages[i].ops->reset(lf->stages[i].ctx);
 
-    /* restore line-buffered for tail -f friendliness */
-    setvbuf(lf->fp, NULL, _IOLBF, 0);
     lf->bytes_written = 0;
     clock_gettime(CLOCK_MONOTONIC, &lf->last_flush);
 
     log_marker(lf, "LOG CLEARED");
 }
 
+long long
+log_checkpoint(log_file_t *lf, FILE *index, const char *cp,
+               const char *label, const char *ts, uint64_t mono,
+               int truncate)
+{
+    long long off;
+    if (truncate) {
+        if (lf->fd < 0)
+            return -1;
+        log_clear(lf);
+        off = 0;
+    } else {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "CHECKPOINT %s", cp);
+        off = log_marker_at(lf, msg, ts);
+    }
+    if (off >= 0 && index) {
+        const char *base = strrchr(lf->filepath, '/');
+        fprintf(index, "%s\t%s\t%llu\t%s\t%lld\t%s\n", cp, ts,
+                (unsigned long long)mono, label, off,
+                base ? base + 1 : lf->filepath);
+    }
+    return off;
+}
+
+long long
+log_checkpoint_offset(const char *index_path, const char *log_name,
+                      const char *cp)
+{
+    FILE *fp = fopen(index_path, "r");
+    if (!fp)
+        return -1;
+
+    /* name ts mono label offset logfile; the newest match wins */
+    long long off = -1;
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        char *f[6];
+        char *saveptr;
+        int n = 0;
+        for (char *t = strtok_r(line, "\t", &saveptr); t && n < 6;
+             t = strtok_r(NULL, "\t", &saveptr))
+            f[n++] = t;
+        if (n < 6 || strcmp(f[5], log_name) != 0)
+            continue;
+        if (strcmp(cp, "last") == 0 || strcmp(cp, f[0]) == 0)
+            off = strtoll(f[4], NULL, 10);
+    }
+    fclose(fp);
+    return off;
+}
+
 void
 log_close(log_file_t *lf)
 {
-    if (lf->fp) {
+    if (lf->fd >= 0) {
         log_flush(lf);
-        fclose(lf->fp);
-        lf->fp = NULL;
+        /* last chance for the backlog */
+        if (lf->degraded) {
+            lf->retry_ns = 0;
+            while (lf->spill_len > 0 && log_service(lf, mono_ns()) &&
+                   lf->retry_ns == 0)
+                ;
+            if (lf->spill_len > 0)
+                fprintf(stderr, "log: %s: closed with %zu bytes unwritten\n",
+                        lf->filepath, lf->spill_len);
+        }
+        close(lf->fd);
+        lf->fd = -1;
     }
+    free(lf->spill);
+    lf->spill = NULL;
+    lf->spill_len = 0;
+    lf->nstages = 0;
 }
 
 /* Compare function for sorting session directory names. */
@@ -288,5 +849,5 @@ log_prune_sessions(int keep)
     for (int i = 0; i < count; i++)
         free(sessions[i]);
 
-    return 0;
+    return to_remove;
 }
@@ -4,24 +4,112 @@
 
 #include <stdio.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
+
 #define LOG_BASE_DIR      "/tmp/uart-monitor"
 #define LOG_LINE_BUF_SIZE 2048
 #define LOG_MAX_SESSIONS  10
+#define LOG_CHECKPOINTS   "checkpoints.log" /* CLEAR index, per session */
+#define LOG_OUT_BUF_SIZE  8192
+#define LOG_SPILL_SIZE    (1024 * 1024) /* per-port backlog while degraded */
+#define LOG_SLOW_WRITE_MS 100           /* a write this slow = stalled disk */
+#define LOG_RETRY_MS      500           /* drain attempts while degraded */
+#define LOG_WRITEBACK_SIZE (256 * 1024) /* start writeback every N bytes */
+#define LOG_MAX_STAGES    8
+
+/* ---- Line pipeline ----
+ *
+ * log_write() frames the bytes of a port into lines (CR/LF handling,
+ * "[timestamp] " prefix); each completed line then goes through the
+ * port's stages in the order they were added, and what passes them all
+ * is staged for the file. A stage gets the line by reference and may
+ * rewrite it in place or drop it. Stages are set up by whoever opens
+ * the log (log_add_stage() after log_open()) and stay until log_close.
+ */
+
+typedef struct log_file log_file_t;
+
+/* One completed line. */
+typedef struct {
+    char      *text;          /* without '\n' */
+    size_t     len;
+    char      *ts;            /* "[timestamp] " prefix, "" if none */
+    size_t     ts_size;       /* room in ts for rewriting it */
+    uint64_t   arrival_ns;    /* mono_ns() of the line's first byte */
+    long long  off;           /* log offset the line would start at */
+} log_record_t;
+
+#define LOG_PASS  0
+#define LOG_DROP  1
+
+/* A stage: line() sees every completed line and returns LOG_PASS, or
+ * LOG_DROP to keep it out of the file (later stages do not see it
+ * either). The optional hooks see the daemon's own marker lines, which
+ * are never dropped, and the log being truncated. Hex dump lines
+ * (log_write_binary()) only reach the stages that set binary. */
+typedef struct {
+    const char *name;
+    int  (*line)(log_file_t *lf, void *ctx, log_record_t *rec);
+    void (*marker)(void *ctx, const log_record_t *rec);
+    void (*reset)(void *ctx);
+    int   binary;             /* also sees hex dump lines */
+} log_stage_ops_t;
 
 typedef struct {
-    FILE  *fp;
+    const log_stage_ops_t *ops;
+    void        *ctx;
+    uint64_t     lines;       /* lines seen */
+    uint64_t     dropped;     /* ... and dropped */
+} log_stage_t;
+
+struct log_file {
+    int    fd;
     char   filepath[512];
     size_t bytes_written;
     time_t session_start;
     /* line buffer for timestamp insertion */
     char   linebuf[LOG_LINE_BUF_SIZE];
     int    linebuf_len;
+    char   line_ts[64];       /* "[timestamp] " of the line being built */
+    uint64_t line_start_ns;   /* mono_ns() of its first byte */
     int    last_was_cr;       /* track \r across read() boundaries */
     int    timestamps;        /* prepend [timestamp] to each line */
     struct timespec last_flush;
-} log_file_t;
+    /* complete lines staged for one write() per log_write() */
+    char   out[LOG_OUT_BUF_SIZE];
+    size_t out_len;
+    /* Storage degradation: when a write fails (ENOSPC, EIO) or stalls,
+     * output goes to an in-memory ring until the disk takes it again. */
+    char    *spill;           /* LOG_SPILL_SIZE ring, allocated on demand */
+    size_t   spill_head;
+    size_t   spill_len;
+    int      degraded;
+    int      last_errno;      /* 0: degraded because writes were slow */
+    uint64_t retry_ns;        /* next drain attempt (mono_ns) */
+    uint64_t spilled;         /* bytes that went through the ring */
+    uint64_t lost;            /* bytes dropped with the ring full */
+    uint64_t episode_spilled; /* ... during the current episode */
+    uint64_t episode_lost;
+    uint64_t degraded_events;
+    uint64_t max_write_ns;
+    /* durability */
+    int      sync_on_marker;  /* fdatasync after markers / pattern lines */
+    const char *const *sync_patterns;
+    int      sync_pattern_count;
+    int      sync_pending;    /* a pattern line was just written */
+    int      dirty;           /* written since the last fdatasync */
+    off_t    file_off;        /* end of file as far as we wrote it */
+    off_t    wb_off;          /* writeback started up to here */
+    uint64_t sync_id;         /* tags this file's syncs done elsewhere */
+    uint64_t syncs;
+    uint64_t sync_ns_total;
+    uint64_t sync_max_ns;
+    log_stage_t stages[LOG_MAX_STAGES];
+    int      nstages;
+    int      binary;          /* the lines being framed are a hex dump */
+};
 
 /* Create a new session directory under LOG_BASE_DIR and update the
  * "latest" symlink. Writes session name into session_path.
@@ -37,20 +125,78 @@ int log_open(log_file_t *lf, const char *session_path,
  * Buffers partial lines until '\n' or flush timeout. */
 int log_write(log_file_t *lf, const char *data, size_t len);
 
+/* Write lines formatted from data that is not text (a hex dump): framed
+ * and stamped like log_write(), but the text stages (clock, crash,
+ * filter, toplines, digest) never see them. */
+int log_write_binary(log_file_t *lf, const char *lines, size_t len);
+
 /* Flush any buffered partial line (called on timeout or close). */
 void log_flush(log_file_t *lf);
 
+/* fdatasync the file if anything was written since the last sync.
+ * Returns 1 if synced, 0 if clean (or degraded), -1 on error. */
+int log_sync(log_file_t *lf);
+
+/* Where marker and sync-pattern fdatasyncs go. With a handler, the file
+ * is marked clean and handed to fn (which syncs it later, elsewhere,
+ * and reports back through log_sync_done()); without one they run
+ * inline in log_write() and log_marker_at(). */
+void log_set_sync_handler(void (*fn)(log_file_t *lf));
+
+/* Count one fdatasync of this file that took ns, with err its errno (0
+ * if it succeeded): log_sync() itself, or one run by another thread on
+ * a dup of the fd and reported back by sync_id. */
+void log_sync_done(log_file_t *lf, uint64_t ns, int err);
+
+/* While degraded, retry draining the spill ring once the retry time has
+ * passed, and write a recovery marker with the spilled/lost byte counts
+ * once it is empty. Returns 1 while still degraded, 0 otherwise. */
+int log_service(log_file_t *lf, uint64_t now_ns);
+
 /* Write a marker line (e.g. yield/reclaim/disconnect). */
 void log_marker(log_file_t *lf, const char *msg);
 
+/* Same, with a caller-supplied timestamp string so one event can carry
+ * an identical time in several logs. Returns the file offset at which
+ * the marker starts (after the flushed partial line), -1 if closed. */
+long long log_marker_at(log_file_t *lf, const char *msg, const char *ts);
+
 /* Truncate/clear a log file. Resets contents and byte counter.
  * Writes a "LOG CLEARED" marker after truncation. */
 void log_clear(log_file_t *lf);
 
-/* Close a log file. */
+/* Checkpoint 'cp' of lf at wall time ts (mono: the same instant,
+ * CLOCK_MONOTONIC ns): append a "CHECKPOINT <cp>" marker, or with
+ * truncate empty the file and use offset 0, then add the index line
+ * (name, ts, mono, label, offset, log file) to index if it is not NULL.
+ * Returns the checkpoint's offset, -1 if the log is closed. */
+long long log_checkpoint(log_file_t *lf, FILE *index, const char *cp,
+                         const char *label, const char *ts, uint64_t mono,
+                         int truncate);
+
+/* Byte offset of checkpoint 'cp' ("last" for the newest) of the log
+ * file named log_name, looked up in a session's checkpoint index.
+ * Returns -1 if there is no such checkpoint. */
+long long log_checkpoint_offset(const char *index_path,
+                                const char *log_name, const char *cp);
+
+/* Append a stage to the port's pipeline; ctx is passed to its hooks.
+ * Returns -1 (and adds nothing) if ctx is NULL or the pipeline is full. */
+int log_add_stage(log_file_t *lf, const log_stage_ops_t *ops, void *ctx);
+
+/* Built-in stages; ctx is the object named. */
+extern const log_stage_ops_t log_stage_clock;   /* devclock_t */
+extern const log_stage_ops_t log_stage_crash;   /* crash_t */
+extern const log_stage_ops_t log_stage_filter;  /* filter_t */
+extern const log_stage_ops_t log_stage_recent;  /* recent_t */
+extern const log_stage_ops_t log_stage_digest;  /* digest_t */
+extern const log_stage_ops_t log_stage_toplines; /* toplines_t */
+
+/* Close a log file (and drop its stages). */
 void log_close(log_file_t *lf);
 
-/* Remove old session directories, keeping the most recent 'keep'. */
+/* Remove old session directories, keeping the most recent 'keep'.
+ * Returns how many were removed, -1 if LOG_BASE_DIR cannot be read. */
 int log_prune_sessions(int keep);
 
 #endif /* LOG_H */
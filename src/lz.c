@@ -0,0 +1,148 @@
+/* lz.c -- Small dependency-free LZ77 block compressor.
+ *
+ * Byte-oriented, in the style of LZ4: a block is a series of sequences,
+ * each a token byte (literal count in the high nibble, match length - 4
+ * in the low nibble; 15 means more length bytes follow, 255 at a time),
+ * the literals, and a 16-bit little-endian back-reference distance. The
+ * last sequence has literals only. Greedy parsing over a hash of the
+ * next four bytes gives a few times compression on UART text at memory
+ * speed, which is what export needs; it is not meant to win on ratio.
+ */
+#include "lz.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define HASH_BITS   14
+#define MIN_MATCH   4
+#define MAX_DIST    65535
+#define TAIL        5           /* last bytes are always literals */
+
+static uint32_t
+read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t
+hash4(const uint8_t *p)
+{
+    return (read32(p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint8_t *
+put_length(uint8_t *op, size_t n)
+{
+    while (n >= 255) {
+        *op++ = 255;
+        n -= 255;
+    }
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+static uint8_t *
+put_sequence(uint8_t *op, const uint8_t *lit, size_t nlit,
+             size_t match, size_t dist)
+{
+    uint8_t *token = op++;
+    size_t ml = match ? match - MIN_MATCH : 0;
+    *token = (uint8_t)((nlit < 15 ? nlit : 15) << 4 | (ml < 15 ? ml : 15));
+    if (nlit >= 15)
+        op = put_length(op, nlit - 15);
+    memcpy(op, lit, nlit);
+    op += nlit;
+    if (match) {
+        *op++ = (uint8_t)dist;
+        *op++ = (uint8_t)(dist >> 8);
+        if (ml >= 15)
+            op = put_length(op, ml - 15);
+    }
+    return op;
+}
+
+size_t
+lz_compress(const void *src, size_t len, void *dst)
+{
+    const uint8_t *in = src;
+    uint8_t *op = dst;
+    uint32_t table[1u << HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    size_t anchor = 0, ip = 0;
+    if (len > MIN_MATCH + TAIL) {
+        size_t limit = len - TAIL;
+        while (ip + MIN_MATCH <= limit) {
+            uint32_t h = hash4(in + ip);
+            size_t cand = table[h];
+            table[h] = (uint32_t)ip;
+            if (cand >= ip || ip - cand > MAX_DIST ||
+                read32(in + cand) != read32(in + ip)) {
+                ip++;
+                continue;
+            }
+            size_t m = MIN_MATCH;
+            while (ip + m < limit && in[cand + m] == in[ip + m])
+                m++;
+            op = put_sequence(op, in + anchor, ip - anchor, m, ip - cand);
+            ip += m;
+            anchor = ip;
+        }
+    }
+    op = put_sequence(op, in + anchor, len - anchor, 0, 0);
+    return (size_t)(op - (uint8_t *)dst);
+}
+
+static int
+get_length(const uint8_t **ip, const uint8_t *end, size_t *n)
+{
+    uint8_t b;
+    do {
+        if (*ip >= end)
+            return -1;
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return 0;
+}
+
+int
+lz_decompress(const void *src, size_t len, void *dst, size_t out_len)
+{
+    const uint8_t *ip = src, *end = ip + len;
+    uint8_t *out = dst, *op = out, *oend = out + out_len;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t nlit = token >> 4;
+        if (nlit == 15 && get_length(&ip, end, &nlit) < 0)
+            return -1;
+        if (nlit > (size_t)(end - ip) || nlit > (size_t)(oend - op))
+            return -1;
+        memcpy(op, ip, nlit);
+        ip += nlit;
+        op += nlit;
+        if (ip == end)
+            break;                      /* last sequence: literals only */
+
+        if (end - ip < 2)
+            return -1;
+        size_t dist = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t m = (token & 15);
+        if (m == 15 && get_length(&ip, end, &m) < 0)
+            return -1;
+        m += MIN_MATCH;
+        if (dist == 0 || dist > (size_t)(op - out) ||
+            m > (size_t)(oend - op))
+            return -1;
+        /* overlapping copies repeat the pattern, byte by byte */
+        const uint8_t *from = op - dist;
+        for (size_t i = 0; i < m; i++)
+            op[i] = from[i];
+        op += m;
+    }
+    return op == oend ? 0 : -1;
+}
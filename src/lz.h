@@ -0,0 +1,19 @@
+/* lz.h -- Small dependency-free LZ77 block compressor */
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+
+/* Worst-case compressed size of n input bytes. */
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+/* Compress src into dst (at least LZ_BOUND(len) bytes). Each call is an
+ * independent block, so blocks can be compressed in parallel and read
+ * back one at a time. Returns the compressed size. */
+size_t lz_compress(const void *src, size_t len, void *dst);
+
+/* Decompress a block into dst, which must hold exactly out_len bytes.
+ * Returns 0, or -1 if the block is corrupt or does not fill out_len. */
+int lz_decompress(const void *src, size_t len, void *dst, size_t out_len);
+
+#endif /* LZ_H */
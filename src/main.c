@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "archive.h"
+#include "crash.h"
 #include "identify.h"
 #include "monitor.h"
 #include "control.h"
@@ -17,11 +19,32 @@ usage(const char *prog)
         "Commands:\n"
         "  identify        Scan and identify USB serial ports\n"
         "  monitor         Start monitoring daemon\n"
-        "  status          Query running daemon status\n"
+        "  status [--full] Query running daemon status\n"
         "  yield <dev>     Release a port for flashing\n"
         "  reclaim <dev>   Re-acquire a yielded port\n"
-        "  clear <dev>     Truncate log for a port (or --all)\n"
-        "  tail <dev>      Tail the latest log for a port\n"
+        "                  (board:<serial> or group:<port>: a whole board,\n"
+        "                  also for clear)\n"
+        "  clear <dev>     Checkpoint a port's log (or --all; --truncate)\n"
+        "  tail <dev>      Tail the latest log (--from <checkpoint|last>;\n"
+        "                  -n N, --since ms, --after off: from memory)\n"
+        "  grep <dev> <s>  Lines containing s (--from <checkpoint|last>)\n"
+        "  wait <dev> <s>  Block until a line contains s (--from, --timeout)\n"
+        "  digest <dev>    Condensed log: repeats folded, errors kept (-f)\n"
+        "  add <dev> [lbl] Monitor a device not found by scanning (e.g. PTY)\n"
+        "                  or unix:<path>, tcp:<host>:<port>, fifo:<path>\n"
+        "  remove <dev>    Stop monitoring a port\n"
+        "  rotate          Start a new session directory\n"
+        "  integrity       Show probe-frame verification results\n"
+        "  metrics         Show daemon and per-port counters\n"
+        "  toplines <dev>  Line templates the port logs most (-n N)\n"
+        "  mark <text>     Same marker in all (or --ports) logs at once\n"
+        "  ping <dev>      Round-trip latency over a loopback (or --to)\n"
+        "  bw <dev>        Max lossless throughput per baud (loopback/--to)\n"
+        "  export <sess>   Pack a session into one compressed, indexed file\n"
+        "                  (--store <dir>: deduplicated across sessions)\n"
+        "  archive <file>  List, cat or grep an export (by port/time range)\n"
+        "  crashes [hash]  Crash signatures seen across sessions, or one's\n"
+        "                  occurrences (--port, --kind, --since)\n"
         "\n"
         "Monitor options:\n"
         "  -f, --foreground    Run in foreground (don't daemonize)\n"
@@ -30,6 +53,19 @@ usage(const char *prog)
         "  --systemd           systemd notify mode (implies -f)\n"
         "  -b, --baud <rate>   Baud rate (default: 115200)\n"
         "  --only <devs>       Only monitor these devices (comma-separated)\n"
+        "  --integrity         Verify probe frames on every port\n"
+        "  --digest            Write a condensed <label>.digest per port\n"
+        "  --config <file>     Config file (default: ~/.config/uart-monitor.conf)\n"
+        "  --durability <mode> none, marker (default) or group (periodic fsync)\n"
+        "  --settle-ms <ms>    Delay before opening a hot-plugged device (200)\n"
+        "  --uevent-fd <fd>    Read uevents from fd instead of netlink (testing)\n"
+        "  --sysfs-root <dir>  Identify devices under <dir> instead of /sys\n"
+        "  --dev-root <dir>    Scan device nodes under <dir> instead of /dev\n"
+        "  --cpus <list>       Pin capture to these CPUs (e.g. 2-3 or 0,4)\n"
+        "  --rt <fifo|rr>      Run capture under SCHED_FIFO or SCHED_RR\n"
+        "  --rt-prio <1-99>    Real-time priority for --rt (default: 10)\n"
+        "  --mlock             Lock daemon memory to avoid page faults\n"
+        "  --system            One shared daemon: per-user port ACLs\n"
         "\n"
         "Identify options:\n"
         "  -v, --verbose       Show full sysfs/udev details\n"
@@ -66,6 +102,36 @@ main(int argc, char *argv[])
         return cmd_clear(argc - 1, argv + 1);
     if (strcmp(cmd, "tail") == 0)
         return cmd_tail(argc - 1, argv + 1);
+    if (strcmp(cmd, "grep") == 0)
+        return cmd_grep(argc - 1, argv + 1);
+    if (strcmp(cmd, "wait") == 0)
+        return cmd_wait(argc - 1, argv + 1);
+    if (strcmp(cmd, "add") == 0)
+        return cmd_add(argc - 1, argv + 1);
+    if (strcmp(cmd, "remove") == 0)
+        return cmd_remove(argc - 1, argv + 1);
+    if (strcmp(cmd, "rotate") == 0)
+        return cmd_rotate(argc - 1, argv + 1);
+    if (strcmp(cmd, "digest") == 0)
+        return cmd_digest(argc - 1, argv + 1);
+    if (strcmp(cmd, "integrity") == 0)
+        return cmd_integrity(argc - 1, argv + 1);
+    if (strcmp(cmd, "metrics") == 0)
+        return cmd_metrics(argc - 1, argv + 1);
+    if (strcmp(cmd, "toplines") == 0)
+        return cmd_toplines(argc - 1, argv + 1);
+    if (strcmp(cmd, "mark") == 0)
+        return cmd_mark(argc - 1, argv + 1);
+    if (strcmp(cmd, "ping") == 0)
+        return cmd_ping(argc - 1, argv + 1);
+    if (strcmp(cmd, "bw") == 0)
+        return cmd_bw(argc - 1, argv + 1);
+    if (strcmp(cmd, "export") == 0)
+        return cmd_export(argc - 1, argv + 1);
+    if (strcmp(cmd, "archive") == 0)
+        return cmd_archive(argc - 1, argv + 1);
+    if (strcmp(cmd, "crashes") == 0)
+        return cmd_crashes(argc - 1, argv + 1);
     if (strcmp(cmd, "-h") == 0 || strcmp(cmd, "--help") == 0) {
         usage(argv[0]);
         return 0;
@@ -14,15 +14,19 @@
 #include "monitor.h"
 #include "hotplug.h"
 #include "control.h"
+#include "housekeep.h"
 #include "util.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/mman.h>
 #include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -30,10 +34,11 @@
 #include <time.h>
 #include <unistd.h>
 
-#define MAX_EPOLL_EVENTS  (MAX_PORTS * 2 + 16)
+#define MAX_EPOLL_EVENTS  (MAX_PORTS * 2 + MAX_CONTROL_CLIENTS + 16)
 #define READ_BUF_SIZE     4096
 #define PID_FILE          LOG_BASE_DIR "/uart-monitor.pid"
 #define STATUS_FILE       LOG_BASE_DIR "/status.json"
+#define MARKS_FILE        "marks.log"     /* per session */
 
 /* ------------------------------------------------------------------ */
 /*  sd_notify -- no libsystemd dependency                             */
@@ -71,9 +76,34 @@ sd_notify_send(const char *state)
 }
 
 /* ------------------------------------------------------------------ */
-/*  PID file                                                          */
+/*  Base directory and PID file                                       */
 /* ------------------------------------------------------------------ */
 
+/* LOG_BASE_DIR sits in /tmp, where any local user could have created
+ * it first and would then control every path the daemon opens in it
+ * (pidfile, sessions, latest, status.json, crashes.idx, the socket).
+ * Use it only if it is a real directory of ours; nobody else may write
+ * to it, and in system mode everyone may reach the socket. */
+static int
+check_base_dir(int system_mode)
+{
+    struct stat st;
+    if (lstat(LOG_BASE_DIR, &st) < 0 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != geteuid()) {
+        fprintf(stderr, "monitor: %s is not a directory owned by uid %d, "
+                "refusing to use it\n", LOG_BASE_DIR, (int)geteuid());
+        return -1;
+    }
+    mode_t mode = st.st_mode & 07777;
+    mode_t want = system_mode ? 0755 : mode & 0755;
+    if (mode != want && chmod(LOG_BASE_DIR, want) < 0) {
+        fprintf(stderr, "monitor: cannot chmod %s: %s\n", LOG_BASE_DIR,
+                strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
 static int
 pidfile_create(void)
 {
@@ -93,9 +123,14 @@ pidfile_create(void)
         unlink(PID_FILE);
     }
 
-    fp = fopen(PID_FILE, "w");
-    if (!fp)
+    int fd = open(PID_FILE, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW |
+                            O_CLOEXEC, 0644);
+    fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!fp) {
+        if (fd >= 0)
+            close(fd);
         return -1;
+    }
     fprintf(fp, "%d\n", getpid());
     fclose(fp);
     return 0;
@@ -129,19 +164,77 @@ pty_remove_symlink(const char *label)
     unlink(link);
 }
 
+/* ------------------------------------------------------------------ */
+/*  Access control (system mode)                                      */
+/* ------------------------------------------------------------------ */
+
+/* Root, the daemon's own user and config "admin" principals see every
+ * port and may use the daemon-wide commands. */
+static int
+peer_is_admin(const monitor_state_t *state, const acl_peer_t *peer)
+{
+    if (peer->uid == 0 || peer->uid == geteuid())
+        return 1;
+    for (int i = 0; i < state->config.admin_count; i++)
+        if (acl_who_matches(peer, state->config.admins[i]))
+            return 1;
+    return 0;
+}
+
+/* Whether the control client being served may see and use port idx.
+ * A restricted client sees the ports an "allow" line grants it; to it
+ * every other port does not exist. */
+static int
+port_visible(const monitor_state_t *state, int idx)
+{
+    if (!state->peer)
+        return 1;
+    const tty_port_t *id = &state->ports[idx].identity;
+    for (int i = 0; i < state->config.acl_count; i++) {
+        const acl_cfg_t *ac = &state->config.acls[i];
+        if ((strcmp(ac->port, "*") == 0 ||
+             config_name_matches(ac->port, id->dev_path, id->tty_name,
+                                 id->label)) &&
+            acl_who_matches(state->peer, ac->who))
+            return 1;
+    }
+    return 0;
+}
+
+/* Commands that act on the daemon rather than on ports. */
+static int
+admin_command(const char *cmd)
+{
+    static const char *const verbs[] = {
+        "ADD ", "REMOVE ", "ROTATE", "METRICS", "QUIT",
+    };
+    for (size_t i = 0; i < sizeof(verbs) / sizeof(verbs[0]); i++)
+        if (strncmp(cmd, verbs[i], strlen(verbs[i])) == 0)
+            return 1;
+    return 0;
+}
+
 /* ------------------------------------------------------------------ */
 /*  Status JSON                                                       */
 /* ------------------------------------------------------------------ */
 
-static void
-write_status_json(monitor_state_t *state)
+static int
+degraded_ports(const monitor_state_t *state)
 {
-    char tmp[512];
-    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", STATUS_FILE, getpid());
+    int n = 0;
+    for (int i = 0; i < state->port_count; i++)
+        n += state->ports[i].log.degraded;
+    return n;
+}
 
-    FILE *fp = fopen(tmp, "w");
+/* Render status.json into a malloc'd buffer. Returns NULL on failure. */
+static char *
+render_status_json(monitor_state_t *state, size_t *len)
+{
+    char *buf = NULL;
+    FILE *fp = open_memstream(&buf, len);
     if (!fp)
-        return;
+        return NULL;
 
     /* extract session name from path */
     const char *session_name = strrchr(state->session_path, '/');
@@ -152,10 +245,23 @@ write_status_json(monitor_state_t *state)
     fprintf(fp, "  \"session\": \"%s\",\n", session_name);
     fprintf(fp, "  \"proxy_mode\": %s,\n",
             state->proxy_mode ? "true" : "false");
-    fprintf(fp, "  \"port_count\": %d,\n", state->port_count);
+    /* a restricted control client gets its own view of the ports */
+    int visible = 0;
+    for (int i = 0; i < state->port_count; i++)
+        visible += port_visible(state, i);
+
+    fprintf(fp, "  \"port_count\": %d,\n", visible);
+    fprintf(fp, "  \"hotplug_adds\": %llu,\n",
+            (unsigned long long)state->hotplug_adds);
+    fprintf(fp, "  \"hotplug_removes\": %llu,\n",
+            (unsigned long long)state->hotplug_removes);
+    fprintf(fp, "  \"hotplug_settling\": %d,\n", state->pending_count);
+    fprintf(fp, "  \"degraded_ports\": %d,\n", degraded_ports(state));
     fprintf(fp, "  \"ports\": [\n");
 
-    for (int i = 0; i < state->port_count; i++) {
+    for (int i = 0, shown = 0; i < state->port_count; i++) {
+        if (!port_visible(state, i))
+            continue;
         monitored_port_t *mp = &state->ports[i];
         const char *board = "Unknown";
         if (mp->identity.board_override)
@@ -174,23 +280,287 @@ write_status_json(monitor_state_t *state)
         fprintf(fp, "      \"vid\": \"%04x\",\n", mp->identity.vid);
         fprintf(fp, "      \"pid\": \"%04x\",\n", mp->identity.pid);
         fprintf(fp, "      \"status\": \"%s\",\n",
-                mp->yielded ? "yielded" : "monitoring");
+                mp->yielded ? "yielded" :
+                mp->serial.fd < 0 || mp->serial.connecting ? "connecting" :
+                "monitoring");
+        if (mp->serial.source != SOURCE_TTY) {
+            fprintf(fp, "      \"source\": \"%s\",\n",
+                    source_kind_name(mp->serial.source));
+            fprintf(fp, "      \"connects\": %llu,\n",
+                    (unsigned long long)mp->connects);
+        }
         fprintf(fp, "      \"log_file\": \"%s\",\n", mp->log.filepath);
+        fprintf(fp, "      \"storage\": \"%s\",\n",
+                mp->log.degraded ? "degraded" : "ok");
+        fprintf(fp, "      \"priority\": \"%s\",\n",
+                config_priority_name(mp->prio));
+        if (mp->content)
+            fprintf(fp, "      \"content\": \"%s\",\n",
+                    classify_name(mp->content->kind));
+        if (mp->raw_fd >= 0)
+            fprintf(fp, "      \"content_file\": \"%s/%s%s\",\n",
+                    state->session_path, mp->identity.label,
+                    CLASSIFY_RAW_EXT);
+        if (mp->log.degraded_events) {
+            fprintf(fp, "      \"spill_backlog\": %zu,\n",
+                    mp->log.spill_len);
+            fprintf(fp, "      \"spilled_bytes\": %llu,\n",
+                    (unsigned long long)mp->log.spilled);
+            fprintf(fp, "      \"lost_bytes\": %llu,\n",
+                    (unsigned long long)mp->log.lost);
+        }
         if (mp->serial.pty_master >= 0) {
             fprintf(fp, "      \"pty_device\": \"%s/%s\",\n",
                     PTY_DIR, mp->identity.label);
             fprintf(fp, "      \"pty_slave\": \"%s\",\n",
                     mp->serial.pty_path);
         }
+        if (mp->link_idx >= 0)
+            fprintf(fp, "      \"link\": \"%s\",\n",
+                    state->links[mp->link_idx].name);
+        if (mp->checkpoint[0]) {
+            fprintf(fp, "      \"checkpoint\": \"%s\",\n", mp->checkpoint);
+            fprintf(fp, "      \"checkpoint_offset\": %lld,\n",
+                    mp->checkpoint_off);
+        }
+        if (mp->clock && mp->clock->samples) {
+            const devclock_t *dc = mp->clock;
+            char boot[32];
+            uint64_t wall = devclock_map(dc, 0) +
+                            (uint64_t)mono_to_wall_offset();
+            struct timespec bt = { .tv_sec = (time_t)(wall / 1000000000ull),
+                                   .tv_nsec = (long)(wall % 1000000000ull) };
+            timestamp_fmt_us(&bt, boot, sizeof(boot));
+            fprintf(fp, "      \"device_clock\": {\n");
+            fprintf(fp, "        \"format\": \"%s\",\n",
+                    devclock_fmt_name(dc->fmt));
+            fprintf(fp, "        \"samples\": %llu,\n",
+                    (unsigned long long)dc->samples);
+            fprintf(fp, "        \"boot\": \"%s\",\n", boot);
+            fprintf(fp, "        \"drift_ppm\": %.2f,\n",
+                    devclock_drift_ppm(dc));
+            fprintf(fp, "        \"mean_latency_us\": %llu,\n",
+                    (unsigned long long)(dc->lat_sum_ns / dc->samples / 1000));
+            fprintf(fp, "        \"resets\": %llu\n",
+                    (unsigned long long)dc->resets);
+            fprintf(fp, "      },\n");
+        }
+        if (mp->crash && mp->crash->detected) {
+            fprintf(fp, "      \"crashes\": %llu,\n",
+                    (unsigned long long)mp->crash->detected);
+            fprintf(fp, "      \"last_crash\": \"%016llx\",\n",
+                    (unsigned long long)mp->crash->last_hash);
+        }
+        if (mp->digest && mp->digest->fd >= 0)
+            fprintf(fp, "      \"digest_file\": \"%s\",\n",
+                    mp->digest->path);
+        if (mp->filter)
+            fprintf(fp, "      \"filtered_lines\": %llu,\n",
+                    (unsigned long long)mp->filter->dropped_lines);
+        if (mp->integrity.enabled) {
+            const integrity_t *ig = &mp->integrity;
+            fprintf(fp, "      \"integrity\": {\n");
+            fprintf(fp, "        \"frames_ok\": %llu,\n",
+                    (unsigned long long)ig->frames_ok);
+            fprintf(fp, "        \"frames_lost\": %llu,\n",
+                    (unsigned long long)ig->frames_lost);
+            fprintf(fp, "        \"gap_events\": %llu,\n",
+                    (unsigned long long)ig->gap_events);
+            fprintf(fp, "        \"duplicates\": %llu,\n",
+                    (unsigned long long)ig->duplicates);
+            fprintf(fp, "        \"corrupt\": %llu,\n",
+                    (unsigned long long)ig->corrupt);
+            if (ig->have_icount) {
+                fprintf(fp, "        \"kernel_overrun\": %ld,\n",
+                        ig->icount_last.overrun - ig->icount_base.overrun);
+                fprintf(fp, "        \"kernel_buf_overrun\": %ld,\n",
+                        ig->icount_last.buf_overrun -
+                        ig->icount_base.buf_overrun);
+            }
+            fprintf(fp, "        \"errors_on_full_read\": %llu,\n",
+                    (unsigned long long)ig->errors_on_full_read);
+            fprintf(fp, "        \"errors_after_stall\": %llu,\n",
+                    (unsigned long long)ig->errors_after_stall);
+            fprintf(fp, "        \"read_size_hist\": [");
+            for (int b = 0; b < IG_READ_BUCKETS; b++)
+                fprintf(fp, "%s%llu", b ? ", " : "",
+                        (unsigned long long)ig->read_hist[b]);
+            fprintf(fp, "],\n");
+            fprintf(fp, "        \"rate_bps\": %llu,\n",
+                    (unsigned long long)ig->last_bps);
+            fprintf(fp, "        \"best_clean_bps\": %llu\n",
+                    (unsigned long long)ig->best_clean_bps);
+            fprintf(fp, "      },\n");
+        }
         fprintf(fp, "      \"bytes_logged\": %zu\n", mp->log.bytes_written);
-        fprintf(fp, "    }%s\n",
-                (i < state->port_count - 1) ? "," : "");
+        fprintf(fp, "    }%s\n", (++shown < visible) ? "," : "");
     }
 
-    fprintf(fp, "  ]\n}\n");
-    fclose(fp);
+    fprintf(fp, "  ],\n");
+    fprintf(fp, "  \"links\": [\n");
+
+    int links_shown = 0;
+    for (int i = 0; i < state->link_count; i++) {
+        timeline_t *tl = &state->links[i];
+        int link_visible = !state->peer;
+        for (int p = 0; p < state->port_count && !link_visible; p++)
+            link_visible = state->ports[p].link_idx == i &&
+                           port_visible(state, p);
+        if (!link_visible)
+            continue;
+        fprintf(fp, "%s    {\n", links_shown++ ? ",\n" : "");
+        fprintf(fp, "      \"name\": \"%s\",\n", tl->name);
+        fprintf(fp, "      \"a_to_b\": \"%s\",\n", tl->label[TL_DIR_A]);
+        fprintf(fp, "      \"b_to_a\": \"%s\",\n", tl->label[TL_DIR_B]);
+        fprintf(fp, "      \"timeline_file\": \"%s\",\n", tl->path);
+        fprintf(fp, "      \"raw_file\": \"%s\",\n", tl->raw_path);
+        fprintf(fp, "      \"bytes_a_to_b\": %zu,\n", tl->bytes[TL_DIR_A]);
+        fprintf(fp, "      \"bytes_b_to_a\": %zu,\n", tl->bytes[TL_DIR_B]);
+        fprintf(fp, "      \"records\": %zu,\n", tl->records);
+        fprintf(fp, "      \"device_clock_records\": %zu,\n",
+                tl->corrected);
+        fprintf(fp, "      \"reorder_overflows\": %zu\n", tl->overflows);
+        fprintf(fp, "    }");
+    }
+
+    fprintf(fp, "%s  ]\n}\n", links_shown ? "\n" : "");
+
+    int failed = ferror(fp);
+    if (fclose(fp) != 0 || failed) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+/* Republish the whole shared-memory page (port table and daemon
+ * counters) after a structural change. */
+static void
+publish_status_page(monitor_state_t *state)
+{
+    statpage_t *sp = state->statpage;
+    if (!sp)
+        return;
+
+    const char *session_name = strrchr(state->session_path, '/');
+    session_name = session_name ? session_name + 1 : state->session_path;
+
+    statpage_begin(sp);
+    sp->updated = mono_ns();
+    strlcpy_safe(sp->session, session_name, sizeof(sp->session));
+    sp->proxy_mode = (uint32_t)state->proxy_mode;
+    sp->port_count = (uint32_t)state->port_count;
+    sp->degraded_ports = (uint32_t)degraded_ports(state);
+    sp->hotplug_settling = (uint32_t)state->pending_count;
+    sp->hotplug_adds = state->hotplug_adds;
+    sp->hotplug_removes = state->hotplug_removes;
+
+    for (int i = 0; i < state->port_count; i++) {
+        const monitored_port_t *mp = &state->ports[i];
+        statpage_port_t *p = &sp->ports[i];
+        const char *board = "Unknown";
+        if (mp->identity.board_override)
+            board = mp->identity.board_override;
+        else if (mp->identity.known && mp->identity.known->boards[0])
+            board = mp->identity.known->boards[0];
+
+        memset(p, 0, sizeof(*p));
+        strlcpy_safe(p->device, mp->identity.dev_path, sizeof(p->device));
+        strlcpy_safe(p->label, mp->identity.label, sizeof(p->label));
+        strlcpy_safe(p->board, board, sizeof(p->board));
+        strlcpy_safe(p->function, mp->identity.function_name ?
+                     mp->identity.function_name : "Unknown",
+                     sizeof(p->function));
+        if (mp->link_idx >= 0)
+            strlcpy_safe(p->link, state->links[mp->link_idx].name,
+                         sizeof(p->link));
+        strlcpy_safe(p->log_file, mp->log.filepath, sizeof(p->log_file));
+        if (mp->serial.source != SOURCE_TTY) {
+            strlcpy_safe(p->source, source_kind_name(mp->serial.source),
+                         sizeof(p->source));
+            p->connects = mp->connects;
+        }
+        strlcpy_safe(p->priority, config_priority_name(mp->prio),
+                     sizeof(p->priority));
+        if (mp->content)
+            strlcpy_safe(p->content, classify_name(mp->content->kind),
+                         sizeof(p->content));
+        strlcpy_safe(p->checkpoint, mp->checkpoint, sizeof(p->checkpoint));
+        p->checkpoint_off = mp->checkpoint_off;
+        p->vid = mp->identity.vid;
+        p->pid = mp->identity.pid;
+        if (mp->yielded)
+            p->flags |= SP_F_YIELDED;
+        else if (mp->serial.fd < 0 || mp->serial.connecting)
+            p->flags |= SP_F_CONNECTING;
+        if (mp->log.degraded)
+            p->flags |= SP_F_DEGRADED;
+        if (mp->integrity.enabled)
+            p->flags |= SP_F_INTEGRITY;
+        if (mp->raw_fd >= 0)
+            p->flags |= SP_F_RAW;
+        if (mp->serial.pty_master >= 0) {
+            p->flags |= SP_F_PROXY;
+            strlcpy_safe(p->pty_slave, mp->serial.pty_path,
+                         sizeof(p->pty_slave));
+        }
+        p->bytes_read = mp->bytes_read;
+        p->bytes_logged = mp->log.bytes_written;
+        p->rate_bps = mp->rate_bps;
+        p->rate_at = mp->rate_at;
+        p->last_activity = mp->last_read_ns;
+        p->spilled = mp->log.spilled;
+        p->lost = mp->log.lost;
+    }
+    statpage_end(sp);
+}
+
+/* Per-read update: only the counters of one port change. */
+static void
+publish_read(monitor_state_t *state, int idx, size_t nr, uint64_t ts)
+{
+    monitored_port_t *mp = &state->ports[idx];
 
-    rename(tmp, STATUS_FILE);
+    mp->last_read_ns = ts;
+    mp->rate_bytes += nr;
+    if (mp->rate_start_ns == 0) {
+        mp->rate_start_ns = ts;
+    } else if (ts - mp->rate_start_ns >= 1000000000ull) {
+        mp->rate_bps = mp->rate_bytes * 1000000000ull /
+                       (ts - mp->rate_start_ns);
+        mp->rate_at = ts;
+        mp->rate_start_ns = ts;
+        mp->rate_bytes = 0;
+    }
+
+    statpage_t *sp = state->statpage;
+    if (!sp || idx >= (int)sp->port_count)
+        return;
+    statpage_port_t *p = &sp->ports[idx];
+    statpage_begin(sp);
+    p->bytes_read = mp->bytes_read;
+    p->bytes_logged = mp->log.bytes_written;
+    p->rate_bps = mp->rate_bps;
+    p->rate_at = mp->rate_at;
+    p->last_activity = ts;
+    statpage_end(sp);
+}
+
+/* The file itself is written by the housekeeping thread, so a slow disk
+ * never stalls capture (which may be running at real-time priority). */
+static void
+write_status_json(monitor_state_t *state)
+{
+    publish_status_page(state);
+
+    /* the file always describes every port, whoever asked */
+    const acl_peer_t *peer = state->peer;
+    state->peer = NULL;
+    size_t len;
+    char *buf = render_status_json(state, &len);
+    state->peer = peer;
+    if (buf)
+        housekeep_write_file(STATUS_FILE, buf, len);
 }
 
 /* ------------------------------------------------------------------ */
@@ -222,40 +592,291 @@ port_matches_filter(const char *dev_path, const char *filter)
     return 0;
 }
 
-static int
-add_port(monitor_state_t *state, tty_port_t *identity)
+/* Attach a port to a configured link if it names one of the halves. */
+static void
+link_port(monitor_state_t *state, monitored_port_t *mp)
 {
-    if (state->port_count >= MAX_PORTS)
-        return -1;
+    mp->link_idx = -1;
+    for (int i = 0; i < state->config.link_count; i++) {
+        const link_cfg_t *lc = &state->config.links[i];
+        const tty_port_t *id = &mp->identity;
+        if (config_name_matches(lc->port_a, id->dev_path,
+                                id->tty_name, id->label)) {
+            mp->link_idx = i;
+            mp->link_dir = TL_DIR_A;
+        } else if (config_name_matches(lc->port_b, id->dev_path,
+                                       id->tty_name, id->label)) {
+            mp->link_idx = i;
+            mp->link_dir = TL_DIR_B;
+        } else {
+            continue;
+        }
+        if (i < state->link_count) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "%s %s CONNECTED",
+                     mp->link_dir == TL_DIR_A ? "A->B" : "B->A", id->label);
+            timeline_marker(&state->links[i], msg);
+        }
+        return;
+    }
+}
 
-    /* check filter */
-    if (!port_matches_filter(identity->dev_path, state->only_filter))
-        return -1;
+/* Read scheduling class from the config's priority lines. */
+static prio_class_t
+port_priority(const monitor_state_t *state, const tty_port_t *id)
+{
+    for (int i = 0; i < state->config.priority_count; i++) {
+        const prio_cfg_t *pc = &state->config.priorities[i];
+        if (config_name_matches(pc->port, id->dev_path, id->tty_name,
+                                id->label))
+            return pc->prio;
+    }
+    return PRIO_NORMAL;
+}
 
-    /* check for duplicate */
-    for (int i = 0; i < state->port_count; i++) {
-        if (strcmp(state->ports[i].identity.dev_path,
-                   identity->dev_path) == 0)
-            return -1; /* already monitoring */
+/* The port's line filter from the config, compiled on first use.
+ * NULL when no filter rule names the port. */
+static filter_t *
+port_filter(monitor_state_t *state, monitored_port_t *mp)
+{
+    if (mp->filter)
+        return mp->filter;
+
+    filter_t *f = NULL;
+    for (int i = 0; i < state->config.filter_count; i++) {
+        const filter_cfg_t *fc = &state->config.filters[i];
+        if (!config_name_matches(fc->port, mp->identity.dev_path,
+                                 mp->identity.tty_name, mp->identity.label))
+            continue;
+        if (!f) {
+            f = malloc(sizeof(*f));
+            if (!f)
+                return NULL;
+            filter_init(f);
+        }
+        if (filter_add(f, fc->drop ? FILTER_DROP : FILTER_KEEP,
+                       fc->pattern) < 0)
+            fprintf(stderr, "monitor: %s: more than %d filter rules "
+                    "(ignoring '%s')\n", mp->identity.label,
+                    FILTER_MAX_RULES, fc->pattern);
+    }
+    if (f && filter_compile(f) < 0) {
+        fprintf(stderr, "monitor: %s: cannot build line filter\n",
+                mp->identity.label);
+        free(f);
+        f = NULL;
     }
+    mp->filter = f;
+    return f;
+}
 
-    int idx = state->port_count;
-    monitored_port_t *mp = &state->ports[idx];
-    memset(mp, 0, sizeof(*mp));
-    mp->identity = *identity;
-    mp->serial.fd = -1;
-    mp->serial.pty_master = -1;
+static void
+free_port_filter(monitored_port_t *mp)
+{
+    if (!mp->filter)
+        return;
+    filter_free(mp->filter);
+    free(mp->filter);
+    mp->filter = NULL;
+}
 
-    /* open serial port (proxy or read-only) */
-    int rc;
-    if (state->proxy_mode)
-        rc = serial_open_proxy(&mp->serial, identity->dev_path,
-                               state->baudrate);
-    else
-        rc = serial_open(&mp->serial, identity->dev_path, state->baudrate);
+/* The port's crash detector, pointed at the log just opened. */
+static crash_t *
+port_crash(monitor_state_t *state, monitored_port_t *mp)
+{
+    if (!mp->crash) {
+        char index[512];
+        mp->crash = malloc(sizeof(*mp->crash));
+        if (!mp->crash)
+            return NULL;
+        snprintf(index, sizeof(index), "%s/%s", LOG_BASE_DIR, CRASH_INDEX);
+        crash_init(mp->crash, index, mp->identity.label);
+    }
+    const char *session = strrchr(state->session_path, '/');
+    const char *log_name = strrchr(mp->log.filepath, '/');
+    crash_attach(mp->crash, session ? session + 1 : state->session_path,
+                 log_name ? log_name + 1 : mp->log.filepath);
+    return mp->crash;
+}
 
-    if (rc < 0)
-        return -1;
+/* The port's device clock model; it survives log rotation. */
+static devclock_t *
+port_clock(monitored_port_t *mp)
+{
+    if (!mp->clock) {
+        mp->clock = malloc(sizeof(*mp->clock));
+        if (mp->clock)
+            devclock_init(mp->clock);
+    }
+    return mp->clock;
+}
+
+static void
+free_port_clock(monitor_state_t *state, monitored_port_t *mp)
+{
+    if (!mp->clock)
+        return;
+    for (int i = 0; i < state->link_count; i++)
+        for (int d = 0; d < 2; d++)
+            if (state->links[i].clock[d] == mp->clock)
+                state->links[i].clock[d] = NULL;
+    free(mp->clock);
+    mp->clock = NULL;
+}
+
+/* The port's recent-lines ring, emptied for the log just opened: its
+ * offsets are those of the new file. */
+static recent_t *
+port_recent(monitored_port_t *mp)
+{
+    if (!mp->recent)
+        mp->recent = malloc(sizeof(*mp->recent));
+    if (mp->recent)
+        recent_reset(mp->recent);
+    return mp->recent;
+}
+
+static void
+free_port_recent(monitored_port_t *mp)
+{
+    free(mp->recent);
+    mp->recent = NULL;
+}
+
+/* The port's template counts, started over for the log just opened. */
+static toplines_t *
+port_toplines(monitored_port_t *mp)
+{
+    if (!mp->toplines)
+        mp->toplines = malloc(sizeof(*mp->toplines));
+    if (mp->toplines)
+        toplines_reset(mp->toplines);
+    return mp->toplines;
+}
+
+static void
+free_port_toplines(monitored_port_t *mp)
+{
+    free(mp->toplines);
+    mp->toplines = NULL;
+}
+
+/* The port's content classifier, pinned by a "content" line if any.
+ * Kept across rotations: what a port sends does not change with the
+ * log file. */
+static classify_t *
+port_content(monitor_state_t *state, monitored_port_t *mp)
+{
+    content_t forced = CONTENT_UNKNOWN;
+    for (int i = 0; i < state->config.content_count; i++) {
+        const content_cfg_t *cc = &state->config.contents[i];
+        if (!config_name_matches(cc->port, mp->identity.dev_path,
+                                 mp->identity.tty_name, mp->identity.label))
+            continue;
+        if (cc->mode == CONTENT_MODE_TEXT)
+            forced = CONTENT_TEXT;
+        else if (cc->mode == CONTENT_MODE_BINARY)
+            forced = CONTENT_BINARY;
+        break;
+    }
+    mp->raw_fd = -1;
+    serial_icount_t ic;
+    mp->frames = serial_get_icount(mp->serial.fd, &ic) == 0 ? ic.frame : -1;
+    mp->content = malloc(sizeof(*mp->content));
+    if (mp->content)
+        classify_init(mp->content, forced);
+    return mp->content;
+}
+
+/* Close <label>.bin; the next binary data opens it in the session of
+ * the moment. */
+static void
+close_port_raw(monitored_port_t *mp)
+{
+    if (mp->raw_fd >= 0)
+        close(mp->raw_fd);
+    mp->raw_fd = -1;
+    mp->raw_bytes = 0;
+}
+
+/* Open <label>.bin in the current session while the port is not text. */
+static void
+open_port_raw(monitor_state_t *state, monitored_port_t *mp)
+{
+    if (mp->raw_fd >= 0 || !mp->content ||
+        mp->content->kind < CONTENT_BINARY)
+        return;
+    char path[600];
+    snprintf(path, sizeof(path), "%s/%s%s", state->session_path,
+             mp->identity.label, CLASSIFY_RAW_EXT);
+    mp->raw_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat st;
+    if (mp->raw_fd < 0)
+        fprintf(stderr, "monitor: cannot open %s: %s\n", path,
+                strerror(errno));
+    else if (fstat(mp->raw_fd, &st) == 0)
+        mp->raw_bytes = (unsigned long long)st.st_size;
+}
+
+static void
+free_port_content(monitored_port_t *mp)
+{
+    close_port_raw(mp);
+    free(mp->content);
+    mp->content = NULL;
+}
+
+/* The port's digest, writing <label>.digest next to the log just
+ * opened; NULL unless --digest or a "digest" line asks for it. */
+static digest_t *
+port_digest(monitor_state_t *state, monitored_port_t *mp)
+{
+    int want = state->digest_all;
+    for (int i = 0; i < state->config.digest_count && !want; i++)
+        want = config_name_matches(state->config.digest[i],
+                                   mp->identity.dev_path,
+                                   mp->identity.tty_name,
+                                   mp->identity.label);
+    if (!want)
+        return NULL;
+    if (!mp->digest) {
+        mp->digest = malloc(sizeof(*mp->digest));
+        if (!mp->digest)
+            return NULL;
+        digest_init(mp->digest);
+    }
+    char path[600];
+    snprintf(path, sizeof(path), "%s/%s%s", state->session_path,
+             mp->identity.label, DIGEST_EXT);
+    return digest_open(mp->digest, path) == 0 ? mp->digest : NULL;
+}
+
+static void
+free_port_digest(monitored_port_t *mp)
+{
+    if (!mp->digest)
+        return;
+    digest_close(mp->digest);
+    free(mp->digest);
+    mp->digest = NULL;
+}
+
+static void
+free_port_crash(monitored_port_t *mp)
+{
+    if (!mp->crash)
+        return;
+    crash_finish(mp->crash);
+    free(mp->crash);
+    mp->crash = NULL;
+}
+
+/* Open the port's log in the current session, with header and the
+ * tty_name.log compat symlink. */
+static int
+open_port_log(monitor_state_t *state, monitored_port_t *mp)
+{
+    const tty_port_t *identity = &mp->identity;
 
     /* build log header */
     char header[512];
@@ -276,11 +897,20 @@ add_port(monitor_state_t *state, tty_port_t *identity)
 
     /* open log file -- use label as filename for human-friendly names */
     if (log_open(&mp->log, state->session_path,
-                 identity->label, header) < 0) {
-        serial_close(&mp->serial);
+                 identity->label, header) < 0)
         return -1;
-    }
     mp->log.timestamps = state->timestamps;
+    mp->log.sync_on_marker = state->config.durability >= DURABILITY_MARKER;
+    mp->log.sync_patterns = state->sync_patterns;
+    mp->log.sync_pattern_count = state->config.sync_pattern_count;
+    /* line stages, in order: the crash detector sees lines before the
+     * filter drops any, TAIL and TOPLINES only what reaches the file */
+    log_add_stage(&mp->log, &log_stage_clock, port_clock(mp));
+    log_add_stage(&mp->log, &log_stage_crash, port_crash(state, mp));
+    log_add_stage(&mp->log, &log_stage_filter, port_filter(state, mp));
+    log_add_stage(&mp->log, &log_stage_recent, port_recent(mp));
+    log_add_stage(&mp->log, &log_stage_toplines, port_toplines(mp));
+    log_add_stage(&mp->log, &log_stage_digest, port_digest(state, mp));
 
     /* create a tty_name.log -> label.log symlink for compatibility */
     if (strcmp(identity->tty_name, identity->label) != 0) {
@@ -296,61 +926,257 @@ add_port(monitor_state_t *state, tty_port_t *identity)
         }
     }
 
-    /* add serial fd to epoll */
-    mp->evt.type = EVT_SERIAL;
-    mp->evt.index = idx;
-    mp->evt.fd = mp->serial.fd;
+    return 0;
+}
 
+/* Register the port's fd with epoll: for writability while a socket
+ * connect is in progress, for input after that. */
+static int
+watch_port(monitor_state_t *state, monitored_port_t *mp, int op)
+{
     struct epoll_event ev;
-    ev.events = EPOLLIN;
+    ev.events = mp->serial.connecting ? EPOLLOUT : EPOLLIN;
     ev.data.ptr = &mp->evt;
-    if (epoll_ctl(state->epoll_fd, EPOLL_CTL_ADD,
-                  mp->serial.fd, &ev) < 0) {
-        fprintf(stderr, "monitor: epoll_ctl add %s: %s\n",
-                identity->dev_path, strerror(errno));
-        log_close(&mp->log);
-        serial_close(&mp->serial);
-        return -1;
-    }
-
-    /* if proxy mode, also add PTY master to epoll */
-    if (mp->serial.pty_master >= 0) {
-        mp->evt_pty.type = EVT_PTY;
-        mp->evt_pty.index = idx;
-        mp->evt_pty.fd = mp->serial.pty_master;
-
-        ev.events = EPOLLIN;
-        ev.data.ptr = &mp->evt_pty;
-        if (epoll_ctl(state->epoll_fd, EPOLL_CTL_ADD,
-                      mp->serial.pty_master, &ev) < 0) {
-            fprintf(stderr, "monitor: epoll_ctl add pty %s: %s\n",
-                    identity->dev_path, strerror(errno));
-            /* non-fatal: serial monitoring still works */
-        }
+    mp->evt.fd = mp->serial.fd;
+    return epoll_ctl(state->epoll_fd, op, mp->serial.fd, &ev);
+}
 
-        /* create PTY symlink */
-        pty_create_symlink(identity->label, mp->serial.pty_path);
-    }
+/* ------------------------------------------------------------------ */
+/*  Socket and FIFO sources                                           */
+/* ------------------------------------------------------------------ */
 
-    state->port_count++;
+/* Try again after the current backoff, doubling it. */
+static void
+source_retry_later(monitored_port_t *mp)
+{
+    mp->retry_ms = mp->retry_ms ? mp->retry_ms * 2 : SOURCE_RETRY_MIN_MS;
+    if (mp->retry_ms > SOURCE_RETRY_MAX_MS)
+        mp->retry_ms = SOURCE_RETRY_MAX_MS;
+    mp->retry_ns = mono_ns() + (uint64_t)mp->retry_ms * 1000000ull;
+}
 
-    if (mp->serial.pty_master >= 0) {
-        printf("  Monitoring: %s [%s] -> %s\n"
-               "    PTY proxy: %s/%s -> %s\n",
-               identity->dev_path, identity->label, mp->log.filepath,
-               PTY_DIR, identity->label, mp->serial.pty_path);
-    } else {
-        printf("  Monitoring: %s [%s] -> %s\n",
-               identity->dev_path, identity->label, mp->log.filepath);
-    }
+static void
+source_connected(monitor_state_t *state, monitored_port_t *mp)
+{
+    char msg[320];
+    mp->retry_ms = 0;
+    mp->connects++;
+    snprintf(msg, sizeof(msg), "SOURCE CONNECTED (%s)",
+             mp->identity.dev_path);
+    log_marker(&mp->log, msg);
+    printf("  Connected: %s [%s]\n", mp->identity.dev_path,
+           mp->identity.label);
+    write_status_json(state);
+}
 
-    return idx;
+/* The peer went away (QEMU exited, ser2net restarted): keep the port
+ * and its log, and reconnect with backoff. */
+static void
+source_lost(monitor_state_t *state, monitored_port_t *mp, const char *why)
+{
+    char msg[320];
+    epoll_ctl(state->epoll_fd, EPOLL_CTL_DEL, mp->serial.fd, NULL);
+    close(mp->serial.fd);
+    mp->serial.fd = -1;
+    mp->serial.connecting = 0;
+    snprintf(msg, sizeof(msg), "SOURCE DISCONNECTED (%s), reconnecting",
+             why);
+    log_marker(&mp->log, msg);
+    fprintf(stderr, "monitor: %s: %s, reconnecting\n",
+            mp->identity.dev_path, why);
+    source_retry_later(mp);
+    write_status_json(state);
 }
 
+/* One connect attempt for a source that is not connected. */
 static void
-remove_port(monitor_state_t *state, int idx)
+source_connect(monitor_state_t *state, monitored_port_t *mp)
 {
-    if (idx < 0 || idx >= state->port_count)
+    if (serial_connect(&mp->serial) < 0) {
+        source_retry_later(mp);
+        return;
+    }
+    if (watch_port(state, mp, EPOLL_CTL_ADD) < 0) {
+        fprintf(stderr, "monitor: epoll_ctl add %s: %s\n",
+                mp->identity.dev_path, strerror(errno));
+        close(mp->serial.fd);
+        mp->serial.fd = -1;
+        source_retry_later(mp);
+        return;
+    }
+    if (!mp->serial.connecting)
+        source_connected(state, mp);
+}
+
+/* A connect in progress finished: watch for input, or start over. */
+static int
+source_finish(monitor_state_t *state, monitored_port_t *mp)
+{
+    if (source_finish_connect(mp->serial.fd) < 0) {
+        char why[128];
+        snprintf(why, sizeof(why), "connect: %s", strerror(errno));
+        source_lost(state, mp, why);
+        return -1;
+    }
+    mp->serial.connecting = 0;
+    watch_port(state, mp, EPOLL_CTL_MOD);
+    source_connected(state, mp);
+    return 0;
+}
+
+/* Reconnect the sources whose retry time has come. */
+static void
+service_sources(monitor_state_t *state, uint64_t now)
+{
+    for (int i = 0; i < state->port_count; i++) {
+        monitored_port_t *mp = &state->ports[i];
+        if (mp->serial.source != SOURCE_TTY && mp->serial.fd < 0 &&
+            !mp->yielded && now >= mp->retry_ns)
+            source_connect(state, mp);
+    }
+}
+
+/* Milliseconds until the next reconnect attempt, or -1 if none. */
+static int
+source_timeout_ms(const monitor_state_t *state, uint64_t now)
+{
+    int wait = -1;
+    for (int i = 0; i < state->port_count; i++) {
+        const monitored_port_t *mp = &state->ports[i];
+        if (mp->serial.source == SOURCE_TTY || mp->serial.fd >= 0 ||
+            mp->yielded)
+            continue;
+        int ms = mp->retry_ns <= now ? 0 :
+                 (int)((mp->retry_ns - now + 999999) / 1000000);
+        if (wait < 0 || ms < wait)
+            wait = ms;
+    }
+    return wait;
+}
+
+static int
+add_port(monitor_state_t *state, tty_port_t *identity)
+{
+    if (state->port_count >= MAX_PORTS)
+        return -1;
+
+    /* check for duplicate */
+    for (int i = 0; i < state->port_count; i++) {
+        if (strcmp(state->ports[i].identity.dev_path,
+                   identity->dev_path) == 0)
+            return -1; /* already monitoring */
+    }
+
+    int idx = state->port_count;
+    monitored_port_t *mp = &state->ports[idx];
+    memset(mp, 0, sizeof(*mp));
+    mp->identity = *identity;
+    mp->serial.fd = -1;
+    mp->serial.pty_master = -1;
+
+    /* open serial port (proxy or read-only) */
+    int rc;
+    if (state->proxy_mode)
+        rc = serial_open_proxy(&mp->serial, identity->dev_path,
+                               state->baudrate);
+    else
+        rc = serial_open(&mp->serial, identity->dev_path, state->baudrate);
+
+    if (rc < 0)
+        return -1;
+
+    if (open_port_log(state, mp) < 0) {
+        serial_close(&mp->serial);
+        return -1;
+    }
+    port_content(state, mp);
+    open_port_raw(state, mp);           /* "content <port> binary" */
+
+    /* add serial fd to epoll; a source not there yet is retried */
+    mp->evt.type = EVT_SERIAL;
+    mp->evt.index = idx;
+    mp->evt.fd = mp->serial.fd;
+
+    struct epoll_event ev;
+    if (mp->serial.fd < 0) {
+        source_retry_later(mp);
+    } else if (watch_port(state, mp, EPOLL_CTL_ADD) < 0) {
+        fprintf(stderr, "monitor: epoll_ctl add %s: %s\n",
+                identity->dev_path, strerror(errno));
+        log_close(&mp->log);
+        serial_close(&mp->serial);
+        free_port_filter(mp);
+        free_port_crash(mp);
+        free_port_clock(state, mp);
+        free_port_recent(mp);
+        free_port_toplines(mp);
+        free_port_digest(mp);
+        free_port_content(mp);
+        return -1;
+    }
+
+    /* if proxy mode, also add PTY master to epoll */
+    if (mp->serial.pty_master >= 0) {
+        mp->evt_pty.type = EVT_PTY;
+        mp->evt_pty.index = idx;
+        mp->evt_pty.fd = mp->serial.pty_master;
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = &mp->evt_pty;
+        if (epoll_ctl(state->epoll_fd, EPOLL_CTL_ADD,
+                      mp->serial.pty_master, &ev) < 0) {
+            fprintf(stderr, "monitor: epoll_ctl add pty %s: %s\n",
+                    identity->dev_path, strerror(errno));
+            /* non-fatal: serial monitoring still works */
+        }
+
+        /* create PTY symlink */
+        pty_create_symlink(identity->label, mp->serial.pty_path);
+    }
+
+    link_port(state, mp);
+    mp->prio = port_priority(state, identity);
+
+    if (state->integrity_all)
+        integrity_init(&mp->integrity, READ_BUF_SIZE, mp->serial.fd);
+    for (int i = 0; i < state->config.integrity_count; i++) {
+        if (config_name_matches(state->config.integrity[i],
+                                identity->dev_path, identity->tty_name,
+                                identity->label))
+            integrity_init(&mp->integrity, READ_BUF_SIZE, mp->serial.fd);
+    }
+
+    state->port_count++;
+
+    if (mp->serial.pty_master >= 0) {
+        printf("  Monitoring: %s [%s] -> %s\n"
+               "    PTY proxy: %s/%s -> %s\n",
+               identity->dev_path, identity->label, mp->log.filepath,
+               PTY_DIR, identity->label, mp->serial.pty_path);
+    } else {
+        printf("  Monitoring: %s [%s] -> %s\n",
+               identity->dev_path, identity->label, mp->log.filepath);
+    }
+    if (mp->serial.source != SOURCE_TTY && mp->serial.fd >= 0 &&
+        !mp->serial.connecting)
+        source_connected(state, mp);
+
+    return idx;
+}
+
+/* Add a port found by scanning or hot-plug, subject to --only. */
+static int
+add_discovered_port(monitor_state_t *state, tty_port_t *identity)
+{
+    if (!port_matches_filter(identity->dev_path, state->only_filter))
+        return -1;
+    return add_port(state, identity);
+}
+
+static void
+remove_port(monitor_state_t *state, int idx)
+{
+    if (idx < 0 || idx >= state->port_count)
         return;
 
     monitored_port_t *mp = &state->ports[idx];
@@ -369,6 +1195,21 @@ remove_port(monitor_state_t *state, int idx)
     log_marker(&mp->log, "PORT DISCONNECTED");
     log_close(&mp->log);
     serial_close(&mp->serial);
+    free_port_filter(mp);
+    free_port_crash(mp);
+    free_port_clock(state, mp);
+    free_port_recent(mp);
+    free_port_toplines(mp);
+    free_port_digest(mp);
+    free_port_content(mp);
+
+    if (mp->link_idx >= 0 && mp->link_idx < state->link_count) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%s %s DISCONNECTED",
+                 mp->link_dir == TL_DIR_A ? "A->B" : "B->A",
+                 mp->identity.label);
+        timeline_marker(&state->links[mp->link_idx], msg);
+    }
 
     printf("  Removed: %s [%s]\n",
            mp->identity.dev_path, mp->identity.label);
@@ -379,13 +1220,8 @@ remove_port(monitor_state_t *state, int idx)
         state->ports[i].evt.index = i;
         state->ports[i].evt_pty.index = i;
         /* re-register with epoll using updated index */
-        if (state->ports[i].serial.fd >= 0 && !state->ports[i].yielded) {
-            struct epoll_event ev;
-            ev.events = EPOLLIN;
-            ev.data.ptr = &state->ports[i].evt;
-            epoll_ctl(state->epoll_fd, EPOLL_CTL_MOD,
-                      state->ports[i].serial.fd, &ev);
-        }
+        if (state->ports[i].serial.fd >= 0 && !state->ports[i].yielded)
+            watch_port(state, &state->ports[i], EPOLL_CTL_MOD);
         if (state->ports[i].serial.pty_master >= 0) {
             struct epoll_event ev;
             ev.events = EPOLLIN;
@@ -395,6 +1231,7 @@ remove_port(monitor_state_t *state, int idx)
         }
     }
     state->port_count--;
+    state->port_gen++;
 }
 
 static int
@@ -402,7 +1239,7 @@ find_port_by_path(monitor_state_t *state, const char *dev_path)
 {
     for (int i = 0; i < state->port_count; i++) {
         if (strcmp(state->ports[i].identity.dev_path, dev_path) == 0)
-            return i;
+            return port_visible(state, i) ? i : -1;
     }
     return -1;
 }
@@ -424,6 +1261,8 @@ find_port_by_name(monitor_state_t *state, const char *name)
 
     /* try label match, then tty_name */
     for (int i = 0; i < state->port_count; i++) {
+        if (!port_visible(state, i))
+            continue;
         if (strcmp(state->ports[i].identity.label, stripped) == 0)
             return i;
         if (strcmp(state->ports[i].identity.tty_name, stripped) == 0)
@@ -433,19 +1272,95 @@ find_port_by_name(monitor_state_t *state, const char *name)
 }
 
 /* ------------------------------------------------------------------ */
-/*  Yield / Reclaim                                                   */
+/*  Port groups                                                       */
 /* ------------------------------------------------------------------ */
 
-static void
-yield_port(monitor_state_t *state, int idx, char *resp, size_t resp_sz)
+static int
+is_group_selector(const char *name)
 {
-    monitored_port_t *mp = &state->ports[idx];
+    return strncmp(name, "board:", 6) == 0 ||
+           strncmp(name, "group:", 6) == 0;
+}
 
-    if (mp->yielded) {
-        snprintf(resp, resp_sz, "OK already yielded %s\n",
-                 mp->identity.dev_path);
-        return;
+/* Ports named by a group selector, in interface order:
+ *   board:<id>    every port whose USB serial number is id, or whose
+ *                 board ~/.boards names id
+ *   group:<port>  every port on the same USB device as <port> (device
+ *                 path, label or tty name), as "identify" groups them
+ * A port not on USB (a socket, a platform UART) is a group of its own.
+ * Returns the number of indices put in sel. */
+static int
+select_group(monitor_state_t *state, const char *name, int sel[MAX_PORTS])
+{
+    int n = 0;
+    if (strncmp(name, "board:", 6) == 0) {
+        const char *id = name + 6;
+        for (int i = 0; *id && i < state->port_count; i++) {
+            const tty_port_t *p = &state->ports[i].identity;
+            if (port_visible(state, i) &&
+                (strcmp(p->serial, id) == 0 ||
+                 (p->board_override &&
+                  strcmp(p->board_override, id) == 0)))
+                sel[n++] = i;
+        }
+    } else {
+        int idx = find_port_by_name(state, name + 6);
+        if (idx < 0)
+            return 0;
+        const tty_port_t *ref = &state->ports[idx].identity;
+        if (!ref->usb_path[0]) {
+            sel[0] = idx;
+            return 1;
+        }
+        char key[256], k[256];
+        port_group_key(ref, key, sizeof(key));
+        for (int i = 0; i < state->port_count; i++) {
+            if (!port_visible(state, i))
+                continue;
+            port_group_key(&state->ports[i].identity, k, sizeof(k));
+            if (strcmp(k, key) == 0)
+                sel[n++] = i;
+        }
+    }
+
+    for (int i = 1; i < n; i++) {
+        int v = sel[i], j = i;
+        int iface = state->ports[v].identity.interface_num;
+        while (j > 0 && state->ports[sel[j - 1]].identity.interface_num >
+                        iface) {
+            sel[j] = sel[j - 1];
+            j--;
+        }
+        sel[j] = v;
     }
+    return n;
+}
+
+/* The ports a control command names: a group selector, or one port by
+ * device path (by_path) or by any name. Returns the count, 0 if none. */
+int
+select_ports(monitor_state_t *state, const char *name, int by_path,
+             int sel[MAX_PORTS])
+{
+    if (is_group_selector(name))
+        return select_group(state, name, sel);
+    sel[0] = by_path ? find_port_by_path(state, name) :
+                       find_port_by_name(state, name);
+    return sel[0] >= 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Yield / Reclaim                                                   */
+/* ------------------------------------------------------------------ */
+
+/* Release one port, marking its log with msg at ts. Returns 1 if it was
+ * already yielded. */
+static int
+yield_one(monitor_state_t *state, monitored_port_t *mp, const char *msg,
+          const char *ts)
+{
+    if (mp->yielded)
+        return 1;
 
     /* remove PTY master from epoll (keep PTY alive for reconnect) */
     if (mp->serial.pty_master >= 0)
@@ -458,27 +1373,41 @@ yield_port(monitor_state_t *state, int idx, char *resp, size_t resp_sz)
         close(mp->serial.fd);
         mp->serial.fd = -1;
     }
+    mp->serial.connecting = 0;
 
     mp->yielded = 1;
-    log_marker(&mp->log, "PORT YIELDED (released for flashing)");
+    log_marker_at(&mp->log, msg, ts);
 
     printf("  Yielded: %s [%s]\n",
            mp->identity.dev_path, mp->identity.label);
-
-    write_status_json(state);
-
-    snprintf(resp, resp_sz, "OK yielded %s\n", mp->identity.dev_path);
+    return 0;
 }
 
-static void
-reclaim_port(monitor_state_t *state, int idx, char *resp, size_t resp_sz)
+/* Reopen one yielded port, marking its log with msg at ts. Returns 0, 1
+ * if it was not yielded, or -1 with the reason in err. */
+static int
+reclaim_one(monitor_state_t *state, monitored_port_t *mp, const char *msg,
+            const char *ts, char *err, size_t err_sz)
 {
-    monitored_port_t *mp = &state->ports[idx];
+    if (!mp->yielded)
+        return 1;
 
-    if (!mp->yielded) {
-        snprintf(resp, resp_sz, "OK already monitoring %s\n",
-                 mp->identity.dev_path);
-        return;
+    /* a socket or FIFO connects as after a disconnect */
+    if (mp->serial.source != SOURCE_TTY) {
+        if (mp->serial.pty_master >= 0) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = &mp->evt_pty;
+            epoll_ctl(state->epoll_fd, EPOLL_CTL_ADD,
+                      mp->serial.pty_master, &ev);
+        }
+        mp->yielded = 0;
+        mp->retry_ms = 0;
+        log_marker_at(&mp->log, msg, ts);
+        source_connect(state, mp);
+        printf("  Reclaimed: %s [%s]\n",
+               mp->identity.dev_path, mp->identity.label);
+        return 0;
     }
 
     /* reopen serial port */
@@ -490,9 +1419,9 @@ reclaim_port(monitor_state_t *state, int idx, char *resp, size_t resp_sz)
 
     mp->serial.fd = open(mp->identity.dev_path, open_flags);
     if (mp->serial.fd < 0) {
-        snprintf(resp, resp_sz, "ERROR cannot reopen %s: %s\n",
+        snprintf(err, err_sz, "cannot reopen %s: %s",
                  mp->identity.dev_path, strerror(errno));
-        return;
+        return -1;
     }
 
     /* reconfigure termios */
@@ -517,9 +1446,9 @@ reclaim_port(monitor_state_t *state, int idx, char *resp, size_t resp_sz)
                   mp->serial.fd, &ev) < 0) {
         close(mp->serial.fd);
         mp->serial.fd = -1;
-        snprintf(resp, resp_sz, "ERROR epoll add failed for %s\n",
+        snprintf(err, err_sz, "epoll add failed for %s",
                  mp->identity.dev_path);
-        return;
+        return -1;
     }
 
     /* re-add PTY master to epoll if proxying */
@@ -531,126 +1460,1421 @@ reclaim_port(monitor_state_t *state, int idx, char *resp, size_t resp_sz)
     }
 
     mp->yielded = 0;
-    log_marker(&mp->log, "PORT RECLAIMED (monitoring resumed)");
+    log_marker_at(&mp->log, msg, ts);
 
     printf("  Reclaimed: %s [%s]\n",
            mp->identity.dev_path, mp->identity.label);
+    return 0;
+}
+
+/* YIELD <dev|board:<id>|group:<port>>: every port named is released in
+ * this one call, with the same marker and timestamp in each log and a
+ * single status update, so a flasher that needs all four UARTs of a
+ * board does not wait for four round trips. */
+static void
+yield_cmd(monitor_state_t *state, const char *name, char *resp,
+          size_t resp_sz)
+{
+    int sel[MAX_PORTS];
+    int n = select_ports(state, name, 1, sel);
+    if (n == 0) {
+        snprintf(resp, resp_sz, "ERROR port not found: %s\n", name);
+        return;
+    }
+    int group = is_group_selector(name);
+
+    char ts[32], msg[640];
+    timestamp_now(ts, sizeof(ts));
+    if (group)
+        snprintf(msg, sizeof(msg),
+                 "PORT YIELDED (released for flashing with %s)", name);
+    else
+        snprintf(msg, sizeof(msg), "PORT YIELDED (released for flashing)");
+
+    int changed = 0;
+    size_t off = 0;
+    if (group)
+        off = (size_t)snprintf(resp, resp_sz, "OK yielded %s %d port(s)\n",
+                               name, n);
+    for (int i = 0; i < n; i++) {
+        monitored_port_t *mp = &state->ports[sel[i]];
+        int already = yield_one(state, mp, msg, ts);
+        changed += !already;
+        if (!group)
+            snprintf(resp, resp_sz, "OK %syielded %s\n",
+                     already ? "already " : "", mp->identity.dev_path);
+        else if (off < resp_sz)
+            off += (size_t)snprintf(resp + off, resp_sz - off, "%s %s%s\n",
+                                    mp->identity.dev_path,
+                                    mp->identity.label,
+                                    already ? " already" : "");
+    }
+    if (changed)
+        write_status_json(state);
+}
+
+/* RECLAIM <dev|board:<id>|group:<port>>: reopens every port named, one
+ * status update for all, and reports how long each reopen took (open,
+ * termios and epoll for a tty; starting the connect for a socket). */
+static void
+reclaim_cmd(monitor_state_t *state, const char *name, char *resp,
+            size_t resp_sz)
+{
+    int sel[MAX_PORTS];
+    int n = select_ports(state, name, 1, sel);
+    if (n == 0) {
+        snprintf(resp, resp_sz, "ERROR port not found: %s\n", name);
+        return;
+    }
+    int group = is_group_selector(name);
+
+    char ts[32], msg[640];
+    timestamp_now(ts, sizeof(ts));
+    if (group)
+        snprintf(msg, sizeof(msg),
+                 "PORT RECLAIMED (monitoring resumed with %s)", name);
+    else
+        snprintf(msg, sizeof(msg), "PORT RECLAIMED (monitoring resumed)");
+
+    int changed = 0, failed = 0;
+    size_t off = 0;
+    if (group)
+        off = (size_t)snprintf(resp, resp_sz,
+                               "OK reclaimed %s %d port(s)\n", name, n);
+    for (int i = 0; i < n; i++) {
+        monitored_port_t *mp = &state->ports[sel[i]];
+        char err[320] = "";
+        uint64_t t0 = mono_ns();
+        int rc = reclaim_one(state, mp, msg, ts, err, sizeof(err));
+        double ms = (double)(mono_ns() - t0) / 1e6;
+        changed += rc == 0;
+        failed += rc < 0;
+        if (!group) {
+            if (rc < 0)
+                snprintf(resp, resp_sz, "ERROR %s\n", err);
+            else if (rc > 0)
+                snprintf(resp, resp_sz, "OK already monitoring %s\n",
+                         mp->identity.dev_path);
+            else
+                snprintf(resp, resp_sz, "OK reclaimed %s reopen_ms=%.3f\n",
+                         mp->identity.dev_path, ms);
+        } else if (off < resp_sz) {
+            if (rc < 0)
+                off += (size_t)snprintf(resp + off, resp_sz - off,
+                                        "%s %s error=%s\n",
+                                        mp->identity.dev_path,
+                                        mp->identity.label, err);
+            else if (rc > 0)
+                off += (size_t)snprintf(resp + off, resp_sz - off,
+                                        "%s %s already\n",
+                                        mp->identity.dev_path,
+                                        mp->identity.label);
+            else
+                off += (size_t)snprintf(resp + off, resp_sz - off,
+                                        "%s %s reopen_ms=%.3f\n",
+                                        mp->identity.dev_path,
+                                        mp->identity.label, ms);
+        }
+    }
+    if (group && failed == n)
+        snprintf(resp, resp_sz, "ERROR cannot reopen any port of %s\n",
+                 name);
+    if (changed)
+        write_status_json(state);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Clear logs (checkpoints)                                          */
+/* ------------------------------------------------------------------ */
+
+/* CLEAR <dev|label|board:<id>|group:<port>|--all> [--name <name>]
+ * [--truncate]: by default the log is left alone. A "CHECKPOINT <name>"
+ * marker is appended and its byte offset and time go to the session's
+ * checkpoints.log (name, wall and monotonic time, label, offset, log
+ * file), so "tail --from", "grep --from" and "wait --from" read only
+ * what came after it. Nothing already in the file moves, so tail -f
+ * readers and partial lines are unaffected. --truncate keeps the old
+ * destructive behavior and records a checkpoint at offset 0. A group
+ * gets one checkpoint, with the same name and time in every member. */
+static void
+clear_cmd(monitor_state_t *state, char *args, char *resp, size_t resp_sz)
+{
+    const char *target = NULL, *name = NULL;
+    int truncate = 0;
+    char *saveptr;
+    for (char *tok = strtok_r(args, " ", &saveptr); tok;
+         tok = strtok_r(NULL, " ", &saveptr)) {
+        if (strcmp(tok, "--truncate") == 0) {
+            truncate = 1;
+        } else if (strcmp(tok, "--name") == 0) {
+            name = strtok_r(NULL, " ", &saveptr);
+            if (!name) {
+                snprintf(resp, resp_sz, "ERROR --name needs a value\n");
+                return;
+            }
+        } else if (!target) {
+            target = tok;
+        } else {
+            snprintf(resp, resp_sz, "ERROR usage: CLEAR <dev|label|"
+                     "board:<id>|group:<port>|--all> [--name <name>] "
+                     "[--truncate]\n");
+            return;
+        }
+    }
+
+    int sel[MAX_PORTS], nsel = 0, idx = -1;
+    if (target && strcmp(target, "--all") != 0) {
+        nsel = select_ports(state, target, 0, sel);
+        if (nsel == 0) {
+            snprintf(resp, resp_sz, "ERROR port not found: %s\n", target);
+            return;
+        }
+        if (!is_group_selector(target))
+            idx = sel[0];
+    } else {
+        for (int i = 0; i < state->port_count; i++)
+            sel[nsel++] = i;
+    }
+
+    char cp[sizeof(state->ports[0].checkpoint)];
+    if (name) {
+        if (strlen(name) >= sizeof(cp) || strchr(name, '\t')) {
+            snprintf(resp, resp_sz, "ERROR bad checkpoint name: %s\n", name);
+            return;
+        }
+        strlcpy_safe(cp, name, sizeof(cp));
+    } else {
+        snprintf(cp, sizeof(cp), "cp%u", state->checkpoint_seq + 1);
+    }
+    state->checkpoint_seq++;
+
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    uint64_t mono = mono_ns();
+    char ts[32];
+    timestamp_fmt_us(&wall, ts, sizeof(ts));
+
+    char index_path[600];
+    snprintf(index_path, sizeof(index_path), "%s/%s",
+             state->session_path, LOG_CHECKPOINTS);
+    FILE *index = fopen(index_path, "a");
+
+    long long off = 0;
+    int count = 0;
+    for (int s = 0; s < nsel; s++) {
+        int i = sel[s];
+        if (!port_visible(state, i))
+            continue;
+        count++;
+        monitored_port_t *mp = &state->ports[i];
+        off = log_checkpoint(&mp->log, index, cp, mp->identity.label, ts,
+                             mono, truncate);
+        if (off < 0)
+            continue;
+        if (truncate)
+            printf("  Cleared: %s [%s]\n",
+                   mp->identity.dev_path, mp->identity.label);
+        strlcpy_safe(mp->checkpoint, cp, sizeof(mp->checkpoint));
+        mp->checkpoint_off = off;
+    }
+    if (index)
+        fclose(index);
 
     write_status_json(state);
 
-    snprintf(resp, resp_sz, "OK reclaimed %s\n", mp->identity.dev_path);
+    if (truncate && idx >= 0)
+        snprintf(resp, resp_sz, "OK cleared %s checkpoint %s\n",
+                 state->ports[idx].identity.dev_path, cp);
+    else if (truncate)
+        snprintf(resp, resp_sz, "OK cleared %d port(s) checkpoint %s\n",
+                 count, cp);
+    else if (idx >= 0)
+        snprintf(resp, resp_sz, "OK checkpoint %s %s %lld [%s]\n", cp,
+                 state->ports[idx].identity.label, off, ts);
+    else
+        snprintf(resp, resp_sz, "OK checkpoint %s %d port(s) [%s]\n", cp,
+                 count, ts);
 }
 
 /* ------------------------------------------------------------------ */
-/*  Clear logs                                                        */
+/*  Control replies                                                   */
 /* ------------------------------------------------------------------ */
 
+/* Client sockets stay nonblocking and replies go out with MSG_NOSIGNAL:
+ * a client that hung up is an EPIPE, not a SIGPIPE, and one that stops
+ * reading gets CONTROL_SEND_MS to make room before the rest of its
+ * reply is dropped (counted in control_dropped). The loop never waits
+ * longer than that on one reply. Returns 0 once all of it is sent. */
+#define CONTROL_SEND_MS  100
+
+static int
+send_reply(monitor_state_t *state, int fd, const char *p, size_t len)
+{
+    uint64_t deadline = mono_ns() + (uint64_t)CONTROL_SEND_MS * 1000000ull;
+    while (len > 0) {
+        ssize_t nw = send(fd, p, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (nw > 0) {
+            p += nw;
+            len -= (size_t)nw;
+            continue;
+        }
+        if (nw < 0 && errno == EINTR)
+            continue;
+        if (nw < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            uint64_t now = mono_ns();
+            if (now < deadline) {
+                struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+                poll(&pfd, 1, (int)((deadline - now + 999999) / 1000000));
+                continue;
+            }
+            state->control_dropped++;
+        }
+        return -1;      /* client went away */
+    }
+    return 0;
+}
+
+/* Write a report (METRICS, INTEGRITY) into a growable buffer and send
+ * it whole: with a few dozen ports it is far past CONTROL_MAX_MSG. */
 static void
-clear_port_log(monitor_state_t *state, int idx, char *resp, size_t resp_sz)
+send_report(monitor_state_t *state, int client_fd,
+            void (*report)(monitor_state_t *state, FILE *fp))
+{
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&buf, &len);
+    if (fp) {
+        report(state, fp);
+        if (fclose(fp) != 0) {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    if (buf) {
+        send_reply(state, client_fd, buf, len);
+    } else {
+        const char *err = "ERROR out of memory\n";
+        send_reply(state, client_fd, err, strlen(err));
+    }
+    free(buf);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Log access (OPEN)                                                 */
+/* ------------------------------------------------------------------ */
+
+/* OPEN <port> [--from <checkpoint|last> | --digest]: reply "OK open
+ * <label> <off>" with a read-only descriptor of the port's log (or of
+ * its digest) attached, off being where the checkpoint starts (0
+ * without --from). In system mode the logs are private to the daemon,
+ * and this is how each user reads the ports it is allowed: every reader
+ * shares the one file the capture loop writes. Returns 0 once the reply
+ * is sent, -1 with an error in resp. */
+static int
+open_cmd(monitor_state_t *state, char *args, int client_fd,
+         char *resp, size_t resp_sz)
 {
+    char *saveptr;
+    const char *name = strtok_r(args, " ", &saveptr);
+    const char *opt = strtok_r(NULL, " ", &saveptr);
+    int digest = opt && strcmp(opt, "--digest") == 0;
+    const char *from = digest ? NULL : strtok_r(NULL, " ", &saveptr);
+    if (!name || (opt && !digest && (strcmp(opt, "--from") != 0 || !from)) ||
+        strtok_r(NULL, " ", &saveptr)) {
+        snprintf(resp, resp_sz, "ERROR usage: OPEN <port> "
+                 "[--from <checkpoint|last> | --digest]\n");
+        return -1;
+    }
+    int idx = find_port_by_name(state, name);
+    if (idx < 0) {
+        snprintf(resp, resp_sz, "ERROR port not found: %s\n", name);
+        return -1;
+    }
     monitored_port_t *mp = &state->ports[idx];
-    log_clear(&mp->log);
+    if (digest && !mp->digest) {
+        snprintf(resp, resp_sz, "ERROR no digest for %s\n",
+                 mp->identity.label);
+        return -1;
+    }
+    const char *path = digest ? mp->digest->path : mp->log.filepath;
+
+    long long off = 0;
+    if (from) {
+        char index_path[600];
+        snprintf(index_path, sizeof(index_path), "%s/%s",
+                 state->session_path, LOG_CHECKPOINTS);
+        const char *base = strrchr(mp->log.filepath, '/');
+        off = log_checkpoint_offset(index_path,
+                                    base ? base + 1 : mp->log.filepath,
+                                    from);
+        if (off < 0) {
+            snprintf(resp, resp_sz, "ERROR no checkpoint '%s' for %s\n",
+                     from, mp->identity.label);
+            return -1;
+        }
+    }
 
-    printf("  Cleared: %s [%s]\n",
-           mp->identity.dev_path, mp->identity.label);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        snprintf(resp, resp_sz, "ERROR cannot open %s: %s\n", path,
+                 strerror(errno));
+        return -1;
+    }
+    snprintf(resp, resp_sz, "OK open %s %lld\n", mp->identity.label, off);
+    control_send_fd(client_fd, resp, fd);
+    close(fd);
+    close(client_fd);
+    return 0;
+}
+
+/* TOPLINES <port> [N]: the N (default 10) line templates the port has
+ * logged most since its log was opened, heaviest first:
+ *   OK toplines <label> <lines> <bytes> <count>\n
+ *   <lines> <bytes> <share>% <template>\n...
+ * Line counts are count-min estimates: never below the truth. Written
+ * here, like TAIL: the reply can outgrow CONTROL_MAX_MSG. */
+static int
+toplines_cmd(monitor_state_t *state, char *args, int client_fd,
+             char *resp, size_t resp_sz)
+{
+    char *saveptr, *end = NULL;
+    const char *name = strtok_r(args, " ", &saveptr);
+    const char *tok = name ? strtok_r(NULL, " ", &saveptr) : NULL;
+    long max = tok ? strtol(tok, &end, 10) : 10;
+    if (!name || (tok && (*end || max <= 0)) ||
+        strtok_r(NULL, " ", &saveptr)) {
+        snprintf(resp, resp_sz, "ERROR usage: TOPLINES <port> [N]\n");
+        return -1;
+    }
+    int idx = find_port_by_name(state, name);
+    if (idx < 0) {
+        snprintf(resp, resp_sz, "ERROR port not found: %s\n", name);
+        return -1;
+    }
+    const monitored_port_t *mp = &state->ports[idx];
+    const toplines_t *t = mp->toplines;
+    if (!t) {
+        snprintf(resp, resp_sz, "ERROR no line counts for %s\n",
+                 mp->identity.label);
+        return -1;
+    }
+
+    int order[TOPLINES_K];
+    int count = toplines_sorted(t, order);
+    if (count > max)
+        count = (int)max;
+    char out[TOPLINES_K * (TOPLINES_TEXT + 64) + 256];
+    size_t off = (size_t)snprintf(out, sizeof(out),
+                                  "OK toplines %s %llu %llu %d\n",
+                                  mp->identity.label,
+                                  (unsigned long long)t->lines,
+                                  (unsigned long long)t->bytes, count);
+    for (int i = 0; i < count && off < sizeof(out); i++) {
+        const toplines_entry_t *e = &t->entry[order[i]];
+        off += (size_t)snprintf(out + off, sizeof(out) - off,
+                                "%u %llu %.1f%% %s\n", e->lines,
+                                (unsigned long long)e->bytes,
+                                t->lines ? 100.0 * e->lines / t->lines : 0.0,
+                                e->text);
+    }
+    if (off > sizeof(out))
+        off = sizeof(out);
+
+    send_reply(state, client_fd, out, off);
+    close(client_fd);
+    return 0;
+}
+
+/* TAIL <port> [N] [--since ms] [--after offset]: the port's latest
+ * lines straight from its recent-lines ring (default the last 10; with
+ * --since or --after every line that qualifies). The reply can be
+ * longer than CONTROL_MAX_MSG, so it is written here:
+ *   OK tail <label> <count> <first offset> <next offset>\n<lines>
+ * next is where a follow-up --after picks up; a first above the
+ * --after asked for means older lines have left the ring. */
+static int
+tail_cmd(monitor_state_t *state, char *args, int client_fd,
+         char *resp, size_t resp_sz)
+{
+    char *saveptr;
+    const char *name = strtok_r(args, " ", &saveptr);
+    recent_query_t q = { .max_lines = 10, .since_ns = 0, .after = -1 };
+    int bad = !name, bounded = 0;
+    const char *tok;
+    while (!bad && (tok = strtok_r(NULL, " ", &saveptr))) {
+        char *end;
+        if (strcmp(tok, "--since") == 0 || strcmp(tok, "--after") == 0) {
+            const char *val = strtok_r(NULL, " ", &saveptr);
+            long long v = val ? strtoll(val, &end, 10) : -1;
+            if (!val || *end || v < 0) {
+                bad = 1;
+            } else if (strcmp(tok, "--since") == 0) {
+                uint64_t now = mono_ns();
+                uint64_t span = (uint64_t)v * 1000000ull;
+                q.since_ns = span < now ? now - span : 0;
+            } else {
+                q.after = v;
+            }
+            if (!bounded)
+                q.max_lines = 0;
+        } else {
+            long n = strtol(tok, &end, 10);
+            if (*end || n <= 0)
+                bad = 1;
+            q.max_lines = (int)(n < RECENT_LINES ? n : RECENT_LINES);
+            bounded = 1;
+        }
+    }
+    if (bad) {
+        snprintf(resp, resp_sz, "ERROR usage: TAIL <port> [N] "
+                 "[--since ms] [--after offset]\n");
+        return -1;
+    }
+    int idx = find_port_by_name(state, name);
+    if (idx < 0) {
+        snprintf(resp, resp_sz, "ERROR port not found: %s\n", name);
+        return -1;
+    }
+    monitored_port_t *mp = &state->ports[idx];
+    if (!mp->recent) {
+        snprintf(resp, resp_sz, "ERROR no recent lines for %s\n",
+                 mp->identity.label);
+        return -1;
+    }
+
+    size_t cap = RECENT_BYTES + 256;
+    char *out = malloc(cap);
+    if (!out) {
+        snprintf(resp, resp_sz, "ERROR out of memory\n");
+        return -1;
+    }
+    /* nothing new: the next line will start at the end of the log */
+    long long next = q.after >= 0 ? q.after :
+                     (long long)mp->log.file_off +
+                     (long long)mp->log.spill_len +
+                     (long long)mp->log.out_len;
+    long long first = next;
+    char hdr[192];
+    size_t body;
+    int lines = recent_query(mp->recent, &q, out + sizeof(hdr),
+                             cap - sizeof(hdr), &body, &first, &next);
+    /* the header goes right before the lines: one buffer to write */
+    int hlen = snprintf(hdr, sizeof(hdr), "OK tail %s %d %lld %lld\n",
+                        mp->identity.label, lines, first, next);
+    memcpy(out + sizeof(hdr) - (size_t)hlen, hdr, (size_t)hlen);
+
+    send_reply(state, client_fd, out + sizeof(hdr) - (size_t)hlen,
+               (size_t)hlen + body);
+    free(out);
+    close(client_fd);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Cross-port markers                                                */
+/* ------------------------------------------------------------------ */
+
+/* MARK <text> [--ports a,b,...]: one instant, one identical marker in
+ * every selected port's log and link timeline. Each port also gets an
+ * index line in the session's marks.log (number, wall and monotonic
+ * time, label, byte offset of the marker, text) so scripts can slice
+ * the logs between marks. */
+static void
+mark_cmd(monitor_state_t *state, char *args, char *resp, size_t resp_sz)
+{
+    char *ports_arg = NULL;
+    char *opt = strstr(args, "--ports");
+    if (opt && (opt == args || opt[-1] == ' ')) {
+        ports_arg = opt + 7;
+        while (*ports_arg == ' ')
+            ports_arg++;
+        *opt = '\0';
+    }
+    size_t tlen = strlen(args);
+    while (tlen > 0 && args[tlen - 1] == ' ')
+        args[--tlen] = '\0';
+    if (tlen == 0) {
+        snprintf(resp, resp_sz,
+                 "ERROR usage: MARK <text> [--ports a,b,...]\n");
+        return;
+    }
+
+    /* resolve every port before touching any log */
+    char selected[MAX_PORTS] = {0};
+    int nsel = 0;
+    if (ports_arg) {
+        char *saveptr;
+        for (char *name = strtok_r(ports_arg, ", ", &saveptr); name;
+             name = strtok_r(NULL, ", ", &saveptr)) {
+            int idx = find_port_by_name(state, name);
+            if (idx < 0) {
+                snprintf(resp, resp_sz, "ERROR port not found: %s\n", name);
+                return;
+            }
+            nsel += !selected[idx];
+            selected[idx] = 1;
+        }
+    } else {
+        for (int i = 0; i < state->port_count; i++) {
+            selected[i] = (char)port_visible(state, i);
+            nsel += selected[i];
+        }
+    }
+    if (nsel == 0) {
+        snprintf(resp, resp_sz, "ERROR no ports to mark\n");
+        return;
+    }
+
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    uint64_t mono = mono_ns();
+    char ts[32];
+    timestamp_fmt_us(&wall, ts, sizeof(ts));
+
+    unsigned seq = ++state->mark_seq;
+    char msg[640];
+    snprintf(msg, sizeof(msg), "MARK %u: %s (mono %llu.%06llu)", seq, args,
+             (unsigned long long)(mono / 1000000000ull),
+             (unsigned long long)(mono % 1000000000ull / 1000));
+
+    char index_path[600];
+    snprintf(index_path, sizeof(index_path), "%s/%s",
+             state->session_path, MARKS_FILE);
+    FILE *index = fopen(index_path, "a");
+    char field[1024];
+    tsv_escape(args, field, sizeof(field));
+
+    for (int i = 0; i < state->port_count; i++) {
+        if (!selected[i])
+            continue;
+        monitored_port_t *mp = &state->ports[i];
+        long long off = log_marker_at(&mp->log, msg, ts);
+        if (index)
+            fprintf(index, "%u\t%s\t%llu\t%s\t%lld\t%s\n", seq, ts,
+                    (unsigned long long)mono, mp->identity.label, off, field);
+    }
+    for (int l = 0; l < state->link_count; l++) {
+        for (int i = 0; i < state->port_count; i++) {
+            if (selected[i] && state->ports[i].link_idx == l) {
+                timeline_marker_at(&state->links[l], msg, ts);
+                break;
+            }
+        }
+    }
+    if (index)
+        fclose(index);
+
+    snprintf(resp, resp_sz, "OK mark %u %d port(s) [%s]\n", seq, nsel, ts);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Manual add / remove / session rotation                            */
+/* ------------------------------------------------------------------ */
+
+/* Identity of a socket or FIFO source: named after its path or host. */
+static void
+source_identity(const char *spec, tty_port_t *port)
+{
+    memset(port, 0, sizeof(*port));
+    strlcpy_safe(port->dev_path, spec, sizeof(port->dev_path));
+    source_name(spec, port->tty_name, sizeof(port->tty_name));
+    strlcpy_safe(port->label, port->tty_name, sizeof(port->label));
+}
+
+/* ADD <dev> [label]: monitor a device that hot-plug and scanning do not
+ * cover (PTYs, on-board UARTs, socket and FIFO sources). USB serial
+ * devices keep their sysfs identity; anything else is monitored under
+ * its tty name, source name or label. */
+static void
+add_port_cmd(monitor_state_t *state, char *args, char *resp, size_t resp_sz)
+{
+    char *saveptr;
+    char *dev = strtok_r(args, " ", &saveptr);
+    char *label = strtok_r(NULL, " ", &saveptr);
+    if (!dev) {
+        snprintf(resp, resp_sz, "ERROR usage: ADD <dev> [label]\n");
+        return;
+    }
+    if (find_port_by_path(state, dev) >= 0) {
+        snprintf(resp, resp_sz, "OK already monitoring %s\n", dev);
+        return;
+    }
+
+    tty_port_t port;
+    if (source_kind(dev) != SOURCE_TTY) {
+        source_identity(dev, &port);
+    } else if (identify_port(dev, &port) == 0) {
+        board_id_t bids[MAX_BOARD_IDS];
+        int nbids = load_board_config(bids, MAX_BOARD_IDS);
+        if (nbids > 0)
+            apply_board_config(&port, 1, bids, nbids);
+    } else {
+        memset(&port, 0, sizeof(port));
+        strlcpy_safe(port.dev_path, dev, sizeof(port.dev_path));
+        const char *slash = strrchr(dev, '/');
+        strlcpy_safe(port.tty_name, slash ? slash + 1 : dev,
+                     sizeof(port.tty_name));
+        strlcpy_safe(port.label, port.tty_name, sizeof(port.label));
+    }
+    if (label)
+        strlcpy_safe(port.label, label, sizeof(port.label));
+
+    int idx = add_port(state, &port);
+    if (idx < 0) {
+        snprintf(resp, resp_sz, "ERROR cannot monitor %s\n", dev);
+        return;
+    }
+
+    write_status_json(state);
+    snprintf(resp, resp_sz, "OK added %s %s\n",
+             dev, state->ports[idx].log.filepath);
+}
+
+/* ROTATE: start a new session directory and reopen every log in it. */
+static void
+rotate_session(monitor_state_t *state, char *resp, size_t resp_sz)
+{
+    char new_path[512];
+    if (log_create_session(new_path, sizeof(new_path)) < 0) {
+        snprintf(resp, resp_sz, "ERROR cannot create session\n");
+        return;
+    }
+
+    for (int i = 0; i < state->port_count; i++)
+        log_marker(&state->ports[i].log, "LOG ROTATED");
+    for (int i = 0; i < state->link_count; i++)
+        timeline_marker(&state->links[i], "LOG ROTATED");
+
+    strlcpy_safe(state->session_path, new_path, sizeof(state->session_path));
+
+    for (int i = 0; i < state->port_count; i++) {
+        monitored_port_t *mp = &state->ports[i];
+        log_close(&mp->log);
+        close_port_raw(mp);
+        mp->checkpoint[0] = '\0';   /* offsets were in the old files */
+        if (open_port_log(state, mp) < 0)
+            fprintf(stderr, "monitor: rotate %s: cannot reopen log\n",
+                    mp->identity.label);
+        open_port_raw(state, mp);
+    }
+    for (int i = 0; i < state->link_count; i++) {
+        timeline_t *tl = &state->links[i];
+        const link_cfg_t *lc = &state->config.links[i];
+        timeline_close(tl);
+        timeline_open(tl, state->session_path, lc->name,
+                      lc->port_a, lc->port_b, state->config.reorder_ms);
+    }
+
+    housekeep_prune(LOG_MAX_SESSIONS);
+
+    printf("  Rotated: %s\n", state->session_path);
+    write_status_json(state);
+    snprintf(resp, resp_sz, "OK rotated %s\n", state->session_path);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Integrity probe                                                   */
+/* ------------------------------------------------------------------ */
+
+static void
+integrity_report(monitor_state_t *state, FILE *fp)
+{
+    int n = 0;
+
+    for (int i = 0; i < state->port_count; i++) {
+        monitored_port_t *mp = &state->ports[i];
+        if (!mp->integrity.enabled || !port_visible(state, i))
+            continue;
+        char line[512];
+        integrity_summary(&mp->integrity, line, sizeof(line));
+        fprintf(fp, "%s%s: %s\n", n++ ? "" : "OK integrity\n",
+                mp->identity.label, line);
+    }
+
+    if (n == 0)
+        fprintf(fp, "ERROR no ports under integrity check "
+                "(use --integrity or 'integrity <port>' in config)\n");
+}
+
+/* ------------------------------------------------------------------ */
+/*  Loopback probe (PING / BW)                                        */
+/* ------------------------------------------------------------------ */
+
+/* Parse "a,b,c" baud rates; each must be a rate the port layer knows. */
+static int
+parse_bauds(char *list, int *bauds, int max)
+{
+    int n = 0;
+    char *saveptr;
+    for (char *tok = strtok_r(list, ",", &saveptr); tok;
+         tok = strtok_r(NULL, ",", &saveptr)) {
+        int b = atoi(tok);
+        if (n >= max || speed_to_baud(baud_to_speed(b)) != b)
+            return -1;
+        bauds[n++] = b;
+    }
+    return n;
+}
+
+/* PING|BW <port> [--to <port>] [options]: start a probe run. Returns 0
+ * if the run started; the client then gets the report when it ends. */
+static int
+probe_cmd(monitor_state_t *state, char *buf, int client_fd,
+          char *resp, size_t resp_sz)
+{
+    int bw = strncmp(buf, "BW ", 3) == 0;
+    char *args = buf + (bw ? 3 : 5);
+    int count = 20, interval_ms = 100, step_ms = 1000;
+    int payload = bw ? 64 : 16;
+    int bauds[PR_MAX_BAUDS];
+    int nbauds = 0;
+    const char *tx_name = NULL, *rx_name = NULL;
+
+    char *saveptr;
+    for (char *tok = strtok_r(args, " ", &saveptr); tok;
+         tok = strtok_r(NULL, " ", &saveptr)) {
+        char *val = NULL;
+        if (tok[0] == '-' && tok[1] == '-') {
+            val = strtok_r(NULL, " ", &saveptr);
+            if (!val) {
+                snprintf(resp, resp_sz, "ERROR %s needs a value\n", tok);
+                return -1;
+            }
+        }
+        if (!val)
+            tx_name = tok;
+        else if (strcmp(tok, "--to") == 0)
+            rx_name = val;
+        else if (strcmp(tok, "--count") == 0 && !bw)
+            count = atoi(val);
+        else if (strcmp(tok, "--interval") == 0 && !bw)
+            interval_ms = atoi(val);
+        else if (strcmp(tok, "--step-ms") == 0 && bw)
+            step_ms = atoi(val);
+        else if (strcmp(tok, "--size") == 0)
+            payload = atoi(val);
+        else if (strcmp(tok, "--bauds") == 0 && bw) {
+            nbauds = parse_bauds(val, bauds, PR_MAX_BAUDS);
+            if (nbauds <= 0) {
+                snprintf(resp, resp_sz, "ERROR bad baud list: %s\n", val);
+                return -1;
+            }
+        } else {
+            snprintf(resp, resp_sz, "ERROR unknown option: %s\n", tok);
+            return -1;
+        }
+    }
+    if (!tx_name) {
+        snprintf(resp, resp_sz, bw ?
+                 "ERROR usage: BW <port> [--to <port>] [--bauds a,b] "
+                 "[--step-ms ms] [--size n]\n" :
+                 "ERROR usage: PING <port> [--to <port>] [--count n] "
+                 "[--interval ms] [--size n]\n");
+        return -1;
+    }
+    if (count < 1 || count > PR_MAX_SAMPLES || interval_ms < 1 ||
+        step_ms < 100 || payload < 1 || payload > PR_LINE_MAX - 48) {
+        snprintf(resp, resp_sz, "ERROR option out of range\n");
+        return -1;
+    }
+    if (state->probe) {
+        snprintf(resp, resp_sz, "ERROR a probe is already running\n");
+        return -1;
+    }
+
+    int tx = find_port_by_name(state, tx_name);
+    int rx = rx_name ? find_port_by_name(state, rx_name) : tx;
+    if (tx < 0 || rx < 0) {
+        snprintf(resp, resp_sz, "ERROR port not found: %s\n",
+                 tx < 0 ? tx_name : rx_name);
+        return -1;
+    }
+    monitored_port_t *mtx = &state->ports[tx];
+    monitored_port_t *mrx = &state->ports[rx];
+    if (mtx->yielded || mrx->yielded) {
+        snprintf(resp, resp_sz, "ERROR port is yielded\n");
+        return -1;
+    }
+
+    /* proxy mode already has a writable fd; read-only mode opens one
+     * for the duration of the run */
+    int tx_fd = -1;
+    state->probe_own_fd = -1;
+    if (mtx->serial.pty_master >= 0) {
+        tx_fd = mtx->serial.fd;
+    } else {
+        tx_fd = open(mtx->identity.dev_path,
+                     O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+        if (tx_fd < 0) {
+            snprintf(resp, resp_sz, "ERROR cannot open %s for writing: %s\n",
+                     mtx->identity.dev_path, strerror(errno));
+            return -1;
+        }
+        state->probe_own_fd = tx_fd;
+    }
+
+    probe_t *pr = malloc(sizeof(*pr));
+    if (!pr) {
+        if (state->probe_own_fd >= 0)
+            close(state->probe_own_fd);
+        snprintf(resp, resp_sz, "ERROR out of memory\n");
+        return -1;
+    }
+    if (bw) {
+        if (nbauds == 0) {
+            bauds[0] = speed_to_baud(mtx->serial.baudrate);
+            nbauds = 1;
+        }
+        probe_init_bw(pr, tx_fd, mrx->serial.fd, bauds, nbauds,
+                      step_ms, payload);
+    } else {
+        probe_init_ping(pr, tx_fd, mrx->serial.fd, count, interval_ms,
+                        payload);
+    }
+
+    state->probe = pr;
+    state->probe_client = client_fd;
+    state->probe_wait_ms = 0;
+    strlcpy_safe(state->probe_tx, mtx->identity.dev_path,
+                 sizeof(state->probe_tx));
+    strlcpy_safe(state->probe_rx, mrx->identity.dev_path,
+                 sizeof(state->probe_rx));
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "PROBE %s %s -> %s STARTED",
+             bw ? "BW" : "PING", mtx->identity.label, mrx->identity.label);
+    log_marker(&mtx->log, msg);
+    if (mrx != mtx)
+        log_marker(&mrx->log, msg);
+    return 0;
+}
+
+/* End the probe run: restore baud rates, answer the waiting client. */
+static void
+probe_finish(monitor_state_t *state, const char *error)
+{
+    probe_t *pr = state->probe;
+    int tx = find_port_by_path(state, state->probe_tx);
+    int rx = find_port_by_path(state, state->probe_rx);
+    const char *tx_label = tx >= 0 ? state->ports[tx].identity.label :
+                                     state->probe_tx;
+    const char *rx_label = rx >= 0 ? state->ports[rx].identity.label :
+                                     state->probe_rx;
+
+    char resp[CONTROL_MAX_MSG];
+    if (error)
+        snprintf(resp, sizeof(resp), "ERROR %s\n", error);
+    else
+        probe_report(pr, tx_label, rx_label, resp, sizeof(resp));
+
+    int idx[2] = { tx, rx != tx ? rx : -1 };
+    for (int i = 0; i < 2; i++) {
+        if (idx[i] < 0)
+            continue;
+        monitored_port_t *mp = &state->ports[idx[i]];
+        if (pr->mode == PROBE_BW && mp->serial.fd >= 0)
+            serial_set_baud(mp->serial.fd, mp->serial.baudrate);
+        log_marker(&mp->log, error ? "PROBE ABORTED" : "PROBE FINISHED");
+    }
+
+    send_reply(state, state->probe_client, resp, strlen(resp));
+    close(state->probe_client);
+    if (state->probe_own_fd >= 0)
+        close(state->probe_own_fd);
+    state->probe_own_fd = -1;
+    free(pr);
+    state->probe = NULL;
+}
+
+/* Advance the probe run; called once per loop iteration. */
+static void
+service_probe(monitor_state_t *state, uint64_t now)
+{
+    if (!state->probe)
+        return;
+
+    int tx = find_port_by_path(state, state->probe_tx);
+    int rx = find_port_by_path(state, state->probe_rx);
+    if (tx < 0 || rx < 0 || state->ports[tx].yielded ||
+        state->ports[rx].yielded) {
+        probe_finish(state, "port removed or yielded during probe");
+        return;
+    }
+    /* the receive fd is reopened by a reclaim */
+    state->probe->rx_fd = state->ports[rx].serial.fd;
+    if (state->probe_own_fd < 0)
+        state->probe->tx_fd = state->ports[tx].serial.fd;
+
+    state->probe_wait_ms = probe_tick(state->probe, now);
+    if (state->probe_wait_ms < 0)
+        probe_finish(state, NULL);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Capture scheduling                                                */
+/* ------------------------------------------------------------------ */
+
+static const char *
+sched_policy_name(int policy)
+{
+    switch (policy) {
+    case SCHED_FIFO: return "fifo";
+    case SCHED_RR:   return "rr";
+    default:         return "other";
+    }
+}
+
+/* Pin the capture thread, raise it to a real-time policy and lock its
+ * memory. Only the calling thread is affected: the housekeeping worker
+ * keeps the default policy and every CPU. Missing privileges are
+ * reported and capture continues with whatever could be applied. */
+static void
+setup_capture_sched(monitor_state_t *state)
+{
+    if (state->pin_cpus &&
+        sched_setaffinity(0, sizeof(state->capture_cpus),
+                          &state->capture_cpus) < 0)
+        fprintf(stderr, "monitor: sched_setaffinity: %s\n", strerror(errno));
+
+    state->sched_applied = SCHED_OTHER;
+    if (state->rt_policy != SCHED_OTHER) {
+        struct sched_param sp = { .sched_priority = state->rt_prio };
+        if (sched_setscheduler(0, state->rt_policy, &sp) == 0)
+            state->sched_applied = state->rt_policy;
+        else
+            fprintf(stderr, "monitor: cannot use SCHED_%s priority %d: %s "
+                    "(need CAP_SYS_NICE or RLIMIT_RTPRIO)\n",
+                    state->rt_policy == SCHED_FIFO ? "FIFO" : "RR",
+                    state->rt_prio, strerror(errno));
+    }
+
+    if (state->mlock) {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+            state->mlock_applied = 1;
+        else
+            fprintf(stderr, "monitor: mlockall: %s "
+                    "(need CAP_IPC_LOCK or RLIMIT_MEMLOCK)\n",
+                    strerror(errno));
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/*  Metrics                                                           */
+/* ------------------------------------------------------------------ */
+
+/* Credit the fdatasyncs the housekeeping thread finished to their
+ * ports' counters. A port removed or rotated since is skipped. */
+static void
+collect_syncs(monitor_state_t *state)
+{
+    housekeep_synced_t done[64];
+    int n;
+    while ((n = housekeep_sync_results(done, 64)) > 0) {
+        for (int d = 0; d < n; d++) {
+            for (int i = 0; i < state->port_count; i++) {
+                log_file_t *lf = &state->ports[i].log;
+                if (lf->sync_id == done[d].id) {
+                    log_sync_done(lf, done[d].ns, done[d].err);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static void
+metrics_report(monitor_state_t *state, FILE *fp)
+{
+    collect_syncs(state);
+
+    uint64_t commits, commit_last_ns, commit_max_ns;
+    housekeep_sync_stats(&commits, &commit_last_ns, &commit_max_ns);
+
+    char cpus[128] = "all";
+    if (state->pin_cpus)
+        format_cpu_list(&state->capture_cpus, cpus, sizeof(cpus));
+
+    fprintf(fp,
+        "OK metrics\n"
+        "daemon ports=%d degraded_ports=%d loop_stalls=%llu "
+        "max_loop_ms=%.1f hotplug_adds=%llu hotplug_removes=%llu "
+        "durability=%s group_commits=%llu commit_last_ms=%.2f "
+        "commit_max_ms=%.2f sched=%s rt_prio=%d cpus=%s mlock=%d "
+        "control_dropped=%llu\n",
+        state->port_count, degraded_ports(state),
+        (unsigned long long)state->loop_stalls,
+        (double)state->max_loop_ns / 1e6,
+        (unsigned long long)state->hotplug_adds,
+        (unsigned long long)state->hotplug_removes,
+        config_durability_name(state->config.durability),
+        (unsigned long long)commits,
+        (double)commit_last_ns / 1e6,
+        (double)commit_max_ns / 1e6,
+        sched_policy_name(state->sched_applied),
+        state->sched_applied == SCHED_OTHER ? 0 : state->rt_prio,
+        cpus, state->mlock_applied,
+        (unsigned long long)state->control_dropped);
+
+    for (int i = 0; i < state->port_count; i++) {
+        const digest_t *d = state->ports[i].digest;
+        if (!d)
+            continue;
+        fprintf(fp,
+            "digest %s lines_in=%llu lines_out=%llu bytes_in=%llu "
+            "bytes_out=%llu ratio=%.1f alerts=%llu\n",
+            state->ports[i].identity.label,
+            (unsigned long long)d->lines_in,
+            (unsigned long long)d->lines_out,
+            (unsigned long long)d->bytes_in,
+            (unsigned long long)d->bytes_out,
+            d->bytes_out ? (double)d->bytes_in / (double)d->bytes_out : 0.0,
+            (unsigned long long)d->alerts);
+    }
+
+    for (int i = 0; i < state->port_count; i++) {
+        const log_file_t *lf = &state->ports[i].log;
+        fprintf(fp,
+            "port %s bytes_logged=%zu storage=%s spill_backlog=%zu "
+            "spilled=%llu lost=%llu degraded_events=%llu "
+            "max_write_ms=%.1f syncs=%llu sync_avg_ms=%.2f "
+            "sync_max_ms=%.2f reads=%llu bytes_per_read=%.0f\n",
+            state->ports[i].identity.label, lf->bytes_written,
+            lf->degraded ? "degraded" : "ok", lf->spill_len,
+            (unsigned long long)lf->spilled,
+            (unsigned long long)lf->lost,
+            (unsigned long long)lf->degraded_events,
+            (double)lf->max_write_ns / 1e6,
+            (unsigned long long)lf->syncs,
+            lf->syncs ? (double)lf->sync_ns_total / (double)lf->syncs / 1e6
+                      : 0.0,
+            (double)lf->sync_max_ns / 1e6,
+            (unsigned long long)state->ports[i].reads,
+            state->ports[i].reads ? (double)state->ports[i].bytes_read /
+                                    (double)state->ports[i].reads : 0.0);
+    }
+
+    for (int i = 0; i < state->port_count; i++) {
+        const monitored_port_t *mp = &state->ports[i];
+        const classify_t *c = mp->content;
+        if (!c)
+            continue;
+        fprintf(fp,
+            "content %s kind=%s forced=%d windows=%llu switches=%llu "
+            "printable=%.1f high=%.1f ctrl=%.1f bitrun=%.1f line_ends=%u "
+            "spread=%u len_bits=%.2f frames=%ld raw_bytes=%llu\n",
+            mp->identity.label,
+            classify_name(c->kind), c->forced,
+            (unsigned long long)c->windows,
+            (unsigned long long)c->switches,
+            c->last_printable / 10.0, c->last_high / 10.0,
+            c->last_ctrl / 10.0, c->last_bitrun / 10.0, c->last_line_ends,
+            c->last_spread, c->last_len_bits / 1000.0, c->last_frames,
+            mp->raw_bytes);
+    }
+
+    for (int i = 0; i < state->port_count; i++) {
+        const filter_t *f = state->ports[i].filter;
+        const char *label = state->ports[i].identity.label;
+        if (!f)
+            continue;
+        fprintf(fp,
+            "filter %s dropped_lines=%llu dropped_bytes=%llu\n", label,
+            (unsigned long long)f->dropped_lines,
+            (unsigned long long)f->dropped_bytes);
+        for (int r = 0; r < f->nrules; r++)
+            fprintf(fp,
+                "filter %s rule=%d %s hits=%llu pattern=%s\n", label, r + 1,
+                filter_action_name(f->action[r]),
+                (unsigned long long)f->hits[r], f->pattern[r]);
+    }
+
+    for (int i = 0; i < state->port_count; i++) {
+        const log_file_t *lf = &state->ports[i].log;
+        for (int k = 0; k < lf->nstages; k++)
+            fprintf(fp,
+                "stage %s %d %s lines=%llu dropped=%llu\n",
+                state->ports[i].identity.label, k + 1,
+                lf->stages[k].ops->name,
+                (unsigned long long)lf->stages[k].lines,
+                (unsigned long long)lf->stages[k].dropped);
+    }
+
+    for (int c = 0; c < PRIO_CLASSES; c++) {
+        const sched_stats_t *st = &state->sched[c];
+        int ports = 0;
+        for (int i = 0; i < state->port_count; i++)
+            ports += state->ports[i].prio == (prio_class_t)c;
+        fprintf(fp,
+            "class %s ports=%d rounds=%llu services=%llu bytes=%llu "
+            "backlogged=%llu wait_avg_us=%.1f wait_max_us=%.1f\n",
+            config_priority_name((prio_class_t)c), ports,
+            (unsigned long long)st->rounds,
+            (unsigned long long)st->services,
+            (unsigned long long)st->bytes,
+            (unsigned long long)st->backlogged,
+            st->services ? (double)st->wait_ns_total /
+                           (double)st->services / 1e3 : 0.0,
+            (double)st->wait_max_ns / 1e3);
+    }
+
+    /* each port's heaviest template; TOPLINES has the rest */
+    for (int i = 0; i < state->port_count; i++) {
+        const toplines_t *t = state->ports[i].toplines;
+        int order[TOPLINES_K];
+        if (!t || toplines_sorted(t, order) == 0)
+            continue;
+        const toplines_entry_t *e = &t->entry[order[0]];
+        fprintf(fp,
+            "top %s lines=%llu tracked=%d top_lines=%u top_share=%.1f "
+            "template=%.60s\n", state->ports[i].identity.label,
+            (unsigned long long)t->lines, t->count, e->lines,
+            t->lines ? 100.0 * e->lines / t->lines : 0.0, e->text);
+    }
+}
+
+static int
+integrity_active(monitor_state_t *state)
+{
+    for (int i = 0; i < state->port_count; i++) {
+        if (state->ports[i].integrity.enabled)
+            return 1;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Control socket command handling                                    */
+/* ------------------------------------------------------------------ */
+
+/* Run one command (buf, NUL-terminated) from client_fd and reply; the
+ * client is closed unless a handler keeps it (PING/BW, TAIL, ...). */
+static void
+handle_control_cmd(monitor_state_t *state, int client_fd, char *buf)
+{
+    size_t n = strlen(buf);
+
+    /* strip trailing newline */
+    while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == '\r'))
+        buf[--n] = '\0';
+
+    char resp[CONTROL_MAX_MSG];
+
+    /* system mode: the kernel says who is asking, and anyone short of
+     * an admin is served its own view of the ports */
+    acl_peer_t peer;
+    if (state->system_mode) {
+        if (acl_peer_from_fd(client_fd, &peer) < 0) {
+            close(client_fd);
+            return;
+        }
+        if (!peer_is_admin(state, &peer))
+            state->peer = &peer;
+    }
+
+    if (state->peer && admin_command(buf)) {
+        snprintf(resp, sizeof(resp), "ERROR permission denied: %s\n", buf);
+    } else if (strcmp(buf, "STATUS") == 0) {
+        /* render fresh status, reply from memory, persist in background;
+         * the JSON outgrows CONTROL_MAX_MSG, so it is sent here whole */
+        size_t len;
+        char *status = render_status_json(state, &len);
+        if (status) {
+            send_reply(state, client_fd, status, len);
+            close(client_fd);
+            if (!state->peer)
+                housekeep_write_file(STATUS_FILE, status, len);
+            else
+                free(status);
+            state->peer = NULL;
+            return;
+        } else {
+            snprintf(resp, sizeof(resp), "ERROR cannot render status\n");
+        }
+    } else if (strncmp(buf, "YIELD ", 6) == 0) {
+        yield_cmd(state, buf + 6, resp, sizeof(resp));
+    } else if (strncmp(buf, "RECLAIM ", 8) == 0) {
+        reclaim_cmd(state, buf + 8, resp, sizeof(resp));
+    } else if (strcmp(buf, "CLEAR") == 0 ||
+               strncmp(buf, "CLEAR ", 6) == 0) {
+        clear_cmd(state, buf + 5, resp, sizeof(resp));
+    } else if (strncmp(buf, "ADD ", 4) == 0) {
+        add_port_cmd(state, buf + 4, resp, sizeof(resp));
+    } else if (strncmp(buf, "REMOVE ", 7) == 0) {
+        const char *name = buf + 7;
+        int idx = find_port_by_name(state, name);
+        if (idx < 0) {
+            snprintf(resp, sizeof(resp),
+                     "ERROR port not found: %s\n", name);
+        } else {
+            snprintf(resp, sizeof(resp), "OK removed %s\n",
+                     state->ports[idx].identity.dev_path);
+            remove_port(state, idx);
+            write_status_json(state);
+        }
+    } else if (strcmp(buf, "ROTATE") == 0) {
+        rotate_session(state, resp, sizeof(resp));
+    } else if (strcmp(buf, "INTEGRITY") == 0) {
+        send_report(state, client_fd, integrity_report);
+        close(client_fd);
+        state->peer = NULL;
+        return;
+    } else if (strncmp(buf, "MARK ", 5) == 0) {
+        mark_cmd(state, buf + 5, resp, sizeof(resp));
+    } else if (strcmp(buf, "METRICS") == 0) {
+        send_report(state, client_fd, metrics_report);
+        close(client_fd);
+        state->peer = NULL;
+        return;
+    } else if (strncmp(buf, "PING ", 5) == 0 ||
+               strncmp(buf, "BW ", 3) == 0) {
+        /* the report is sent when the run ends */
+        if (probe_cmd(state, buf, client_fd, resp, sizeof(resp)) == 0) {
+            state->peer = NULL;
+            return;
+        }
+    } else if (strncmp(buf, "TAIL ", 5) == 0) {
+        if (tail_cmd(state, buf + 5, client_fd, resp, sizeof(resp)) == 0) {
+            state->peer = NULL;
+            return;
+        }
+    } else if (strncmp(buf, "TOPLINES ", 9) == 0) {
+        if (toplines_cmd(state, buf + 9, client_fd, resp,
+                         sizeof(resp)) == 0) {
+            state->peer = NULL;
+            return;
+        }
+    } else if (strncmp(buf, "OPEN ", 5) == 0) {
+        if (open_cmd(state, buf + 5, client_fd, resp, sizeof(resp)) == 0) {
+            state->peer = NULL;
+            return;
+        }
+    } else if (strcmp(buf, "QUIT") == 0) {
+        snprintf(resp, sizeof(resp), "OK shutting down\n");
+        state->running = 0;
+    } else {
+        snprintf(resp, sizeof(resp),
+                 "ERROR unknown command: %s\n", buf);
+    }
+
+    state->peer = NULL;
+
+    /* send response (best effort) and close */
+    send_reply(state, client_fd, resp, strlen(resp));
+    close(client_fd);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Control clients                                                    */
+/* ------------------------------------------------------------------ */
 
-    write_status_json(state);
+/* Clients are accepted nonblocking and their command is collected from
+ * epoll like any other input: one that connects and says nothing costs
+ * a slot until CONTROL_CLIENT_MS, never a stalled capture loop. */
+#define CONTROL_CLIENT_MS  1000
 
-    snprintf(resp, resp_sz, "OK cleared %s\n", mp->identity.dev_path);
+static void
+drop_control_client(monitor_state_t *state, control_client_t *c)
+{
+    epoll_ctl(state->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
 }
 
 static void
-clear_all_logs(monitor_state_t *state, char *resp, size_t resp_sz)
+accept_control_client(monitor_state_t *state)
 {
-    for (int i = 0; i < state->port_count; i++) {
-        log_clear(&state->ports[i].log);
-        printf("  Cleared: %s [%s]\n",
-               state->ports[i].identity.dev_path,
-               state->ports[i].identity.label);
-    }
+    int cfd = accept4(state->control_fd, NULL, NULL,
+                      SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (cfd < 0)
+        return;
 
-    write_status_json(state);
+    control_client_t *c = NULL;
+    for (int i = 0; i < MAX_CONTROL_CLIENTS && !c; i++) {
+        if (state->clients[i].fd < 0)
+            c = &state->clients[i];
+    }
+    if (!c) {
+        const char *busy = "ERROR busy\n";
+        ssize_t nw = send(cfd, busy, strlen(busy), MSG_NOSIGNAL);
+        (void)nw;
+        close(cfd);
+        return;
+    }
 
-    snprintf(resp, resp_sz, "OK cleared %d port(s)\n", state->port_count);
+    c->fd = cfd;
+    c->len = 0;
+    c->deadline_ns = mono_ns() + (uint64_t)CONTROL_CLIENT_MS * 1000000ull;
+    c->evt.type = EVT_CONTROL_CLIENT;
+    c->evt.index = (int)(c - state->clients);
+    c->evt.fd = cfd;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &c->evt };
+    if (epoll_ctl(state->epoll_fd, EPOLL_CTL_ADD, cfd, &ev) < 0) {
+        close(cfd);
+        c->fd = -1;
+    }
 }
 
-/* ------------------------------------------------------------------ */
-/*  Control socket command handling                                    */
-/* ------------------------------------------------------------------ */
-
+/* Collect what the client sent; once the command is complete (newline,
+ * EOF or a full buffer) hand the fd over to handle_control_cmd(). */
 static void
-handle_control_cmd(monitor_state_t *state, int client_fd)
+read_control_client(monitor_state_t *state, control_client_t *c)
 {
-    char buf[512];
-    ssize_t n = read(client_fd, buf, sizeof(buf) - 1);
-    if (n <= 0) {
-        close(client_fd);
+    if (c->fd < 0)
         return;
-    }
-    buf[n] = '\0';
-
-    /* strip trailing newline */
-    while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == '\r'))
-        buf[--n] = '\0';
 
-    char resp[CONTROL_MAX_MSG];
+    ssize_t n = read(c->fd, c->buf + c->len, sizeof(c->buf) - 1 - c->len);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                  errno == EINTR))
+        return;
+    if (n < 0 || (n == 0 && c->len == 0)) {
+        drop_control_client(state, c);
+        return;
+    }
+    c->len += (size_t)n;
+    c->buf[c->len] = '\0';
+    if (n > 0 && !memchr(c->buf, '\n', c->len) &&
+        c->len < sizeof(c->buf) - 1)
+        return;
 
-    if (strcmp(buf, "STATUS") == 0) {
-        /* write fresh status and send it */
-        write_status_json(state);
+    int fd = c->fd;
+    char cmd[sizeof(c->buf)];
+    memcpy(cmd, c->buf, c->len + 1);
+    char *nl = strchr(cmd, '\n');
+    if (nl)
+        nl[1] = '\0';
+    epoll_ctl(state->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    c->fd = -1;
+    handle_control_cmd(state, fd, cmd);
+}
 
-        FILE *fp = fopen(STATUS_FILE, "r");
-        if (fp) {
-            size_t nr = fread(resp, 1, sizeof(resp) - 1, fp);
-            resp[nr] = '\0';
-            fclose(fp);
-        } else {
-            snprintf(resp, sizeof(resp), "ERROR cannot read status\n");
-        }
-    } else if (strncmp(buf, "YIELD ", 6) == 0) {
-        const char *dev = buf + 6;
-        int idx = find_port_by_path(state, dev);
-        if (idx < 0) {
-            snprintf(resp, sizeof(resp),
-                     "ERROR port not found: %s\n", dev);
-        } else {
-            yield_port(state, idx, resp, sizeof(resp));
-        }
-    } else if (strncmp(buf, "RECLAIM ", 8) == 0) {
-        const char *dev = buf + 8;
-        int idx = find_port_by_path(state, dev);
-        if (idx < 0) {
-            snprintf(resp, sizeof(resp),
-                     "ERROR port not found: %s\n", dev);
-        } else {
-            reclaim_port(state, idx, resp, sizeof(resp));
-        }
-    } else if (strncmp(buf, "CLEAR", 5) == 0) {
-        if (strcmp(buf, "CLEAR --all") == 0 ||
-            strcmp(buf, "CLEAR") == 0) {
-            clear_all_logs(state, resp, sizeof(resp));
-        } else if (strncmp(buf, "CLEAR ", 6) == 0) {
-            const char *name = buf + 6;
-            int idx = find_port_by_name(state, name);
-            if (idx < 0) {
-                snprintf(resp, sizeof(resp),
-                         "ERROR port not found: %s\n", name);
-            } else {
-                clear_port_log(state, idx, resp, sizeof(resp));
-            }
+/* Close clients that have not sent a whole command in time. */
+static void
+expire_control_clients(monitor_state_t *state, uint64_t now)
+{
+    for (int i = 0; i < MAX_CONTROL_CLIENTS; i++) {
+        control_client_t *c = &state->clients[i];
+        if (c->fd >= 0 && now >= c->deadline_ns) {
+            drop_control_client(state, c);
+            state->control_dropped++;
         }
-    } else if (strcmp(buf, "QUIT") == 0) {
-        snprintf(resp, sizeof(resp), "OK shutting down\n");
-        state->running = 0;
-    } else {
-        snprintf(resp, sizeof(resp),
-                 "ERROR unknown command: %s\n", buf);
     }
+}
 
-    /* send response (best effort) and close */
-    ssize_t written = write(client_fd, resp, strlen(resp));
-    (void)written;
-    close(client_fd);
+/* Milliseconds until the next client deadline, or -1 if none. */
+static int
+control_timeout_ms(const monitor_state_t *state, uint64_t now)
+{
+    int wait = -1;
+    for (int i = 0; i < MAX_CONTROL_CLIENTS; i++) {
+        const control_client_t *c = &state->clients[i];
+        if (c->fd < 0)
+            continue;
+        int ms = c->deadline_ns <= now ? 0 :
+                 (int)((c->deadline_ns - now + 999999) / 1000000);
+        if (wait < 0 || ms < wait)
+            wait = ms;
+    }
+    return wait;
 }
 
 /* ------------------------------------------------------------------ */
@@ -687,7 +2911,7 @@ handle_signal(monitor_state_t *state)
 
         for (int i = 0; i < nports; i++) {
             /* add_port checks for duplicates internally */
-            add_port(state, &ports[i]);
+            add_discovered_port(state, &ports[i]);
         }
 
         write_status_json(state);
@@ -699,39 +2923,393 @@ handle_signal(monitor_state_t *state)
 /*  Hot-plug handling                                                  */
 /* ------------------------------------------------------------------ */
 
+#define HOTPLUG_BATCH  64    /* uevents drained per wakeup */
+#define ATTACH_BATCH   4     /* settled devices opened per loop iteration */
+
+static int
+find_pending(monitor_state_t *state, const char *dev_path)
+{
+    for (int i = 0; i < state->pending_count; i++) {
+        if (strcmp(state->pending[i].dev_path, dev_path) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void
+drop_pending(monitor_state_t *state, int idx)
+{
+    state->pending[idx] = state->pending[--state->pending_count];
+}
+
+/* Identify and open a settled device. Returns 1 if a port was added. */
+static int
+attach_hotplugged(monitor_state_t *state, const char *dev_path)
+{
+    tty_port_t port;
+    if (identify_port(dev_path, &port) < 0)
+        return 0;
+
+    /* apply board config */
+    board_id_t bids[MAX_BOARD_IDS];
+    int nbids = load_board_config(bids, MAX_BOARD_IDS);
+    if (nbids > 0)
+        apply_board_config(&port, 1, bids, nbids);
+
+    int before = state->port_count;
+    add_discovered_port(state, &port);
+    return state->port_count > before;
+}
+
+/* Open devices whose settle delay has expired. Opening is bounded per
+ * iteration so that a hub full of adapters settling together does not
+ * delay reads on the ports already open; the rest stay due and keep the
+ * loop timeout at zero. */
+static void
+process_pending_adds(monitor_state_t *state, uint64_t now)
+{
+    int changed = 0, opened = 0;
+    for (int i = 0; i < state->pending_count && opened < ATTACH_BATCH; ) {
+        if (state->pending[i].due_ns > now) {
+            i++;
+            continue;
+        }
+        char dev_path[256];
+        strlcpy_safe(dev_path, state->pending[i].dev_path, sizeof(dev_path));
+        drop_pending(state, i);
+        changed |= attach_hotplugged(state, dev_path);
+        opened++;
+    }
+    if (changed)
+        write_status_json(state);
+}
+
+/* Milliseconds until the next pending add is due, or -1 if none. */
+static int
+pending_timeout_ms(const monitor_state_t *state, uint64_t now)
+{
+    if (state->pending_count == 0)
+        return -1;
+
+    uint64_t due = state->pending[0].due_ns;
+    for (int i = 1; i < state->pending_count; i++) {
+        if (state->pending[i].due_ns < due)
+            due = state->pending[i].due_ns;
+    }
+    if (due <= now)
+        return 0;
+    return (int)((due - now + 999999) / 1000000);
+}
+
+/* Drain queued uevents. Adds are deferred by settle_ms instead of
+ * sleeping in the loop, so a storm of plugs does not stall capture on
+ * the ports already open; a remove cancels a pending add. */
 static void
 handle_hotplug(monitor_state_t *state)
 {
-    hotplug_event_t hev;
-    int ret = hotplug_read(state->hotplug_fd, &hev);
-    if (ret <= 0)
-        return;
+    uint64_t settle_ns = (uint64_t)state->settle_ms * 1000000ull;
+    int removed = 0;
+
+    for (int n = 0; n < HOTPLUG_BATCH; n++) {
+        hotplug_event_t hev;
+        int ret = hotplug_read(state->hotplug_fd, &hev);
+        if (ret < 0)
+            break;
+        if (ret == 0)
+            continue;
+
+        int p = find_pending(state, hev.devpath);
+        if (hev.action == HOTPLUG_ADD) {
+            state->hotplug_adds++;
+            printf("  Hot-plug: %s added\n", hev.devpath);
+
+            if (p < 0) {
+                if (state->pending_count >= MAX_PORTS) {
+                    fprintf(stderr, "monitor: too many devices settling, "
+                            "ignoring %s\n", hev.devpath);
+                    continue;
+                }
+                p = state->pending_count++;
+                strlcpy_safe(state->pending[p].dev_path, hev.devpath,
+                             sizeof(state->pending[p].dev_path));
+            }
+            state->pending[p].due_ns = mono_ns() + settle_ns;
+        } else if (hev.action == HOTPLUG_REMOVE) {
+            state->hotplug_removes++;
+            printf("  Hot-plug: %s removed\n", hev.devpath);
+
+            if (p >= 0)
+                drop_pending(state, p);
+            int idx = find_port_by_path(state, hev.devpath);
+            if (idx >= 0) {
+                remove_port(state, idx);
+                removed = 1;
+            }
+        }
+    }
+
+    if (removed)
+        write_status_json(state);
+}
 
-    if (hev.action == HOTPLUG_ADD) {
-        printf("  Hot-plug: %s added\n", hev.devpath);
+/* ------------------------------------------------------------------ */
+/*  Port read scheduling (deficit round-robin by priority class)      */
+/* ------------------------------------------------------------------ */
 
-        /* wait for device to settle */
-        usleep(200000);
+/* Bytes a ready port may read per round, by class. A firehose bulk
+ * port gets one read per round; critical ports are served first and
+ * get the most, so under overload the backlog builds up in the bulk
+ * ports' kernel buffers, not in the consoles'. */
+static const size_t prio_quantum[PRIO_CLASSES] = {
+    8 * READ_BUF_SIZE,      /* critical */
+    4 * READ_BUF_SIZE,      /* normal */
+    1 * READ_BUF_SIZE,      /* bulk */
+};
+
+/* Framing errors the driver counted since the last verdict, -1 if it
+ * does not count them (USB CDC-ACM, PTYs). */
+static long
+port_frame_errors(monitored_port_t *mp)
+{
+    serial_icount_t ic;
+    if (mp->frames < 0 || serial_get_icount(mp->serial.fd, &ic) < 0)
+        return -1;
+    long d = ic.frame - mp->frames;
+    mp->frames = ic.frame;
+    return d;
+}
 
-        tty_port_t port;
-        if (identify_port(hev.devpath, &port) == 0) {
-            /* apply board config */
-            board_id_t bids[MAX_BOARD_IDS];
-            int nbids = load_board_config(bids, MAX_BOARD_IDS);
-            if (nbids > 0)
-                apply_board_config(&port, 1, bids, nbids);
-
-            add_port(state, &port);
-            write_status_json(state);
+/* A port changed from text to binary or mis-baud, or back: say so in
+ * the log, where the reader needs to know, and in status. */
+static void
+content_switched(monitor_state_t *state, monitored_port_t *mp,
+                 content_t was)
+{
+    content_t now = mp->content->kind;
+    char msg[256];
+    if (was == CONTENT_UNKNOWN && now == CONTENT_TEXT)
+        return;                     /* as it was being logged */
+    if (now == CONTENT_TEXT)
+        snprintf(msg, sizeof(msg), "PORT LOOKS LIKE TEXT AGAIN");
+    else
+        snprintf(msg, sizeof(msg), "PORT LOOKS %s: hex dump from here, "
+                 "raw bytes in %s%s", now == CONTENT_MISBAUD ?
+                 "MIS-BAUD (check the baud rate)" : "BINARY",
+                 mp->identity.label, CLASSIFY_RAW_EXT);
+    log_marker(&mp->log, msg);
+    if (now == CONTENT_TEXT)
+        close_port_raw(mp);
+    else
+        open_port_raw(state, mp);
+    fprintf(stderr, "monitor: %s: content %s -> %s\n", mp->identity.label,
+            classify_name(was), classify_name(now));
+    write_status_json(state);
+}
+
+/* Feed the classifier, window by window. */
+static void
+port_classify(monitor_state_t *state, monitored_port_t *mp,
+              const char *buf, size_t nr)
+{
+    classify_t *c = mp->content;
+    for (size_t done = 0; done < nr; ) {
+        done += classify_feed(c, buf + done, nr - done);
+        if (!classify_full(c))
+            break;
+        content_t was = c->kind;
+        if (classify_decide(c, port_frame_errors(mp)))
+            content_switched(state, mp, was);
+    }
+}
+
+/* Log data that is not text: the bytes as they came to <label>.bin,
+ * and a hex dump to the log so timestamps, markers and TAIL keep
+ * working. The dump goes around the text stages: a filter, the crash
+ * detector, toplines or the digest have nothing to find in it. Each
+ * read is dumped on its own, so a line break in the dump is also a gap
+ * in arrival. */
+static void
+log_binary(monitored_port_t *mp, const char *buf, size_t nr)
+{
+    for (size_t off = 0; off < nr && mp->raw_fd >= 0; ) {
+        ssize_t n = write(mp->raw_fd, buf + off, nr - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            /* the hex dump in the log still has every byte */
+            fprintf(stderr, "monitor: %s%s: %s\n", mp->identity.label,
+                    CLASSIFY_RAW_EXT, n < 0 ? strerror(errno) :
+                    "short write");
+            close(mp->raw_fd);
+            mp->raw_fd = -1;        /* not again until the next session */
+            break;
+        }
+        off += (size_t)n;
+    }
+
+    char out[4096];
+    size_t len = 0;
+    for (size_t i = 0; i < nr; i += CLASSIFY_HEX_BYTES) {
+        if (len + CLASSIFY_HEX_LINE > sizeof(out)) {
+            log_write_binary(&mp->log, out, len);
+            len = 0;
         }
-    } else if (hev.action == HOTPLUG_REMOVE) {
-        printf("  Hot-plug: %s removed\n", hev.devpath);
+        len += classify_hexline(buf + i, nr - i, mp->raw_bytes + i,
+                                out + len);
+    }
+    log_write_binary(&mp->log, out, len);
+    mp->raw_bytes += nr;
+}
+
+/* Hand one read() worth of port data to every consumer. */
+static void
+consume_read(monitor_state_t *state, int idx, const char *buf, size_t nr,
+             uint64_t ts)
+{
+    monitored_port_t *mp = &state->ports[idx];
+
+    if (mp->content && !mp->content->forced)
+        port_classify(state, mp, buf, nr);
+    if (mp->content && mp->content->kind >= CONTENT_BINARY)
+        log_binary(mp, buf, nr);
+    else
+        log_write(&mp->log, buf, nr);
+    mp->bytes_read += nr;
+    publish_read(state, idx, nr, ts);
+    if (state->probe && strcmp(mp->identity.dev_path, state->probe_rx) == 0)
+        probe_feed(state->probe, buf, nr, ts);
+
+    if (mp->integrity.enabled)
+        integrity_feed(&mp->integrity, buf, nr, ts);
+    if (mp->link_idx >= 0 && mp->link_idx < state->link_count) {
+        timeline_t *tl = &state->links[mp->link_idx];
+        tl->clock[mp->link_dir] = mp->clock;
+        timeline_feed(tl, mp->link_dir, buf, nr, ts);
+    }
+
+    /* proxy mode: forward serial data to PTY master
+     * so anyone reading the PTY slave sees the output */
+    if (mp->serial.pty_master >= 0) {
+        ssize_t nw = write(mp->serial.pty_master, buf, nr);
+        (void)nw; /* best effort */
+    }
+}
+
+/* Why serve_port() stopped reading */
+enum {
+    DRAIN_BUDGET,       /* the budget ran out, data is left */
+    DRAIN_SHORT,        /* a read came back short: probably empty */
+    DRAIN_EMPTY,        /* EAGAIN, or the source went away */
+};
+
+/* Read up to budget bytes from a port. Returns the bytes read and sets
+ * *drained to why it stopped; -1 if the port went away (it has been
+ * removed and ports[] shifted). */
+static long
+serve_port(monitor_state_t *state, int idx, size_t budget, char *buf,
+           size_t bufsz, int *drained)
+{
+    monitored_port_t *mp = &state->ports[idx];
+    long total = 0;
 
-        int idx = find_port_by_path(state, hev.devpath);
-        if (idx >= 0) {
+    *drained = DRAIN_BUDGET;
+    if (mp->serial.fd < 0 ||
+        (mp->serial.connecting && source_finish(state, mp) < 0)) {
+        *drained = DRAIN_EMPTY;
+        return 0;
+    }
+    while (budget > 0 && mp->serial.fd >= 0) {
+        size_t want = budget < bufsz ? budget : bufsz;
+        ssize_t nr = read(mp->serial.fd, buf, want);
+        if (nr > 0) {
+            consume_read(state, idx, buf, (size_t)nr, mono_ns());
+            total += nr;
+            budget -= (size_t)nr;
+            mp->reads++;
+            if ((size_t)nr < want) {
+                *drained = DRAIN_SHORT;
+                break;
+            }
+        } else if (nr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            *drained = DRAIN_EMPTY;
+            break;
+        } else if (nr < 0 && errno == EINTR) {
+            continue;
+        } else if (mp->serial.source != SOURCE_TTY) {
+            source_lost(state, mp, nr == 0 ? "EOF" : strerror(errno));
+            *drained = DRAIN_EMPTY;
+            break;
+        } else {
+            /* port disconnected or error */
+            fprintf(stderr, "monitor: read %s: %s\n",
+                    mp->identity.dev_path,
+                    nr == 0 ? "EOF" : strerror(errno));
             remove_port(state, idx);
             write_status_json(state);
+            return -1;
+        }
+    }
+    return total;
+}
+
+/* One deficit round-robin round over the ports epoll reported ready:
+ * classes in priority order, each port topped up by its class quantum
+ * and read until the deficit or the data runs out. A read that comes
+ * back short ends the service, but a tty's flip buffer may still hold
+ * more: the credit left unused is kept, up to one quantum, for as long
+ * as epoll keeps reporting the port. A port that is not ready (its
+ * queue is empty) or read EAGAIN starts from zero. */
+void
+schedule_ports(monitor_state_t *state, char *buf, size_t bufsz,
+               uint64_t batch_ns)
+{
+    int n = state->port_count;
+    unsigned start = n ? state->sched_rr++ % (unsigned)n : 0;
+
+    for (int c = 0; c < PRIO_CLASSES; c++) {
+        sched_stats_t *st = &state->sched[c];
+        int served = 0;
+        for (int k = 0; k < n; k++) {
+            int idx = (int)((start + (unsigned)k) % (unsigned)n);
+            monitored_port_t *mp = &state->ports[idx];
+            if (mp->prio != (prio_class_t)c)
+                continue;
+            if (!mp->ready) {
+                mp->deficit = 0;
+                continue;
+            }
+            mp->ready = 0;
+
+            uint64_t wait = mono_ns() - batch_ns;
+            st->wait_ns_total += wait;
+            if (wait > st->wait_max_ns)
+                st->wait_max_ns = wait;
+            st->services++;
+            served = 1;
+
+            mp->deficit += prio_quantum[c];
+            int drained;
+            long got = serve_port(state, idx, mp->deficit, buf, bufsz,
+                                  &drained);
+            if (got < 0) {
+                /* ports[] shifted: the rest are ready again next time */
+                for (int i = 0; i < state->port_count; i++)
+                    state->ports[i].ready = 0;
+                return;
+            }
+            st->bytes += (uint64_t)got;
+            if (drained == DRAIN_EMPTY) {
+                mp->deficit = 0;
+            } else {
+                mp->deficit -= (size_t)got;
+                if (mp->deficit > prio_quantum[c])
+                    mp->deficit = prio_quantum[c];
+                if (drained == DRAIN_BUDGET)
+                    st->backlogged++;
+            }
         }
+        if (served)
+            st->rounds++;
     }
 }
 
@@ -754,7 +3332,111 @@ flush_stale_lines(monitor_state_t *state)
             if (elapsed_ms > 200)
                 log_flush(&mp->log);
         }
+        if (mp->crash)
+            crash_poll(mp->crash, mono_ns());
+        if (mp->digest)
+            digest_poll(mp->digest, mono_ns());
+    }
+}
+
+/* Marker and sync-pattern syncs run on the housekeeping thread too: a
+ * crash storm with "panic" on every line must not hold the capture of
+ * every port behind one fdatasync each. */
+static void
+queue_log_sync(log_file_t *lf)
+{
+    housekeep_sync(&lf->fd, &lf->sync_id, 1);
+}
+
+/* Group commit: one fdatasync batch over every port written since the
+ * last one, so a crash loses at most sync_ms of output. */
+static void
+group_commit(monitor_state_t *state, uint64_t now)
+{
+    if (state->config.durability != DURABILITY_GROUP ||
+        now < state->next_commit_ns)
+        return;
+
+    /* the fdatasync batch runs on the housekeeping thread */
+    int fds[MAX_PORTS];
+    uint64_t ids[MAX_PORTS];
+    int n = 0;
+    for (int i = 0; i < state->port_count; i++) {
+        log_file_t *lf = &state->ports[i].log;
+        if (lf->fd >= 0 && lf->dirty && !lf->degraded) {
+            fds[n] = lf->fd;
+            ids[n++] = lf->sync_id;
+            lf->dirty = 0;
+        }
+    }
+    housekeep_sync(fds, ids, n);
+    state->next_commit_ns = now + (uint64_t)state->config.sync_ms * 1000000ull;
+}
+
+/* Retry degraded logs; status follows storage state changes. */
+static void
+service_logs(monitor_state_t *state)
+{
+    uint64_t now = mono_ns();
+    for (int i = 0; i < state->port_count; i++)
+        log_service(&state->ports[i].log, now);
+
+    int degraded = degraded_ports(state);
+    if (degraded != state->degraded_reported) {
+        state->degraded_reported = degraded;
+        write_status_json(state);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/*  Link timelines                                                    */
+/* ------------------------------------------------------------------ */
+
+static void
+open_links(monitor_state_t *state)
+{
+    if (state->config.link_count == 0)
+        return;
+
+    state->links = calloc((size_t)state->config.link_count,
+                          sizeof(timeline_t));
+    if (!state->links) {
+        fprintf(stderr, "monitor: out of memory for links\n");
+        return;
+    }
+
+    for (int i = 0; i < state->config.link_count; i++) {
+        const link_cfg_t *lc = &state->config.links[i];
+        if (timeline_open(&state->links[i], state->session_path,
+                          lc->name, lc->port_a, lc->port_b,
+                          state->config.reorder_ms) == 0)
+            printf("  Link: %s [%s <-> %s] -> %s\n", lc->name,
+                   lc->port_a, lc->port_b, state->links[i].path);
+    }
+    state->link_count = state->config.link_count;
+}
+
+static void
+poll_links(monitor_state_t *state)
+{
+    if (state->link_count == 0)
+        return;
+
+    uint64_t now = mono_ns();
+    for (int i = 0; i < state->link_count; i++)
+        timeline_poll(&state->links[i], now);
+}
+
+static void
+close_links(monitor_state_t *state)
+{
+    for (int i = 0; i < state->link_count; i++) {
+        timeline_marker(&state->links[i], "MONITOR STOPPED");
+        timeline_close(&state->links[i]);
     }
+    free(state->links);
+    state->links = NULL;
+    state->link_count = 0;
 }
 
 /* ------------------------------------------------------------------ */
@@ -772,8 +3454,19 @@ cmd_monitor(int argc, char *argv[])
     state.signal_fd = -1;
     state.hotplug_fd = -1;
     state.control_fd = -1;
+    for (int i = 0; i < MAX_CONTROL_CLIENTS; i++)
+        state.clients[i].fd = -1;
+    state.settle_ms = 200;
+    state.rt_policy = SCHED_OTHER;
+    state.rt_prio = 10;
 
     int foreground = 0;
+    const char *config_path = NULL;
+    int uevent_fd = -1;
+    const char *sysfs_root = NULL;
+    const char *dev_root = NULL;
+    const char *durability = NULL;
+    config_defaults(&state.config);
 
     /* parse options */
     for (int i = 1; i < argc; i++) {
@@ -795,14 +3488,82 @@ cmd_monitor(int argc, char *argv[])
         } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
             strlcpy_safe(state.only_filter, argv[++i],
                         sizeof(state.only_filter));
+        } else if (strcmp(argv[i], "--integrity") == 0) {
+            state.integrity_all = 1;
+        } else if (strcmp(argv[i], "--digest") == 0) {
+            state.digest_all = 1;
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            config_path = argv[++i];
+        } else if (strcmp(argv[i], "--durability") == 0 && i + 1 < argc) {
+            durability = argv[++i];
+        } else if (strcmp(argv[i], "--settle-ms") == 0 && i + 1 < argc) {
+            state.settle_ms = atoi(argv[++i]);
+            if (state.settle_ms < 0)
+                state.settle_ms = 0;
+        } else if (strcmp(argv[i], "--uevent-fd") == 0 && i + 1 < argc) {
+            uevent_fd = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sysfs-root") == 0 && i + 1 < argc) {
+            sysfs_root = argv[++i];
+        } else if (strcmp(argv[i], "--dev-root") == 0 && i + 1 < argc) {
+            dev_root = argv[++i];
+        } else if (strcmp(argv[i], "--cpus") == 0 && i + 1 < argc) {
+            if (parse_cpu_list(argv[++i], &state.capture_cpus) < 0) {
+                fprintf(stderr, "monitor: bad CPU list '%s'\n", argv[i]);
+                return 1;
+            }
+            state.pin_cpus = 1;
+        } else if (strcmp(argv[i], "--rt") == 0 && i + 1 < argc) {
+            const char *p = argv[++i];
+            if (strcmp(p, "fifo") == 0) {
+                state.rt_policy = SCHED_FIFO;
+            } else if (strcmp(p, "rr") == 0) {
+                state.rt_policy = SCHED_RR;
+            } else {
+                fprintf(stderr, "monitor: unknown policy '%s' (fifo, rr)\n",
+                        p);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--rt-prio") == 0 && i + 1 < argc) {
+            state.rt_prio = atoi(argv[++i]);
+            if (state.rt_prio < 1 || state.rt_prio > 99) {
+                fprintf(stderr, "monitor: --rt-prio must be 1-99\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--mlock") == 0) {
+            state.mlock = 1;
+        } else if (strcmp(argv[i], "--system") == 0) {
+            state.system_mode = 1;
         }
     }
+    identify_set_roots(sysfs_root, dev_root);
+
+    /* system mode: everything the daemon creates is private to it;
+     * users reach the ports their "allow" lines grant through the
+     * control socket */
+    if (state.system_mode) {
+        umask(077);
+        if (!config_path && access(CONFIG_SYSTEM_PATH, R_OK) == 0)
+            config_path = CONFIG_SYSTEM_PATH;
+    }
+
+    if (config_load(&state.config, config_path) < 0)
+        return 1;
+    if (durability &&
+        config_parse_durability(durability, &state.config.durability) < 0) {
+        fprintf(stderr, "monitor: unknown durability '%s' "
+                "(none, marker, group)\n", durability);
+        return 1;
+    }
+    for (int i = 0; i < state.config.sync_pattern_count; i++)
+        state.sync_patterns[i] = state.config.sync_patterns[i];
 
     /* ensure base directory exists */
     if (mkdirp(LOG_BASE_DIR) < 0) {
         fprintf(stderr, "monitor: cannot create %s\n", LOG_BASE_DIR);
         return 1;
     }
+    if (check_base_dir(state.system_mode) < 0)
+        return 1;
 
     /* PID file */
     if (pidfile_create() < 0)
@@ -822,8 +3583,16 @@ cmd_monitor(int argc, char *argv[])
         }
     }
 
+    /* shared-memory status page for readers that poll */
+    state.statpage = statpage_create(STATPAGE_PATH);
+
+    /* slow file work goes to a normal-priority thread; start it before
+     * the capture thread changes its own policy and affinity */
+    housekeep_start();
+    log_set_sync_handler(queue_log_sync);
+
     /* prune old sessions */
-    log_prune_sessions(LOG_MAX_SESSIONS);
+    housekeep_prune(LOG_MAX_SESSIONS);
 
     printf("uart-monitor starting%s...\n",
            state.proxy_mode ? " (proxy mode)" : "");
@@ -845,6 +3614,7 @@ cmd_monitor(int argc, char *argv[])
     state.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
     if (state.epoll_fd < 0) {
         fprintf(stderr, "monitor: epoll_create1: %s\n", strerror(errno));
+        housekeep_stop();
         pidfile_remove();
         return 1;
     }
@@ -856,6 +3626,9 @@ cmd_monitor(int argc, char *argv[])
     sigaddset(&mask, SIGINT);
     sigaddset(&mask, SIGHUP);
     sigprocmask(SIG_BLOCK, &mask, NULL);
+    /* a control client or socket source whose peer is gone fails a
+     * write with EPIPE instead of killing the daemon */
+    signal(SIGPIPE, SIG_IGN);
 
     state.signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
     if (state.signal_fd >= 0) {
@@ -868,8 +3641,13 @@ cmd_monitor(int argc, char *argv[])
         epoll_ctl(state.epoll_fd, EPOLL_CTL_ADD, state.signal_fd, &ev);
     }
 
-    /* setup hot-plug */
-    state.hotplug_fd = hotplug_init();
+    /* setup hot-plug (an injected uevent source replaces the kernel's) */
+    if (uevent_fd >= 0) {
+        fcntl(uevent_fd, F_SETFD, FD_CLOEXEC);
+        state.hotplug_fd = hotplug_init_fd(uevent_fd, dev_root);
+    } else {
+        state.hotplug_fd = hotplug_init();
+    }
     if (state.hotplug_fd >= 0) {
         state.evt_hotplug.type = EVT_HOTPLUG;
         state.evt_hotplug.fd = state.hotplug_fd;
@@ -882,6 +3660,11 @@ cmd_monitor(int argc, char *argv[])
 
     /* setup control socket */
     state.control_fd = control_init(CONTROL_SOCK_PATH);
+    if (state.control_fd >= 0 && state.system_mode) {
+        chmod(CONTROL_SOCK_PATH, 0666);
+        printf("System mode: control open to all users, %d allow rule(s)\n",
+               state.config.acl_count);
+    }
     if (state.control_fd >= 0) {
         state.evt_control.type = EVT_CONTROL;
         state.evt_control.fd = state.control_fd;
@@ -892,9 +3675,23 @@ cmd_monitor(int argc, char *argv[])
         epoll_ctl(state.epoll_fd, EPOLL_CTL_ADD, state.control_fd, &ev);
     }
 
+    /* link timelines must exist before ports attach to them */
+    open_links(&state);
+
     /* open all serial ports */
     for (int i = 0; i < nports; i++)
-        add_port(&state, &ports[i]);
+        add_discovered_port(&state, &ports[i]);
+    for (int i = 0; i < state.config.source_count; i++) {
+        const source_cfg_t *sc = &state.config.sources[i];
+        tty_port_t port;
+        source_identity(sc->spec, &port);
+        if (sc->label[0])
+            strlcpy_safe(port.label, sc->label, sizeof(port.label));
+        add_port(&state, &port);
+    }
+
+    /* everything is open: from here on capture runs as configured */
+    setup_capture_sched(&state);
 
     /* write initial status */
     write_status_json(&state);
@@ -928,6 +3725,54 @@ cmd_monitor(int argc, char *argv[])
                 break;
             }
         }
+        for (int i = 0; i < state.link_count; i++) {
+            if (timeline_busy(&state.links[i])) {
+                int wait = state.config.reorder_ms > 0 ?
+                           state.config.reorder_ms : 1;
+                if (timeout_ms < 0 || wait < timeout_ms)
+                    timeout_ms = wait;
+                break;
+            }
+        }
+        /* an open crash capture ends after CRASH_IDLE_MS of silence */
+        for (int i = 0; i < state.port_count; i++) {
+            const crash_t *c = state.ports[i].crash;
+            if (c && c->kind != CRASH_NONE &&
+                (timeout_ms < 0 || timeout_ms > CRASH_IDLE_MS / 4)) {
+                timeout_ms = CRASH_IDLE_MS / 4;
+                break;
+            }
+        }
+        /* a held progress line shows after DIGEST_IDLE_MS of quiet */
+        for (int i = 0; i < state.port_count; i++) {
+            const digest_t *d = state.ports[i].digest;
+            if (d && digest_pending(d) &&
+                (timeout_ms < 0 || timeout_ms > DIGEST_IDLE_MS / 4)) {
+                timeout_ms = DIGEST_IDLE_MS / 4;
+                break;
+            }
+        }
+        if (timeout_ms < 0 && integrity_active(&state))
+            timeout_ms = IG_WINDOW_MS;
+        if (degraded_ports(&state) > 0 &&
+            (timeout_ms < 0 || timeout_ms > LOG_RETRY_MS))
+            timeout_ms = LOG_RETRY_MS;
+        if (state.config.durability == DURABILITY_GROUP &&
+            (timeout_ms < 0 || timeout_ms > state.config.sync_ms))
+            timeout_ms = state.config.sync_ms;
+        if (state.probe && (timeout_ms < 0 ||
+                            state.probe_wait_ms < timeout_ms))
+            timeout_ms = state.probe_wait_ms;
+        int settle_wait = pending_timeout_ms(&state, mono_ns());
+        if (settle_wait >= 0 && (timeout_ms < 0 || settle_wait < timeout_ms))
+            timeout_ms = settle_wait;
+        int retry_wait = source_timeout_ms(&state, mono_ns());
+        if (retry_wait >= 0 && (timeout_ms < 0 || retry_wait < timeout_ms))
+            timeout_ms = retry_wait;
+        int client_wait = control_timeout_ms(&state, mono_ns());
+        if (client_wait >= 0 &&
+            (timeout_ms < 0 || client_wait < timeout_ms))
+            timeout_ms = client_wait;
         int nfds = epoll_wait(state.epoll_fd, events,
                               MAX_EPOLL_EVENTS, timeout_ms);
 
@@ -937,12 +3782,20 @@ cmd_monitor(int argc, char *argv[])
             fprintf(stderr, "monitor: epoll_wait: %s\n", strerror(errno));
             break;
         }
+        uint64_t loop_start = mono_ns();
 
+        unsigned gen = state.port_gen;
         for (int i = 0; i < nfds; i++) {
             event_ctx_t *ctx = events[i].data.ptr;
             if (!ctx)
                 continue;
 
+            /* a port was removed while handling this batch: the rest of
+             * the batch may point at shifted ports[] slots. epoll is
+             * level-triggered, so anything skipped is reported again. */
+            if (state.port_gen != gen)
+                break;
+
             switch (ctx->type) {
             case EVT_SIGNAL:
                 handle_signal(&state);
@@ -952,53 +3805,19 @@ cmd_monitor(int argc, char *argv[])
                 handle_hotplug(&state);
                 break;
 
-            case EVT_CONTROL: {
-                /* accept new control client */
-                int cfd = accept4(state.control_fd, NULL, NULL,
-                                  SOCK_CLOEXEC);
-                if (cfd >= 0)
-                    handle_control_cmd(&state, cfd);
+            case EVT_CONTROL:
+                accept_control_client(&state);
                 break;
-            }
 
             case EVT_CONTROL_CLIENT:
-                /* handled inline at accept time */
+                read_control_client(&state, &state.clients[ctx->index]);
                 break;
 
-            case EVT_SERIAL: {
-                int idx = ctx->index;
-                if (idx < 0 || idx >= state.port_count)
-                    break;
-
-                monitored_port_t *mp = &state.ports[idx];
-                ssize_t nr = read(mp->serial.fd, read_buf,
-                                  sizeof(read_buf));
-
-                if (nr > 0) {
-                    log_write(&mp->log, read_buf, (size_t)nr);
-                    mp->bytes_read += (size_t)nr;
-
-                    /* proxy mode: forward serial data to PTY master
-                     * so anyone reading the PTY slave sees the output */
-                    if (mp->serial.pty_master >= 0) {
-                        ssize_t nw = write(mp->serial.pty_master,
-                                           read_buf, (size_t)nr);
-                        (void)nw; /* best effort */
-                    }
-                } else if (nr == 0 ||
-                           (nr < 0 && errno != EAGAIN &&
-                            errno != EWOULDBLOCK)) {
-                    /* port disconnected or error */
-                    fprintf(stderr, "monitor: read %s: %s\n",
-                            mp->identity.dev_path,
-                            nr == 0 ? "EOF" : strerror(errno));
-                    remove_port(&state, idx);
-                    write_status_json(&state);
-                    /* adjust loop since we shifted ports */
-                    i = nfds; /* break out of event loop iteration */
-                }
+            case EVT_SERIAL:
+                /* read by schedule_ports() once the batch is sorted */
+                if (ctx->index >= 0 && ctx->index < state.port_count)
+                    state.ports[ctx->index].ready = 1;
                 break;
-            }
 
             case EVT_PTY: {
                 /* proxy mode: user wrote to PTY slave, forward to serial */
@@ -1013,8 +3832,9 @@ cmd_monitor(int argc, char *argv[])
                 ssize_t nr = read(mp->serial.pty_master, read_buf,
                                   sizeof(read_buf));
 
-                if (nr > 0) {
-                    /* forward to real serial port */
+                if (nr > 0 && mp->serial.source != SOURCE_FIFO) {
+                    /* forward to real serial port (a FIFO is read
+                     * only: it would come straight back) */
                     ssize_t nw = write(mp->serial.fd,
                                        read_buf, (size_t)nr);
                     (void)nw; /* best effort */
@@ -1028,13 +3848,41 @@ cmd_monitor(int argc, char *argv[])
             }
         }
 
+        schedule_ports(&state, read_buf, sizeof(read_buf), loop_start);
+
         /* flush partial lines older than 200ms */
         flush_stale_lines(&state);
+        service_logs(&state);
+        group_commit(&state, mono_ns());
+        collect_syncs(&state);
+        poll_links(&state);
+        process_pending_adds(&state, mono_ns());
+        service_sources(&state, mono_ns());
+        service_probe(&state, mono_ns());
+        expire_control_clients(&state, mono_ns());
+
+        /* loop stalls delay every port's reads; the integrity probe
+         * correlates them with the errors that follow */
+        uint64_t loop_end = mono_ns();
+        uint64_t loop_ns = loop_end - loop_start;
+        if (loop_ns > state.max_loop_ns)
+            state.max_loop_ns = loop_ns;
+        if (loop_ns > (uint64_t)IG_STALL_MS * 1000000ull) {
+            state.loop_stalls++;
+            for (int i = 0; i < state.port_count; i++)
+                integrity_note_stall(&state.ports[i].integrity, loop_ns);
+        }
+        for (int i = 0; i < state.port_count; i++)
+            integrity_tick(&state.ports[i].integrity, loop_end,
+                           state.ports[i].serial.fd);
     }
 
     /* ---- cleanup ---- */
     printf("Shutting down...\n");
 
+    if (state.probe)
+        probe_finish(&state, "daemon stopping");
+
     for (int i = state.port_count - 1; i >= 0; i--) {
         monitored_port_t *mp = &state.ports[i];
         if (mp->serial.pty_master >= 0)
@@ -1042,6 +3890,18 @@ cmd_monitor(int argc, char *argv[])
         log_marker(&mp->log, "MONITOR STOPPED");
         log_close(&mp->log);
         serial_close(&mp->serial);
+        free_port_filter(mp);
+        free_port_crash(mp);
+        free_port_clock(&state, mp);
+        free_port_recent(mp);
+        free_port_toplines(mp);
+        free_port_digest(mp);
+        free_port_content(mp);
+    }
+    close_links(&state);
+    for (int i = 0; i < MAX_CONTROL_CLIENTS; i++) {
+        if (state.clients[i].fd >= 0)
+            drop_control_client(&state, &state.clients[i]);
     }
 
     if (state.hotplug_fd >= 0)
@@ -1052,6 +3912,10 @@ cmd_monitor(int argc, char *argv[])
     if (state.epoll_fd >= 0)
         close(state.epoll_fd);
 
+    /* let queued status writes and syncs finish before removing */
+    housekeep_stop();
+    statpage_destroy(state.statpage, STATPAGE_PATH);
+
     pidfile_remove();
     unlink(STATUS_FILE);
 
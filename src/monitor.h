@@ -2,9 +2,24 @@
 #ifndef MONITOR_H
 #define MONITOR_H
 
+#include "acl.h"
+#include "classify.h"
+#include "crash.h"
+#include "devclock.h"
+#include "digest.h"
+#include "filter.h"
 #include "identify.h"
 #include "serial.h"
 #include "log.h"
+#include "config.h"
+#include "integrity.h"
+#include "timeline.h"
+#include "statpage.h"
+#include "probe.h"
+#include "recent.h"
+#include "toplines.h"
+
+#include <sched.h>
 
 /* Event source types for epoll dispatch */
 typedef enum {
@@ -31,8 +46,63 @@ typedef struct {
     event_ctx_t  evt_pty;     /* epoll context for PTY master fd */
     int          yielded;
     size_t       bytes_read;
+    int          link_idx;    /* index into links[], -1 if not linked */
+    int          link_dir;    /* TL_DIR_A or TL_DIR_B */
+    integrity_t  integrity;   /* probe-frame checker (--integrity) */
+    filter_t    *filter;      /* config line filter, NULL if none */
+    crash_t     *crash;       /* crash signature detector */
+    devclock_t  *clock;       /* device clock model (stamped lines) */
+    recent_t    *recent;      /* last lines logged, for TAIL */
+    digest_t    *digest;      /* condensed log, NULL if not wanted */
+    toplines_t  *toplines;    /* heaviest line templates, for TOPLINES */
+    classify_t  *content;     /* text / binary / mis-baud verdict */
+    int          raw_fd;      /* <label>.bin once not text, else -1 */
+    unsigned long long raw_bytes; /* written there: hex line offsets */
+    long         frames;      /* driver framing errors at the last
+                               * verdict, -1 if it does not count them */
+    uint64_t     retry_ns;    /* socket/FIFO source: next connect try */
+    int          retry_ms;    /* its backoff, 0 while connected */
+    uint64_t     connects;    /* connections made to the source */
+    prio_class_t prio;        /* read scheduling class */
+    int          ready;       /* epoll reported data this batch */
+    size_t       deficit;     /* DRR byte credit carried over */
+    uint64_t     reads;       /* read() calls that returned data */
+    uint64_t     last_read_ns;
+    uint64_t     rate_start_ns; /* current read-rate window */
+    uint64_t     rate_bytes;
+    uint64_t     rate_bps;    /* bytes/s over the last full window */
+    uint64_t     rate_at;     /* when rate_bps was computed */
+    char         checkpoint[64]; /* last CLEAR checkpoint, "" if none */
+    long long    checkpoint_off; /* its byte offset in the log */
 } monitored_port_t;
 
+/* Hot-plugged device waiting to settle before it is opened */
+typedef struct {
+    char         dev_path[256];
+    uint64_t     due_ns;      /* mono_ns() after which it is identified */
+} pending_add_t;
+
+/* Control connection whose command has not fully arrived yet */
+#define MAX_CONTROL_CLIENTS 16
+
+typedef struct {
+    int          fd;          /* -1: slot free */
+    event_ctx_t  evt;         /* EVT_CONTROL_CLIENT, index = slot */
+    uint64_t     deadline_ns; /* dropped if still silent at mono_ns() */
+    size_t       len;
+    char         buf[512];    /* command bytes received so far */
+} control_client_t;
+
+/* Read scheduler counters for one priority class */
+typedef struct {
+    uint64_t     rounds;      /* scheduling rounds with a ready port */
+    uint64_t     services;    /* ports served */
+    uint64_t     bytes;
+    uint64_t     backlogged;  /* services that left data behind */
+    uint64_t     wait_ns_total; /* epoll return -> first read */
+    uint64_t     wait_max_ns;
+} sched_stats_t;
+
 /* Overall daemon state */
 typedef struct {
     int              epoll_fd;
@@ -51,9 +121,62 @@ typedef struct {
     int              timestamps;      /* --timestamps: prepend [ts] to log lines */
     speed_t          baudrate;
     char             only_filter[512];  /* comma-separated device filter */
+    config_t         config;
+    timeline_t      *links;           /* one per config link, heap */
+    int              link_count;
+    int              integrity_all;   /* --integrity: check every port */
+    int              digest_all;      /* --digest: digest every port */
+    uint64_t         loop_stalls;     /* iterations over IG_STALL_MS */
+    uint64_t         max_loop_ns;
+    unsigned         port_gen;        /* bumped when ports[] shifts */
+    pending_add_t    pending[MAX_PORTS]; /* hot-plug adds still settling */
+    int              pending_count;
+    int              settle_ms;       /* --settle-ms: hot-plug settle delay */
+    uint64_t         hotplug_adds;    /* tty add/remove uevents seen */
+    uint64_t         hotplug_removes;
+    int              degraded_reported; /* degraded logs in last status */
+    const char      *sync_patterns[CONFIG_MAX_PATTERNS]; /* -> config */
+    uint64_t         next_commit_ns;  /* next group commit (mono_ns) */
+    cpu_set_t        capture_cpus;    /* --cpus: capture (and reader) CPUs */
+    int              pin_cpus;        /* capture_cpus is set */
+    int              rt_policy;       /* --rt: SCHED_FIFO/RR, or SCHED_OTHER */
+    int              rt_prio;         /* --rt-prio */
+    int              mlock;           /* --mlock: mlockall() */
+    int              sched_applied;   /* policy actually in effect */
+    int              mlock_applied;
+    unsigned         mark_seq;        /* last MARK number */
+    unsigned         checkpoint_seq;  /* last CLEAR checkpoint number */
+    statpage_t      *statpage;        /* shared-memory status, or NULL */
+    probe_t         *probe;           /* running PING/BW, or NULL */
+    int              probe_client;    /* control client awaiting result */
+    int              probe_own_fd;    /* write fd opened for the probe */
+    char             probe_tx[256];   /* device paths: ports[] may shift */
+    char             probe_rx[256];
+    int              probe_wait_ms;   /* next probe tick */
+    int              system_mode;     /* --system: shared, ACL-checked */
+    const acl_peer_t *peer;           /* restricted control client being
+                                       * served, NULL: sees every port */
+    control_client_t clients[MAX_CONTROL_CLIENTS]; /* awaiting a command */
+    uint64_t         control_dropped; /* clients silent past the deadline
+                                       * or not reading their reply */
+    sched_stats_t    sched[PRIO_CLASSES]; /* per priority class */
+    unsigned         sched_rr;        /* rotates the start of each round */
 } monitor_state_t;
 
 /* The monitor subcommand entry point. */
 int cmd_monitor(int argc, char *argv[]);
 
+/* Internals, exposed for tests. */
+
+/* One read scheduling round over the ports marked ready, reading into
+ * buf; batch_ns is when epoll returned. */
+void schedule_ports(monitor_state_t *state, char *buf, size_t bufsz,
+                    uint64_t batch_ns);
+
+/* The ports a control command names ("board:<id>", "group:<port>", or
+ * one port by device path if by_path, else by any name), as visible to
+ * state->peer, into sel. Returns the count. */
+int select_ports(monitor_state_t *state, const char *name, int by_path,
+                 int sel[MAX_PORTS]);
+
 #endif /* MONITOR_H */
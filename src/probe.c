@@ -0,0 +1,377 @@
+/* probe.c -- Loopback latency and throughput probe (ping / bw).
+ *
+ * The daemon writes timestamped, CRC-protected frames to one port and
+ * verifies them as they come back on the same port (a loopback plug) or
+ * on a second port wired to the first. ping sends a frame per interval
+ * and reports round-trip percentiles; bw sends at fixed fractions of the
+ * line rate for each baud rate under test and reports the highest rate
+ * that arrived without a lost or corrupt frame.
+ *
+ * The frames go out through the daemon's own file descriptors and come
+ * back through the normal capture path, so the numbers include the
+ * event loop and match what the monitor actually sees.
+ */
+#include "probe.h"
+#include "serial.h"
+#include "util.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const int load_pct[PR_LOAD_STEPS] = { 50, 75, 90, 100 };
+
+size_t
+probe_frame(char *buf, size_t sz, uint32_t seq, uint64_t ts,
+            int payload_len)
+{
+    char body[PR_LINE_MAX];
+    if (payload_len < 1 || payload_len > PR_LINE_MAX - 48)
+        return 0;
+
+    int n = snprintf(body, sizeof(body), "%08x %016llx ", seq,
+                     (unsigned long long)ts);
+    for (int i = 0; i < payload_len; i++)
+        body[n + i] = (char)('a' + (seq + (uint32_t)i) % 26);
+    n += payload_len;
+
+    uint32_t crc = crc32_update(0, body, (size_t)n);
+    int total = snprintf(buf, sz, PR_MAGIC "%.*s %08x\n", n, body, crc);
+    if (total < 0 || (size_t)total >= sz)
+        return 0;
+    return (size_t)total;
+}
+
+/* Parse "UMLP <seq> <ts> <payload> <crc>"; returns 0 if intact. */
+static int
+parse_frame(const char *line, int len, uint32_t *seq, uint64_t *ts)
+{
+    const int magic_len = (int)sizeof(PR_MAGIC) - 1;
+    if (len < magic_len + 8 + 1 + 16 + 1 + 1 + 1 + 8)
+        return -1;
+
+    const char *body = line + magic_len;
+    int body_len = len - magic_len - 9;      /* strip " <crc>" */
+    if (body[body_len] != ' ' || body[8] != ' ' || body[25] != ' ')
+        return -1;
+
+    char hex[17];
+    char *end;
+    memcpy(hex, body + body_len + 1, 8);
+    hex[8] = '\0';
+    uint32_t crc = (uint32_t)strtoul(hex, &end, 16);
+    if (*end != '\0' || crc32_update(0, body, (size_t)body_len) != crc)
+        return -1;
+
+    memcpy(hex, body, 8);
+    hex[8] = '\0';
+    *seq = (uint32_t)strtoul(hex, &end, 16);
+    if (*end != '\0')
+        return -1;
+    memcpy(hex, body + 9, 16);
+    hex[16] = '\0';
+    *ts = strtoull(hex, &end, 16);
+    return *end == '\0' ? 0 : -1;
+}
+
+static void
+check_line(probe_t *pr, uint64_t now)
+{
+    const char *line = pr->line;
+    int len = pr->line_len;
+
+    const char *start = NULL;
+    for (const char *p = line; (p = memmem(p, (size_t)(line + len - p),
+                                            PR_MAGIC, 5)) != NULL; p++)
+        start = p;
+    if (!start)
+        return;                      /* not ours */
+    len -= (int)(start - line);
+
+    uint32_t seq;
+    uint64_t ts;
+    if (parse_frame(start, len, &seq, &ts) < 0) {
+        pr->corrupt++;
+        return;
+    }
+    /* late frames of an earlier step, or duplicates */
+    if ((int32_t)(seq - pr->rx_next) < 0)
+        return;
+
+    pr->rx_next = seq + 1;
+    pr->received++;
+    pr->rx_bytes += (uint64_t)len + 1;
+    pr->last_rx = now;
+    if (pr->nrtt < PR_MAX_SAMPLES && now >= ts)
+        pr->rtt[pr->nrtt++] = now - ts;
+}
+
+void
+probe_feed(probe_t *pr, const char *data, size_t len, uint64_t now)
+{
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        if (c == '\n') {
+            check_line(pr, now);
+            pr->line_len = 0;
+        } else if (c != '\r') {
+            if (pr->line_len < PR_LINE_MAX)
+                pr->line[pr->line_len++] = c;
+            else
+                pr->line_len = 0;    /* runaway line: resync */
+        }
+    }
+}
+
+/* Push out the frame the tty only partly accepted. Returns 1 once the
+ * transmit buffer is empty. */
+static int
+tx_flush(probe_t *pr)
+{
+    while (pr->tx_off < pr->tx_len) {
+        ssize_t n = write(pr->tx_fd, pr->tx_buf + pr->tx_off,
+                          pr->tx_len - pr->tx_off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+        pr->tx_off += (size_t)n;
+        pr->sent_bytes += (uint64_t)n;
+    }
+    return 1;
+}
+
+static int
+send_frame(probe_t *pr, uint64_t now)
+{
+    if (!tx_flush(pr))
+        return 0;
+    pr->tx_len = probe_frame(pr->tx_buf, sizeof(pr->tx_buf), pr->tx_seq++,
+                             now, pr->payload);
+    pr->tx_off = 0;
+    pr->sent++;
+    return tx_flush(pr);
+}
+
+static void
+start_step(probe_t *pr, uint64_t now)
+{
+    pr->draining = 0;
+    pr->step_start = now;
+    pr->next_tx = now;
+    pr->sent = pr->received = pr->corrupt = 0;
+    pr->rx_bytes = pr->sent_bytes = 0;
+    pr->last_rx = 0;
+    pr->nrtt = 0;
+    pr->line_len = 0;
+    pr->rx_next = pr->tx_seq;
+
+    if (pr->mode != PROBE_BW)
+        return;
+    int baud = pr->bauds[pr->step / PR_LOAD_STEPS];
+    if (pr->step % PR_LOAD_STEPS == 0) {
+        speed_t speed = baud_to_speed(baud);
+        serial_set_baud(pr->tx_fd, speed);
+        if (pr->rx_fd >= 0 && pr->rx_fd != pr->tx_fd)
+            serial_set_baud(pr->rx_fd, speed);
+    }
+    /* 8N1: ten bits on the wire per byte */
+    pr->offered_bps = (uint64_t)baud / 10 *
+                      (uint64_t)load_pct[pr->step % PR_LOAD_STEPS] / 100;
+}
+
+static void
+finish_step(probe_t *pr)
+{
+    if (pr->mode != PROBE_BW || pr->nsteps >= PR_MAX_BAUDS * PR_LOAD_STEPS)
+        return;
+    probe_step_t *st = &pr->steps[pr->nsteps++];
+    st->baud = pr->bauds[pr->step / PR_LOAD_STEPS];
+    st->load_pct = load_pct[pr->step % PR_LOAD_STEPS];
+    st->offered_bps = pr->offered_bps;
+    st->sent = pr->sent;
+    st->received = pr->received;
+    st->corrupt = pr->corrupt;
+    st->lost = pr->sent > pr->received + pr->corrupt ?
+               pr->sent - pr->received - pr->corrupt : 0;
+    /* over the send phase, or longer if frames were still arriving */
+    uint64_t span = (uint64_t)pr->step_ms * 1000000ull;
+    if (pr->last_rx > pr->step_start + span)
+        span = pr->last_rx - pr->step_start;
+    st->rx_bps = pr->rx_bytes * 1000000000ull / span;
+}
+
+static void
+probe_init(probe_t *pr, probe_mode_t mode, int tx_fd, int rx_fd,
+           int payload)
+{
+    memset(pr, 0, sizeof(*pr));
+    pr->mode = mode;
+    pr->tx_fd = tx_fd;
+    pr->rx_fd = rx_fd;
+    pr->payload = payload;
+}
+
+void
+probe_init_ping(probe_t *pr, int tx_fd, int rx_fd, int count,
+                int interval_ms, int payload)
+{
+    probe_init(pr, PROBE_PING, tx_fd, rx_fd, payload);
+    pr->count = count;
+    pr->interval_ms = interval_ms;
+    start_step(pr, mono_ns());
+}
+
+void
+probe_init_bw(probe_t *pr, int tx_fd, int rx_fd, const int *bauds,
+              int nbauds, int step_ms, int payload)
+{
+    probe_init(pr, PROBE_BW, tx_fd, rx_fd, payload);
+    if (nbauds > PR_MAX_BAUDS)
+        nbauds = PR_MAX_BAUDS;
+    memcpy(pr->bauds, bauds, (size_t)nbauds * sizeof(int));
+    pr->nbauds = nbauds;
+    pr->step_ms = step_ms;
+    start_step(pr, mono_ns());
+}
+
+static int
+ms_until(uint64_t when, uint64_t now)
+{
+    if (when <= now)
+        return 1;
+    return (int)((when - now + 999999) / 1000000);
+}
+
+int
+probe_tick(probe_t *pr, uint64_t now)
+{
+    if (pr->done)
+        return -1;
+
+    int tx_done = tx_flush(pr);
+    if (!pr->draining) {
+        if (pr->mode == PROBE_PING) {
+            while (tx_done && pr->sent < (uint64_t)pr->count &&
+                   now >= pr->next_tx) {
+                tx_done = send_frame(pr, now);
+                pr->next_tx += (uint64_t)pr->interval_ms * 1000000ull;
+            }
+            if (pr->sent >= (uint64_t)pr->count)
+                pr->draining = 1;
+        } else {
+            uint64_t elapsed = now - pr->step_start;
+            if (elapsed >= (uint64_t)pr->step_ms * 1000000ull) {
+                pr->draining = 1;
+            } else {
+                /* pace to the offered load; the first frame goes now */
+                uint64_t due = pr->offered_bps * elapsed / 1000000000ull +
+                               (uint64_t)pr->payload;
+                while (tx_done && pr->sent_bytes < due)
+                    tx_done = send_frame(pr, now);
+            }
+        }
+        if (pr->draining)
+            pr->drain_end = now + (uint64_t)PR_DRAIN_MS * 1000000ull;
+    }
+
+    if (pr->draining) {
+        int settled = tx_done && pr->received + pr->corrupt >= pr->sent;
+        if (!settled && now < pr->drain_end)
+            return ms_until(pr->drain_end, now) < PR_TICK_MS ?
+                   ms_until(pr->drain_end, now) : PR_TICK_MS;
+
+        finish_step(pr);
+        pr->step++;
+        if (pr->mode == PROBE_PING ||
+            pr->step >= pr->nbauds * PR_LOAD_STEPS) {
+            pr->done = 1;
+            return -1;
+        }
+        start_step(pr, now);
+        return PR_TICK_MS;
+    }
+
+    if (pr->mode == PROBE_PING)
+        return ms_until(pr->next_tx, now);
+    return PR_TICK_MS;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double
+pct_ms(const uint64_t *sorted, size_t n, int pct)
+{
+    size_t i = (n * (size_t)pct + 99) / 100;
+    if (i > 0)
+        i--;
+    return (double)sorted[i] / 1e6;
+}
+
+void
+probe_report(probe_t *pr, const char *tx_label, const char *rx_label,
+             char *buf, size_t sz)
+{
+    size_t off;
+
+    if (pr->mode == PROBE_PING) {
+        uint64_t lost = pr->sent > pr->received + pr->corrupt ?
+                        pr->sent - pr->received - pr->corrupt : 0;
+        off = (size_t)snprintf(buf, sz,
+            "OK ping %s -> %s sent=%llu received=%llu lost=%llu "
+            "corrupt=%llu\n", tx_label, rx_label,
+            (unsigned long long)pr->sent,
+            (unsigned long long)pr->received,
+            (unsigned long long)lost,
+            (unsigned long long)pr->corrupt);
+        if (off >= sz)
+            return;
+        if (pr->nrtt == 0) {
+            snprintf(buf + off, sz - off, "rtt_ms none\n");
+            return;
+        }
+        qsort(pr->rtt, pr->nrtt, sizeof(pr->rtt[0]), cmp_u64);
+        snprintf(buf + off, sz - off,
+                 "rtt_ms min=%.3f p50=%.3f p90=%.3f p99=%.3f max=%.3f\n",
+                 (double)pr->rtt[0] / 1e6,
+                 pct_ms(pr->rtt, pr->nrtt, 50),
+                 pct_ms(pr->rtt, pr->nrtt, 90),
+                 pct_ms(pr->rtt, pr->nrtt, 99),
+                 (double)pr->rtt[pr->nrtt - 1] / 1e6);
+        return;
+    }
+
+    off = (size_t)snprintf(buf, sz, "OK bw %s -> %s\n", tx_label, rx_label);
+    for (int i = 0; i < pr->nsteps && off < sz; i++) {
+        const probe_step_t *st = &pr->steps[i];
+        off += (size_t)snprintf(buf + off, sz - off,
+            "baud=%d load=%d%% offered_Bps=%llu rx_Bps=%llu sent=%llu "
+            "lost=%llu corrupt=%llu\n", st->baud, st->load_pct,
+            (unsigned long long)st->offered_bps,
+            (unsigned long long)st->rx_bps,
+            (unsigned long long)st->sent,
+            (unsigned long long)st->lost,
+            (unsigned long long)st->corrupt);
+    }
+    for (int b = 0; b < pr->nbauds && off < sz; b++) {
+        uint64_t best = 0;
+        for (int i = 0; i < pr->nsteps; i++) {
+            const probe_step_t *st = &pr->steps[i];
+            if (st->baud == pr->bauds[b] && st->sent > 0 &&
+                st->lost == 0 && st->corrupt == 0 && st->rx_bps > best)
+                best = st->rx_bps;
+        }
+        double line = (double)pr->bauds[b] / 10.0;
+        off += (size_t)snprintf(buf + off, sz - off,
+            "baud=%d max_lossless_Bps=%llu (%.1f%% of line rate)\n",
+            pr->bauds[b], (unsigned long long)best,
+            line > 0 ? 100.0 * (double)best / line : 0.0);
+    }
+}
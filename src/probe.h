@@ -0,0 +1,104 @@
+/* probe.h -- Loopback latency and throughput probe (ping / bw) */
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Probe frame, one per line (CRC-32 covers "<seq> <ts> <payload>"):
+ *
+ *   UMLP <seq:8 hex> <ts:16 hex> <payload> <crc32:8 hex>\n
+ *
+ * ts is the sender's CLOCK_MONOTONIC time. The daemon both sends and
+ * receives, so the round-trip time is arrival time minus ts. Lines
+ * without "UMLP " are ignored, so the probe coexists with console
+ * output on the receiving port. */
+#define PR_MAGIC        "UMLP "
+#define PR_LINE_MAX     256
+#define PR_MAX_SAMPLES  4096
+#define PR_MAX_BAUDS    8
+#define PR_LOAD_STEPS   4         /* offered load: 50, 75, 90, 100 % */
+#define PR_TICK_MS      5         /* bw pacing interval */
+#define PR_DRAIN_MS     1000      /* wait for frames still in flight */
+
+typedef enum { PROBE_PING, PROBE_BW } probe_mode_t;
+
+/* One bw measurement: a baud rate at one offered load */
+typedef struct {
+    int      baud;
+    int      load_pct;
+    uint64_t offered_bps;         /* bytes/s */
+    uint64_t rx_bps;              /* intact frame bytes/s received */
+    uint64_t sent;
+    uint64_t received;
+    uint64_t lost;
+    uint64_t corrupt;
+} probe_step_t;
+
+typedef struct {
+    probe_mode_t mode;
+    int      tx_fd;               /* write side (not owned) */
+    int      rx_fd;               /* receive port, for baud changes */
+    int      payload;
+    int      count;               /* ping: frames to send */
+    int      interval_ms;         /* ping: frame spacing */
+    int      bauds[PR_MAX_BAUDS]; /* bw: rates to measure */
+    int      nbauds;
+    int      step_ms;             /* bw: send phase of one step */
+
+    /* progress */
+    int      done;
+    int      step;                /* bw: baud * PR_LOAD_STEPS + load */
+    int      draining;
+    uint64_t step_start;
+    uint64_t next_tx;
+    uint64_t drain_end;
+    uint64_t offered_bps;
+    uint64_t sent_bytes;
+    char     tx_buf[PR_LINE_MAX]; /* frame partly accepted by the tty */
+    size_t   tx_len;
+    size_t   tx_off;
+
+    /* frame assembly and counters of the current step */
+    char     line[PR_LINE_MAX];
+    int      line_len;
+    uint32_t tx_seq;
+    uint32_t rx_next;
+    uint64_t sent;
+    uint64_t received;
+    uint64_t corrupt;
+    uint64_t rx_bytes;
+    uint64_t last_rx;
+    uint64_t rtt[PR_MAX_SAMPLES];
+    size_t   nrtt;
+
+    probe_step_t steps[PR_MAX_BAUDS * PR_LOAD_STEPS];
+    int      nsteps;
+} probe_t;
+
+/* Format frame 'seq' sent at ts with payload_len payload bytes into buf.
+ * Returns the frame length including '\n', or 0 if buf is too small. */
+size_t probe_frame(char *buf, size_t sz, uint32_t seq, uint64_t ts,
+                   int payload_len);
+
+/* Set up a round-trip run: count frames, one every interval_ms. */
+void probe_init_ping(probe_t *pr, int tx_fd, int rx_fd, int count,
+                     int interval_ms, int payload);
+
+/* Set up a throughput run: each baud rate at each offered load for
+ * step_ms, reporting the best load that arrived without loss. */
+void probe_init_bw(probe_t *pr, int tx_fd, int rx_fd, const int *bauds,
+                   int nbauds, int step_ms, int payload);
+
+/* Verify one read() chunk from the receiving port. */
+void probe_feed(probe_t *pr, const char *data, size_t len, uint64_t now);
+
+/* Send what is due and advance the run. Returns the number of ms until
+ * the next tick is needed, or -1 once the run is complete. */
+int probe_tick(probe_t *pr, uint64_t now);
+
+/* Format the result ("OK ping ..." / "OK bw ..."). */
+void probe_report(probe_t *pr, const char *tx_label, const char *rx_label,
+                  char *buf, size_t sz);
+
+#endif /* PROBE_H */
@@ -0,0 +1,101 @@
+/* recent.c -- In-memory ring of a port's most recent log lines.
+ *
+ * Lines enter in log order, so both their offsets and their times only
+ * grow: every query selects a suffix of the ring, found by walking back
+ * from the newest line.
+ */
+#include "recent.h"
+
+#include <string.h>
+
+void
+recent_reset(recent_t *r)
+{
+    r->first = 0;
+    r->count = 0;
+    r->text_head = 0;
+    r->text_used = 0;
+}
+
+static void
+put(recent_t *r, const char *data, size_t len)
+{
+    while (len > 0) {
+        size_t run = RECENT_BYTES - r->text_head;
+        if (run > len)
+            run = len;
+        memcpy(r->text + r->text_head, data, run);
+        r->text_head = (r->text_head + run) % RECENT_BYTES;
+        data += run;
+        len -= run;
+    }
+}
+
+void
+recent_push(recent_t *r, long long off, uint64_t ns,
+            const char *prefix, const char *text, size_t len)
+{
+    size_t plen = prefix ? strlen(prefix) : 0;
+    if (plen + len + 1 > RECENT_BYTES)
+        return;
+    size_t total = plen + len + 1;
+
+    while (r->count > 0 &&
+           (r->count == RECENT_LINES || r->text_used + total > RECENT_BYTES)) {
+        r->text_used -= r->line[r->first].len;
+        r->first = (r->first + 1) % RECENT_LINES;
+        r->count--;
+    }
+
+    recent_line_t *l = &r->line[(r->first + r->count) % RECENT_LINES];
+    l->off = off;
+    l->ns = ns;
+    l->pos = (uint32_t)r->text_head;
+    l->len = (uint32_t)total;
+    put(r, prefix, plen);
+    put(r, text, len);
+    put(r, "\n", 1);
+    r->text_used += total;
+    r->count++;
+}
+
+int
+recent_query(const recent_t *r, const recent_query_t *q, char *out,
+             size_t sz, size_t *out_len, long long *first, long long *next)
+{
+    int start = r->count;
+    while (start > 0) {
+        const recent_line_t *l =
+            &r->line[(r->first + start - 1) % RECENT_LINES];
+        if (l->ns < q->since_ns || l->off < q->after)
+            break;
+        start--;
+    }
+    if (q->max_lines > 0 && r->count - start > q->max_lines)
+        start = r->count - q->max_lines;
+
+    size_t n = 0;
+    int lines = 0;
+    for (int i = start; i < r->count; i++) {
+        const recent_line_t *l = &r->line[(r->first + i) % RECENT_LINES];
+        if (n + l->len > sz)
+            break;
+        size_t run = RECENT_BYTES - l->pos;
+        if (run > l->len)
+            run = l->len;
+        memcpy(out + n, r->text + l->pos, run);
+        memcpy(out + n + run, r->text, l->len - run);
+        n += l->len;
+        if (lines++ == 0)
+            *first = l->off;
+        *next = l->off + l->len;
+    }
+    *out_len = n;
+    return lines;
+}
+
+long long
+recent_oldest(const recent_t *r)
+{
+    return r->count ? r->line[r->first].off : -1;
+}
@@ -0,0 +1,58 @@
+/* recent.h -- In-memory ring of a port's most recent log lines */
+#ifndef RECENT_H
+#define RECENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RECENT_BYTES    (64 * 1024)     /* line text kept per port */
+#define RECENT_LINES    1024            /* lines kept per port, at most */
+
+typedef struct {
+    long long off;          /* offset of the line in the port log */
+    uint64_t  ns;           /* mono_ns() when it was logged */
+    uint32_t  pos;          /* start of its text in the byte ring */
+    uint32_t  len;          /* bytes, as in the log: "[ts] text\n" */
+} recent_line_t;
+
+/* The last RECENT_LINES lines written to a port log, or fewer if they
+ * do not fit in RECENT_BYTES, exactly as they are in the file. Answers
+ * "what did the board just print" without reading the log back. */
+typedef struct {
+    recent_line_t line[RECENT_LINES];   /* ring, oldest at first */
+    int           first;
+    int           count;
+    char          text[RECENT_BYTES];   /* byte ring */
+    size_t        text_head;            /* next byte written */
+    size_t        text_used;
+} recent_t;
+
+/* Which lines a query returns: those logged at or after since_ns and
+ * starting at or after offset after, the last max_lines of them
+ * (0: no limit). */
+typedef struct {
+    int       max_lines;
+    uint64_t  since_ns;
+    long long after;
+} recent_query_t;
+
+/* Empty the ring (new or truncated log: offsets start over). */
+void recent_reset(recent_t *r);
+
+/* Add a line made of prefix (may be NULL) and text plus '\n', which
+ * starts at byte offset off of the log. Evicts the oldest lines. */
+void recent_push(recent_t *r, long long off, uint64_t ns,
+                 const char *prefix, const char *text, size_t len);
+
+/* Copy the lines selected by q into out. Returns the number of lines;
+ * *first is the offset of the first one and *next the end of the last
+ * one (both left untouched when none match). A line that does not fit
+ * in sz stops the copy. */
+int recent_query(const recent_t *r, const recent_query_t *q, char *out,
+                 size_t sz, size_t *out_len, long long *first,
+                 long long *next);
+
+/* Offset of the oldest line kept, -1 if the ring is empty. */
+long long recent_oldest(const recent_t *r);
+
+#endif /* RECENT_H */
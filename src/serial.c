@@ -6,12 +6,16 @@
  * Proxy mode: O_RDWR | O_NOCTTY | O_NONBLOCK + openpty().
  *   Creates a PTY pair. Sets TIOCEXCL on the real port to prevent
  *   other processes from opening it. All access goes through the PTY slave.
+ *
+ * Socket and FIFO sources (source.h) skip termios and TIOCEXCL; in proxy
+ * mode they get a PTY pair all the same.
  */
 #include "serial.h"
 #include "util.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/serial.h>
 #include <pty.h>
 #include <stdio.h>
 #include <string.h>
@@ -44,8 +48,40 @@ configure_raw(int fd, speed_t baud, const char *label)
     return 0;
 }
 
-int
-serial_open(serial_port_t *sp, const char *dev_path, speed_t baud)
+/* Create the PTY pair of a proxied port. */
+static int
+open_pty(serial_port_t *sp)
+{
+    int master, slave;
+    char slave_name[256];
+    if (openpty(&master, &slave, slave_name, NULL, NULL) < 0) {
+        fprintf(stderr, "serial: openpty for %s: %s\n",
+                sp->dev_path, strerror(errno));
+        return -1;
+    }
+
+    /* configure PTY slave for raw mode matching the serial config */
+    if (configure_raw(slave, sp->baudrate, "pty-slave") < 0) {
+        /* non-fatal: PTY slave may not fully support all termios */
+    }
+
+    /* Keep slave fd open -- if all slave fds are closed, the PTY master
+     * becomes perpetually readable (EIO), causing an epoll busy loop.
+     * Holding one reference keeps the PTY pair alive and quiescent. */
+    sp->pty_slave = slave;
+
+    /* set PTY master to non-blocking for epoll */
+    int flags = fcntl(master, F_GETFL);
+    if (flags >= 0)
+        fcntl(master, F_SETFL, flags | O_NONBLOCK);
+
+    sp->pty_master = master;
+    strlcpy_safe(sp->pty_path, slave_name, sizeof(sp->pty_path));
+    return 0;
+}
+
+static void
+init_port(serial_port_t *sp, const char *dev_path, speed_t baud)
 {
     sp->fd = -1;
     sp->pty_master = -1;
@@ -53,6 +89,48 @@ serial_open(serial_port_t *sp, const char *dev_path, speed_t baud)
     sp->pty_path[0] = '\0';
     strlcpy_safe(sp->dev_path, dev_path, sizeof(sp->dev_path));
     sp->baudrate = baud;
+    sp->source = source_kind(dev_path);
+    sp->connecting = 0;
+    memset(&sp->addrs, 0, sizeof(sp->addrs));
+}
+
+int
+serial_connect(serial_port_t *sp)
+{
+    sp->fd = source_open(sp->dev_path, &sp->addrs, &sp->connecting);
+    return sp->fd < 0 ? -1 : 0;
+}
+
+/* A socket or FIFO: no termios, no exclusive lock. Not being able to
+ * connect yet is fine, the monitor retries. */
+static int
+open_source(serial_port_t *sp, int proxy)
+{
+    if (serial_connect(sp) < 0) {
+        if (errno == EINVAL || errno == ENAMETOOLONG) {
+            fprintf(stderr, "serial: bad source %s\n", sp->dev_path);
+            return -1;
+        }
+        if (errno == EADDRNOTAVAIL) {
+            fprintf(stderr, "serial: cannot resolve %s\n", sp->dev_path);
+            return -1;
+        }
+        fprintf(stderr, "serial: cannot connect %s: %s (will retry)\n",
+                sp->dev_path, strerror(errno));
+    }
+    if (proxy && open_pty(sp) < 0) {
+        serial_close(sp);
+        return -1;
+    }
+    return 0;
+}
+
+int
+serial_open(serial_port_t *sp, const char *dev_path, speed_t baud)
+{
+    init_port(sp, dev_path, baud);
+    if (sp->source != SOURCE_TTY)
+        return open_source(sp, 0);
 
     int fd = open(dev_path, O_RDONLY | O_NOCTTY | O_NONBLOCK);
     if (fd < 0) {
@@ -73,12 +151,9 @@ serial_open(serial_port_t *sp, const char *dev_path, speed_t baud)
 int
 serial_open_proxy(serial_port_t *sp, const char *dev_path, speed_t baud)
 {
-    sp->fd = -1;
-    sp->pty_master = -1;
-    sp->pty_slave = -1;
-    sp->pty_path[0] = '\0';
-    strlcpy_safe(sp->dev_path, dev_path, sizeof(sp->dev_path));
-    sp->baudrate = baud;
+    init_port(sp, dev_path, baud);
+    if (sp->source != SOURCE_TTY)
+        return open_source(sp, 1);
 
     /* open real port O_RDWR for bidirectional proxy */
     int fd = open(dev_path, O_RDWR | O_NOCTTY | O_NONBLOCK);
@@ -100,35 +175,12 @@ serial_open_proxy(serial_port_t *sp, const char *dev_path, speed_t baud)
         /* non-fatal: continue without exclusive lock */
     }
 
-    /* create PTY pair */
-    int master, slave;
-    char slave_name[256];
-    if (openpty(&master, &slave, slave_name, NULL, NULL) < 0) {
-        fprintf(stderr, "serial: openpty for %s: %s\n",
-                dev_path, strerror(errno));
-        close(fd);
+    sp->fd = fd;
+    if (open_pty(sp) < 0) {
+        serial_close(sp);
         return -1;
     }
 
-    /* configure PTY slave for raw mode matching the serial config */
-    if (configure_raw(slave, baud, "pty-slave") < 0) {
-        /* non-fatal: PTY slave may not fully support all termios */
-    }
-
-    /* Keep slave fd open -- if all slave fds are closed, the PTY master
-     * becomes perpetually readable (EIO), causing an epoll busy loop.
-     * Holding one reference keeps the PTY pair alive and quiescent. */
-    sp->pty_slave = slave;
-
-    /* set PTY master to non-blocking for epoll */
-    int flags = fcntl(master, F_GETFL);
-    if (flags >= 0)
-        fcntl(master, F_SETFL, flags | O_NONBLOCK);
-
-    sp->fd = fd;
-    sp->pty_master = master;
-    strlcpy_safe(sp->pty_path, slave_name, sizeof(sp->pty_path));
-
     return 0;
 }
 
@@ -150,6 +202,22 @@ serial_close(serial_port_t *sp)
     sp->pty_path[0] = '\0';
 }
 
+int
+serial_get_icount(int fd, serial_icount_t *ic)
+{
+    struct serial_icounter_struct sic;
+    memset(&sic, 0, sizeof(sic));
+    if (fd < 0 || ioctl(fd, TIOCGICOUNT, &sic) < 0)
+        return -1;
+
+    ic->rx = sic.rx;
+    ic->frame = sic.frame;
+    ic->overrun = sic.overrun;
+    ic->parity = sic.parity;
+    ic->buf_overrun = sic.buf_overrun;
+    return 0;
+}
+
 speed_t
 baud_to_speed(int baud)
 {
@@ -170,3 +238,35 @@ baud_to_speed(int baud)
     default:      return B115200;
     }
 }
+
+int
+speed_to_baud(speed_t speed)
+{
+    switch (speed) {
+    case B9600:    return 9600;
+    case B19200:   return 19200;
+    case B38400:   return 38400;
+    case B57600:   return 57600;
+    case B115200:  return 115200;
+    case B230400:  return 230400;
+    case B460800:  return 460800;
+    case B921600:  return 921600;
+    case B1000000: return 1000000;
+    case B1500000: return 1500000;
+    case B2000000: return 2000000;
+    case B3000000: return 3000000;
+    case B4000000: return 4000000;
+    default:       return 0;
+    }
+}
+
+int
+serial_set_baud(int fd, speed_t baud)
+{
+    struct termios tty;
+    if (tcgetattr(fd, &tty) < 0)
+        return -1;
+    cfsetispeed(&tty, baud);
+    cfsetospeed(&tty, baud);
+    return tcsetattr(fd, TCSANOW, &tty);
+}
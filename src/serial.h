@@ -2,6 +2,8 @@
 #ifndef SERIAL_H
 #define SERIAL_H
 
+#include "source.h"
+
 #include <termios.h>
 
 #define PTY_DIR  LOG_BASE_DIR "/pty"
@@ -11,12 +13,27 @@ typedef struct {
     int     pty_master;      /* PTY master fd (-1 if not proxying) */
     int     pty_slave;       /* PTY slave fd (kept open to prevent EIO) */
     char    pty_path[256];   /* PTY slave path (e.g. /dev/pts/5) */
-    char    dev_path[256];
+    char    dev_path[256];   /* device, or a source spec (source.h) */
     speed_t baudrate;
+    source_kind_t source;
+    int     connecting;      /* socket connect in progress */
+    source_addr_t addrs;     /* tcp: source's looked-up addresses */
 } serial_port_t;
 
+/* Kernel line-error counters (subset of TIOCGICOUNT) */
+typedef struct {
+    long rx;
+    long frame;
+    long overrun;       /* UART FIFO overrun */
+    long parity;
+    long buf_overrun;   /* tty flip buffer overrun */
+} serial_icount_t;
+
 /* Open a serial port read-only (O_RDONLY | O_NOCTTY | O_NONBLOCK).
  * Configures termios for the given baud, 8N1, raw mode.
+ * dev_path may also name a socket or FIFO source (source.h); one that
+ * cannot be reached yet is not an error: fd stays -1 until a later
+ * serial_connect() succeeds.
  * Returns 0 on success, -1 on error. */
 int serial_open(serial_port_t *sp, const char *dev_path, speed_t baud);
 
@@ -27,11 +44,27 @@ int serial_open(serial_port_t *sp, const char *dev_path, speed_t baud);
  * Returns 0 on success, -1 on error. */
 int serial_open_proxy(serial_port_t *sp, const char *dev_path, speed_t baud);
 
+/* (Re)open the fd of a socket or FIFO source. Returns 0 if it is open
+ * (connecting may be set), -1 with errno set otherwise. */
+int serial_connect(serial_port_t *sp);
+
 /* Close a serial port (and PTY master if proxying).
  * Safe to call on already-closed port. */
 void serial_close(serial_port_t *sp);
 
+/* Read the kernel's line-error counters for an open port.
+ * Returns 0 on success, -1 if the driver does not provide them
+ * (PTYs, most CDC-ACM devices). */
+int serial_get_icount(int fd, serial_icount_t *ic);
+
 /* Map a numeric baud rate (e.g. 115200) to a speed_t constant. */
 speed_t baud_to_speed(int baud);
 
+/* Map a speed_t constant back to its numeric rate; 0 if unknown. */
+int speed_to_baud(speed_t speed);
+
+/* Change the baud rate of an open port, keeping its other settings.
+ * Returns 0 on success, -1 on error. */
+int serial_set_baud(int fd, speed_t baud);
+
 #endif /* SERIAL_H */
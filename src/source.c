@@ -0,0 +1,225 @@
+/* source.c -- Ports that are not ttys: stream sockets and FIFOs.
+ *
+ * Emulated boards (QEMU character devices) and consoles exported over
+ * the network (ser2net) are byte streams like a UART, just not behind a
+ * tty. Only the way the fd is obtained differs; everything after that,
+ * from the event loop to the log pipeline and the PTY proxy, is shared
+ * with real ports.
+ */
+#include "source.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const struct {
+    const char   *prefix;
+    source_kind_t kind;
+} prefixes[] = {
+    { "unix:", SOURCE_UNIX },
+    { "tcp:",  SOURCE_TCP },
+    { "fifo:", SOURCE_FIFO },
+};
+
+static const char *const kind_names[] = { "tty", "unix", "tcp", "fifo" };
+
+source_kind_t
+source_kind(const char *spec)
+{
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        const char *p = prefixes[i].prefix;
+        if (strncmp(spec, p, strlen(p)) == 0)
+            return prefixes[i].kind;
+    }
+    return SOURCE_TTY;
+}
+
+const char *
+source_kind_name(source_kind_t k)
+{
+    return kind_names[k];
+}
+
+/* The part after "kind:" */
+static const char *
+source_target(const char *spec)
+{
+    const char *colon = strchr(spec, ':');
+    return colon ? colon + 1 : spec;
+}
+
+void
+source_name(const char *spec, char *out, size_t sz)
+{
+    const char *t = source_target(spec);
+    const char *slash = strrchr(t, '/');
+    if (slash && source_kind(spec) != SOURCE_TCP)
+        t = slash + 1;
+    strlcpy_safe(out, t, sz);
+    for (char *p = out; *p; p++)
+        if (!((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+              (*p >= '0' && *p <= '9') || *p == '-' || *p == '.'))
+            *p = '_';
+}
+
+/* Start a non-blocking connect. */
+static int
+connect_nb(int family, const struct sockaddr *sa, socklen_t len,
+           int *connecting)
+{
+    int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, sa, len) == 0) {
+        *connecting = 0;
+    } else if (errno == EINPROGRESS) {
+        *connecting = 1;
+    } else {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    if (family != AF_UNIX) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static int
+open_unix(const char *path, int *connecting)
+{
+    struct sockaddr_un sun;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sun.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strlcpy_safe(sun.sun_path, path, sizeof(sun.sun_path));
+    return connect_nb(AF_UNIX, (const struct sockaddr *)&sun, sizeof(sun),
+                      connecting);
+}
+
+/* tcp:<host>:<port>, host may be [v6]. The lookup blocks, so it is
+ * done once per source: use names the resolver answers locally
+ * (addresses, /etc/hosts). */
+static int
+resolve_tcp(const char *target, source_addr_t *addrs)
+{
+    char host[256];
+    const char *port = strrchr(target, ':');
+    if (!port || port == target || (size_t)(port - target) >= sizeof(host)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(host, target, (size_t)(port - target));
+    host[port - target] = '\0';
+    port++;
+    char *h = host;
+    size_t hl = strlen(h);
+    if (hl >= 2 && h[0] == '[' && h[hl - 1] == ']') {
+        h[hl - 1] = '\0';
+        h++;
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+    if (getaddrinfo(h, port, &hints, &res) != 0) {
+        addrs->n = -1;
+        return -1;
+    }
+    addrs->n = 0;
+    for (struct addrinfo *ai = res; ai && addrs->n < SOURCE_MAX_ADDRS;
+         ai = ai->ai_next) {
+        if (ai->ai_addrlen > sizeof(addrs->addr[0]))
+            continue;
+        memcpy(&addrs->addr[addrs->n], ai->ai_addr, ai->ai_addrlen);
+        addrs->len[addrs->n++] = ai->ai_addrlen;
+    }
+    freeaddrinfo(res);
+    if (addrs->n == 0)
+        addrs->n = -1;
+    return addrs->n > 0 ? 0 : -1;
+}
+
+static int
+open_tcp(const char *target, source_addr_t *addrs, int *connecting)
+{
+    /* a malformed target leaves n at 0, errno EINVAL */
+    if (addrs->n == 0 && resolve_tcp(target, addrs) < 0 && addrs->n == 0)
+        return -1;
+    if (addrs->n < 0) {
+        errno = EADDRNOTAVAIL;
+        return -1;
+    }
+    int fd = -1;
+    for (int i = 0; i < addrs->n && fd < 0; i++)
+        fd = connect_nb(addrs->addr[i].ss_family,
+                        (const struct sockaddr *)&addrs->addr[i],
+                        addrs->len[i], connecting);
+    return fd;
+}
+
+/* Read-write, so the daemon itself is a writer: the FIFO never reports
+ * EOF or HUP between the writers that come and go. */
+static int
+open_fifo(const char *path, int *connecting)
+{
+    *connecting = 0;
+    int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISFIFO(st.st_mode)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    return fd;
+}
+
+int
+source_open(const char *spec, source_addr_t *addrs, int *connecting)
+{
+    const char *t = source_target(spec);
+    *connecting = 0;
+    switch (source_kind(spec)) {
+    case SOURCE_UNIX:
+        return open_unix(t, connecting);
+    case SOURCE_TCP:
+        return open_tcp(t, addrs, connecting);
+    case SOURCE_FIFO:
+        return open_fifo(t, connecting);
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+int
+source_finish_connect(int fd)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+        return -1;
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
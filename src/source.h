@@ -0,0 +1,58 @@
+/* source.h -- Ports that are not ttys: stream sockets and FIFOs */
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+#include <sys/socket.h>
+
+#define SOURCE_RETRY_MIN_MS  250        /* first reconnect attempt */
+#define SOURCE_RETRY_MAX_MS  8000       /* backoff doubles up to this */
+#define SOURCE_MAX_ADDRS     4          /* tcp: addresses kept per host */
+
+/* A port is named by its device path, or by one of:
+ *
+ *   unix:<path>        Unix stream socket (QEMU -serial unix:<path>,server)
+ *   tcp:<host>:<port>  TCP stream (QEMU -serial tcp:..., ser2net)
+ *   fifo:<path>        named pipe, read only
+ *
+ * Such a source is read like a tty (no termios, no line counters) and,
+ * unlike a tty that hot-plug removes, it is reconnected when its peer
+ * goes away. */
+typedef enum {
+    SOURCE_TTY,
+    SOURCE_UNIX,
+    SOURCE_TCP,
+    SOURCE_FIFO,
+} source_kind_t;
+
+/* Addresses of a tcp: source. The host is looked up on the first open
+ * only: reconnects reuse them, so a retry never waits on the resolver. */
+typedef struct {
+    int                     n;   /* 0: not looked up, -1: lookup failed */
+    struct sockaddr_storage addr[SOURCE_MAX_ADDRS];
+    socklen_t               len[SOURCE_MAX_ADDRS];
+} source_addr_t;
+
+/* Kind of a port spec; SOURCE_TTY for anything without a known prefix. */
+source_kind_t source_kind(const char *spec);
+
+/* "tty", "unix", "tcp", "fifo" */
+const char *source_kind_name(source_kind_t k);
+
+/* Name for a source with no label: the socket or FIFO file name, or
+ * "<host>_<port>", with characters unsafe in file names replaced. */
+void source_name(const char *spec, char *out, size_t sz);
+
+/* Open a non-tty source, non-blocking. A connect that cannot complete
+ * at once leaves *connecting set: wait for the fd to become writable
+ * and call source_finish_connect(). addrs caches a tcp: host's lookup
+ * (zero it for a new spec). Returns the fd, or -1 with errno set (the
+ * peer may just not be there yet; EADDRNOTAVAIL: the host does not
+ * resolve, and will not be looked up again). */
+int source_open(const char *spec, source_addr_t *addrs, int *connecting);
+
+/* Result of a connect in progress: 0 if connected, else -1 with errno
+ * set. */
+int source_finish_connect(int fd);
+
+#endif /* SOURCE_H */
@@ -0,0 +1,217 @@
+/* statpage.c -- Seqlock-protected shared-memory status page.
+ *
+ * The daemon keeps a fixed-layout copy of its status in /dev/shm and
+ * updates it in place: structural changes (ports added, removed, yielded,
+ * storage state) republish the port table, and every read bumps that
+ * port's counters. Readers map the file and copy it under the sequence
+ * counter, so polling status never goes through the control socket or
+ * the event loop.
+ */
+#include "statpage.h"
+#include "classify.h"
+#include "log.h"
+#include "serial.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_TRIES  1000
+
+statpage_t *
+statpage_create(const char *path)
+{
+    /* a fresh inode: readers that still map an old page keep theirs */
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, getpid());
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC,
+                  0644);
+    if (fd < 0) {
+        fprintf(stderr, "statpage: %s: %s\n", tmp, strerror(errno));
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(statpage_t)) < 0) {
+        fprintf(stderr, "statpage: ftruncate: %s\n", strerror(errno));
+        close(fd);
+        unlink(tmp);
+        return NULL;
+    }
+    statpage_t *sp = mmap(NULL, sizeof(statpage_t), PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+    close(fd);
+    if (sp == MAP_FAILED) {
+        fprintf(stderr, "statpage: mmap: %s\n", strerror(errno));
+        unlink(tmp);
+        return NULL;
+    }
+
+    sp->version = STATPAGE_VERSION;
+    sp->pid = getpid();
+    atomic_store(&sp->seq, 0);
+    /* magic last: a half-initialized page is never valid */
+    atomic_thread_fence(memory_order_release);
+    sp->magic = STATPAGE_MAGIC;
+
+    if (rename(tmp, path) < 0) {
+        fprintf(stderr, "statpage: rename %s: %s\n", path, strerror(errno));
+        munmap(sp, sizeof(statpage_t));
+        unlink(tmp);
+        return NULL;
+    }
+    return sp;
+}
+
+void
+statpage_destroy(statpage_t *sp, const char *path)
+{
+    if (!sp)
+        return;
+    /* only remove the page if it is still ours */
+    if (sp->pid == getpid())
+        unlink(path);
+    munmap(sp, sizeof(statpage_t));
+}
+
+int
+statpage_snapshot(const statpage_t *sp, statpage_t *out)
+{
+    if (sp->magic != STATPAGE_MAGIC || sp->version != STATPAGE_VERSION)
+        return -1;
+
+    for (int i = 0; i < SNAPSHOT_TRIES; i++) {
+        uint32_t s1 = atomic_load_explicit(
+            (_Atomic uint32_t *)&sp->seq, memory_order_acquire);
+        if (s1 & 1)
+            continue;
+        memcpy(out, sp, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        uint32_t s2 = atomic_load_explicit(
+            (_Atomic uint32_t *)&sp->seq, memory_order_relaxed);
+        if (s1 == s2) {
+            if (out->port_count > MAX_PORTS)
+                out->port_count = MAX_PORTS;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int
+statpage_read(const char *path, statpage_t *out)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(statpage_t)) {
+        close(fd);
+        return -1;
+    }
+    const statpage_t *sp = mmap(NULL, sizeof(statpage_t), PROT_READ,
+                                MAP_SHARED, fd, 0);
+    close(fd);
+    if (sp == MAP_FAILED)
+        return -1;
+
+    int rc = statpage_snapshot(sp, out);
+    munmap((void *)sp, sizeof(statpage_t));
+
+    /* a page left behind by a daemon that was killed */
+    if (rc == 0 && kill(out->pid, 0) < 0 && errno == ESRCH)
+        rc = -1;
+    return rc;
+}
+
+void
+statpage_print_json(const statpage_t *sp, FILE *out)
+{
+    uint64_t now = mono_ns();
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"pid\": %d,\n", sp->pid);
+    fprintf(out, "  \"session\": \"%s\",\n", sp->session);
+    fprintf(out, "  \"proxy_mode\": %s,\n",
+            sp->proxy_mode ? "true" : "false");
+    fprintf(out, "  \"port_count\": %u,\n", sp->port_count);
+    fprintf(out, "  \"hotplug_adds\": %llu,\n",
+            (unsigned long long)sp->hotplug_adds);
+    fprintf(out, "  \"hotplug_removes\": %llu,\n",
+            (unsigned long long)sp->hotplug_removes);
+    fprintf(out, "  \"hotplug_settling\": %u,\n", sp->hotplug_settling);
+    fprintf(out, "  \"degraded_ports\": %u,\n", sp->degraded_ports);
+    fprintf(out, "  \"ports\": [\n");
+
+    for (uint32_t i = 0; i < sp->port_count; i++) {
+        const statpage_port_t *p = &sp->ports[i];
+
+        /* a rate nobody has refreshed for a while means the port is idle */
+        uint64_t rate = p->rate_bps;
+        if (now > p->rate_at && now - p->rate_at > 2000000000ull)
+            rate = 0;
+
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"device\": \"%s\",\n", p->device);
+        fprintf(out, "      \"label\": \"%s\",\n", p->label);
+        fprintf(out, "      \"board\": \"%s\",\n", p->board);
+        fprintf(out, "      \"function\": \"%s\",\n", p->function);
+        fprintf(out, "      \"vid\": \"%04x\",\n", p->vid);
+        fprintf(out, "      \"pid\": \"%04x\",\n", p->pid);
+        fprintf(out, "      \"status\": \"%s\",\n",
+                (p->flags & SP_F_YIELDED) ? "yielded" :
+                (p->flags & SP_F_CONNECTING) ? "connecting" : "monitoring");
+        if (p->source[0]) {
+            fprintf(out, "      \"source\": \"%s\",\n", p->source);
+            fprintf(out, "      \"connects\": %llu,\n",
+                    (unsigned long long)p->connects);
+        }
+        fprintf(out, "      \"log_file\": \"%s\",\n", p->log_file);
+        fprintf(out, "      \"storage\": \"%s\",\n",
+                (p->flags & SP_F_DEGRADED) ? "degraded" : "ok");
+        fprintf(out, "      \"priority\": \"%s\",\n", p->priority);
+        if (p->content[0])
+            fprintf(out, "      \"content\": \"%s\",\n", p->content);
+        if (p->flags & SP_F_RAW) {
+            /* <label>.bin sits next to the log */
+            const char *slash = strrchr(p->log_file, '/');
+            int dir = slash ? (int)(slash - p->log_file) : 0;
+            fprintf(out, "      \"content_file\": \"%.*s/%s%s\",\n", dir,
+                    p->log_file, p->label, CLASSIFY_RAW_EXT);
+        }
+        if (p->spilled || p->lost) {
+            fprintf(out, "      \"spilled_bytes\": %llu,\n",
+                    (unsigned long long)p->spilled);
+            fprintf(out, "      \"lost_bytes\": %llu,\n",
+                    (unsigned long long)p->lost);
+        }
+        if (p->flags & SP_F_PROXY) {
+            fprintf(out, "      \"pty_device\": \"%s/%s\",\n",
+                    PTY_DIR, p->label);
+            fprintf(out, "      \"pty_slave\": \"%s\",\n", p->pty_slave);
+        }
+        if (p->link[0])
+            fprintf(out, "      \"link\": \"%s\",\n", p->link);
+        if (p->checkpoint[0]) {
+            fprintf(out, "      \"checkpoint\": \"%s\",\n", p->checkpoint);
+            fprintf(out, "      \"checkpoint_offset\": %lld,\n",
+                    (long long)p->checkpoint_off);
+        }
+        fprintf(out, "      \"bytes_read\": %llu,\n",
+                (unsigned long long)p->bytes_read);
+        fprintf(out, "      \"rate_bps\": %llu,\n",
+                (unsigned long long)rate);
+        if (p->last_activity)
+            fprintf(out, "      \"idle_ms\": %llu,\n",
+                    (unsigned long long)((now - p->last_activity) /
+                                         1000000ull));
+        fprintf(out, "      \"bytes_logged\": %llu\n",
+                (unsigned long long)p->bytes_logged);
+        fprintf(out, "    }%s\n", (i + 1 < sp->port_count) ? "," : "");
+    }
+
+    fprintf(out, "  ]\n}\n");
+}
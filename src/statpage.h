@@ -0,0 +1,104 @@
+/* statpage.h -- Seqlock-protected shared-memory status page */
+#ifndef STATPAGE_H
+#define STATPAGE_H
+
+#include "identify.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define STATPAGE_PATH    "/dev/shm/uart-monitor.status"
+#define STATPAGE_MAGIC   0x314d5355u        /* "USM1" */
+#define STATPAGE_VERSION 2
+#define STATPAGE_STR     64
+
+/* statpage_port_t.flags */
+#define SP_F_YIELDED     0x1
+#define SP_F_DEGRADED    0x2
+#define SP_F_PROXY       0x4
+#define SP_F_INTEGRITY   0x8
+#define SP_F_CONNECTING  0x10
+#define SP_F_RAW         0x20
+
+/* One port. Strings are NUL-terminated; times are CLOCK_MONOTONIC ns,
+ * which every process on the host shares. */
+typedef struct {
+    char     device[STATPAGE_STR];
+    char     label[STATPAGE_STR];
+    char     board[STATPAGE_STR];
+    char     function[STATPAGE_STR];
+    char     link[STATPAGE_STR];      /* link name, "" if not linked */
+    char     pty_slave[STATPAGE_STR]; /* proxy mode */
+    char     log_file[256];
+    char     source[16];              /* "tcp", "unix"; "" for a tty */
+    char     priority[16];
+    char     content[16];             /* "" if not classified */
+    char     checkpoint[STATPAGE_STR]; /* last CLEAR, "" if none */
+    int64_t  checkpoint_off;
+    uint64_t connects;
+    uint16_t vid;
+    uint16_t pid;
+    uint32_t flags;
+    uint64_t bytes_read;
+    uint64_t bytes_logged;
+    uint64_t rate_bps;                /* bytes/s over the last window */
+    uint64_t rate_at;                 /* end of that window */
+    uint64_t last_activity;           /* last read, 0 if none yet */
+    uint64_t spilled;
+    uint64_t lost;
+} statpage_port_t;
+
+/* The whole page. The daemon is the only writer: it makes seq odd,
+ * updates fields in place, and makes seq even again. A reader copies the
+ * page and retries if seq was odd or changed meanwhile. */
+typedef struct {
+    uint32_t         magic;
+    uint32_t         version;
+    _Atomic uint32_t seq;
+    int32_t          pid;
+    uint64_t         updated;         /* last structural publish */
+    char             session[STATPAGE_STR];
+    uint32_t         proxy_mode;
+    uint32_t         port_count;
+    uint32_t         degraded_ports;
+    uint32_t         hotplug_settling;
+    uint64_t         hotplug_adds;
+    uint64_t         hotplug_removes;
+    statpage_port_t  ports[MAX_PORTS];
+} statpage_t;
+
+/* Create (or replace) the page at path and map it read-write.
+ * Returns NULL on failure. */
+statpage_t *statpage_create(const char *path);
+
+/* Unmap the page and remove it. */
+void statpage_destroy(statpage_t *sp, const char *path);
+
+/* Bracket every update of the page (writer side). */
+static inline void
+statpage_begin(statpage_t *sp)
+{
+    atomic_fetch_add_explicit(&sp->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void
+statpage_end(statpage_t *sp)
+{
+    atomic_fetch_add_explicit(&sp->seq, 1, memory_order_release);
+}
+
+/* Copy a consistent snapshot out of a mapped page. Returns 0, or -1 if
+ * the page is invalid or stayed busy. */
+int statpage_snapshot(const statpage_t *sp, statpage_t *out);
+
+/* Map the page at path read-only and take a snapshot. Returns 0, or -1
+ * if there is no valid page or its daemon is gone. */
+int statpage_read(const char *path, statpage_t *out);
+
+/* Print a snapshot as status JSON (the status.json fields the page
+ * carries, plus read counters, rate and idle time). */
+void statpage_print_json(const statpage_t *sp, FILE *out);
+
+#endif /* STATPAGE_H */
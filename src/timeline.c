@@ -0,0 +1,281 @@
+/* timeline.c -- Merged directional timeline for two-adapter link sniffing.
+ *
+ * Two monitored ports tap the two directions of one UART link. Each
+ * direction is assembled into lines keyed by the arrival time of their
+ * first byte; completed lines from both halves share one bounded reorder
+ * buffer and are emitted in arrival order once nothing earlier can still
+ * show up. A line the device stamped itself (devclock.h) is placed at
+ * its corrected device time instead of its arrival. Every read() chunk
+ * is also appended to a raw capture with its timestamp and direction,
+ * so byte-exact replay stays possible.
+ *
+ *   [2026-02-25 14:30:12.789123] >> AT+RESET
+ *   [2026-02-25 14:30:12.790456] << OK
+ */
+#include "timeline.h"
+#include "util.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *const dir_tag[2] = { ">>", "<<" };
+
+int
+timeline_open(timeline_t *tl, const char *session_path,
+              const char *name, const char *label_a,
+              const char *label_b, int window_ms)
+{
+    memset(tl, 0, sizeof(*tl));
+    strlcpy_safe(tl->name, name, sizeof(tl->name));
+    strlcpy_safe(tl->label[TL_DIR_A], label_a, sizeof(tl->label[0]));
+    strlcpy_safe(tl->label[TL_DIR_B], label_b, sizeof(tl->label[1]));
+    tl->window_ns = (uint64_t)window_ms * 1000000ull;
+    tl->wall_offset = mono_to_wall_offset();
+
+    snprintf(tl->path, sizeof(tl->path),
+             "%s/%s.timeline.log", session_path, name);
+    snprintf(tl->raw_path, sizeof(tl->raw_path),
+             "%s/%s.raw", session_path, name);
+
+    tl->fp = fopen(tl->path, "a");
+    if (!tl->fp) {
+        fprintf(stderr, "timeline: cannot open %s: %s\n",
+                tl->path, strerror(errno));
+        return -1;
+    }
+    setvbuf(tl->fp, NULL, _IOLBF, 0);
+
+    tl->raw_fp = fopen(tl->raw_path, "a");
+    if (!tl->raw_fp) {
+        fprintf(stderr, "timeline: cannot open %s: %s\n",
+                tl->raw_path, strerror(errno));
+        fclose(tl->fp);
+        tl->fp = NULL;
+        return -1;
+    }
+    if (ftell(tl->raw_fp) == 0)
+        fwrite(TL_RAW_MAGIC, 1, 8, tl->raw_fp);
+
+    char ts[32];
+    timestamp_now(ts, sizeof(ts));
+    fprintf(tl->fp, "=== UART Monitor Link Timeline ===\n");
+    fprintf(tl->fp, "Link: %s\n", name);
+    fprintf(tl->fp, "%s %s (A->B)\n", dir_tag[TL_DIR_A], label_a);
+    fprintf(tl->fp, "%s %s (B->A)\n", dir_tag[TL_DIR_B], label_b);
+    fprintf(tl->fp, "Reorder window: %d ms\n", window_ms);
+    fprintf(tl->fp, "Started: %s\n", ts);
+    fprintf(tl->fp, "===\n\n");
+
+    return 0;
+}
+
+static void
+emit_record(timeline_t *tl, const tl_record_t *rec)
+{
+    uint64_t wall = rec->ts_ns + (uint64_t)tl->wall_offset;
+    struct timespec ts = {
+        .tv_sec  = (time_t)(wall / 1000000000ull),
+        .tv_nsec = (long)(wall % 1000000000ull),
+    };
+    char tsbuf[40];
+    timestamp_fmt_us(&ts, tsbuf, sizeof(tsbuf));
+
+    fprintf(tl->fp, "[%s] %s %.*s\n",
+            tsbuf, dir_tag[rec->dir], rec->len, rec->data);
+    tl->records++;
+}
+
+/* Index of the earliest pending record, or -1. */
+static int
+earliest_pending(const timeline_t *tl)
+{
+    int m = -1;
+    for (int i = 0; i < tl->npending; i++) {
+        const tl_record_t *r = &tl->pending[i];
+        if (m < 0 || r->ts_ns < tl->pending[m].ts_ns ||
+            (r->ts_ns == tl->pending[m].ts_ns &&
+             r->seq < tl->pending[m].seq))
+            m = i;
+    }
+    return m;
+}
+
+static void
+remove_pending(timeline_t *tl, int idx)
+{
+    tl->npending--;
+    if (idx != tl->npending)
+        tl->pending[idx] = tl->pending[tl->npending];
+}
+
+/* Move a half's assembled line into the reorder buffer. */
+static void
+commit_half(timeline_t *tl, int dir)
+{
+    tl_half_t *h = &tl->half[dir];
+
+    if (tl->npending >= TL_MAX_PENDING) {
+        /* bounded: give up waiting for the oldest line */
+        int m = earliest_pending(tl);
+        emit_record(tl, &tl->pending[m]);
+        remove_pending(tl, m);
+        tl->overflows++;
+    }
+
+    tl_record_t *rec = &tl->pending[tl->npending++];
+    rec->ts_ns = h->start_ns;
+    if (tl->clock[dir] &&
+        devclock_lookup(tl->clock[dir], h->buf, (size_t)h->len,
+                        &rec->ts_ns) == 0)
+        tl->corrected++;
+    rec->seq = tl->seq++;
+    rec->dir = dir;
+    rec->len = h->len;
+    memcpy(rec->data, h->buf, (size_t)h->len);
+    h->len = 0;
+}
+
+void
+timeline_feed(timeline_t *tl, int dir, const char *data, size_t len,
+              uint64_t ts_ns)
+{
+    if (!tl->fp || len == 0 || (dir != TL_DIR_A && dir != TL_DIR_B))
+        return;
+
+    tl->bytes[dir] += len;
+
+    if (tl->raw_fp) {
+        tl_raw_hdr_t hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.ts_ns = ts_ns + (uint64_t)tl->wall_offset;
+        hdr.len = (uint16_t)(len > 0xffff ? 0xffff : len);
+        hdr.dir = (uint8_t)dir;
+        fwrite(&hdr, sizeof(hdr), 1, tl->raw_fp);
+        fwrite(data, 1, hdr.len, tl->raw_fp);
+    }
+
+    tl_half_t *h = &tl->half[dir];
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+
+        /* same \r / \r\n / \r\r\n folding as log_write() */
+        if (h->last_was_cr && (c == '\n' || c == '\r')) {
+            if (c == '\n')
+                h->last_was_cr = 0;
+            continue;
+        }
+        h->last_was_cr = 0;
+        if (c == '\r') {
+            h->last_was_cr = 1;
+            c = '\n';
+        }
+
+        if (c == '\n') {
+            if (h->len > 0)
+                commit_half(tl, dir);
+            continue;
+        }
+
+        if (h->len == 0)
+            h->start_ns = ts_ns;
+        h->buf[h->len++] = c;
+        if (h->len >= TL_LINE_MAX)
+            commit_half(tl, dir);
+    }
+}
+
+void
+timeline_poll(timeline_t *tl, uint64_t now_ns)
+{
+    if (!tl->fp)
+        return;
+
+    /* partial lines stuck longer than the stale-line timeout are
+     * committed as they are, like log_flush() does for the port logs */
+    for (int d = 0; d < 2; d++) {
+        tl_half_t *h = &tl->half[d];
+        if (h->len > 0 &&
+            now_ns - h->start_ns >= (uint64_t)TL_PARTIAL_MS * 1000000ull)
+            commit_half(tl, d);
+    }
+
+    while (tl->npending > 0) {
+        int m = earliest_pending(tl);
+        const tl_record_t *rec = &tl->pending[m];
+
+        if (rec->ts_ns + tl->window_ns > now_ns)
+            break;
+
+        /* an open line on either half that started earlier must be
+         * emitted first, so wait for it to complete */
+        int blocked = 0;
+        for (int d = 0; d < 2; d++) {
+            if (tl->half[d].len > 0 && tl->half[d].start_ns < rec->ts_ns)
+                blocked = 1;
+        }
+        if (blocked)
+            break;
+
+        emit_record(tl, rec);
+        remove_pending(tl, m);
+    }
+
+    if (tl->raw_fp)
+        fflush(tl->raw_fp);
+}
+
+int
+timeline_busy(const timeline_t *tl)
+{
+    return tl->npending > 0 || tl->half[0].len > 0 || tl->half[1].len > 0;
+}
+
+/* Commit open lines and emit everything in arrival order. */
+static void
+timeline_drain(timeline_t *tl)
+{
+    for (int d = 0; d < 2; d++) {
+        if (tl->half[d].len > 0)
+            commit_half(tl, d);
+    }
+    while (tl->npending > 0) {
+        int m = earliest_pending(tl);
+        emit_record(tl, &tl->pending[m]);
+        remove_pending(tl, m);
+    }
+}
+
+void
+timeline_marker(timeline_t *tl, const char *msg)
+{
+    char ts[32];
+    timestamp_now(ts, sizeof(ts));
+    timeline_marker_at(tl, msg, ts);
+}
+
+void
+timeline_marker_at(timeline_t *tl, const char *msg, const char *ts)
+{
+    if (!tl->fp)
+        return;
+
+    timeline_drain(tl);
+
+    fprintf(tl->fp, "\n--- %s [%s] ---\n\n", msg, ts);
+    fflush(tl->fp);
+}
+
+void
+timeline_close(timeline_t *tl)
+{
+    if (tl->fp) {
+        timeline_drain(tl);
+        fclose(tl->fp);
+        tl->fp = NULL;
+    }
+    if (tl->raw_fp) {
+        fclose(tl->raw_fp);
+        tl->raw_fp = NULL;
+    }
+}
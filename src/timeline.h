@@ -0,0 +1,98 @@
+/* timeline.h -- Merged directional timeline for two-adapter link sniffing */
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#include "devclock.h"
+
+#define TL_LINE_MAX     1024
+#define TL_MAX_PENDING  64
+#define TL_PARTIAL_MS   200     /* same as the per-port stale-line flush */
+
+/* Directions of a link: half A carries A->B, half B carries B->A. */
+#define TL_DIR_A 0
+#define TL_DIR_B 1
+
+/* Raw capture record header (host byte order), followed by len bytes.
+ * The raw file starts with the 8-byte magic TL_RAW_MAGIC. */
+#define TL_RAW_MAGIC "UMRAW1\n"
+typedef struct {
+    uint64_t ts_ns;      /* CLOCK_REALTIME nanoseconds at read() */
+    uint16_t len;
+    uint8_t  dir;        /* TL_DIR_A or TL_DIR_B */
+    uint8_t  reserved;
+    uint32_t pad;
+} tl_raw_hdr_t;
+
+/* A completed line waiting in the reorder buffer */
+typedef struct {
+    uint64_t ts_ns;      /* monotonic arrival time of the first byte */
+    uint64_t seq;        /* insertion order, breaks timestamp ties */
+    int      dir;
+    int      len;
+    char     data[TL_LINE_MAX];
+} tl_record_t;
+
+/* Per-direction line assembly */
+typedef struct {
+    char     buf[TL_LINE_MAX];
+    int      len;
+    uint64_t start_ns;   /* arrival time of buf[0] */
+    int      last_was_cr;
+} tl_half_t;
+
+typedef struct {
+    char        name[64];
+    char        label[2][64];   /* port labels for A->B and B->A */
+    char        path[512];      /* merged text timeline */
+    char        raw_path[512];  /* raw binary capture */
+    FILE       *fp;
+    FILE       *raw_fp;
+    int64_t     wall_offset;    /* mono -> realtime */
+    uint64_t    window_ns;      /* bounded reorder window */
+    tl_half_t   half[2];
+    tl_record_t pending[TL_MAX_PENDING];
+    int         npending;
+    uint64_t    seq;
+    size_t      bytes[2];
+    size_t      records;
+    size_t      overflows;      /* records emitted early: buffer full */
+    const devclock_t *clock[2]; /* per half: device-stamped lines are
+                                 * placed at their corrected time */
+    size_t      corrected;      /* records placed by device clock */
+} timeline_t;
+
+/* Open <name>.timeline.log and <name>.raw in the session directory.
+ * label_a/label_b are the port names shown in the header.
+ * Returns 0 on success, -1 on error. */
+int timeline_open(timeline_t *tl, const char *session_path,
+                  const char *name, const char *label_a,
+                  const char *label_b, int window_ms);
+
+/* Feed bytes read from one half, stamped with the mono_ns() time taken
+ * right after read(). Raw bytes go straight to the raw capture; completed
+ * lines enter the reorder buffer. */
+void timeline_feed(timeline_t *tl, int dir, const char *data, size_t len,
+                   uint64_t ts_ns);
+
+/* Emit every buffered line that can no longer be preceded by an
+ * earlier arrival: older than the reorder window and not younger than
+ * an open partial line on either half. */
+void timeline_poll(timeline_t *tl, uint64_t now_ns);
+
+/* Nonzero if lines are buffered or partially assembled. */
+int timeline_busy(const timeline_t *tl);
+
+/* Drain everything, then write a marker line. */
+void timeline_marker(timeline_t *tl, const char *msg);
+
+/* Same, with a caller-supplied timestamp string. */
+void timeline_marker_at(timeline_t *tl, const char *msg, const char *ts);
+
+/* Drain and close both files. */
+void timeline_close(timeline_t *tl);
+
+#endif /* TIMELINE_H */
@@ -0,0 +1,137 @@
+/* toplines.c -- Heaviest line templates of a port, in fixed memory.
+ *
+ * A log that balloons usually does so because of a handful of messages.
+ * Counting every distinct template exactly would take memory without
+ * bound, so templates are counted in a count-min sketch (conservative
+ * update: only the counters at the minimum grow) and only the top ones
+ * are named.
+ */
+#include "toplines.h"
+#include "crash.h"
+
+#include <string.h>
+
+void
+toplines_reset(toplines_t *t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+static int
+heavier(const toplines_t *t, int a, int b)
+{
+    return t->entry[t->heap[a]].lines > t->entry[t->heap[b]].lines;
+}
+
+static void
+swap(toplines_t *t, int a, int b)
+{
+    uint8_t e = t->heap[a];
+    t->heap[a] = t->heap[b];
+    t->heap[b] = e;
+    t->pos[t->heap[a]] = (uint8_t)a;
+    t->pos[t->heap[b]] = (uint8_t)b;
+}
+
+/* Restore the heap below slot i after its entry grew. */
+static void
+sift_down(toplines_t *t, int i)
+{
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, min = i;
+        if (l < t->count && heavier(t, min, l))
+            min = l;
+        if (r < t->count && heavier(t, min, r))
+            min = r;
+        if (min == i)
+            return;
+        swap(t, i, min);
+        i = min;
+    }
+}
+
+static void
+sift_up(toplines_t *t, int i)
+{
+    while (i > 0 && heavier(t, (i - 1) / 2, i)) {
+        swap(t, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void
+toplines_add(toplines_t *t, const char *text, size_t len)
+{
+    char norm[512];
+    size_t n = crash_normalize(text, len, norm, sizeof(norm));
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)norm[i];
+        h *= 0x100000001b3ull;
+    }
+    t->lines++;
+    t->bytes += len + 1;
+
+    /* rows indexed by h1 + i * h2 (two halves of one hash) */
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+    uint32_t *c[TOPLINES_DEPTH];
+    uint32_t est = UINT32_MAX;
+    for (int i = 0; i < TOPLINES_DEPTH; i++) {
+        c[i] = &t->sketch[i][(h1 + (uint32_t)i * h2) & (TOPLINES_WIDTH - 1)];
+        if (*c[i] < est)
+            est = *c[i];
+    }
+    if (est == UINT32_MAX)
+        return;                     /* saturated: nothing changes */
+    for (int i = 0; i < TOPLINES_DEPTH; i++)
+        if (*c[i] == est)
+            *c[i] = est + 1;
+    est++;
+
+    for (int e = 0; e < t->count; e++) {
+        if (t->keys[e] == h) {
+            t->entry[e].lines = est;
+            t->entry[e].bytes += len + 1;
+            sift_down(t, t->pos[e]);
+            return;
+        }
+    }
+
+    int e, evicted = 0;
+    if (t->count < TOPLINES_K) {
+        e = t->count++;
+        t->heap[e] = (uint8_t)e;
+        t->pos[e] = (uint8_t)e;
+    } else if (est > t->entry[t->heap[0]].lines) {
+        e = t->heap[0];             /* evict the lightest */
+        evicted = 1;
+    } else {
+        return;
+    }
+    toplines_entry_t *en = &t->entry[e];
+    t->keys[e] = h;
+    en->lines = est;
+    en->bytes = (uint64_t)est * (len + 1);
+    size_t tl = n < sizeof(en->text) - 1 ? n : sizeof(en->text) - 1;
+    memcpy(en->text, norm, tl);
+    en->text[tl] = '\0';
+    if (evicted)
+        sift_down(t, 0);
+    else
+        sift_up(t, t->pos[e]);
+}
+
+int
+toplines_sorted(const toplines_t *t, int order[TOPLINES_K])
+{
+    /* insertion sort: TOPLINES_K entries */
+    for (int i = 0; i < t->count; i++) {
+        int j = i;
+        while (j > 0 && t->entry[order[j - 1]].lines < t->entry[i].lines) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    return t->count;
+}
@@ -0,0 +1,47 @@
+/* toplines.h -- Heaviest line templates of a port, in fixed memory */
+#ifndef TOPLINES_H
+#define TOPLINES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TOPLINES_WIDTH   2048       /* counters per sketch row, 2^n */
+#define TOPLINES_DEPTH   4          /* sketch rows */
+#define TOPLINES_K       32         /* templates tracked */
+#define TOPLINES_TEXT    120        /* template text kept */
+
+typedef struct {
+    uint32_t lines;                 /* sketch estimate: never low */
+    uint64_t bytes;                 /* lines x length when it entered,
+                                     * then counted */
+    char     text[TOPLINES_TEXT];
+} toplines_entry_t;
+
+/* Which line templates (a line with its numbers and addresses masked,
+ * as for crash signatures) a port prints most. Every line adds one to
+ * its template in a count-min sketch; the TOPLINES_K templates with the
+ * highest estimates are kept in a min-heap, so a template that becomes
+ * frequent replaces the least frequent one. Each line costs one
+ * normalization, TOPLINES_DEPTH counters and a scan of TOPLINES_K keys,
+ * whatever the log has seen. */
+typedef struct {
+    uint32_t         sketch[TOPLINES_DEPTH][TOPLINES_WIDTH];
+    uint64_t         keys[TOPLINES_K];    /* keys of entry[], for the scan */
+    toplines_entry_t entry[TOPLINES_K];
+    uint8_t          heap[TOPLINES_K];    /* entry indexes, min at 0 */
+    uint8_t          pos[TOPLINES_K];     /* entry index -> heap slot */
+    int              count;
+    uint64_t         lines;               /* all lines seen */
+    uint64_t         bytes;
+} toplines_t;
+
+/* Forget everything (new or truncated log). */
+void toplines_reset(toplines_t *t);
+
+/* Count one line (without its timestamp prefix). */
+void toplines_add(toplines_t *t, const char *text, size_t len);
+
+/* Fill order[] with entry indexes, heaviest first. Returns how many. */
+int toplines_sorted(const toplines_t *t, int order[TOPLINES_K]);
+
+#endif /* TOPLINES_H */
@@ -73,6 +73,113 @@ timestamp_now(char *buf, size_t bufsz)
              ts.tv_nsec / 1000000);
 }
 
+void
+timestamp_fmt_us(const struct timespec *ts, char *buf, size_t bufsz)
+{
+    struct tm tm;
+    localtime_r(&ts->tv_sec, &tm);
+
+    snprintf(buf, bufsz, "%04d-%02d-%02d %02d:%02d:%02d.%06ld",
+             tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+             tm.tm_hour, tm.tm_min, tm.tm_sec,
+             ts->tv_nsec / 1000);
+}
+
+int
+timestamp_parse_ms(const char *s, int64_t *ms)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    int n = 0;
+    if (sscanf(s, "%4d-%2d-%2d%*1[ T]%2d:%2d:%2d%n", &tm.tm_year, &tm.tm_mon,
+               &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &n) != 6 ||
+        n == 0)
+        return -1;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    if (t == (time_t)-1)
+        return -1;
+
+    /* fraction: up to millisecond precision, extra digits skipped */
+    int frac = 0, digits = 0;
+    if (s[n] == '.') {
+        n++;
+        while (s[n] >= '0' && s[n] <= '9') {
+            if (digits < 3) {
+                frac = frac * 10 + (s[n] - '0');
+                digits++;
+            }
+            n++;
+        }
+        while (digits < 3) {
+            frac *= 10;
+            digits++;
+        }
+    }
+    *ms = (int64_t)t * 1000 + frac;
+    return n;
+}
+
+int
+timestamp_parse_arg(const char *s, int64_t *ms)
+{
+    if (s[0] == '@') {
+        *ms = strtoll(s + 1, NULL, 10) * 1000;
+        return 0;
+    }
+    if (s[0] == '-') {
+        char *end;
+        long long n = strtoll(s + 1, &end, 10);
+        int64_t unit = 1000;
+        switch (*end) {
+        case 'm': unit = 60000; break;
+        case 'h': unit = 3600000; break;
+        case 'd': unit = 86400000; break;
+        case 's': case '\0': break;
+        default: return -1;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        *ms = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000 - n * unit;
+        return 0;
+    }
+    return timestamp_parse_ms(s, ms) > 0 ? 0 : -1;
+}
+
+void
+timestamp_fmt_ms(int64_t ms, char *buf, size_t sz)
+{
+    if (!ms) {
+        snprintf(buf, sz, "-");
+        return;
+    }
+    struct timespec ts = { .tv_sec = ms / 1000,
+                           .tv_nsec = (long)(ms % 1000) * 1000000 };
+    char us[32];
+    timestamp_fmt_us(&ts, us, sizeof(us));
+    snprintf(buf, sz, "%.23s", us);
+}
+
+uint64_t
+mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int64_t
+mono_to_wall_offset(void)
+{
+    struct timespec rt, mt;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    clock_gettime(CLOCK_MONOTONIC, &mt);
+    return ((int64_t)rt.tv_sec - (int64_t)mt.tv_sec) * 1000000000ll +
+           ((int64_t)rt.tv_nsec - (int64_t)mt.tv_nsec);
+}
+
 void
 timestamp_filename(char *buf, size_t bufsz)
 {
@@ -125,3 +232,94 @@ symlink_update(const char *target, const char *linkpath)
     }
     return 0;
 }
+
+uint32_t
+crc32_update(uint32_t crc, const void *buf, size_t len)
+{
+    static uint32_t table[256];
+    static int table_ready;
+
+    if (!table_ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        table_ready = 1;
+    }
+
+    const uint8_t *p = buf;
+    crc = ~crc;
+    while (len--)
+        crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+int
+parse_cpu_list(const char *s, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    while (*s) {
+        char *end;
+        long lo = strtol(s, &end, 10);
+        if (end == s || lo < 0 || lo >= CPU_SETSIZE)
+            return -1;
+        long hi = lo;
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if (end == s || hi < lo || hi >= CPU_SETSIZE)
+                return -1;
+        }
+        for (long c = lo; c <= hi; c++)
+            CPU_SET((int)c, set);
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        s = end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+void
+format_cpu_list(const cpu_set_t *set, char *buf, size_t bufsz)
+{
+    size_t off = 0;
+    buf[0] = '\0';
+    for (int c = 0; c < CPU_SETSIZE && off < bufsz; c++) {
+        if (!CPU_ISSET(c, set))
+            continue;
+        int hi = c;
+        while (hi + 1 < CPU_SETSIZE && CPU_ISSET(hi + 1, set))
+            hi++;
+        if (hi > c)
+            off += (size_t)snprintf(buf + off, bufsz - off, "%s%d-%d",
+                                    off ? "," : "", c, hi);
+        else
+            off += (size_t)snprintf(buf + off, bufsz - off, "%s%d",
+                                    off ? "," : "", c);
+        c = hi;
+    }
+}
+
+void
+tsv_escape(const char *s, char *out, size_t sz)
+{
+    size_t n = 0;
+    for (; *s; s++) {
+        char esc = *s == '\\' ? '\\' : *s == '\t' ? 't' :
+                   *s == '\n' ? 'n' : *s == '\r' ? 'r' : 0;
+        if (n + (esc ? 2 : 1) >= sz)
+            break;
+        if (esc) {
+            out[n++] = '\\';
+            out[n++] = esc;
+        } else {
+            out[n++] = *s;
+        }
+    }
+    if (sz > 0)
+        out[n] = '\0';
+}
@@ -2,8 +2,10 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <sched.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 
 /* Read a sysfs attribute file, strip trailing newline.
  * Returns bytes read (excluding trailing NUL), or -1 on error. */
@@ -20,6 +22,30 @@ void strlcpy_safe(char *dst, const char *src, size_t sz);
  * buf must be at least 24 bytes. */
 void timestamp_now(char *buf, size_t bufsz);
 
+/* Format a CLOCK_REALTIME instant as "YYYY-MM-DD HH:MM:SS.uuuuuu"
+ * (microsecond precision). buf must be at least 27 bytes. */
+void timestamp_fmt_us(const struct timespec *ts, char *buf, size_t bufsz);
+
+/* Parse a local "YYYY-MM-DD HH:MM:SS[.frac]" (or with 'T') into
+ * milliseconds since the epoch. Returns the characters consumed, or -1
+ * if s does not start with a timestamp. */
+int timestamp_parse_ms(const char *s, int64_t *ms);
+
+/* Parse a command-line time: "YYYY-MM-DD HH:MM:SS[.mmm]", "@<epoch
+ * seconds>" or "-<n>[smhd]" (that long ago), in ms since the epoch.
+ * Returns 0 on success. */
+int timestamp_parse_arg(const char *s, int64_t *ms);
+
+/* Format ms since the epoch as "YYYY-MM-DD HH:MM:SS.mmm", "-" for 0.
+ * buf must be at least 24 bytes. */
+void timestamp_fmt_ms(int64_t ms, char *buf, size_t sz);
+
+/* CLOCK_MONOTONIC in nanoseconds. */
+uint64_t mono_ns(void);
+
+/* Offset to add to a mono_ns() value to get CLOCK_REALTIME nanoseconds. */
+int64_t mono_to_wall_offset(void);
+
 /* Get timestamp string "YYYYMMDD-HHMMSS" for filenames.
  * buf must be at least 16 bytes. */
 void timestamp_filename(char *buf, size_t bufsz);
@@ -28,7 +54,23 @@ void timestamp_filename(char *buf, size_t bufsz);
  * Returns 0 on success, -1 on error. */
 int mkdirp(const char *path);
 
+/* CRC-32 (IEEE 802.3, reflected) over buf, continuing from crc
+ * (pass 0 to start). */
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len);
+
 /* Atomically update a symlink (create tmp, rename). Returns 0 on success. */
 int symlink_update(const char *target, const char *linkpath);
 
+/* Copy s into out (of size sz) as one tab-separated-values field:
+ * backslash, tab, newline and carriage return become \\, \t, \n and
+ * \r. Truncates at a whole escape. */
+void tsv_escape(const char *s, char *out, size_t sz);
+
+/* Parse a CPU list such as "0-3,6" into set. Returns 0 on success, -1
+ * if it is malformed or names no CPU. */
+int parse_cpu_list(const char *s, cpu_set_t *set);
+
+/* Format set as a CPU list, ranges collapsed ("0-3,6"). */
+void format_cpu_list(const cpu_set_t *set, char *buf, size_t bufsz);
+
 #endif /* UTIL_H */
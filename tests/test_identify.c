@@ -151,6 +151,34 @@ test_group_ports(void)
     PASS();
 }
 
+static void
+test_port_group_key(void)
+{
+    TEST("port_group_key ties one chip's interfaces together");
+    tty_port_t a, b, c;
+    memset(&a, 0, sizeof(a));
+    a.vid = 0x0403; a.pid = 0x6011;
+    strlcpy_safe(a.serial, "FT4BRD01", sizeof(a.serial));
+    strlcpy_safe(a.usb_path, "1-6", sizeof(a.usb_path));
+    b = a;
+    b.interface_num = 3;
+    c = a;
+    strlcpy_safe(c.usb_path, "1-7", sizeof(c.usb_path));
+
+    char ka[256], kb[256], kc[256];
+    port_group_key(&a, ka, sizeof(ka));
+    port_group_key(&b, kb, sizeof(kb));
+    port_group_key(&c, kc, sizeof(kc));
+    if (strcmp(ka, "0403:6011:FT4BRD01:1-6") != 0) {
+        printf("\n    got \"%s\"\n    ", ka);
+        FAIL("wrong key");
+        return;
+    }
+    if (strcmp(ka, kb) != 0) { FAIL("interfaces split"); return; }
+    if (strcmp(ka, kc) == 0) { FAIL("other USB path merged"); return; }
+    PASS();
+}
+
 int main(void)
 {
     printf("=== test_identify ===\n");
@@ -162,6 +190,7 @@ int main(void)
     test_get_device_label_override();
     test_get_device_label_fallback();
     test_group_ports();
+    test_port_group_key();
 
     printf("\n  Results: %d passed, %d failed\n\n",
            tests_passed, tests_failed);
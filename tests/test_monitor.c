@@ -5,16 +5,42 @@
  */
 #include <assert.h>
 #include <errno.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
 #include <pty.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/select.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include "../src/acl.h"
+#include "../src/archive.h"
+#include "../src/classify.h"
+#include "../src/config.h"
+#include "../src/control.h"
+#include "../src/crash.h"
+#include "../src/devclock.h"
+#include "../src/digest.h"
+#include "../src/filter.h"
+#include "../src/housekeep.h"
+#include "../src/integrity.h"
 #include "../src/log.h"
+#include "../src/lz.h"
+#include "../src/monitor.h"
+#include "../src/probe.h"
+#include "../src/recent.h"
 #include "../src/serial.h"
+#include "../src/statpage.h"
+#include "../src/timeline.h"
+#include "../src/toplines.h"
 #include "../src/util.h"
 
 static int tests_passed = 0;
@@ -69,6 +95,7 @@ test_log_write_timestamps(void)
         FAIL("log_open failed");
         return;
     }
+    lf.timestamps = 1;
 
     /* write some data */
     log_write(&lf, "Hello world\n", 12);
@@ -392,6 +419,2184 @@ test_proxy_log_and_forward(void)
     PASS();
 }
 
+static void
+test_timeline_arrival_order(void)
+{
+    TEST("timeline: merge halves by arrival");
+    char session_path[512];
+    log_create_session(session_path, sizeof(session_path));
+
+    timeline_t *tl = calloc(1, sizeof(*tl));
+    if (!tl || timeline_open(tl, session_path, "TEST_LINK",
+                             "PORT_A", "PORT_B", 10) < 0) {
+        FAIL("timeline_open failed");
+        free(tl);
+        return;
+    }
+
+    /* A starts a line at t=1ms but finishes it after B's complete line
+     * that started at t=2ms: A must still come first */
+    uint64_t ms = 1000000ull;
+    timeline_feed(tl, TL_DIR_A, "req", 3, 1 * ms);
+    timeline_feed(tl, TL_DIR_B, "resp\n", 5, 2 * ms);
+    timeline_poll(tl, 50 * ms);              /* blocked by A's open line */
+    if (tl->records != 0) {
+        FAIL("emitted before earlier open line completed");
+        timeline_close(tl);
+        free(tl);
+        return;
+    }
+    timeline_feed(tl, TL_DIR_A, "uest\n", 5, 60 * ms);
+    timeline_poll(tl, 100 * ms);
+    timeline_close(tl);
+
+    FILE *fp = fopen(tl->path, "r");
+    free(tl);
+    if (!fp) { FAIL("cannot read timeline"); return; }
+
+    char line[512];
+    int pos_a = -1, pos_b = -1, n = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (strstr(line, ">> request")) pos_a = n;
+        if (strstr(line, "<< resp")) pos_b = n;
+        n++;
+    }
+    fclose(fp);
+
+    if (pos_a < 0 || pos_b < 0) { FAIL("lines missing"); return; }
+    if (pos_a > pos_b) { FAIL("wrong order"); return; }
+    PASS();
+}
+
+static void
+test_integrity_pty_board(void)
+{
+    TEST("integrity: PTY board gap/dup/corrupt");
+
+    int master, slave;
+    if (openpty(&master, &slave, NULL, NULL, NULL) < 0) {
+        FAIL("openpty failed");
+        return;
+    }
+    char *slave_name = ttyname(slave);
+    close(slave);
+
+    serial_port_t sp;
+    if (serial_open(&sp, slave_name, B115200) < 0) {
+        FAIL("serial_open failed");
+        close(master);
+        return;
+    }
+
+    integrity_t ig;
+    integrity_init(&ig, 4096, sp.fd);
+
+    /* board emits frames 0..9 but drops 4, repeats 6 and mangles 8 */
+    char frame[128];
+    for (uint32_t seq = 0; seq < 10; seq++) {
+        if (seq == 4)
+            continue;
+        size_t n = integrity_frame(frame, sizeof(frame), seq, 32);
+        if (seq == 8)
+            frame[20] ^= 0x01;
+        ssize_t nw = write(master, frame, n);
+        if (seq == 6)
+            nw = write(master, frame, n);
+        (void)nw;
+    }
+    ssize_t nw = write(master, "plain console text\n", 19);
+    (void)nw;
+    usleep(100000);
+
+    char buf[4096];
+    fd_set rfds;
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    FD_ZERO(&rfds);
+    FD_SET(sp.fd, &rfds);
+    while (select(sp.fd + 1, &rfds, NULL, NULL, &tv) > 0) {
+        ssize_t nr = read(sp.fd, buf, sizeof(buf));
+        if (nr <= 0)
+            break;
+        integrity_feed(&ig, buf, (size_t)nr, 0);
+        tv.tv_sec = 0;
+        tv.tv_usec = 50000;
+    }
+
+    serial_close(&sp);
+    close(master);
+
+    if (ig.frames_ok != 8) { FAIL("wrong good frame count"); return; }
+    /* 8 arrived mangled: corrupt, but not lost as well */
+    if (ig.frames_lost != 1) { FAIL("gap not counted"); return; }
+    if (ig.duplicates != 1) { FAIL("duplicate not counted"); return; }
+    if (ig.corrupt != 1) { FAIL("corruption not counted"); return; }
+    if (ig.frames_lost + ig.duplicates + ig.corrupt != 3) {
+        FAIL("a frame counted twice");
+        return;
+    }
+    PASS();
+}
+
+static void
+test_log_spill_on_enospc(void)
+{
+    TEST("log: ENOSPC spill, drain, marker");
+    char session_path[512];
+    log_create_session(session_path, sizeof(session_path));
+
+    log_file_t lf;
+    if (log_open(&lf, session_path, "test_spill", NULL) < 0) {
+        FAIL("log_open failed");
+        return;
+    }
+
+    /* the disk "fills up": every write fails with ENOSPC */
+    int full = open("/dev/full", O_WRONLY);
+    int real = dup(lf.fd);
+    if (full < 0 || real < 0) { FAIL("cannot open /dev/full"); return; }
+    dup2(full, lf.fd);
+    close(full);
+
+    log_write(&lf, "spilled one\nspilled two\n", 24);
+    if (!lf.degraded || lf.last_errno != ENOSPC || lf.spill_len != 24) {
+        FAIL("write failure not spilled");
+        return;
+    }
+    if (log_service(&lf, mono_ns() + 1000000000ull) != 1) {
+        FAIL("recovered while disk is still full");
+        return;
+    }
+
+    /* space is back */
+    dup2(real, lf.fd);
+    close(real);
+    log_write(&lf, "after\n", 6);
+    if (log_service(&lf, mono_ns() + 2000000000ull) != 0) {
+        FAIL("did not recover");
+        return;
+    }
+    log_close(&lf);
+
+    FILE *fp = fopen(lf.filepath, "r");
+    if (!fp) { FAIL("cannot read log"); return; }
+    char text[1024];
+    size_t n = fread(text, 1, sizeof(text) - 1, fp);
+    text[n] = '\0';
+    fclose(fp);
+
+    char *one = strstr(text, "spilled one\nspilled two\nafter\n");
+    char *mark = strstr(text, "STORAGE RECOVERED: 30 bytes spilled, "
+                        "0 bytes lost");
+    if (!one) { FAIL("spilled data missing or out of order"); return; }
+    if (!mark || mark < one) { FAIL("recovery marker missing"); return; }
+    PASS();
+}
+
+static void
+test_log_sync_triggers(void)
+{
+    TEST("log: fdatasync on marker and pattern");
+    char session_path[512];
+    log_create_session(session_path, sizeof(session_path));
+
+    log_file_t lf;
+    if (log_open(&lf, session_path, "test_sync", NULL) < 0) {
+        FAIL("log_open failed");
+        return;
+    }
+    static const char *const patterns[] = { "Kernel panic" };
+    lf.sync_on_marker = 1;
+    lf.sync_patterns = patterns;
+    lf.sync_pattern_count = 1;
+
+    log_write(&lf, "booting\n", 8);
+    if (lf.syncs != 0) { FAIL("synced an ordinary line"); return; }
+    log_write(&lf, "Kernel panic - not syncing\n", 27);
+    if (lf.syncs != 1 || lf.dirty) { FAIL("pattern did not sync"); return; }
+    if (log_sync(&lf) != 0) { FAIL("clean file synced again"); return; }
+    log_marker(&lf, "PORT YIELDED");
+    if (lf.syncs != 2) { FAIL("marker did not sync"); return; }
+    log_close(&lf);
+    PASS();
+}
+
+static int handed_off;
+
+static void
+count_handoff(log_file_t *lf)
+{
+    (void)lf;
+    handed_off++;
+}
+
+static void
+test_log_sync_handler(void)
+{
+    TEST("log: marker sync handed off, not inline");
+    char session_path[512];
+    log_create_session(session_path, sizeof(session_path));
+
+    log_file_t lf;
+    if (log_open(&lf, session_path, "test_sync_handoff", NULL) < 0) {
+        FAIL("log_open failed");
+        return;
+    }
+    static const char *const patterns[] = { "panic" };
+    lf.sync_on_marker = 1;
+    lf.sync_patterns = patterns;
+    lf.sync_pattern_count = 1;
+
+    handed_off = 0;
+    log_set_sync_handler(count_handoff);
+    log_write(&lf, "panic: one\n", 11);
+    log_write(&lf, "panic: two\n", 11);
+    log_marker(&lf, "PORT YIELDED");
+    log_marker(&lf, "PORT RECLAIMED");
+    log_set_sync_handler(NULL);
+    log_close(&lf);
+
+    if (lf.syncs != 0) { FAIL("synced in the capture path"); return; }
+    if (handed_off != 4) { FAIL("sync not handed off"); return; }
+    if (lf.dirty) { FAIL("file left dirty"); return; }
+    PASS();
+}
+
+static void
+test_housekeep_group_commit(void)
+{
+    TEST("housekeep: group commit feeds counters");
+    char session_path[512];
+    log_create_session(session_path, sizeof(session_path));
+
+    log_file_t a, b;
+    if (log_open(&a, session_path, "test_commit_a", NULL) < 0 ||
+        log_open(&b, session_path, "test_commit_b", NULL) < 0) {
+        FAIL("log_open failed");
+        return;
+    }
+    log_write(&a, "one\n", 4);
+    log_write(&b, "two\n", 4);
+
+    uint64_t before, after, last_ns, max_ns;
+    housekeep_sync_stats(&before, &last_ns, &max_ns);
+    if (housekeep_start() < 0) { FAIL("worker did not start"); return; }
+    int fds[2] = { a.fd, b.fd };
+    uint64_t ids[2] = { a.sync_id, b.sync_id };
+    housekeep_sync(fds, ids, 2);
+    housekeep_stop();               /* runs what is queued */
+    housekeep_sync_stats(&after, &last_ns, &max_ns);
+
+    housekeep_synced_t done[4];
+    int n = housekeep_sync_results(done, 4);
+    for (int i = 0; i < n; i++) {
+        log_file_t *lf = done[i].id == a.sync_id ? &a :
+                         done[i].id == b.sync_id ? &b : NULL;
+        if (lf)
+            log_sync_done(lf, done[i].ns, done[i].err);
+    }
+    log_close(&a);
+    log_close(&b);
+
+    if (a.sync_id == b.sync_id) { FAIL("logs share a sync id"); return; }
+    if (n != 2) { FAIL("finished syncs not reported"); return; }
+    if (after != before + 1) { FAIL("batch not counted"); return; }
+    if (a.syncs != 1 || b.syncs != 1) {
+        FAIL("port sync counters not fed");
+        return;
+    }
+    if (housekeep_sync_results(done, 4) != 0) {
+        FAIL("results reported twice");
+        return;
+    }
+    PASS();
+}
+
+static void
+test_tsv_escape(void)
+{
+    TEST("marks.log: text escaped as one field");
+    char out[32];
+    tsv_escape("a\tb\\c\r\nd", out, sizeof(out));
+    if (strcmp(out, "a\\tb\\\\c\\r\\nd") != 0) {
+        FAIL("not escaped");
+        return;
+    }
+    tsv_escape("ab\t", out, 4);
+    if (strcmp(out, "ab") != 0) { FAIL("escape split by truncation"); return; }
+    PASS();
+}
+
+static void
+test_cpu_list(void)
+{
+    TEST("sched: --cpus list parse and format");
+    cpu_set_t set;
+    char buf[64];
+    if (parse_cpu_list("0-3,6", &set) < 0 || CPU_COUNT(&set) != 5 ||
+        !CPU_ISSET(6, &set) || CPU_ISSET(4, &set)) {
+        FAIL("0-3,6 misparsed");
+        return;
+    }
+    format_cpu_list(&set, buf, sizeof(buf));
+    if (strcmp(buf, "0-3,6") != 0) { FAIL("not formatted back"); return; }
+    parse_cpu_list("5,1,2", &set);
+    format_cpu_list(&set, buf, sizeof(buf));
+    if (strcmp(buf, "1-2,5") != 0) { FAIL("ranges not collapsed"); return; }
+    if (parse_cpu_list("3-1", &set) == 0 || parse_cpu_list("", &set) == 0 ||
+        parse_cpu_list("1,x", &set) == 0 || parse_cpu_list("-1", &set) == 0) {
+        FAIL("bad list accepted");
+        return;
+    }
+    PASS();
+}
+
+static void
+test_log_marker_at_offset(void)
+{
+    TEST("log_marker_at flushes, returns offset");
+    char session_path[512];
+    log_create_session(session_path, sizeof(session_path));
+
+    log_file_t lf;
+    if (log_open(&lf, session_path, "test_mark", NULL) < 0) {
+        FAIL("log_open failed");
+        return;
+    }
+    log_write(&lf, "half a line", 11);
+    long long off = log_marker_at(&lf, "MARK 1: step",
+                                  "2026-01-01 00:00:00.000000");
+    log_close(&lf);
+
+    FILE *fp = fopen(lf.filepath, "r");
+    if (!fp) { FAIL("cannot read log"); return; }
+    char text[256];
+    size_t n = fread(text, 1, sizeof(text) - 1, fp);
+    text[n] = '\0';
+    fclose(fp);
+
+    if (off != 12) { FAIL("offset not after flushed partial line"); return; }
+    if (strncmp(text + off, "\n--- MARK 1: step [2026-01-01", 29) != 0) {
+        FAIL("marker not at offset");
+        return;
+    }
+    PASS();
+}
+
+static void
+test_checkpoint_index(void)
+{
+    TEST("checkpoint: index offsets, last, unknown");
+    char session_path[512];
+    log_create_session(session_path, sizeof(session_path));
+
+    log_file_t lf;
+    if (log_open(&lf, session_path, "test_cp", NULL) < 0) {
+        FAIL("log_open failed");
+        return;
+    }
+    char index_path[600];
+    snprintf(index_path, sizeof(index_path), "%s/%s", session_path,
+             LOG_CHECKPOINTS);
+    FILE *index = fopen(index_path, "a");
+    if (!index) { FAIL("cannot open index"); log_close(&lf); return; }
+
+    log_write(&lf, "boot 1\n", 7);
+    long long cp1 = log_checkpoint(&lf, index, "cp1", "test_cp",
+                                   "2026-01-01 00:00:01.000000", 1, 0);
+    log_write(&lf, "boot 2\n", 7);
+    long long cp2 = log_checkpoint(&lf, index, "cp2", "test_cp",
+                                   "2026-01-01 00:00:02.000000", 2, 0);
+    fclose(index);
+    log_close(&lf);
+
+    FILE *fp = fopen(lf.filepath, "r");
+    if (!fp) { FAIL("cannot read log"); return; }
+    char text[512];
+    size_t n = fread(text, 1, sizeof(text) - 1, fp);
+    text[n] = '\0';
+    fclose(fp);
+
+    const char *base = strrchr(lf.filepath, '/') + 1;
+    if (cp1 <= 0 || cp2 <= cp1 || cp2 >= (long long)n) {
+        FAIL("bad checkpoint offsets");
+        return;
+    }
+    if (strncmp(text + cp1, "\n--- CHECKPOINT cp1 [", 21) != 0 ||
+        strncmp(text + cp2, "\n--- CHECKPOINT cp2 [", 21) != 0) {
+        FAIL("marker not at indexed offset");
+        return;
+    }
+    if (log_checkpoint_offset(index_path, base, "cp1") != cp1) {
+        FAIL("named checkpoint offset wrong");
+        return;
+    }
+    if (log_checkpoint_offset(index_path, base, "last") != cp2) {
+        FAIL("last is not the newest checkpoint");
+        return;
+    }
+    if (log_checkpoint_offset(index_path, base, "nope") != -1) {
+        FAIL("unknown checkpoint found");
+        return;
+    }
+    if (log_checkpoint_offset(index_path, "other.log", "cp1") != -1) {
+        FAIL("checkpoint of another log found");
+        return;
+    }
+    PASS();
+}
+
+static void
+test_checkpoint_truncate(void)
+{
+    TEST("checkpoint --truncate records offset 0");
+    char session_path[512];
+    log_create_session(session_path, sizeof(session_path));
+
+    log_file_t lf;
+    if (log_open(&lf, session_path, "test_cp_trunc", NULL) < 0) {
+        FAIL("log_open failed");
+        return;
+    }
+    char index_path[600];
+    snprintf(index_path, sizeof(index_path), "%s/%s", session_path,
+             LOG_CHECKPOINTS);
+    FILE *index = fopen(index_path, "a");
+    if (!index) { FAIL("cannot open index"); log_close(&lf); return; }
+
+    log_write(&lf, "old output\n", 11);
+    long long cp1 = log_checkpoint(&lf, index, "cp1", "test_cp_trunc",
+                                   "2026-01-01 00:00:01.000000", 1, 0);
+    long long cp2 = log_checkpoint(&lf, index, "cp2", "test_cp_trunc",
+                                   "2026-01-01 00:00:02.000000", 2, 1);
+    fclose(index);
+    log_close(&lf);
+
+    const char *base = strrchr(lf.filepath, '/') + 1;
+    FILE *fp = fopen(lf.filepath, "r");
+    if (!fp) { FAIL("cannot read log"); return; }
+    char text[512];
+    size_t n = fread(text, 1, sizeof(text) - 1, fp);
+    text[n] = '\0';
+    fclose(fp);
+
+    if (cp1 <= 0 || cp2 != 0) {
+        FAIL("truncate checkpoint not at offset 0");
+        return;
+    }
+    if (strstr(text, "old output")) {
+        FAIL("log not truncated");
+        return;
+    }
+    if (log_checkpoint_offset(index_path, base, "last") != 0 ||
+        log_checkpoint_offset(index_path, base, "cp2") != 0) {
+        FAIL("index offset for truncate not 0");
+        return;
+    }
+    PASS();
+}
+
+static void
+test_statpage_seqlock(void)
+{
+    TEST("statpage: snapshots consistent vs writer");
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/uart-monitor-test-%d.status",
+             getpid());
+    statpage_t *sp = statpage_create(path);
+    if (!sp) { FAIL("statpage_create failed"); return; }
+
+    /* the writer keeps every counter of a port equal to seq/2 */
+    pid_t child = fork();
+    if (child == 0) {
+        for (uint64_t v = 1; v <= 200000; v++) {
+            statpage_begin(sp);
+            sp->port_count = 2;
+            for (int i = 0; i < 2; i++) {
+                sp->ports[i].bytes_read = v;
+                sp->ports[i].bytes_logged = v;
+                sp->ports[i].last_activity = v;
+            }
+            statpage_end(sp);
+        }
+        _exit(0);
+    }
+
+    static statpage_t snap;
+    int torn = 0, reads = 0;
+    for (int n = 0; n < 2000; n++) {
+        if (statpage_read(path, &snap) < 0)
+            continue;
+        reads++;
+        for (uint32_t i = 0; i < snap.port_count; i++) {
+            const statpage_port_t *p = &snap.ports[i];
+            if (p->bytes_read != p->bytes_logged ||
+                p->bytes_read != p->last_activity ||
+                p->bytes_read != snap.ports[0].bytes_read)
+                torn++;
+        }
+    }
+    waitpid(child, NULL, 0);
+    int final = statpage_read(path, &snap);
+    statpage_destroy(sp, path);
+
+    if (torn) { FAIL("torn snapshot"); return; }
+    if (reads == 0 || final < 0) { FAIL("no snapshot"); return; }
+    if (snap.ports[1].bytes_read != 200000) {
+        FAIL("final snapshot stale");
+        return;
+    }
+    if (access(path, F_OK) == 0) { FAIL("page not removed"); return; }
+    PASS();
+}
+
+static void
+test_statpage_fields(void)
+{
+    TEST("statpage: JSON carries source, content, checkpoint");
+    static statpage_t sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.port_count = 1;
+    statpage_port_t *p = &sp.ports[0];
+    strcpy(p->label, "NET");
+    strcpy(p->log_file, "/tmp/s/NET.log");
+    strcpy(p->source, "tcp");
+    p->connects = 3;
+    strcpy(p->priority, "bulk");
+    strcpy(p->content, "binary");
+    strcpy(p->checkpoint, "boot2");
+    p->checkpoint_off = 4096;
+    p->flags = SP_F_RAW;
+
+    char *json = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&json, &len);
+    if (!fp) { FAIL("open_memstream"); return; }
+    statpage_print_json(&sp, fp);
+    fclose(fp);
+
+    static const char *const want[] = {
+        "\"source\": \"tcp\"", "\"connects\": 3,",
+        "\"priority\": \"bulk\"", "\"content\": \"binary\"",
+        "\"content_file\": \"/tmp/s/NET.bin\"",
+        "\"checkpoint\": \"boot2\"", "\"checkpoint_offset\": 4096,",
+    };
+    for (size_t i = 0; i < sizeof(want) / sizeof(want[0]); i++) {
+        if (!strstr(json, want[i])) {
+            free(json);
+            FAIL(want[i]);
+            return;
+        }
+    }
+    free(json);
+    PASS();
+}
+
+static void
+test_probe_ping_pty_loopback(void)
+{
+    TEST("probe: ping over PTY wire, corrupt");
+
+    /* the PTY is the wire: frames written to the master arrive on the
+     * monitored slave, as on a loopback plug */
+    int master, slave;
+    if (openpty(&master, &slave, NULL, NULL, NULL) < 0) {
+        FAIL("openpty failed");
+        return;
+    }
+    char *slave_name = ttyname(slave);
+    serial_port_t sp;
+    if (serial_open(&sp, slave_name, B115200) < 0) {
+        FAIL("serial_open failed");
+        close(master);
+        close(slave);
+        return;
+    }
+    close(slave);
+    fcntl(master, F_SETFL, O_NONBLOCK);
+
+    static probe_t pr;
+    probe_init_ping(&pr, master, sp.fd, 10, 2, 16);
+    char buf[4096];
+    uint64_t deadline = mono_ns() + 3000000000ull;
+    while (probe_tick(&pr, mono_ns()) >= 0 && mono_ns() < deadline) {
+        fd_set rfds;
+        struct timeval tv = { .tv_sec = 0, .tv_usec = 1000 };
+        FD_ZERO(&rfds);
+        FD_SET(sp.fd, &rfds);
+        if (select(sp.fd + 1, &rfds, NULL, NULL, &tv) > 0) {
+            ssize_t nr = read(sp.fd, buf, sizeof(buf));
+            if (nr > 0)
+                probe_feed(&pr, buf, (size_t)nr, mono_ns());
+        }
+    }
+    serial_close(&sp);
+    close(master);
+
+    char report[512];
+    probe_report(&pr, "A", "A", report, sizeof(report));
+    if (!pr.done) { FAIL("run did not finish"); return; }
+    if (strncmp(report, "OK ping A -> A sent=10 received=10 lost=0 "
+                "corrupt=0\nrtt_ms min=", 61) != 0) {
+        FAIL(report);
+        return;
+    }
+
+    /* a flipped payload byte is corrupt, console text is ignored */
+    char frame[128];
+    size_t n = probe_frame(frame, sizeof(frame), pr.tx_seq, mono_ns(), 16);
+    frame[40] ^= 0x01;
+    probe_feed(&pr, "login: \n", 8, mono_ns());
+    probe_feed(&pr, frame, n, mono_ns());
+    if (pr.corrupt != 1 || pr.received != 10) {
+        FAIL("corrupt frame not detected");
+        return;
+    }
+    PASS();
+}
+
+static void
+test_log_filter_rules(void)
+{
+    TEST("log: keep/drop filter, first rule wins");
+    char session_path[512];
+    log_create_session(session_path, sizeof(session_path));
+
+    filter_t f;
+    filter_init(&f);
+    filter_add(&f, FILTER_KEEP, "HB ERR");
+    filter_add(&f, FILTER_DROP, "HB ");
+    filter_add(&f, FILTER_DROP, "^tlm");
+    if (filter_compile(&f) < 0) { FAIL("filter_compile failed"); return; }
+
+    log_file_t lf;
+    if (log_open(&lf, session_path, "test_filter", NULL) < 0) {
+        FAIL("log_open failed");
+        filter_free(&f);
+        return;
+    }
+    log_add_stage(&lf, &log_stage_filter, &f);
+    const char *in = "boot ok\nHB 1\n[HB ERR] fan\ntlm x=1\nsaw tlm\n"
+                     "xHB 2\n";
+    log_write(&lf, in, strlen(in));
+    /* a hex dump line goes around the filter */
+    log_write_binary(&lf, "HB 3\n", 5);
+    log_close(&lf);
+
+    FILE *fp = fopen(lf.filepath, "r");
+    if (!fp) { FAIL("cannot read log"); filter_free(&f); return; }
+    char text[256];
+    size_t n = fread(text, 1, sizeof(text) - 1, fp);
+    text[n] = '\0';
+    fclose(fp);
+
+    int ok = strcmp(text, "boot ok\n[HB ERR] fan\nsaw tlm\nHB 3\n") == 0 &&
+             f.hits[0] == 1 && f.hits[1] == 2 && f.hits[2] == 1 &&
+             f.dropped_lines == 3 && lf.bytes_written == 34 &&
+             lf.stages[0].lines == 6 && lf.stages[0].dropped == 3;
+    filter_free(&f);
+    if (!ok) { FAIL("wrong lines kept or counted"); return; }
+    PASS();
+}
+
+static void
+test_acl_principals(void)
+{
+    TEST("acl: users, uids, groups, wildcard");
+
+    /* a user outside the passwd file, in group 0 as a supplement */
+    acl_peer_t p;
+    memset(&p, 0, sizeof(p));
+    p.uid = 4242;
+    p.gid = 4242;
+    strcpy(p.user, "alice");
+    p.groups[0] = 4242;
+    p.groups[1] = 0;
+    p.ngroups = 2;
+
+    int ok = acl_who_matches(&p, "alice") &&
+             acl_who_matches(&p, "bob,4242") &&
+             acl_who_matches(&p, "@0") &&
+             acl_who_matches(&p, "@root") &&
+             acl_who_matches(&p, "*") &&
+             !acl_who_matches(&p, "bob") &&
+             !acl_who_matches(&p, "4243,@4243") &&
+             !acl_who_matches(&p, "alic");
+
+    /* a nameless uid only matches by number */
+    p.user[0] = '\0';
+    ok = ok && !acl_who_matches(&p, "alice") &&
+         acl_who_matches(&p, "4242");
+
+    if (!ok) { FAIL("wrong principal decision"); return; }
+    PASS();
+}
+
+static void
+test_archive_export_window(void)
+{
+    TEST("archive: lz round trip, port/time export");
+
+    /* compressor: repetitive text, incompressible bytes, tiny input */
+    static char text[200000], packed[LZ_BOUND(200000)], back[200000];
+    size_t n = 0;
+    for (int i = 0; n + 64 < sizeof(text); i++)
+        n += (size_t)snprintf(text + n, sizeof(text) - n,
+                              "[2026-01-01 00:00:%02d.000] iter %d ok\n",
+                              i % 60, i);
+    size_t plen = lz_compress(text, n, packed);
+    int ok = plen < n / 3 && lz_decompress(packed, plen, back, n) == 0 &&
+             memcmp(text, back, n) == 0 &&
+             lz_decompress(packed, plen, back, n - 1) < 0;
+    unsigned seed = 1;
+    for (size_t i = 0; i < n; i++)
+        text[i] = (char)((seed = seed * 1103515245u + 12345u) >> 16);
+    plen = lz_compress(text, n, packed);
+    ok = ok && plen <= LZ_BOUND(n) &&
+         lz_decompress(packed, plen, back, n) == 0 &&
+         memcmp(text, back, n) == 0;
+    plen = lz_compress("ab", 2, packed);
+    ok = ok && lz_decompress(packed, plen, back, 2) == 0 &&
+         memcmp(back, "ab", 2) == 0;
+    if (!ok) { FAIL("lz round trip"); return; }
+
+    char dir[] = "/tmp/uart-monitor-test-XXXXXX";
+    if (!mkdtemp(dir)) { FAIL("mkdtemp"); return; }
+    char path[256];
+    const char *ports[] = { "KEEP", "SKIP" };
+    for (int p = 0; p < 2; p++) {
+        snprintf(path, sizeof(path), "%s/%s.log", dir, ports[p]);
+        FILE *fp = fopen(path, "w");
+        fprintf(fp, "=== header ===\n");
+        for (int i = 0; i < 10; i++)
+            fprintf(fp, "[2026-01-01 10:00:%02d.500] %s line %d\n"
+                    "  continued %d\n", i, ports[p], i, i);
+        fclose(fp);
+    }
+
+    archive_opts_t o = { .ports = "KEEP", .jobs = 2 };
+    timestamp_parse_ms("2026-01-01 10:00:03", &o.since);
+    timestamp_parse_ms("2026-01-01 10:00:05", &o.until);
+    snprintf(path, sizeof(path), "%s.umz", dir);
+    archive_stats_t st;
+    archive_t a;
+    if (archive_export(dir, path, &o, &st) < 0 ||
+        archive_open(&a, path) < 0) {
+        FAIL("export/open failed");
+        return;
+    }
+    /* lines 3 and 4 (10:00:05.500 is past the window) */
+    char *raw = a.nblocks == 1 ? archive_read_block(&a, 0) : NULL;
+    const char *want = "[2026-01-01 10:00:03.500] KEEP line 3\n"
+                       "  continued 3\n"
+                       "[2026-01-01 10:00:04.500] KEEP line 4\n"
+                       "  continued 4\n";
+    ok = raw && a.nstreams == 1 &&
+         strcmp(a.streams[0].name, "KEEP.log") == 0 &&
+         a.blocks[0].raw_len == strlen(want) &&
+         memcmp(raw, want, strlen(want)) == 0 &&
+         a.blocks[0].t_first == o.since + 500 &&
+         a.blocks[0].t_last == o.since + 1500;
+    free(raw);
+    archive_close(&a);
+    unlink(path);
+    for (int p = 0; p < 2; p++) {
+        snprintf(path, sizeof(path), "%s/%s.log", dir, ports[p]);
+        unlink(path);
+    }
+    rmdir(dir);
+    if (!ok) { FAIL("wrong streams, lines or times"); return; }
+    PASS();
+}
+
+/* More files than any fixed table would hold: every one is exported. */
+static void
+test_archive_many_streams(void)
+{
+    TEST("archive: export keeps every file");
+
+    enum { FILES = 300 };
+    char dir[] = "/tmp/uart-monitor-test-XXXXXX";
+    if (!mkdtemp(dir)) { FAIL("mkdtemp"); return; }
+    char path[256];
+    for (int i = 0; i < FILES; i++) {
+        snprintf(path, sizeof(path), "%s/P%03d.log", dir, i);
+        FILE *fp = fopen(path, "w");
+        if (fp) {
+            fprintf(fp, "[2026-01-01 10:00:00.000] port %d\n", i);
+            fclose(fp);
+        }
+    }
+
+    archive_opts_t o = { .jobs = 2 };
+    archive_stats_t st;
+    archive_t a;
+    snprintf(path, sizeof(path), "%s.umz", dir);
+    int ok = archive_export(dir, path, &o, &st) == 0 &&
+             archive_open(&a, path) == 0;
+    if (ok) {
+        ok = st.streams == FILES && a.nstreams == FILES &&
+             a.nblocks == FILES &&
+             strcmp(a.streams[FILES - 1].name, "P299.log") == 0;
+        archive_close(&a);
+    }
+    unlink(path);
+    for (int i = 0; i < FILES; i++) {
+        snprintf(path, sizeof(path), "%s/P%03d.log", dir, i);
+        unlink(path);
+    }
+    rmdir(dir);
+    if (!ok) { FAIL("files dropped from the export"); return; }
+    PASS();
+}
+
+static void
+feed_lines(crash_t *c, const char *const *lines, long long off)
+{
+    for (; *lines; lines++)
+        crash_feed(c, *lines, strlen(*lines), off++);
+}
+
+static void
+test_crash_signatures(void)
+{
+    TEST("crash: signatures mask addresses, dedupe");
+
+    char norm[128];
+    crash_normalize("[   12.345678] CFSR: 0x00008200 PC: 0x0800f1a2 r3",
+                    49, norm, sizeof(norm));
+    if (strcmp(norm, "CFSR: 0x00008200 PC: # r3") != 0) {
+        FAIL(norm);
+        return;
+    }
+
+    /* the same oops twice (other addresses, times and PIDs), a Zephyr
+     * fault, and a HardFault dump that ends with the port going quiet */
+    const char *oops1[] = {
+        "[   10.100000] DEBUG: not a crash",
+        "[   12.345678] Unable to handle kernel NULL pointer dereference "
+        "at virtual address 0000000000000008",
+        "[   12.345700] Mem abort info:",
+        "[   12.345701]   ESR = 0x96000005",
+        "[   12.345800] CPU: 1 PID: 217 Comm: kworker/1:2",
+        "[   12.345900] pc : spi_sync+0x1c/0x40",
+        "[   12.346000] Call trace:",
+        "[   12.346100]  spi_sync+0x1c/0x40",
+        "[   12.346200]  ? bogus_frame+0x0/0x10",
+        "[   12.346300]  sensor_read+0x88/0x120",
+        "[   12.346400] ---[ end trace 1a2b3c4d5e6f7081 ]---",
+        "[   12.346500] Kernel panic - not syncing: Fatal exception",
+        "[   12.346600] ---[ end Kernel panic - not syncing ]---",
+        NULL
+    };
+    const char *oops2[] = {
+        "[  845.000001] Unable to handle kernel NULL pointer dereference "
+        "at virtual address 0000000000000008",
+        "[  845.000002] Mem abort info:",
+        "[  845.000003]   ESR = 0x96000005",
+        "[  845.000004] CPU: 0 PID: 3301 Comm: kworker/0:0",
+        "[  845.000005] pc : spi_sync+0x1c/0x40",
+        "[  845.000006] Call trace:",
+        "[  845.000007]  spi_sync+0x1c/0x40",
+        "[  845.000008]  sensor_read+0x88/0x120",
+        "[  845.000009] ---[ end trace 99aa00bb11cc22dd ]---",
+        "[  845.000010] Kernel panic - not syncing: Fatal exception",
+        "[  845.000011] ---[ end Kernel panic - not syncing ]---",
+        NULL
+    };
+    const char *zephyr[] = {
+        "[00:00:01.234,000] <err> os: ***** BUS FAULT *****",
+        "[00:00:01.234,000] <err> os:   Precise data bus error",
+        "[00:00:01.234,000] <err> os: >>> ZEPHYR FATAL ERROR 0: CPU "
+        "exception on CPU 0",
+        "[00:00:01.234,000] <err> os: Halting system",
+        NULL
+    };
+    const char *hardfault[] = {
+        "HardFault!",
+        "CFSR  0x00008200 HFSR 0x40000000",
+        "PC    0x0800F1A2 LR 0x0800E001",
+        NULL
+    };
+
+    char dir[] = "/tmp/uart-monitor-test-XXXXXX";
+    if (!mkdtemp(dir)) { FAIL("mkdtemp"); return; }
+    char index[256];
+    snprintf(index, sizeof(index), "%s/%s", dir, CRASH_INDEX);
+    crash_t c;
+    crash_init(&c, index, "board");
+    crash_attach(&c, "session-1", "board.log");
+    feed_lines(&c, oops1, 100);
+    crash_attach(&c, "session-2", "board.log");
+    feed_lines(&c, oops2, 200);
+    feed_lines(&c, zephyr, 300);
+    feed_lines(&c, hardfault, 400);
+    int pending = c.kind == CRASH_HARDFAULT;
+    crash_finish(&c);
+
+    char hash[4][17] = {{0}}, sig[512] = "";
+    long long off[4] = {0};
+    int n = 0;
+    FILE *fp = fopen(index, "r");
+    char line[1024];
+    while (fp && n < 4 && fgets(line, sizeof(line), fp)) {
+        sscanf(line, "%16s", hash[n]);
+        char *f = line;
+        for (int i = 0; i < 6 && f; i++)
+            f = strchr(f, '\t') ? strchr(f, '\t') + 1 : NULL;
+        off[n] = f ? atoll(f) : -1;
+        if (n == 0 && f && strchr(f, '\t'))
+            strlcpy_safe(sig, strchr(f, '\t') + 1, sizeof(sig));
+        n++;
+    }
+    if (fp)
+        fclose(fp);
+    unlink(index);
+    rmdir(dir);
+
+    int ok = n == 4 && pending && c.detected == 4 &&
+             strcmp(hash[0], hash[1]) == 0 &&
+             strcmp(hash[0], hash[2]) != 0 &&
+             strcmp(hash[2], hash[3]) != 0 &&
+             off[0] == 101 && off[1] == 200 && off[2] == 300 &&
+             off[3] == 400 &&
+             strstr(sig, "ESR = 0x96000005") &&
+             strstr(sig, "Kernel panic - not syncing: Fatal exception") &&
+             strstr(sig, "@ spi_sync < spi_sync < sensor_read\n");
+    if (!ok) { FAIL(n ? sig : "no index lines"); return; }
+    PASS();
+}
+
+static void
+test_crash_prune_index(void)
+{
+    TEST("crash: index pruned with its sessions");
+
+    char dir[] = "/tmp/uart-monitor-test-XXXXXX";
+    if (!mkdtemp(dir)) { FAIL("mkdtemp"); return; }
+    char index[256], kept[256];
+    snprintf(index, sizeof(index), "%s/%s", dir, CRASH_INDEX);
+    snprintf(kept, sizeof(kept), "%s/session-2", dir);
+    mkdir(kept, 0755);
+    FILE *fp = fopen(index, "w");
+    if (!fp) { FAIL("index"); rmdir(kept); rmdir(dir); return; }
+    fputs("aaaa\tlinux\t1\tboard\tsession-1\tboard.log\t0\tsig\n"
+          "bbbb\tlinux\t2\tboard\tsession-2\tboard.log\t0\tsig\n"
+          "cccc\tzephyr\t3\tboard\t-\t-\t0\tsig\n", fp);
+    fclose(fp);
+
+    int first = crash_prune_index(index, dir);
+    int again = crash_prune_index(index, dir);
+    char buf[512] = "";
+    fp = fopen(index, "r");
+    size_t n = fp ? fread(buf, 1, sizeof(buf) - 1, fp) : 0;
+    buf[n] = '\0';
+    if (fp)
+        fclose(fp);
+    unlink(index);
+    rmdir(kept);
+    int none = crash_prune_index(index, dir);
+    rmdir(dir);
+
+    if (first != 1 || again != 0 || none != 0 || strstr(buf, "aaaa") ||
+        !strstr(buf, "bbbb") || !strstr(buf, "cccc")) {
+        FAIL(buf);
+        return;
+    }
+    PASS();
+}
+
+static void
+test_devclock_fit(void)
+{
+    TEST("devclock: formats, offset+drift, reset");
+
+    int64_t ns = 0;
+    const char *esp = "\033[0;32mI (1234) wifi: connected";
+    if (devclock_parse("[    1.234567] Booting", 22, &ns) != DEVCLOCK_PRINTK ||
+        ns != 1234567000ll ||
+        devclock_parse("[00:01:02.003,004] <inf> main", 29, &ns) !=
+            DEVCLOCK_ZEPHYR || ns != 62003004000ll ||
+        devclock_parse(esp, strlen(esp), &ns) != DEVCLOCK_TICKS ||
+        ns != 1234000000ll ||
+        devclock_parse("[2026-01-01 10:00:00.000] x", 27, &ns) !=
+            DEVCLOCK_NONE ||
+        devclock_parse("I (abc) x", 9, &ns) != DEVCLOCK_NONE ||
+        devclock_parse("[999999999999.000000] x", 23, &ns) !=
+            DEVCLOCK_NONE) {
+        FAIL("timestamp formats");
+        return;
+    }
+
+    /* a device clock 40 ppm fast, lines every 100 ms for 2 minutes,
+     * arriving 300 us to 3.3 ms after they were printed */
+    devclock_t dc;
+    devclock_init(&dc);
+    const uint64_t boot = 1000000000000ull;
+    unsigned seed = 7;
+    uint64_t emit = 0;
+    int64_t dev = 0;
+    for (int k = 0; k < 1200; k++) {
+        emit = boot + (uint64_t)k * 100000000ull;
+        dev = (int64_t)((double)(emit - boot) * (1 + 40e-6));
+        seed = seed * 1103515245u + 12345u;
+        uint64_t lat = 300000 + (k % 7 ? (seed >> 8) % 3000000 : 0);
+        if (devclock_observe(&dc, dev, emit + lat) != 0) {
+            FAIL("spurious reset");
+            return;
+        }
+    }
+    int64_t err = (int64_t)devclock_map(&dc, dev) - (int64_t)(emit + 300000);
+    double ppm = devclock_drift_ppm(&dc);
+    if (err < -50000 || err > 50000 || ppm < 35 || ppm > 45) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "err %lld ns, drift %.2f ppm",
+                 (long long)err, ppm);
+        FAIL(msg);
+        return;
+    }
+
+    /* reboot: the device clock starts over */
+    if (devclock_observe(&dc, 500000000ll, emit + 5000000000ull) != 1 ||
+        dc.resets != 1 || dc.npts != 0 ||
+        devclock_map(&dc, 500000000ll) != emit + 5000000000ull) {
+        FAIL("reset not detected");
+        return;
+    }
+    PASS();
+}
+
+/* Priority lines: class per port name, unknown classes rejected */
+static void
+test_config_priority(void)
+{
+    TEST("config: priority classes");
+
+    char path[] = "/tmp/uart-monitor-test-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) { FAIL("mkstemp"); return; }
+    const char *text =
+        "priority STM32H563_UART critical\n"
+        "priority /dev/ttyUSB3 bulk\n"
+        "priority ttyACM0 urgent\n";
+    ssize_t nw = write(fd, text, strlen(text));
+    close(fd);
+
+    config_t cfg;
+    config_defaults(&cfg);
+    int rc = config_load(&cfg, path);
+    unlink(path);
+    if (nw < 0 || rc < 0) { FAIL("config_load"); return; }
+
+    prio_class_t p;
+    if (cfg.priority_count != 2 ||
+        cfg.priorities[0].prio != PRIO_CRITICAL ||
+        strcmp(cfg.priorities[0].port, "STM32H563_UART") != 0 ||
+        cfg.priorities[1].prio != PRIO_BULK ||
+        !config_name_matches(cfg.priorities[1].port, "/dev/ttyUSB3",
+                             "ttyUSB3", "FTDI_A") ||
+        config_parse_priority("normal", &p) != 0 || p != PRIO_NORMAL ||
+        strcmp(config_priority_name(PRIO_BULK), "bulk") != 0) {
+        FAIL("wrong classes");
+        return;
+    }
+    PASS();
+}
+
+/* A device reset marker goes through the marker path: the stages after
+ * "clock" see it ahead of the line that showed the reset */
+static void
+test_devclock_reset_marker(void)
+{
+    TEST("devclock: reset marker reaches the stages");
+    char session_path[512];
+    log_create_session(session_path, sizeof(session_path));
+
+    devclock_t dc;
+    devclock_init(&dc);
+    recent_t *r = malloc(sizeof(*r));
+    log_file_t lf;
+    if (!r || log_open(&lf, session_path, "test_reset", "hdr\n") < 0) {
+        FAIL("log_open failed");
+        free(r);
+        return;
+    }
+    recent_reset(r);
+    log_add_stage(&lf, &log_stage_clock, &dc);
+    log_add_stage(&lf, &log_stage_recent, r);
+    const char *in = "[   10.000000] up\n[    0.500000] again\n";
+    log_write(&lf, in, strlen(in));
+    log_close(&lf);
+
+    char out[4096];
+    size_t len;
+    long long first = -1, next = -1;
+    recent_query_t q = { .max_lines = 0, .since_ns = 0, .after = -1 };
+    int lines = recent_query(r, &q, out, sizeof(out), &len, &first, &next);
+    out[len] = '\0';
+    free(r);
+    const char *m = strstr(out, "--- DEVICE RESET (printk clock went back) [");
+    const char *again = strstr(out, "again\n");
+    if (lines != 3 || !m || !again || m > again) {
+        FAIL("marker missing from the stages");
+        return;
+    }
+    PASS();
+}
+
+/* The recent-lines ring returns lines byte-identical to the log, at the
+ * log's offsets, and keeps only the newest when full */
+static void
+test_recent_tail(void)
+{
+    TEST("recent: TAIL ring matches the log");
+    char session_path[512];
+    log_create_session(session_path, sizeof(session_path));
+
+    recent_t *r = malloc(sizeof(*r));
+    log_file_t lf;
+    if (!r || log_open(&lf, session_path, "test_recent", "hdr\n") < 0) {
+        FAIL("log_open failed");
+        free(r);
+        return;
+    }
+    recent_reset(r);
+    log_add_stage(&lf, &log_stage_recent, r);
+    lf.timestamps = 1;
+    log_write(&lf, "one\r\ntwo\r\n", 10);
+    log_marker(&lf, "STEP");
+    log_write(&lf, "three\n", 6);
+    log_close(&lf);
+
+    FILE *fp = fopen(lf.filepath, "r");
+    char text[1024];
+    size_t n = fp ? fread(text, 1, sizeof(text) - 1, fp) : 0;
+    if (fp)
+        fclose(fp);
+    text[n] = '\0';
+
+    char out[4096];
+    size_t len;
+    long long first = -1, next = -1;
+    recent_query_t q = { .max_lines = 0, .since_ns = 0, .after = -1 };
+    int lines = recent_query(r, &q, out, sizeof(out), &len, &first, &next);
+    out[len] = '\0';
+    if (lines != 4 || next != (long long)n) {
+        FAIL("lines or offsets differ from the log");
+        free(r);
+        return;
+    }
+    /* each line sits at its offset */
+    const char *p = out;
+    long long off = first;
+    for (int i = 0; i < lines; i++) {
+        const char *nl = strchr(p, '\n');
+        if (strncmp(text + off, p, (size_t)(nl - p + 1)) != 0) {
+            FAIL("line not at its offset");
+            free(r);
+            return;
+        }
+        off += nl - p + 1;
+        if (i == 1 || i == 2)
+            off++;          /* blank lines around the marker */
+        p = nl + 1;
+    }
+
+    /* --after the marker: only "three"; 2 lines: marker and "three" */
+    q.after = next - 1;
+    lines = recent_query(r, &q, out, sizeof(out), &len, &first, &next);
+    q.after = -1;
+    q.max_lines = 2;
+    int last2 = recent_query(r, &q, out, sizeof(out), &len, &first, &next);
+    if (lines != 0 || last2 != 2 || strncmp(out, "--- STEP [", 10) != 0) {
+        FAIL("selection");
+        free(r);
+        return;
+    }
+
+    /* overflow by count and by bytes: the newest lines stay */
+    recent_reset(r);
+    char line[32];
+    for (int i = 0; i < RECENT_LINES + 100; i++) {
+        int m = snprintf(line, sizeof(line), "line %d", i);
+        recent_push(r, (long long)i * 100, (uint64_t)i, NULL, line,
+                    (size_t)m);
+    }
+    q.max_lines = 1;
+    recent_query(r, &q, out, sizeof(out), &len, &first, &next);
+    if (r->count != RECENT_LINES || recent_oldest(r) != 10000 ||
+        strncmp(out, "line 1123\n", 10) != 0) {
+        FAIL("count eviction");
+        free(r);
+        return;
+    }
+    char big[1000];
+    memset(big, 'x', sizeof(big));
+    for (int i = 0; i < 200; i++)
+        recent_push(r, 1000000 + i, 5000, "[ts] ", big, sizeof(big));
+    q.max_lines = 0;
+    q.since_ns = 5000;
+    lines = recent_query(r, &q, out, sizeof(out), &len, &first, &next);
+    if (r->text_used > RECENT_BYTES ||
+        r->count != RECENT_BYTES / (int)(sizeof(big) + 6) ||
+        lines != (int)(sizeof(out) / (sizeof(big) + 6))) {
+        FAIL("byte eviction");
+        free(r);
+        return;
+    }
+    free(r);
+    PASS();
+}
+
+/* Digest: repeats folded with offsets, progress to its final state,
+ * ANSI stripped, alerts never folded and kept with context */
+static void
+test_digest_condense(void)
+{
+    TEST("digest: fold repeats, keep errors");
+
+    char path[] = "/tmp/uart-monitor-test-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) { FAIL("mkstemp"); return; }
+    close(fd);
+
+    digest_t *d = malloc(sizeof(*d));
+    if (!d) { FAIL("malloc"); unlink(path); return; }
+    digest_init(d);
+    if (digest_open(d, path) < 0) { FAIL("digest_open"); free(d); return; }
+
+    char line[128];
+    long long off = 0;
+    uint64_t ns = 1000;
+#define FEED(s) do { digest_line(d, "", s, strlen(s), off, ns); \
+                     off += (long long)strlen(s) + 1; ns += 1000; } while (0)
+    FEED("\033[0;32mboot ok\033[0m");
+    for (int i = 0; i < 100; i++) {
+        snprintf(line, sizeof(line), "HB %d uptime=%d", i, i * 10);
+        FEED(line);
+    }
+    for (int i = 0; i <= 100; i += 5) {
+        snprintf(line, sizeof(line), "flash: %d%%", i);
+        FEED(line);
+    }
+    FEED("i2c: ERROR nack at 0x50");
+    FEED("i2c: ERROR nack at 0x51");
+    FEED("retrying");
+    FEED("HB 100 uptime=1000");
+    digest_marker(d, "--- CHECKPOINT cp1 ---", 22);
+    digest_close(d);
+#undef FEED
+
+    FILE *fp = fopen(path, "r");
+    char text[1024];
+    size_t n = fp ? fread(text, 1, sizeof(text) - 1, fp) : 0;
+    if (fp)
+        fclose(fp);
+    unlink(path);
+    text[n] = '\0';
+
+    const char *want =
+        "boot ok\n"
+        "HB 0 uptime=0\n"
+        "... 98 similar lines (log 33-1681) ...\n"
+        "HB 99 uptime=990\n"
+        "flash: 100%  [21 updates]\n"
+        "i2c: ERROR nack at 0x50\n"
+        "i2c: ERROR nack at 0x51\n"
+        "retrying\n"
+        "HB 100 uptime=1000\n"
+        "--- CHECKPOINT cp1 ---\n";
+    int ok = strcmp(text, want) == 0 && d->lines_in == 126 &&
+             d->alerts == 2 && d->bytes_out == n &&
+             digest_is_progress("[=====>    ] 3/9", 16) == 0 &&
+             digest_is_progress("##########", 10) == 1;
+    free(d);
+    if (!ok) {
+        printf("\n%s", text);
+        FAIL("wrong digest");
+        return;
+    }
+    PASS();
+}
+
+/* Dedup store: five boots with different timestamps on two ports share
+ * their chunks, and every block is rebuilt byte for byte */
+static void
+test_archive_dedup_store(void)
+{
+    TEST("archive: dedup store, same boot stored once");
+
+    char dir[] = "/tmp/uart-monitor-test-XXXXXX";
+    if (!mkdtemp(dir)) { FAIL("mkdtemp"); return; }
+    char path[300], store[256];
+    static char want[2][131072];
+    size_t want_len[2] = { 0, 0 };
+    const char *ports[] = { "A", "B" };
+    for (int p = 0; p < 2; p++) {
+        int ms = p * 7;
+        for (int boot = 0; boot < 5; boot++) {
+            for (int i = 0; i < 400; i++, ms += 13)
+                want_len[p] += (size_t)snprintf(
+                    want[p] + want_len[p], sizeof(want[p]) - want_len[p],
+                    "[2026-01-01 10:%02d:%02d.%03d] [ %d.%03d] dev%d: "
+                    "probed\n", ms / 60000, ms / 1000 % 60, ms % 1000,
+                    i / 100, i % 100, i);
+        }
+        snprintf(path, sizeof(path), "%s/%s.log", dir, ports[p]);
+        FILE *fp = fopen(path, "w");
+        fwrite(want[p], 1, want_len[p], fp);
+        fclose(fp);
+    }
+
+    snprintf(store, sizeof(store), "%s/store", dir);
+    snprintf(path, sizeof(path), "%s/s.umd", store);
+    archive_opts_t o = { .store = store, .jobs = 2 };
+    archive_stats_t st;
+    archive_t a;
+    int ok = archive_export(dir, path, &o, &st) == 0 &&
+             archive_open(&a, path) == 0;
+    if (!ok) { FAIL("export/open failed"); return; }
+
+    /* the chunks of about one boot are new, the rest are shared */
+    ok = a.store && a.nstreams == 2 && st.chunks > 10 &&
+         st.new_chunks * 3 < st.chunks &&
+         st.stored_bytes * 4 < st.raw_bytes;
+    for (uint32_t s = 0; ok && s < a.nstreams; s++) {
+        const archive_stream_t *as = &a.streams[s];
+        size_t n = 0;
+        for (uint32_t i = as->first_block;
+             ok && i < as->first_block + as->nblocks; i++) {
+            char *raw = archive_read_block(&a, i);
+            ok = raw && n + a.blocks[i].raw_len <= want_len[s] &&
+                 memcmp(raw, want[s] + n, a.blocks[i].raw_len) == 0;
+            n += a.blocks[i].raw_len;
+            free(raw);
+        }
+        ok = ok && n == want_len[s];
+    }
+    archive_close(&a);
+
+    char cmd[300];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0)
+        ok = 0;
+    if (!ok) { FAIL("chunks not shared or streams not rebuilt"); return; }
+    PASS();
+}
+
+/* TOPLINES: the heavy templates surface over hundreds of rare ones, with
+ * counts never below the truth */
+static void
+test_toplines_heavy_hitters(void)
+{
+    TEST("toplines: heavy templates over churn");
+
+    toplines_t *t = malloc(sizeof(*t));
+    if (!t) { FAIL("malloc"); return; }
+    toplines_reset(t);
+    char line[64];
+    for (int i = 0; i < 3000; i++) {
+        int n;
+        if (i % 3 == 0)
+            n = snprintf(line, sizeof(line), "HB uptime=%d", i);
+        else if (i % 10 == 1)
+            n = snprintf(line, sizeof(line), "eth0: rx 0x%08x", i * 4099);
+        else                        /* 1800 templates, once each */
+            n = snprintf(line, sizeof(line), "evt %c%c%c", 'a' + i % 26,
+                         'a' + i / 26 % 26, 'a' + i / 676 % 26);
+        toplines_add(t, line, (size_t)n);
+    }
+
+    int order[TOPLINES_K];
+    int count = toplines_sorted(t, order);
+    const toplines_entry_t *a = &t->entry[order[0]];
+    const toplines_entry_t *b = &t->entry[order[1]];
+    int ok = count == TOPLINES_K && t->lines == 3000 &&
+             strncmp(a->text, "HB uptime", 9) == 0 &&
+             a->lines >= 1000 && a->lines < 1050 &&
+             strncmp(b->text, "eth0: rx", 8) == 0 && b->lines >= 200 &&
+             t->entry[order[count - 1]].lines <= b->lines;
+    free(t);
+    if (!ok) { FAIL("wrong top templates"); return; }
+    PASS();
+}
+
+static void
+test_classify_kinds(void)
+{
+    TEST("classify: text, binary, mis-baud");
+
+    classify_t c;
+    char buf[CLASSIFY_WINDOW];
+    size_t n = 0;
+    classify_init(&c, CONTENT_UNKNOWN);
+    while (n + 64 < sizeof(buf))      /* a boot log, some of it UTF-8 */
+        n += (size_t)snprintf(buf + n, sizeof(buf) - n,
+                              "[%6zu] probe \xc2\xb5s ok\r\n", n);
+    memset(buf + n, '.', sizeof(buf) - n);
+    if (classify_feed(&c, buf, sizeof(buf)) != sizeof(buf) ||
+        !classify_full(&c) || classify_decide(&c, -1) != 1 ||
+        c.kind != CONTENT_TEXT) {
+        FAIL("boot log not text"); return;
+    }
+
+    /* a binary protocol: one window is a burst, two are a switch */
+    uint32_t x = 12345;
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        x = x * 1103515245u + 12345u;
+        buf[i] = i % 32 == 0 ? (char)0xc0 : (char)(x >> 24);
+    }
+    classify_feed(&c, buf, sizeof(buf));
+    if (classify_decide(&c, -1) != 0 || c.kind != CONTENT_TEXT) {
+        FAIL("switched on one window"); return;
+    }
+    classify_feed(&c, buf, sizeof(buf));
+    if (classify_decide(&c, -1) != 1 || c.kind != CONTENT_BINARY ||
+        c.switches != 1) {
+        FAIL("binary frames not binary"); return;
+    }
+
+    /* mostly letters with a few stray bytes: lines of one length read
+     * as glitchy text, line ends at random as binary */
+    for (int random_ends = 0; random_ends < 2; random_ends++) {
+        classify_t t;
+        classify_init(&t, CONTENT_UNKNOWN);
+        for (size_t i = 0; i < sizeof(buf); i++) {
+            x = x * 1103515245u + 12345u;
+            int end = random_ends ? (x >> 16) % 24 == 0 : i % 40 == 39;
+            buf[i] = end ? '\n' : (x >> 16) % 10 == 0 ? (char)0x90 :
+                     (char)('a' + (x >> 20) % 26);
+        }
+        classify_feed(&t, buf, sizeof(buf));
+        uint32_t bits = classify_len_bits(&t);
+        if (classify_window(&t, -1) !=
+            (random_ends ? CONTENT_BINARY : CONTENT_TEXT)) {
+            printf("len_bits=%u ", bits);
+            FAIL("line length spread"); return;
+        }
+    }
+
+    /* "OK\r\n" sampled far too fast: runs of zeros and ones */
+    static const unsigned char runs[] = { 0x00, 0x80, 0xe0, 0xf8, 0xfe,
+                                          0xc0, 0x00, 0xf0, 0xff };
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = (char)runs[(i * 7 + i / 5) % sizeof(runs)];
+    classify_feed(&c, buf, sizeof(buf));
+    classify_decide(&c, -1);
+    classify_feed(&c, buf, sizeof(buf));
+    if (classify_decide(&c, -1) != 1 || c.kind != CONTENT_MISBAUD) {
+        FAIL("bit runs not mis-baud"); return;
+    }
+
+    /* framing errors decide whatever the bytes look like; zero padding
+     * alone is binary, and a pinned port never changes */
+    classify_init(&c, CONTENT_UNKNOWN);
+    memset(buf, 'A', sizeof(buf));
+    classify_feed(&c, buf, sizeof(buf));
+    if (classify_window(&c, 64) != CONTENT_MISBAUD ||
+        classify_window(&c, 0) != CONTENT_TEXT) {
+        FAIL("frame errors ignored"); return;
+    }
+    memset(buf, 0, sizeof(buf) / 2);
+    classify_init(&c, CONTENT_UNKNOWN);
+    classify_feed(&c, buf, sizeof(buf));
+    if (classify_window(&c, -1) != CONTENT_BINARY) {
+        FAIL("zero padding not binary"); return;
+    }
+    classify_init(&c, CONTENT_BINARY);
+    memset(buf, 'A', sizeof(buf));
+    classify_feed(&c, buf, sizeof(buf));
+    classify_feed(&c, buf, sizeof(buf));
+    if (classify_decide(&c, -1) != 0 || c.kind != CONTENT_BINARY) {
+        FAIL("forced kind changed"); return;
+    }
+
+    char line[CLASSIFY_HEX_LINE];
+    size_t len = classify_hexline("\x7e" "AB\n", 4, 0x20, line);
+    const char *want = "00000020  7e 41 42 0a"
+                       "                                      |~AB.|\n";
+    if (len != strlen(want) || memcmp(line, want, len) != 0) {
+        FAIL("hex line"); return;
+    }
+    PASS();
+}
+
+/* A port of a hand-built monitor state reading from fd. */
+static int
+sched_port(monitor_state_t *st, const char *session, const char *label,
+           int fd)
+{
+    monitored_port_t *mp = &st->ports[st->port_count];
+    memset(mp, 0, sizeof(*mp));
+    strlcpy_safe(mp->identity.label, label, sizeof(mp->identity.label));
+    strlcpy_safe(mp->identity.dev_path, label,
+                 sizeof(mp->identity.dev_path));
+    mp->serial.fd = fd;
+    mp->serial.pty_master = -1;
+    mp->serial.pty_slave = -1;
+    mp->serial.source = SOURCE_FIFO;
+    mp->link_idx = -1;
+    mp->raw_fd = -1;
+    mp->prio = PRIO_NORMAL;
+    if (log_open(&mp->log, session, label, NULL) < 0)
+        return -1;
+    return st->port_count++;
+}
+
+static void
+test_schedule_flood_and_quiet(void)
+{
+    TEST("schedule_ports: flood, quiet, credit");
+    static monitor_state_t st;
+    memset(&st, 0, sizeof(st));
+    char session[512];
+    log_create_session(session, sizeof(session));
+
+    /* flood: 64 KiB waiting; quiet: one line; chunky: data arrives in
+     * pieces smaller than a read, as from a tty's flip buffer */
+    int flood[2], quiet[2], chunky[2];
+    if (pipe(flood) < 0 || pipe(quiet) < 0 ||
+        socketpair(AF_UNIX, SOCK_SEQPACKET, 0, chunky) < 0) {
+        FAIL("pipes"); return;
+    }
+    fcntl(flood[0], F_SETFL, O_NONBLOCK);
+    fcntl(quiet[0], F_SETFL, O_NONBLOCK);
+    fcntl(chunky[0], F_SETFL, O_NONBLOCK);
+    fcntl(flood[1], F_SETFL, O_NONBLOCK);
+    static char blob[65536];
+    memset(blob, 'x', sizeof(blob));
+    size_t flooded = 0;
+    ssize_t nw;
+    while ((nw = write(flood[1], blob, sizeof(blob) - flooded)) > 0 &&
+           (flooded += (size_t)nw) < sizeof(blob))
+        ;
+    nw = write(quiet[1], "boot ok\n", 8);
+    for (int i = 0; i < 8; i++)
+        nw = write(chunky[1], blob, 1000);
+    (void)nw;
+
+    int f = sched_port(&st, session, "SCHED_FLOOD", flood[0]);
+    int q = sched_port(&st, session, "SCHED_QUIET", quiet[0]);
+    int c = sched_port(&st, session, "SCHED_CHUNKY", chunky[0]);
+    const char *fail = NULL;
+    if (f < 0 || q < 0 || c < 0)
+        fail = "log_open failed";
+
+    char buf[4096];
+    size_t quantum = 4 * sizeof(buf);       /* normal class */
+    for (int round = 0; round < 2 && !fail; round++) {
+        st.ports[f].ready = st.ports[c].ready = 1;
+        st.ports[q].ready = round == 0;
+        schedule_ports(&st, buf, sizeof(buf), mono_ns());
+        if (st.ports[f].bytes_read != quantum * (size_t)(round + 1) ||
+            st.ports[f].deficit != 0)
+            fail = "flood not held to its quantum";
+        else if (st.ports[q].bytes_read != 8)
+            fail = "quiet line not read";
+        else if (round == 0 && st.ports[q].deficit != quantum - 8)
+            fail = "short read lost the quiet port's credit";
+        else if (round == 1 && st.ports[q].deficit != 0)
+            fail = "idle port kept its credit";
+        else if (st.ports[c].bytes_read != 1000 * (size_t)(round + 1))
+            fail = "chunky port not read";
+        else if (st.ports[c].deficit !=
+                 (round == 0 ? quantum - 1000 : quantum))
+            fail = "backlogged port lost or overran its credit";
+    }
+    if (!fail && (st.sched[PRIO_NORMAL].backlogged != 2 ||
+                  st.sched[PRIO_NORMAL].services != 5))
+        fail = "class counters";
+    if (!fail && st.ports[f].reads != 8)
+        fail = "reads not counted";
+
+    /* nothing reported for the chunky port: its credit goes */
+    st.ports[f].ready = 1;
+    schedule_ports(&st, buf, sizeof(buf), mono_ns());
+    if (!fail && st.ports[c].deficit != 0)
+        fail = "credit kept without backlog";
+
+    for (int i = 0; i < st.port_count; i++)
+        log_close(&st.ports[i].log);
+    close(flood[0]); close(flood[1]);
+    close(quiet[0]); close(quiet[1]);
+    close(chunky[0]); close(chunky[1]);
+    if (fail) { FAIL(fail); return; }
+    PASS();
+}
+
+/* A port of a hand-built state with just an identity. */
+static void
+group_port(monitor_state_t *st, const char *tty, const char *serial,
+           const char *usb_path, int iface)
+{
+    tty_port_t *id = &st->ports[st->port_count++].identity;
+    memset(id, 0, sizeof(*id));
+    snprintf(id->dev_path, sizeof(id->dev_path), "/dev/%s", tty);
+    strlcpy_safe(id->tty_name, tty, sizeof(id->tty_name));
+    snprintf(id->label, sizeof(id->label), "L_%s", tty);
+    strlcpy_safe(id->serial, serial, sizeof(id->serial));
+    strlcpy_safe(id->usb_path, usb_path, sizeof(id->usb_path));
+    id->vid = 0x0403;
+    id->pid = 0x6011;
+    id->interface_num = iface;
+}
+
+static void
+test_select_group(void)
+{
+    TEST("select_ports: board:, group:, hidden");
+    static monitor_state_t st;
+    memset(&st, 0, sizeof(st));
+    /* a quad UART listed out of interface order, a second board with
+     * no serial number, a port not on USB */
+    group_port(&st, "ttyUSB2", "BRD1", "1-6", 2);
+    group_port(&st, "ttyUSB0", "BRD1", "1-6", 0);
+    group_port(&st, "ttyUSB1", "BRD1", "1-6", 1);
+    group_port(&st, "ttyUSB5", "", "1-7", 0);
+    group_port(&st, "ttyUSB6", "", "1-7", 1);
+    group_port(&st, "ttyS0", "", "", 0);
+    st.ports[3].identity.board_override = "SPARE";
+
+    int sel[MAX_PORTS];
+    const char *fail = NULL;
+    int n = select_ports(&st, "board:BRD1", 0, sel);
+    if (n != 3 || sel[0] != 1 || sel[1] != 2 || sel[2] != 0)
+        fail = "board: not all interfaces in order";
+    else if (select_ports(&st, "board:", 0, sel) != 0)
+        fail = "empty board id matched ports without a serial";
+    else if (select_ports(&st, "board:SPARE", 0, sel) != 1 || sel[0] != 3)
+        fail = "board override not matched";
+    else if ((n = select_ports(&st, "group:L_ttyUSB6", 0, sel)) != 2 ||
+             sel[0] != 3 || sel[1] != 4)
+        fail = "group: of a serial-less device";
+    else if (select_ports(&st, "group:ttyS0", 0, sel) != 1 || sel[0] != 5)
+        fail = "port off USB not a group of one";
+    else if (select_ports(&st, "group:nope", 0, sel) != 0)
+        fail = "unknown group matched";
+    else if (select_ports(&st, "/dev/ttyUSB1", 1, sel) != 1 || sel[0] != 2)
+        fail = "single port by path";
+
+    /* a restricted client sees only the port it is allowed */
+    acl_peer_t peer;
+    memset(&peer, 0, sizeof(peer));
+    peer.uid = 4242;
+    strlcpy_safe(peer.user, "alice", sizeof(peer.user));
+    strlcpy_safe(st.config.acls[0].port, "ttyUSB1",
+                 sizeof(st.config.acls[0].port));
+    strlcpy_safe(st.config.acls[0].who, "alice",
+                 sizeof(st.config.acls[0].who));
+    st.config.acl_count = 1;
+    st.peer = &peer;
+    if (!fail && (select_ports(&st, "board:BRD1", 0, sel) != 1 ||
+                  sel[0] != 2))
+        fail = "hidden ports selected by board:";
+    if (!fail && select_ports(&st, "group:ttyUSB0", 0, sel) != 0)
+        fail = "group: of a hidden port";
+    if (!fail && (select_ports(&st, "group:ttyUSB1", 0, sel) != 1 ||
+                  sel[0] != 2))
+        fail = "hidden ports selected by group:";
+    st.peer = NULL;
+
+    if (fail) { FAIL(fail); return; }
+    PASS();
+}
+
+/* ------------------------------------------------------------------ */
+/*  Daemon tests: the real ./uart-monitor, PTY ports only              */
+/* ------------------------------------------------------------------ */
+
+#define DAEMON_EMPTY_ROOT "/tmp/uart-monitor-test-empty"
+
+/* Connect to the daemon's control socket, or -1. */
+static int
+daemon_connect(void)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy_safe(addr.sun_path, CONTROL_SOCK_PATH, sizeof(addr.sun_path));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    /* a stuck daemon fails the test instead of hanging it */
+    struct timeval tv = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+/* Send cmd and read the reply until the daemon closes. Returns 0 on an
+ * "OK" reply. */
+static int
+daemon_ctl(const char *cmd, char *resp, size_t sz)
+{
+    resp[0] = '\0';
+    int fd = daemon_connect();
+    if (fd < 0)
+        return -1;
+    ssize_t nw = write(fd, cmd, strlen(cmd));
+    (void)nw;
+    size_t off = 0;
+    ssize_t n;
+    while (off < sz - 1 && (n = read(fd, resp + off, sz - 1 - off)) > 0)
+        off += (size_t)n;
+    resp[off] = '\0';
+    close(fd);
+    return strncmp(resp, "OK", 2) == 0 ? 0 : -1;
+}
+
+/* Start a daemon on the given device and sysfs trees (NULL: empty ones,
+ * no ports). Returns its pid, 0 if one is already running (the test is
+ * skipped), -1 on failure. */
+static pid_t
+daemon_start(const char *dev_root, const char *sysfs_root)
+{
+    int probe = daemon_connect();
+    if (probe >= 0) {
+        close(probe);
+        return 0;
+    }
+    mkdirp(DAEMON_EMPTY_ROOT);
+
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+            close(devnull);
+        }
+        execl("./uart-monitor", "uart-monitor", "monitor", "-f",
+              "--dev-root", dev_root ? dev_root : DAEMON_EMPTY_ROOT,
+              "--sysfs-root", sysfs_root ? sysfs_root : DAEMON_EMPTY_ROOT,
+              (char *)NULL);
+        _exit(127);
+    }
+
+    char resp[CONTROL_MAX_MSG];
+    for (int i = 0; i < 50; i++) {
+        usleep(100000);
+        if (daemon_ctl("STATUS\n", resp, sizeof(resp)) == 0 ||
+            resp[0] == '{')
+            return pid;
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+            return -1;
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static void
+daemon_stop(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+/* Wait up to ms for text to appear in the file at path. */
+static int
+file_has_within(const char *path, const char *text, int ms)
+{
+    char buf[8192];
+    for (int waited = 0; waited <= ms; waited += 20) {
+        FILE *fp = fopen(path, "r");
+        if (fp) {
+            size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+            buf[n] = '\0';
+            fclose(fp);
+            if (strstr(buf, text))
+                return 1;
+        }
+        usleep(20000);
+    }
+    return 0;
+}
+
+/* ADD a fresh PTY as a port; *master is its writing end, log its file. */
+static int
+daemon_add_pty(const char *label, int *master, char *log, size_t log_sz)
+{
+    int slave;
+    if (openpty(master, &slave, NULL, NULL, NULL) < 0)
+        return -1;
+    char cmd[256], resp[CONTROL_MAX_MSG];
+    snprintf(cmd, sizeof(cmd), "ADD %s %s\n", ttyname(slave), label);
+    close(slave);
+    if (daemon_ctl(cmd, resp, sizeof(resp)) < 0) {
+        close(*master);
+        return -1;
+    }
+    /* "OK added <dev> <log file>" */
+    char *sp = strrchr(resp, ' ');
+    strlcpy_safe(log, sp ? sp + 1 : "", log_sz);
+    log[strcspn(log, "\n")] = '\0';
+    return 0;
+}
+
+static void
+test_daemon_silent_client(void)
+{
+    TEST("daemon: stuck clients, capture goes on");
+    pid_t pid = daemon_start(NULL, NULL);
+    if (pid == 0) { printf("SKIP (daemon already running)\n"); return; }
+    if (pid < 0) { FAIL("daemon did not start"); return; }
+
+    int master;
+    char log[512];
+    if (daemon_add_pty("SILENT_TEST", &master, log, sizeof(log)) < 0) {
+        FAIL("ADD failed");
+        daemon_stop(pid);
+        return;
+    }
+
+    /* connects, never sends a command */
+    int silent = daemon_connect();
+    const char *fail = NULL;
+    char resp[CONTROL_MAX_MSG];
+    ssize_t nw = write(master, "captured while waiting\n", 23);
+    (void)nw;
+    if (silent < 0)
+        fail = "cannot connect";
+    else if (!file_has_within(log, "captured while waiting", 500))
+        fail = "port not read while a client is silent";
+    else if (daemon_ctl("STATUS\n", resp, sizeof(resp)) < 0 &&
+             resp[0] != '{')
+        fail = "other clients not served";
+
+    /* the daemon gives up on it: EOF */
+    if (!fail) {
+        struct pollfd pfd = { .fd = silent, .events = POLLIN };
+        char c;
+        if (poll(&pfd, 1, 3000) != 1 || read(silent, &c, 1) != 0)
+            fail = "silent client not closed";
+    }
+    if (!fail && (daemon_ctl("METRICS\n", resp, sizeof(resp)) < 0 ||
+                  !strstr(resp, "control_dropped=1")))
+        fail = "drop not counted";
+
+    /* OPEN --digest goes through the same lookup: no digest here */
+    if (!fail) {
+        daemon_ctl("OPEN SILENT_TEST --digest\n", resp, sizeof(resp));
+        if (strncmp(resp, "ERROR no digest for SILENT_TEST", 31) != 0)
+            fail = "OPEN --digest";
+    }
+
+    /* asks and hangs up before the reply: EPIPE, not SIGPIPE */
+    int gone = fail ? -1 : daemon_connect();
+    if (gone >= 0) {
+        nw = write(gone, "TAIL SILENT_TEST\n", 17);
+        close(gone);
+        usleep(100000);
+        if (daemon_ctl("METRICS\n", resp, sizeof(resp)) < 0 ||
+            !strstr(resp, "control_dropped=1"))
+            fail = "daemon lost to a client that hung up";
+    }
+
+    if (silent >= 0)
+        close(silent);
+    close(master);
+    daemon_stop(pid);
+    if (fail) { FAIL(fail); return; }
+    PASS();
+}
+
+/* Replies longer than CONTROL_MAX_MSG come through whole. */
+static void
+test_daemon_long_replies(void)
+{
+    TEST("daemon: long STATUS/METRICS replies whole");
+    pid_t pid = daemon_start(NULL, NULL);
+    if (pid == 0) { printf("SKIP (daemon already running)\n"); return; }
+    if (pid < 0) { FAIL("daemon did not start"); return; }
+
+    enum { PORTS = 24 };
+    int master[PORTS], added = 0;
+    const char *fail = NULL;
+    for (; added < PORTS && !fail; added++) {
+        char label[32], log[512];
+        snprintf(label, sizeof(label), "LONG_%d", added);
+        if (daemon_add_pty(label, &master[added], log, sizeof(log)) < 0)
+            fail = "ADD failed";
+    }
+    if (fail)
+        added--;
+
+    size_t sz = 16 * CONTROL_MAX_MSG;
+    char *resp = malloc(sz);
+    if (!fail && !resp)
+        fail = "malloc";
+    if (!fail) {
+        daemon_ctl("STATUS\n", resp, sz);
+        size_t n = strlen(resp);
+        while (n > 0 && resp[n - 1] == '\n')
+            n--;
+        if (n <= CONTROL_MAX_MSG || resp[0] != '{' || resp[n - 1] != '}' ||
+            !strstr(resp, "LONG_23"))
+            fail = "STATUS cut short";
+    }
+    /* class lines come after every port and stage line */
+    if (!fail && (daemon_ctl("METRICS\n", resp, sz) < 0 ||
+                  strlen(resp) <= CONTROL_MAX_MSG ||
+                  !strstr(resp, "port LONG_23 ") ||
+                  !strstr(resp, "\nclass bulk ")))
+        fail = "METRICS cut short";
+
+    free(resp);
+    for (int i = 0; i < added; i++)
+        close(master[i]);
+    daemon_stop(pid);
+    if (fail) { FAIL(fail); return; }
+    PASS();
+}
+
+/* Listen on 127.0.0.1:*port (0: any free port, set on return). */
+static int
+tcp_listen(int *port)
+{
+    struct sockaddr_in sin;
+    socklen_t slen = sizeof(sin);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sin.sin_port = htons((uint16_t)*port);
+    int one = 1;
+    int ls = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (ls < 0)
+        return -1;
+    setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(ls, (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+        listen(ls, 1) < 0 ||
+        getsockname(ls, (struct sockaddr *)&sin, &slen) < 0) {
+        close(ls);
+        return -1;
+    }
+    *port = ntohs(sin.sin_port);
+    return ls;
+}
+
+/* Accept within ms, or -1. */
+static int
+accept_within(int ls, int ms)
+{
+    struct pollfd pfd = { .fd = ls, .events = POLLIN };
+    if (poll(&pfd, 1, ms) != 1)
+        return -1;
+    return accept(ls, NULL, NULL);
+}
+
+static void
+test_daemon_source_reconnect(void)
+{
+    TEST("daemon: tcp source lost, backoff, back");
+    pid_t pid = daemon_start(NULL, NULL);
+    if (pid == 0) { printf("SKIP (daemon already running)\n"); return; }
+    if (pid < 0) { FAIL("daemon did not start"); return; }
+
+    int port = 0;
+    int ls = tcp_listen(&port);
+    char cmd[128], resp[CONTROL_MAX_MSG], log[512] = "";
+    snprintf(cmd, sizeof(cmd), "ADD tcp:127.0.0.1:%d RECONNECT_TEST\n",
+             port);
+    const char *fail = NULL;
+    if (ls < 0)
+        fail = "tcp listen";
+    else if (daemon_ctl(cmd, resp, sizeof(resp)) < 0)
+        fail = "ADD failed";
+    if (!fail) {
+        char *sp = strrchr(resp, ' ');
+        strlcpy_safe(log, sp ? sp + 1 : "", sizeof(log));
+        log[strcspn(log, "\n")] = '\0';
+    }
+
+    int c = fail ? -1 : accept_within(ls, 2000);
+    if (!fail && (c < 0 || write(c, "first boot\n", 11) != 11 ||
+                  !file_has_within(log, "first boot", 1000)))
+        fail = "first connection not logged";
+
+    /* the peer goes away and stays away through a few retries */
+    if (c >= 0)
+        close(c);
+    if (ls >= 0)
+        close(ls);
+    ls = -1;
+    if (!fail && !file_has_within(log, "SOURCE DISCONNECTED", 1000))
+        fail = "loss not marked";
+    if (!fail) {
+        usleep(1000000);
+        ls = tcp_listen(&port);
+        c = ls < 0 ? -1 : accept_within(ls, 5000);
+        if (c < 0 || write(c, "second boot\n", 12) != 12 ||
+            !file_has_within(log, "second boot", 1000))
+            fail = "not reconnected";
+        if (c >= 0)
+            close(c);
+    }
+    if (!fail && (daemon_ctl("STATUS\n", resp, sizeof(resp)) < 0 &&
+                  resp[0] != '{'))
+        fail = "no status";
+    if (!fail && !strstr(resp, "\"connects\": 2"))
+        fail = "connects not 2";
+
+    if (ls >= 0)
+        close(ls);
+    daemon_stop(pid);
+    if (fail) { FAIL(fail); return; }
+    PASS();
+}
+
+static void
+put_file(const char *path, const char *text)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp) {
+        fputs(text, fp);
+        fclose(fp);
+    }
+}
+
+/* A synthetic FT4232H (0403:6011, serial FT4BRD01) under root: sysfs in
+ * root/sys, root/dev/ttyUSB<i> links to PTYs whose masters go in m. */
+static int
+fake_quad_uart(const char *root, int m[4])
+{
+    char usb[256], path[512], target[512];
+    snprintf(usb, sizeof(usb), "%s/sys/devices/pci0/usb1/1-6", root);
+    mkdirp(usb);
+    const char *attrs[][2] = {
+        { "idVendor", "0403\n" }, { "idProduct", "6011\n" },
+        { "serial", "FT4BRD01\n" }, { "product", "Quad RS232-HS\n" },
+        { "manufacturer", "FTDI\n" },
+    };
+    for (size_t i = 0; i < sizeof(attrs) / sizeof(attrs[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", usb, attrs[i][0]);
+        put_file(path, attrs[i][1]);
+    }
+    snprintf(path, sizeof(path), "%s/dev", root);
+    mkdirp(path);
+    for (int i = 0; i < 4; i++) {
+        int slave;
+        if (openpty(&m[i], &slave, NULL, NULL, NULL) < 0)
+            return -1;
+        snprintf(target, sizeof(target), "%s/1-6:1.%d/ttyUSB%d", usb, i, i);
+        mkdirp(target);
+        snprintf(path, sizeof(path), "%s/1-6:1.%d/bInterfaceNumber", usb, i);
+        put_file(path, i == 0 ? "00\n" : i == 1 ? "01\n" :
+                       i == 2 ? "02\n" : "03\n");
+        snprintf(path, sizeof(path), "%s/sys/class/tty/ttyUSB%d", root, i);
+        mkdirp(path);
+        strcat(path, "/device");
+        if (symlink(target, path) < 0)
+            return -1;
+        snprintf(path, sizeof(path), "%s/dev/ttyUSB%d", root, i);
+        if (symlink(ttyname(slave), path) < 0)
+            return -1;
+        close(slave);
+    }
+    return 0;
+}
+
+static void
+test_daemon_board_group(void)
+{
+    TEST("daemon: group yield, reclaim, clear");
+    char root[64], dev[128], cmd[256], resp[CONTROL_MAX_MSG];
+    snprintf(root, sizeof(root), "/tmp/uart-monitor-test-grp-%d",
+             (int)getpid());
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    if (system(cmd) != 0) { FAIL("cannot clean fake tree"); return; }
+    int m[4] = { -1, -1, -1, -1 };
+    char sysfs[96], devs[96];
+    snprintf(sysfs, sizeof(sysfs), "%s/sys", root);
+    snprintf(devs, sizeof(devs), "%s/dev", root);
+    if (fake_quad_uart(root, m) < 0) { FAIL("fake sysfs"); return; }
+
+    pid_t pid = daemon_start(devs, sysfs);
+    if (pid == 0) { printf("SKIP (daemon already running)\n"); return; }
+    if (pid < 0) { FAIL("daemon did not start"); return; }
+
+    const char *fail = NULL;
+    daemon_ctl("YIELD board:FT4BRD01\n", resp, sizeof(resp));
+    char want[512];
+    snprintf(want, sizeof(want),
+             "OK yielded board:FT4BRD01 4 port(s)\n%s/ttyUSB0 ", devs);
+    if (strncmp(resp, want, strlen(want)) != 0)
+        fail = "board yield";
+    snprintf(want, sizeof(want), "%s/ttyUSB3 ", devs);
+    if (!fail && (!strstr(resp, want) || strstr(resp, "already")))
+        fail = "board yield: not every interface";
+    if (!fail && daemon_ctl("YIELD board:\n", resp, sizeof(resp)) == 0)
+        fail = "empty board id accepted";
+
+    /* one interface cannot be reopened: the rest still are */
+    snprintf(dev, sizeof(dev), "%s/ttyUSB2", devs);
+    unlink(dev);
+    if (!fail) {
+        daemon_ctl("RECLAIM group:ttyUSB0\n", resp, sizeof(resp));
+        int reopened = 0;
+        for (const char *p = resp; (p = strstr(p, "reopen_ms=")); p++)
+            reopened++;
+        snprintf(want, sizeof(want), "%s/ttyUSB2 ", devs);
+        const char *bad = strstr(resp, want);
+        const char *err = bad ? strstr(bad, " error=") : NULL;
+        const char *eol = bad ? strchr(bad, '\n') : NULL;
+        if (strncmp(resp, "OK reclaimed group:ttyUSB0 4 port(s)\n", 37))
+            fail = "partial reclaim not OK";
+        else if (reopened != 3)
+            fail = "reopen_ms not reported per port";
+        else if (!err || (eol && err > eol))
+            fail = "failed port not reported";
+    }
+    snprintf(cmd, sizeof(cmd), "RECLAIM %s\n", dev);
+    if (!fail && (daemon_ctl(cmd, resp, sizeof(resp)) == 0 ||
+                  strncmp(resp, "ERROR", 5) != 0))
+        fail = "all-failed reclaim not an error";
+
+    /* and the reclaimed ports capture again */
+    ssize_t nw = write(m[1], "after reclaim\n", 14);
+    (void)nw;
+    daemon_ctl("STATUS\n", resp, sizeof(resp));
+    char *logf = strstr(resp, "ttyUSB1");
+    char log[512] = "";
+    if (logf && (logf = strstr(logf, "\"log_file\": \"")))
+        sscanf(logf + 13, "%511[^\"]", log);
+    if (!fail && !file_has_within(log, "after reclaim", 1000))
+        fail = "reclaimed port not read";
+
+    if (!fail && daemon_ctl("CLEAR board:FT4BRD01 --name grp1\n", resp,
+                            sizeof(resp)) < 0)
+        fail = "group clear";
+    if (!fail && strncmp(resp, "OK checkpoint grp1 4 port(s)", 28) != 0)
+        fail = "group clear: not every port";
+    if (!fail) {
+        char index_path[512];
+        snprintf(index_path, sizeof(index_path), "%s/latest/%s",
+                 LOG_BASE_DIR, LOG_CHECKPOINTS);
+        FILE *fp = fopen(index_path, "r");
+        char line[512];
+        int n = 0;
+        while (fp && fgets(line, sizeof(line), fp))
+            n += strncmp(line, "grp1\t", 5) == 0;
+        if (fp)
+            fclose(fp);
+        if (n != 4)
+            fail = "checkpoint index not per port";
+    }
+
+    daemon_stop(pid);
+    for (int i = 0; i < 4; i++)
+        close(m[i]);
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    if (system(cmd) != 0 && !fail)
+        fail = "cannot remove fake tree";
+    if (fail) { FAIL(fail); return; }
+    PASS();
+}
+
 int main(void)
 {
     printf("=== test_monitor ===\n");
@@ -404,6 +2609,40 @@ int main(void)
     test_pty_to_log();
     test_label_log_filename();
     test_proxy_log_and_forward();
+    test_timeline_arrival_order();
+    test_integrity_pty_board();
+    test_log_spill_on_enospc();
+    test_log_sync_triggers();
+    test_log_sync_handler();
+    test_housekeep_group_commit();
+    test_cpu_list();
+    test_tsv_escape();
+    test_log_marker_at_offset();
+    test_checkpoint_index();
+    test_checkpoint_truncate();
+    test_statpage_seqlock();
+    test_statpage_fields();
+    test_probe_ping_pty_loopback();
+    test_log_filter_rules();
+    test_acl_principals();
+    test_archive_export_window();
+    test_archive_many_streams();
+    test_archive_dedup_store();
+    test_crash_signatures();
+    test_crash_prune_index();
+    test_devclock_fit();
+    test_config_priority();
+    test_devclock_reset_marker();
+    test_recent_tail();
+    test_digest_condense();
+    test_toplines_heavy_hitters();
+    test_classify_kinds();
+    test_schedule_flood_and_quiet();
+    test_select_group();
+    test_daemon_silent_client();
+    test_daemon_long_replies();
+    test_daemon_source_reconnect();
+    test_daemon_board_group();
 
     printf("\n  Results: %d passed, %d failed\n\n",
            tests_passed, tests_failed);
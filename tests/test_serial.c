@@ -4,14 +4,20 @@
  *   - ReadOnlySerial opens and reads data
  *   - O_RDONLY prevents writes
  *   - Non-blocking reads work with select/poll
+ *   - Socket and FIFO sources connect, read and reconnect
  */
 #include <assert.h>
 #include <errno.h>
+#include <arpa/inet.h>
 #include <fcntl.h>
+#include <netinet/in.h>
 #include <pty.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include "../src/serial.h"
@@ -348,6 +354,136 @@ test_proxy_bidirectional(void)
     PASS();
 }
 
+/* Wait up to 1s for fd to be readable (or writable) and read it. */
+static int
+wait_fd(int fd, int for_write)
+{
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    return select(fd + 1, for_write ? NULL : &fds, for_write ? &fds : NULL,
+                  NULL, &tv);
+}
+
+static int
+read_expect(int fd, const char *want)
+{
+    char buf[64];
+    if (wait_fd(fd, 0) <= 0)
+        return -1;
+    ssize_t n = read(fd, buf, sizeof(buf));
+    return n == (ssize_t)strlen(want) && memcmp(buf, want, (size_t)n) == 0
+           ? 0 : -1;
+}
+
+static void
+test_socket_sources(void)
+{
+    TEST("sources: unix, tcp and fifo");
+
+    char spec[160], name[64];
+    source_name("tcp:localhost:5555", name, sizeof(name));
+    if (source_kind("/dev/ttyUSB0") != SOURCE_TTY ||
+        strcmp(name, "localhost_5555") != 0) {
+        FAIL("spec parsing"); return;
+    }
+
+    /* unix: added before the server exists, connected when it does */
+    struct sockaddr_un sun;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    snprintf(sun.sun_path, sizeof(sun.sun_path),
+             "/tmp/uart-monitor-test-%d.sock", (int)getpid());
+    snprintf(spec, sizeof(spec), "unix:%s", sun.sun_path);
+    unlink(sun.sun_path);
+    serial_port_t sp;
+    if (serial_open(&sp, spec, B115200) != 0 || sp.fd != -1 ||
+        sp.source != SOURCE_UNIX) {
+        FAIL("unix: not deferred"); return;
+    }
+    int ls = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (ls < 0 || bind(ls, (struct sockaddr *)&sun, sizeof(sun)) < 0 ||
+        listen(ls, 1) < 0) {
+        FAIL("unix listen"); return;
+    }
+    int ok = 1;
+    for (int round = 0; round < 2 && ok; round++) {  /* and reconnect */
+        ok = serial_connect(&sp) == 0 && !sp.connecting;
+        int c = ok ? accept(ls, NULL, NULL) : -1;
+        ok = ok && c >= 0 && write(c, "boot\n", 5) == 5 &&
+             read_expect(sp.fd, "boot\n") == 0;
+        if (c >= 0)
+            close(c);
+        char b;
+        ok = ok && wait_fd(sp.fd, 0) > 0 && read(sp.fd, &b, 1) == 0;
+        close(sp.fd);
+    }
+    close(ls);
+    unlink(sun.sun_path);
+    if (!ok) { FAIL("unix: read/reconnect"); return; }
+
+    /* tcp on the loopback, non-blocking connect */
+    struct sockaddr_in sin;
+    socklen_t slen = sizeof(sin);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ls = socket(AF_INET, SOCK_STREAM, 0);
+    if (ls < 0 || bind(ls, (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+        listen(ls, 1) < 0 ||
+        getsockname(ls, (struct sockaddr *)&sin, &slen) < 0) {
+        FAIL("tcp listen"); return;
+    }
+    snprintf(spec, sizeof(spec), "tcp:127.0.0.1:%d", ntohs(sin.sin_port));
+    ok = serial_open(&sp, spec, B115200) == 0 && sp.fd >= 0 &&
+         sp.addrs.n == 1;
+    if (ok && sp.connecting)
+        ok = wait_fd(sp.fd, 1) > 0 && source_finish_connect(sp.fd) == 0;
+    int c = ok ? accept(ls, NULL, NULL) : -1;
+    ok = ok && c >= 0 && write(c, "U-Boot\n", 7) == 7 &&
+         read_expect(sp.fd, "U-Boot\n") == 0;
+    if (c >= 0)
+        close(c);
+    if (ok) {
+        /* a reconnect reuses the address looked up by the open */
+        close(sp.fd);
+        ok = serial_connect(&sp) == 0 && sp.addrs.n == 1;
+        if (ok && sp.connecting)
+            ok = wait_fd(sp.fd, 1) > 0 &&
+                 source_finish_connect(sp.fd) == 0;
+        c = ok ? accept(ls, NULL, NULL) : -1;
+        ok = ok && c >= 0;
+        if (c >= 0)
+            close(c);
+    }
+    serial_close(&sp);
+    close(ls);
+    if (!ok) { FAIL("tcp: read"); return; }
+
+    /* fifo: writers come and go without an EOF */
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/uart-monitor-test-%d.fifo",
+             (int)getpid());
+    unlink(path);
+    snprintf(spec, sizeof(spec), "fifo:%s", path);
+    ok = mkfifo(path, 0600) == 0 && serial_open(&sp, spec, B115200) == 0 &&
+         sp.fd >= 0;
+    for (int round = 0; round < 2 && ok; round++) {
+        int w = open(path, O_WRONLY | O_NONBLOCK);
+        ok = w >= 0 && write(w, "ok\n", 3) == 3;
+        if (w >= 0)
+            close(w);
+        ok = ok && read_expect(sp.fd, "ok\n") == 0;
+        char b;
+        ok = ok && read(sp.fd, &b, 1) < 0 && errno == EAGAIN;
+    }
+    serial_close(&sp);
+    unlink(path);
+    if (!ok) { FAIL("fifo: read"); return; }
+    PASS();
+}
+
 int main(void)
 {
     printf("=== test_serial ===\n");
@@ -358,6 +494,7 @@ int main(void)
     test_double_close();
     test_proxy_open_close();
     test_proxy_bidirectional();
+    test_socket_sources();
 
     printf("\n  Results: %d passed, %d failed\n\n",
            tests_passed, tests_failed);